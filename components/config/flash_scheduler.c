@@ -0,0 +1,364 @@
+/**
+ * @file flash_scheduler.c
+ * @brief Flash writes deferred to radio-idle windows
+ *
+ * While flash is erased or programmed the cache is off on both cores, so
+ * a DIO interrupt can't be serviced and a timed downlink can't be loaded
+ * until the operation ends: a 4 KB sector erase takes tens of ms, longer
+ * than the RX service budget and the TX prepare lead. Each write is a job
+ * run by a low-priority task as a series of steps short enough to fit
+ * between packets, each started only when the idle check reports the
+ * radios quiet for the step's expected duration. A job that has waited
+ * CONFIG_FLASH_SCHED_MAX_DEFER_MS runs its remaining steps regardless, so
+ * a busy channel can't hold a configuration change back forever.
+ *
+ * An NVS blob can't be split (NVS writes it in one set), so its steps are
+ * the set and the commit. Raw partition writes are split into sector
+ * erases and page programs.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include "flash_scheduler.h"
+#include "nvs.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+static const char *TAG = "flash_sched";
+
+#define FLASH_SCHED_MAX_JOBS    8
+#define FLASH_TASK_PRIORITY     2       // Below every radio and network task
+#define FLASH_TASK_STACK        3072
+#define FLASH_POLL_MAX_MS       20      // Idle re-check backoff limit (each check may read the radio)
+#define FLASH_SECTOR_SIZE       4096
+#define FLASH_PAGE_SIZE         256
+
+// Expected step durations (typical worst case, us)
+#define NVS_SET_US              30000   // May erase a full NVS page
+#define NVS_COMMIT_US           5000
+#define SECTOR_ERASE_US         50000
+#define PAGE_PROGRAM_US         2000
+
+typedef enum {
+    JOB_NVS_BLOB,
+    JOB_PARTITION,
+} flash_job_type_t;
+
+// One queued write (heap, with its own copy of the data)
+typedef struct {
+    flash_job_type_t type;
+    char ns[NVS_KEY_NAME_MAX_SIZE];
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    nvs_handle_t nvs;
+    const esp_partition_t *partition;
+    uint32_t offset;
+    uint8_t *data;
+    size_t size;
+    uint32_t step;                      // Next step
+    uint32_t sectors;                   // Erase steps before the page programs
+    int64_t queued_at;
+    esp_err_t *result;                  // NULL if queued without waiting
+    SemaphoreHandle_t done;             // Given on completion, NULL if queued
+} flash_job_t;
+
+// Scheduler state
+typedef struct {
+    QueueHandle_t queue;
+    TaskHandle_t task;
+    flash_sched_idle_fn_t idle;
+    volatile bool busy;                 // A job is being run
+
+    // Statistics
+    uint32_t jobs;
+    uint32_t failed;
+    uint32_t steps;
+    uint32_t deferrals;
+    uint32_t forced;
+    uint64_t deferred_us;
+    uint32_t deferred_max_us;
+} flash_sched_t;
+
+static flash_sched_t s_fs = {0};
+
+// Forward declarations
+static void flash_task(void *arg);
+
+esp_err_t flash_sched_init(void)
+{
+    if (s_fs.task) {
+        return ESP_OK;
+    }
+
+    s_fs.queue = xQueueCreate(FLASH_SCHED_MAX_JOBS, sizeof(flash_job_t *));
+    if (!s_fs.queue) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    // Core 0, away from gw_rx_task; flash stalls both cores anyway
+    if (xTaskCreatePinnedToCore(flash_task, "flash_sched", FLASH_TASK_STACK, NULL,
+                                FLASH_TASK_PRIORITY, &s_fs.task, 0) != pdPASS) {
+        vQueueDelete(s_fs.queue);
+        s_fs.queue = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGI(TAG, "Flash scheduler started (max deferral %d ms)",
+             CONFIG_FLASH_SCHED_MAX_DEFER_MS);
+    return ESP_OK;
+}
+
+void flash_sched_set_idle_check(flash_sched_idle_fn_t idle)
+{
+    s_fs.idle = idle;
+}
+
+// Internal: Expected duration of the job's next step (us)
+static uint32_t step_duration_us(const flash_job_t *job)
+{
+    if (job->type == JOB_NVS_BLOB) {
+        return job->step == 0 ? NVS_SET_US : NVS_COMMIT_US;
+    }
+    return job->step < job->sectors ? SECTOR_ERASE_US : PAGE_PROGRAM_US;
+}
+
+// Internal: Run the job's next step; true when the job is finished
+static bool run_step(flash_job_t *job, esp_err_t *err)
+{
+    uint32_t step = job->step++;
+
+    if (job->type == JOB_NVS_BLOB) {
+        if (step == 0) {
+            *err = nvs_open(job->ns, NVS_READWRITE, &job->nvs);
+            if (*err != ESP_OK) {
+                return true;
+            }
+            *err = nvs_set_blob(job->nvs, job->key, job->data, job->size);
+            if (*err != ESP_OK) {
+                nvs_close(job->nvs);
+                return true;
+            }
+            return false;
+        }
+        *err = nvs_commit(job->nvs);
+        nvs_close(job->nvs);
+        return true;
+    }
+
+    if (step < job->sectors) {
+        *err = esp_partition_erase_range(job->partition,
+                                         job->offset + step * FLASH_SECTOR_SIZE,
+                                         FLASH_SECTOR_SIZE);
+        return *err != ESP_OK;
+    }
+
+    uint32_t pos = (step - job->sectors) * FLASH_PAGE_SIZE;
+    size_t len = job->size - pos;
+    if (len > FLASH_PAGE_SIZE) {
+        len = FLASH_PAGE_SIZE;
+    }
+    *err = esp_partition_write(job->partition, job->offset + pos, job->data + pos, len);
+    return *err != ESP_OK || pos + len >= job->size;
+}
+
+// Internal: Wait for a window the next step fits in; false if forced
+static bool wait_for_window(const flash_job_t *job)
+{
+    uint32_t window = step_duration_us(job);
+    TickType_t poll = 1;
+    bool deferred = false;
+
+    while (s_fs.idle && !s_fs.idle(window)) {
+        if (esp_timer_get_time() - job->queued_at >= CONFIG_FLASH_SCHED_MAX_DEFER_MS * 1000LL) {
+            return false;
+        }
+        if (!deferred) {
+            s_fs.deferrals++;
+            deferred = true;
+        }
+        // Back off: a busy channel stays busy for a packet's time on air
+        vTaskDelay(poll);
+        if (poll * 2 <= pdMS_TO_TICKS(FLASH_POLL_MAX_MS)) {
+            poll *= 2;
+        }
+    }
+
+    return true;
+}
+
+// Internal: Run a job to completion, each step in a window when the idle
+// check allows (the queue task), or back to back (inline)
+static esp_err_t run_job(flash_job_t *job, bool scheduled)
+{
+    esp_err_t err = ESP_OK;
+    uint64_t deferred_us = 0;
+    bool finished = false;
+
+    while (!finished) {
+        if (scheduled) {
+            int64_t wait_start = esp_timer_get_time();
+            if (!wait_for_window(job)) {
+                s_fs.forced++;
+            }
+            deferred_us += esp_timer_get_time() - wait_start;
+        }
+        finished = run_step(job, &err);
+        s_fs.steps++;
+    }
+
+    s_fs.jobs++;
+    if (err != ESP_OK) {
+        s_fs.failed++;
+        ESP_LOGE(TAG, "Flash write failed: %s", esp_err_to_name(err));
+    }
+    s_fs.deferred_us += deferred_us;
+    if (deferred_us > s_fs.deferred_max_us) {
+        s_fs.deferred_max_us = deferred_us;
+    }
+
+    return err;
+}
+
+// Internal: Release a job's memory
+static void free_job(flash_job_t *job)
+{
+    free(job->data);
+    free(job);
+}
+
+// Internal: Flash scheduler task
+static void flash_task(void *arg)
+{
+    flash_job_t *job;
+
+    while (1) {
+        if (xQueueReceive(s_fs.queue, &job, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+
+        s_fs.busy = true;
+        esp_err_t err = run_job(job, true);
+        s_fs.busy = false;
+
+        // The waiting caller may return as soon as done is given
+        SemaphoreHandle_t done = job->done;
+        if (job->result) {
+            *job->result = err;
+        }
+        free_job(job);
+        if (done) {
+            xSemaphoreGive(done);
+        }
+    }
+}
+
+// Internal: Run a job on the scheduler task, or inline when there is no
+// task or no idle check (nothing to wait for)
+static esp_err_t submit(flash_job_t *job, bool wait)
+{
+    job->queued_at = esp_timer_get_time();
+
+    if (!s_fs.task || !s_fs.idle || xTaskGetCurrentTaskHandle() == s_fs.task) {
+        esp_err_t err = run_job(job, false);
+        free_job(job);
+        return err;
+    }
+
+    if (!wait) {
+        if (xQueueSend(s_fs.queue, &job, 0) != pdTRUE) {
+            ESP_LOGW(TAG, "Flash queue full, write dropped");
+            free_job(job);
+            return ESP_ERR_NO_MEM;
+        }
+        return ESP_OK;
+    }
+
+    // flash_task frees the job before giving done: only locals after the send
+    esp_err_t result = ESP_OK;
+    StaticSemaphore_t done_buf;
+    SemaphoreHandle_t done = xSemaphoreCreateBinaryStatic(&done_buf);
+    job->result = &result;
+    job->done = done;
+
+    xQueueSend(s_fs.queue, &job, portMAX_DELAY);
+    xSemaphoreTake(done, portMAX_DELAY);
+    vSemaphoreDelete(done);
+
+    return result;
+}
+
+// Internal: Allocate a job with a copy of the data
+static flash_job_t *alloc_job(flash_job_type_t type, const void *data, size_t size)
+{
+    flash_job_t *job = calloc(1, sizeof(flash_job_t));
+    if (!job) {
+        return NULL;
+    }
+
+    job->data = malloc(size);
+    if (!job->data) {
+        free(job);
+        return NULL;
+    }
+    memcpy(job->data, data, size);
+    job->size = size;
+    job->type = type;
+
+    return job;
+}
+
+esp_err_t flash_sched_nvs_set_blob(const char *ns, const char *key, const void *data,
+                                   size_t size, bool wait)
+{
+    if (!ns || !key || !data || size == 0 ||
+        strlen(ns) >= NVS_KEY_NAME_MAX_SIZE || strlen(key) >= NVS_KEY_NAME_MAX_SIZE) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    flash_job_t *job = alloc_job(JOB_NVS_BLOB, data, size);
+    if (!job) {
+        return ESP_ERR_NO_MEM;
+    }
+    strcpy(job->ns, ns);
+    strcpy(job->key, key);
+
+    return submit(job, wait);
+}
+
+esp_err_t flash_sched_partition_write(const esp_partition_t *partition, uint32_t offset,
+                                      const void *data, size_t size, bool wait)
+{
+    if (!partition || !data || size == 0 || offset % FLASH_SECTOR_SIZE != 0 ||
+        offset + size > partition->size) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    flash_job_t *job = alloc_job(JOB_PARTITION, data, size);
+    if (!job) {
+        return ESP_ERR_NO_MEM;
+    }
+    job->partition = partition;
+    job->offset = offset;
+    job->sectors = (size + FLASH_SECTOR_SIZE - 1) / FLASH_SECTOR_SIZE;
+
+    return submit(job, wait);
+}
+
+void flash_sched_get_stats(flash_sched_stats_t *stats)
+{
+    memset(stats, 0, sizeof(flash_sched_stats_t));
+
+    stats->jobs = s_fs.jobs;
+    stats->failed = s_fs.failed;
+    stats->steps = s_fs.steps;
+    stats->deferrals = s_fs.deferrals;
+    stats->forced = s_fs.forced;
+    stats->deferred_ms = s_fs.deferred_us / 1000;
+    stats->deferred_max_ms = s_fs.deferred_max_us / 1000;
+    if (s_fs.queue) {
+        stats->pending = uxQueueMessagesWaiting(s_fs.queue) + (s_fs.busy ? 1 : 0);
+    }
+}
@@ -6,6 +6,7 @@
 #include <string.h>
 #include <stdio.h>
 #include "gateway_config.h"
+#include "flash_scheduler.h"
 #include "esp_log.h"
 #include "esp_mac.h"
 
@@ -34,6 +35,12 @@ esp_err_t gw_config_init(void)
         gw_config_defaults(&s_config);
     }
 
+    // Later saves wait for radio-idle windows
+    ret = flash_sched_init();
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Flash scheduler not started, saves run at once: %s", esp_err_to_name(ret));
+    }
+
     s_initialized = true;
     ESP_LOGI(TAG, "Configuration initialized");
 
@@ -0,0 +1,103 @@
+/**
+ * @file flash_scheduler.h
+ * @brief Flash writes deferred to radio-idle windows
+ *
+ * Erasing or programming flash disables the cache on both cores for
+ * milliseconds, which stalls every task running from flash, including
+ * the radio service tasks. Writes are queued here and run as short steps
+ * (an NVS set or commit, one sector erase, one page program), each only
+ * when the registered idle check says nothing will happen on the radios
+ * for the step's expected duration.
+ */
+
+#ifndef FLASH_SCHEDULER_H
+#define FLASH_SCHEDULER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_partition.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Idle check: true if flash may be busy for window_us from now
+ */
+typedef bool (*flash_sched_idle_fn_t)(uint32_t window_us);
+
+/**
+ * @brief Flash scheduler statistics
+ */
+typedef struct {
+    uint32_t jobs;              // Writes completed
+    uint32_t failed;
+    uint32_t pending;           // Queued now
+    uint32_t steps;             // Flash operations run
+    uint32_t deferrals;         // Steps postponed by the idle check
+    uint32_t forced;            // Steps run after the longest deferral
+    uint32_t deferred_ms;       // Total time steps waited for a window
+    uint32_t deferred_max_ms;   // Longest wait of one write
+} flash_sched_stats_t;
+
+/**
+ * @brief Start the scheduler task
+ *
+ * Before this, and with no idle check registered, writes run at once.
+ *
+ * @return ESP_OK on success
+ */
+esp_err_t flash_sched_init(void);
+
+/**
+ * @brief Register the radio idle check (NULL: always idle)
+ *
+ * @param idle Idle check, called from the scheduler task
+ */
+void flash_sched_set_idle_check(flash_sched_idle_fn_t idle);
+
+/**
+ * @brief Queue an NVS blob write (set, then commit)
+ *
+ * The data is copied.
+ *
+ * @param ns NVS namespace
+ * @param key NVS key
+ * @param data Blob
+ * @param size Blob size
+ * @param wait Block until written
+ * @return ESP_OK if queued (or written, with wait), ESP_ERR_NO_MEM if the queue is full
+ */
+esp_err_t flash_sched_nvs_set_blob(const char *ns, const char *key, const void *data,
+                                   size_t size, bool wait);
+
+/**
+ * @brief Queue a raw partition write, erased and programmed in small steps
+ *
+ * The covered sectors are erased one by one, then the data is programmed
+ * page by page. The data is copied.
+ *
+ * @param partition Partition
+ * @param offset Offset in the partition (sector aligned)
+ * @param data Data
+ * @param size Data size
+ * @param wait Block until written
+ * @return ESP_OK if queued (or written, with wait)
+ */
+esp_err_t flash_sched_partition_write(const esp_partition_t *partition, uint32_t offset,
+                                      const void *data, size_t size, bool wait);
+
+/**
+ * @brief Get scheduler statistics
+ *
+ * @param stats Output statistics
+ */
+void flash_sched_get_stats(flash_sched_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FLASH_SCHEDULER_H
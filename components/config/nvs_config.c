@@ -5,6 +5,7 @@
 
 #include <string.h>
 #include "gateway_config.h"
+#include "flash_scheduler.h"
 #include "nvs_flash.h"
 #include "nvs.h"
 #include "esp_log.h"
@@ -76,28 +77,11 @@ esp_err_t gw_config_save(const gateway_config_t *config)
         return ret;
     }
 
-    // Open NVS namespace
-    nvs_handle_t nvs_handle;
-    ret = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to open NVS: %s", esp_err_to_name(ret));
-        return ret;
-    }
-
-    // Write configuration blob
-    ret = nvs_set_blob(nvs_handle, NVS_KEY_CONFIG, config, sizeof(gateway_config_t));
+    // Set and commit in radio-idle windows, waiting for the result
+    ret = flash_sched_nvs_set_blob(NVS_NAMESPACE, NVS_KEY_CONFIG, config,
+                                   sizeof(gateway_config_t), true);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to write config: %s", esp_err_to_name(ret));
-        nvs_close(nvs_handle);
-        return ret;
-    }
-
-    // Commit changes
-    ret = nvs_commit(nvs_handle);
-    nvs_close(nvs_handle);
-
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to commit NVS: %s", esp_err_to_name(ret));
         return ret;
     }
 
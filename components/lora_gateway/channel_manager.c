@@ -5,27 +5,57 @@
  * Manages RX and TX radios independently:
  * - Radio 0: Continuous RX
  * - Radio 1: TX on demand
+ *
+ * With hopping enabled, the RX radio rotates through the channels unless
+ * the device table expects a periodic device's uplink soon: then it is
+ * pre-tuned to that channel and SF and held there for the window.
+ * During a downlink it may instead be moved to the channel farthest from
+ * the TX frequency (see coex_manager.c).
+ *
+ * With CONFIG_LORA_DUAL_TX, a timed downlink starting while radio 1 is
+ * still on air is sent by radio 0 instead of going out late: listening
+ * stops at the prepare lead and resumes as soon as TxDone arrives. The
+ * RX blind time this costs is bounded per downlink and per minute.
  */
 
 #include <string.h>
 #include "lora_gateway.h"
+#include "lora_codec.h"
 #include "gateway_config.h"
 #include "esp_log.h"
 #include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "freertos/queue.h"
 #include "freertos/semphr.h"
+#include "freertos/timers.h"
+#include "spsc_ring.h"
+#include "gw_trace.h"
 
 static const char *TAG = "ch_manager";
 
+#define TX_PREPARE_LEAD_US      1500    // Wake this early to load FIFO and lock the PLL
+#define TX_MAX_DELAY_US         5000000 // Max scheduling horizon
+#define TX_LATE_LIMIT_US        100000  // Drop downlinks later than this
+#define TX_DONE_MARGIN_MS       50      // TxDone timeout beyond time on air
+#define TX_PREAMBLE_SYMBOLS     8
+#define TX_TASK_PRIORITY        9
+#define TX_TASK_MAX_BOOST       2       // Self-heal priority steps above the base
+#define LISTEN_LEAD_US          50000   // Pre-tune this early (timer tick, retune)
+#define BORROW_RESTORE_US       2000    // Modem, frequency and RX restart after a borrowed TX
+#define BORROW_BUDGET_PERIOD_US 60000000
+
+// Latency budgets (deadline monitor)
+#define RX_SERVICE_BUDGET_US    2000    // DIO0 to RX ring, well inside the shortest packet
+#define TX_WAKE_BUDGET_US       (TX_PREPARE_LEAD_US - 500)
+#define TX_FIRE_BUDGET_US       100
+
 // Channel manager state
 typedef struct {
     sx1276_handle_t rx_radio;
     sx1276_handle_t tx_radio;
 
-    // TX queue
-    QueueHandle_t tx_queue;
+    // TX ring (packet forwarder RX task -> cm_tx_task)
+    spsc_ring_t tx_ring;
 
     // Tasks
     TaskHandle_t tx_task_handle;
@@ -33,18 +63,68 @@ typedef struct {
     // State
     bool running;
     bool tx_busy;
+    volatile bool tx_waiting;       // Sleeping until a timed TX due at tx_waiting_at
+    volatile uint32_t tx_waiting_at;
 
-    // Channel hopping
+    // Channel hopping (timer daemon only; cm_tx_task's coex moves take
+    // rx_ctl as well, and neither side ever waits for it)
+    SemaphoreHandle_t rx_ctl;
     bool hopping_enabled;
     uint32_t hop_interval_ms;
     uint8_t current_channel;
     TimerHandle_t hop_timer;
+    volatile bool hop_pending;      // Hop due, waiting for the packet on air
+    uint32_t hops_deferred;
+
+    // Predictive listening (timer task, like the hops)
+    TimerHandle_t listen_timer;     // Opens, then closes the next window
+    bool listen_hold;               // Window open: no hops
+    bool listen_sf_switched;        // RX SF changed for the window
+    sx1276_spreading_factor_t scan_sf;  // Modulation to restore after it
+    sx1276_bandwidth_t scan_bw;
+    sx1276_coding_rate_t scan_cr;
+    gw_listen_prediction_t listen;
+    uint32_t listen_windows;
+
+    // TX/RX coexistence
+    bool coex_hold;                 // RX moved away from a downlink: no hops
+
+    // Dual TX (cm_tx_task; hops and listen windows wait while borrowed)
+    volatile bool rx_borrowed;      // RX radio transmitting: no hops, no retunes
+    volatile bool borrow_busy;      // Waiting for the RX radio's TxDone
+    lora_tx_packet_t borrow_packet;
+    sx1276_tx_packet_t borrow_sx;
+    uint32_t borrow_sent;
+    uint32_t borrow_declined;
+    uint64_t blind_total_us;
+    uint32_t blind_max_us;
+    uint32_t budget_start;          // Current budget period (gateway timestamp)
+    uint32_t budget_used_us;
 
     // Synchronization
     SemaphoreHandle_t tx_mutex;
 
+    // Downlink start timing
+    esp_timer_handle_t tx_timer;        // Wakes tx_task shortly before a timed TX
+    SemaphoreHandle_t tx_wake;
+    uint32_t tx_scheduled;
+    uint32_t tx_late;
+    uint32_t tx_timeouts;
+    int64_t fire_err_total;
+    uint32_t fire_err_max;
+    int64_t start_err_total;
+    int32_t start_err_min;
+    int32_t start_err_max;
+    uint32_t tx_late_starts;
+    uint32_t start_err_hist[GW_TX_ERR_BUCKETS];
+    uint32_t tx_dequeued;
+    uint64_t queue_wait_total;
+    uint32_t queue_wait_max;
+
 } channel_manager_t;
 
+const uint32_t gw_tx_err_edges[GW_TX_ERR_BUCKETS - 1] = {10, 25, 50, 100, 250, 1000};
+
 static channel_manager_t s_cm = {0};
 
 // Forward declarations
@@ -52,6 +132,21 @@ static void tx_task(void *arg);
 static void hop_timer_callback(TimerHandle_t timer);
 static void rx_callback(sx1276_rx_packet_t *packet, void *user_data);
 static void tx_done_callback(bool success, void *user_data);
+static void tx_timer_callback(void *arg);
+static void header_callback(uint32_t header_time, void *user_data);
+static void do_hop(void);
+static void try_hop(void);
+static void hop_probed(bool busy, void *user_data);
+static void finish_hop(void *arg, uint32_t busy);
+static void pended_hop(void *arg, uint32_t unused);
+static void listen_timer_callback(TimerHandle_t timer);
+static void plan_listen(void);
+static bool tx_task_heal(gw_stage_t stage);
+static bool tx_task_relax(gw_stage_t stage);
+static void coex_begin(uint32_t tx_freq, uint32_t start, uint32_t airtime);
+#ifdef CONFIG_LORA_DUAL_TX
+static void borrow_rx_for_overlap(uint32_t busy_until);
+#endif
 
 esp_err_t channel_manager_init(sx1276_handle_t rx_handle, sx1276_handle_t tx_handle)
 {
@@ -67,18 +162,42 @@ esp_err_t channel_manager_init(sx1276_handle_t rx_handle, sx1276_handle_t tx_han
     s_cm.rx_radio = rx_handle;
     s_cm.tx_radio = tx_handle;
 
-    // Create TX queue
-    s_cm.tx_queue = xQueueCreate(GATEWAY_TX_QUEUE_SIZE, sizeof(lora_tx_packet_t));
-    if (!s_cm.tx_queue) {
-        ESP_LOGE(TAG, "Failed to create TX queue");
-        return ESP_ERR_NO_MEM;
+    // Create TX ring
+    esp_err_t err = spsc_ring_init(&s_cm.tx_ring, GATEWAY_TX_QUEUE_SIZE, sizeof(lora_tx_packet_t));
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create TX ring");
+        return err;
     }
 
-    // Create TX mutex
+    // Create TX and RX channel control mutexes
     s_cm.tx_mutex = xSemaphoreCreateMutex();
-    if (!s_cm.tx_mutex) {
+    s_cm.rx_ctl = xSemaphoreCreateMutex();
+    if (!s_cm.tx_mutex || !s_cm.rx_ctl) {
         ESP_LOGE(TAG, "Failed to create TX mutex");
-        vQueueDelete(s_cm.tx_queue);
+        if (s_cm.tx_mutex) {
+            vSemaphoreDelete(s_cm.tx_mutex);
+        }
+        if (s_cm.rx_ctl) {
+            vSemaphoreDelete(s_cm.rx_ctl);
+        }
+        spsc_ring_deinit(&s_cm.tx_ring);
+        return ESP_ERR_NO_MEM;
+    }
+
+    // Create TX wake timer
+    s_cm.tx_wake = xSemaphoreCreateBinary();
+    const esp_timer_create_args_t timer_args = {
+        .callback = tx_timer_callback,
+        .name = "cm_tx_wake",
+    };
+    if (!s_cm.tx_wake || esp_timer_create(&timer_args, &s_cm.tx_timer) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create TX timer");
+        if (s_cm.tx_wake) {
+            vSemaphoreDelete(s_cm.tx_wake);
+        }
+        vSemaphoreDelete(s_cm.tx_mutex);
+        vSemaphoreDelete(s_cm.rx_ctl);
+        spsc_ring_deinit(&s_cm.tx_ring);
         return ESP_ERR_NO_MEM;
     }
 
@@ -88,6 +207,16 @@ esp_err_t channel_manager_init(sx1276_handle_t rx_handle, sx1276_handle_t tx_han
                                    pdTRUE,
                                    NULL,
                                    hop_timer_callback);
+    s_cm.listen_timer = xTimerCreate("ch_listen",
+                                      1,
+                                      pdFALSE,
+                                      NULL,
+                                      listen_timer_callback);
+
+    deadline_monitor_register(GW_STAGE_RX_SERVICE, "rx_service", RX_SERVICE_BUDGET_US, NULL, NULL);
+    deadline_monitor_register(GW_STAGE_TX_WAKE, "tx_wake", TX_WAKE_BUDGET_US, tx_task_heal,
+                              tx_task_relax);
+    deadline_monitor_register(GW_STAGE_TX_START, "tx_start", TX_FIRE_BUDGET_US, NULL, NULL);
 
     ESP_LOGI(TAG, "Channel Manager initialized");
     return ESP_OK;
@@ -101,27 +230,39 @@ esp_err_t channel_manager_start(void)
 
     ESP_LOGI(TAG, "Starting Channel Manager...");
 
+    // Set before creating the task, which loops while running
+    s_cm.running = true;
+
     // Create TX task
     BaseType_t ret = xTaskCreatePinnedToCore(tx_task,
                                               "cm_tx_task",
                                               4096,
                                               NULL,
-                                              9,
+                                              TX_TASK_PRIORITY,
                                               &s_cm.tx_task_handle,
                                               1);  // Core 1
     if (ret != pdPASS) {
         ESP_LOGE(TAG, "Failed to create TX task");
+        s_cm.running = false;
         return ESP_FAIL;
     }
+    spsc_ring_set_consumer(&s_cm.tx_ring, s_cm.tx_task_handle);
 
     // Start RX on radio 0
     esp_err_t err = sx1276_start_rx(s_cm.rx_radio, rx_callback, NULL);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Failed to start RX: %s", esp_err_to_name(err));
+        spsc_ring_set_consumer(&s_cm.tx_ring, NULL);
         vTaskDelete(s_cm.tx_task_handle);
+        s_cm.running = false;
         return err;
     }
 
+    // Early packet detection (DIO3 wired): reserve the RX slot on ValidHeader
+    if (sx1276_set_header_callback(s_cm.rx_radio, header_callback, NULL) == ESP_OK) {
+        ESP_LOGI(TAG, "ValidHeader interrupt enabled");
+    }
+
     // Put TX radio in standby
     sx1276_set_mode(s_cm.tx_radio, SX1276_MODE_STANDBY);
 
@@ -130,7 +271,6 @@ esp_err_t channel_manager_start(void)
         xTimerStart(s_cm.hop_timer, 0);
     }
 
-    s_cm.running = true;
     ESP_LOGI(TAG, "Channel Manager started (RX continuous, TX standby)");
 
     return ESP_OK;
@@ -150,12 +290,18 @@ esp_err_t channel_manager_stop(void)
     if (s_cm.hop_timer) {
         xTimerStop(s_cm.hop_timer, 0);
     }
+    if (s_cm.listen_timer) {
+        xTimerStop(s_cm.listen_timer, 0);
+    }
+    s_cm.listen_hold = false;
 
     // Stop RX
     sx1276_stop_rx(s_cm.rx_radio);
 
     // Stop TX task
+    esp_timer_stop(s_cm.tx_timer);
     if (s_cm.tx_task_handle) {
+        spsc_ring_set_consumer(&s_cm.tx_ring, NULL);
         vTaskDelete(s_cm.tx_task_handle);
         s_cm.tx_task_handle = NULL;
     }
@@ -174,11 +320,16 @@ esp_err_t channel_manager_schedule_tx(const lora_tx_packet_t *packet)
         return ESP_ERR_INVALID_STATE;
     }
 
-    // Add to TX queue
-    if (xQueueSend(s_cm.tx_queue, packet, pdMS_TO_TICKS(100)) != pdTRUE) {
-        ESP_LOGW(TAG, "TX queue full, packet dropped");
+    // Add to TX ring
+    lora_tx_packet_t *slot = spsc_ring_reserve(&s_cm.tx_ring);
+    if (!slot) {
+        ESP_LOGW(TAG, "TX ring full, packet dropped");
         return ESP_ERR_NO_MEM;
     }
+    memcpy(slot, packet, sizeof(lora_tx_packet_t));
+    slot->queued_at = lora_gateway_get_timestamp();
+    spsc_ring_commit(&s_cm.tx_ring);
+    gw_trace(GW_TRACE_TX_QUEUED, packet->tx_timestamp, spsc_ring_count(&s_cm.tx_ring));
 
     ESP_LOGD(TAG, "TX packet queued (freq: %lu, size: %d)",
              packet->modulation.frequency, packet->payload_size);
@@ -186,6 +337,94 @@ esp_err_t channel_manager_schedule_tx(const lora_tx_packet_t *packet)
     return ESP_OK;
 }
 
+void channel_manager_get_tx_ring_stats(spsc_ring_stats_t *stats)
+{
+    spsc_ring_get_stats(&s_cm.tx_ring, stats);
+}
+
+void channel_manager_get_stats(gateway_stats_t *stats)
+{
+    stats->hops_deferred = s_cm.hops_deferred;
+    stats->listen_windows = s_cm.listen_windows;
+    stats->dual_tx_sent = s_cm.borrow_sent;
+    stats->dual_tx_declined = s_cm.borrow_declined;
+    stats->rx_blind_ms = s_cm.blind_total_us / 1000;
+    stats->rx_blind_max_us = s_cm.blind_max_us;
+}
+
+void channel_manager_get_tx_timing_stats(gw_tx_timing_stats_t *stats)
+{
+    memset(stats, 0, sizeof(gw_tx_timing_stats_t));
+
+#ifdef CONFIG_LORA_TX_PRELOCK
+    stats->prelock = true;
+#endif
+    stats->scheduled = s_cm.tx_scheduled;
+    stats->late = s_cm.tx_late;
+    stats->late_starts = s_cm.tx_late_starts;
+    stats->timeouts = s_cm.tx_timeouts;
+    stats->fire_err_max_us = s_cm.fire_err_max;
+    stats->start_err_min_us = s_cm.start_err_min;
+    stats->start_err_max_us = s_cm.start_err_max;
+    if (s_cm.tx_scheduled > 0) {
+        stats->fire_err_avg_us = s_cm.fire_err_total / s_cm.tx_scheduled;
+        stats->start_err_avg_us = s_cm.start_err_total / s_cm.tx_scheduled;
+    }
+    memcpy(stats->start_err_hist, s_cm.start_err_hist, sizeof(stats->start_err_hist));
+    stats->dequeued = s_cm.tx_dequeued;
+    stats->queue_wait_max_us = s_cm.queue_wait_max;
+    if (s_cm.tx_dequeued > 0) {
+        stats->queue_wait_avg_us = s_cm.queue_wait_total / s_cm.tx_dequeued;
+    }
+}
+
+void channel_manager_reset_tx_timing_stats(void)
+{
+    s_cm.tx_scheduled = 0;
+    s_cm.tx_late = 0;
+    s_cm.tx_late_starts = 0;
+    s_cm.tx_timeouts = 0;
+    s_cm.fire_err_total = 0;
+    s_cm.fire_err_max = 0;
+    s_cm.start_err_total = 0;
+    s_cm.start_err_min = 0;
+    s_cm.start_err_max = 0;
+    memset(s_cm.start_err_hist, 0, sizeof(s_cm.start_err_hist));
+    s_cm.tx_dequeued = 0;
+    s_cm.queue_wait_total = 0;
+    s_cm.queue_wait_max = 0;
+}
+
+bool channel_manager_radio_idle_for(uint32_t window_us)
+{
+    if (!s_cm.running) {
+        return true;
+    }
+
+    // Cheap state first: the RX check below may cost an SPI read
+
+    // A queued downlink may be due at any time
+    if (spsc_ring_count(&s_cm.tx_ring) > 0) {
+        return false;
+    }
+
+    // A timed downlink waiting for its start, cm_tx_task wakes a lead early
+    if (s_cm.tx_waiting) {
+        int32_t until = (int32_t)(s_cm.tx_waiting_at - lora_gateway_get_timestamp());
+        if (until <= (int32_t)(window_us + TX_PREPARE_LEAD_US)) {
+            return false;
+        }
+    } else if (s_cm.tx_busy) {
+        return false;
+    }
+
+    // An uplink predicted, or in progress (a header seen costs no SPI read)
+    if (s_cm.listen_hold || s_cm.rx_borrowed) {
+        return false;
+    }
+    return !sx1276_rx_busy(s_cm.rx_radio);
+}
+
 esp_err_t channel_manager_set_hopping(bool enabled, uint32_t interval_ms)
 {
     s_cm.hopping_enabled = enabled;
@@ -208,105 +447,286 @@ esp_err_t channel_manager_set_hopping(bool enabled, uint32_t interval_ms)
     return ESP_OK;
 }
 
+// Internal: Sleep until shortly before a timed TX (esp_timer, not tick-bound)
+static void wait_until(uint32_t wake_time)
+{
+    int32_t remaining = (int32_t)(wake_time - lora_gateway_get_timestamp());
+    if (remaining <= 0) {
+        return;
+    }
+
+    xSemaphoreTake(s_cm.tx_wake, 0);
+    esp_timer_start_once(s_cm.tx_timer, remaining);
+    xSemaphoreTake(s_cm.tx_wake, pdMS_TO_TICKS(remaining / 1000 + 100));
+}
+
+// Internal: Self-heal for late TX wake-ups, raise cm_tx_task one step
+static bool tx_task_heal(gw_stage_t stage)
+{
+    if (!s_cm.tx_task_handle) {
+        return false;
+    }
+
+    UBaseType_t priority = uxTaskPriorityGet(s_cm.tx_task_handle);
+    if (priority >= TX_TASK_PRIORITY + TX_TASK_MAX_BOOST) {
+        return false;
+    }
+
+    vTaskPrioritySet(s_cm.tx_task_handle, priority + 1);
+    ESP_LOGW(TAG, "cm_tx_task priority raised to %u", priority + 1);
+    return true;
+}
+
+// Internal: Lower cm_tx_task one step back towards its base priority
+static bool tx_task_relax(gw_stage_t stage)
+{
+    if (!s_cm.tx_task_handle) {
+        return false;
+    }
+
+    UBaseType_t priority = uxTaskPriorityGet(s_cm.tx_task_handle);
+    if (priority <= TX_TASK_PRIORITY) {
+        return false;
+    }
+
+    vTaskPrioritySet(s_cm.tx_task_handle, priority - 1);
+    ESP_LOGI(TAG, "cm_tx_task priority back to %u", priority - 1);
+    return true;
+}
+
+// Internal: Account start timing of a timed TX once TxDone has arrived
+static void record_tx_timing(sx1276_handle_t radio, uint32_t requested, uint32_t fired,
+                             uint32_t airtime)
+{
+    int32_t fire_err = (int32_t)(fired - requested);
+    int32_t start_err = (int32_t)(sx1276_get_tx_done_time(radio) - airtime - requested);
+    uint32_t fire_abs = fire_err < 0 ? -fire_err : fire_err;
+    uint32_t start_abs = start_err < 0 ? -start_err : start_err;
+    int bucket = 0;
+
+    while (bucket < GW_TX_ERR_BUCKETS - 1 && start_abs > gw_tx_err_edges[bucket]) {
+        bucket++;
+    }
+    s_cm.start_err_hist[bucket]++;
+    if (start_err > GW_TX_LATE_START_US) {
+        s_cm.tx_late_starts++;
+    }
+
+    if (s_cm.tx_scheduled == 0 || start_err < s_cm.start_err_min) {
+        s_cm.start_err_min = start_err;
+    }
+    if (s_cm.tx_scheduled == 0 || start_err > s_cm.start_err_max) {
+        s_cm.start_err_max = start_err;
+    }
+    if (fire_abs > s_cm.fire_err_max) {
+        s_cm.fire_err_max = fire_abs;
+    }
+    deadline_monitor_check(GW_STAGE_TX_START, fire_abs);
+    s_cm.fire_err_total += fire_err;
+    s_cm.start_err_total += start_err;
+    s_cm.tx_scheduled++;
+}
+
+// Internal: Account the time a downlink waited in the TX ring
+static void note_dequeued(const lora_tx_packet_t *packet)
+{
+    uint32_t queue_wait = lora_gateway_get_timestamp() - packet->queued_at;
+    s_cm.queue_wait_total += queue_wait;
+    if (queue_wait > s_cm.queue_wait_max) {
+        s_cm.queue_wait_max = queue_wait;
+    }
+    s_cm.tx_dequeued++;
+}
+
+// Internal: Downlink to radio packet
+static void build_sx_packet(const lora_tx_packet_t *packet, sx1276_tx_packet_t *sx_packet)
+{
+    memcpy(sx_packet->data, packet->payload, packet->payload_size);
+    sx_packet->length = packet->payload_size;
+    // Shift onto the device's actual RX frequency (crystal offset)
+    sx_packet->frequency = packet->modulation.frequency + device_table_downlink_offset(packet);
+    sx_packet->power = packet->tx_power;
+    sx_packet->sf = packet->modulation.spreading_factor;
+    sx_packet->bw = lora_gateway_bw_to_radio(packet->modulation.bandwidth);
+    sx_packet->cr = packet->modulation.coding_rate;
+    sx_packet->invert_iq = packet->modulation.invert_polarity;
+    sx_packet->tx_delay_us = 0;
+}
+
 // Internal: TX task
 static void tx_task(void *arg)
 {
     lora_tx_packet_t packet;
     sx1276_tx_packet_t sx_packet;
+#ifdef CONFIG_LORA_TX_PRELOCK
+    const bool prelock = true;
+#else
+    const bool prelock = false;
+#endif
 
     ESP_LOGI(TAG, "TX task started");
 
     while (s_cm.running) {
-        // Wait for packet in queue
-        if (xQueueReceive(s_cm.tx_queue, &packet, pdMS_TO_TICKS(100)) == pdTRUE) {
-            xSemaphoreTake(s_cm.tx_mutex, portMAX_DELAY);
-            s_cm.tx_busy = true;
-
-            // Check timing
-            if (!packet.immediate) {
-                uint32_t current = lora_gateway_get_timestamp();
-                int32_t delay = (int32_t)(packet.tx_timestamp - current);
-
-                if (delay > 0 && delay < 5000000) {  // Max 5 second delay
-                    ESP_LOGD(TAG, "TX scheduled in %ld us", delay);
-                    // Wait until timestamp
-                    while (lora_gateway_get_timestamp() < packet.tx_timestamp) {
-                        vTaskDelay(1);
-                    }
-                } else if (delay < -100000) {
-                    // Too late, skip packet
-                    ESP_LOGW(TAG, "TX too late by %ld us, skipping", -delay);
-                    s_cm.tx_busy = false;
-                    xSemaphoreGive(s_cm.tx_mutex);
-                    continue;
+        // Wait for packet in ring
+        if (!spsc_ring_pop(&s_cm.tx_ring, &packet, pdMS_TO_TICKS(100))) {
+            // Idle gap: no downlink pending, safe to touch the TX radio.
+            // The RX radio's FSK visits need RX channel control, so no hop
+            // or listen window retunes it meanwhile, and never blind an
+            // open window
+            radio_monitor_poll_tx();
+            if (xSemaphoreTake(s_cm.rx_ctl, 0) == pdTRUE) {
+                if (!s_cm.listen_hold && !s_cm.rx_borrowed) {
+                    radio_monitor_poll_rx(s_cm.current_channel);
                 }
-            }
+                xSemaphoreGive(s_cm.rx_ctl);
 
-            // Prepare SX1276 packet
-            memcpy(sx_packet.data, packet.payload, packet.payload_size);
-            sx_packet.length = packet.payload_size;
-            sx_packet.frequency = packet.modulation.frequency;
-            sx_packet.power = packet.tx_power;
-            sx_packet.sf = packet.modulation.spreading_factor;
-            sx_packet.bw = packet.modulation.bandwidth;
-            sx_packet.cr = packet.modulation.coding_rate;
-            sx_packet.invert_iq = packet.modulation.invert_polarity;
-            sx_packet.tx_delay_us = 0;
-
-            ESP_LOGI(TAG, "TX: freq=%lu, SF%d, %d bytes",
-                     sx_packet.frequency, sx_packet.sf, sx_packet.length);
-
-            // Transmit
-            esp_err_t err = sx1276_transmit(s_cm.tx_radio, &sx_packet,
-                                            tx_done_callback, NULL);
-            if (err != ESP_OK) {
-                ESP_LOGE(TAG, "TX failed: %s", esp_err_to_name(err));
+                // A hop that came due meanwhile
+                if (s_cm.hop_pending) {
+                    xTimerPendFunctionCall(pended_hop, NULL, 0, 0);
+                }
             }
+            continue;
+        }
 
-            // Wait for TX complete (with timeout)
-            int timeout = 0;
-            while (s_cm.tx_busy && timeout < 5000) {
-                vTaskDelay(pdMS_TO_TICKS(1));
-                timeout++;
+        note_dequeued(&packet);
+
+        xSemaphoreTake(s_cm.tx_mutex, portMAX_DELAY);
+        s_cm.tx_busy = true;
+
+        // Check timing
+        bool timed = false;
+        if (!packet.immediate) {
+            uint32_t current = lora_gateway_get_timestamp();
+            int32_t delay = (int32_t)(packet.tx_timestamp - current);
+
+            if (delay > 0 && delay < TX_MAX_DELAY_US) {
+                ESP_LOGD(TAG, "TX scheduled in %ld us", delay);
+                // Wake just early enough to load the radio; the final
+                // wait is a busy-wait inside sx1276_tx_fire()
+                uint32_t wake_time = packet.tx_timestamp - TX_PREPARE_LEAD_US;
+                s_cm.tx_waiting_at = packet.tx_timestamp;
+                s_cm.tx_waiting = true;
+                wait_until(wake_time);
+                s_cm.tx_waiting = false;
+                gw_trace(GW_TRACE_TX_WAKE, packet.tx_timestamp, 0);
+                int32_t wake_late = (int32_t)(lora_gateway_get_timestamp() - wake_time);
+                deadline_monitor_check(GW_STAGE_TX_WAKE, wake_late > 0 ? wake_late : 0);
+                timed = true;
+            } else if (delay < -TX_LATE_LIMIT_US) {
+                // Too late, skip packet
+                ESP_LOGW(TAG, "TX too late by %ld us, skipping", -delay);
+                // Arrived late from the network: not a wake-up overrun of this task
+                gw_trace(GW_TRACE_TX_LATE, packet.tx_timestamp, 0);
+                s_cm.tx_late++;
+                s_cm.tx_busy = false;
+                xSemaphoreGive(s_cm.tx_mutex);
+                continue;
             }
+        }
 
-            if (timeout >= 5000) {
-                ESP_LOGW(TAG, "TX timeout");
-            }
+        // Prepare SX1276 packet
+        build_sx_packet(&packet, &sx_packet);
+
+        // Load FIFO and (optionally) lock the PLL, then fire with a
+        // single register write at the requested time
+        uint32_t start = timed ? packet.tx_timestamp : lora_gateway_get_timestamp();
+        uint32_t fired = 0;
+        uint32_t airtime = lora_codec_time_on_air_us(&packet.modulation, packet.payload_size,
+                                                     TX_PREAMBLE_SYMBOLS, false);
+        esp_err_t err = sx1276_tx_prepare(s_cm.tx_radio, &sx_packet, prelock,
+                                          tx_done_callback, NULL);
+        if (err == ESP_OK) {
+            err = sx1276_tx_fire(s_cm.tx_radio, start, &fired);
+            gw_trace(GW_TRACE_TX_FIRE, packet.tx_timestamp, 0);
+        }
+        if (err == ESP_OK) {
+            // After the fire, which must not wait on the RX radio
+            coex_begin(sx_packet.frequency, start, airtime);
+#ifdef CONFIG_LORA_DUAL_TX
+            borrow_rx_for_overlap(start + airtime);
+#endif
+        } else {
+            ESP_LOGE(TAG, "TX failed: %s", esp_err_to_name(err));
+            s_cm.tx_busy = false;
+        }
+
+        ESP_LOGI(TAG, "TX: freq=%lu, SF%d, %d bytes",
+                 sx_packet.frequency, sx_packet.sf, sx_packet.length);
 
-            xSemaphoreGive(s_cm.tx_mutex);
+        // Wait for TX complete (time on air plus margin)
+        uint32_t timeout_ms = airtime / 1000 + TX_DONE_MARGIN_MS;
+        uint32_t waited = 0;
+        while (s_cm.tx_busy && waited < timeout_ms) {
+            vTaskDelay(pdMS_TO_TICKS(1));
+            waited++;
+        }
+
+        if (s_cm.tx_busy) {
+            ESP_LOGW(TAG, "TX timeout");
+            gw_trace(GW_TRACE_TX_TIMEOUT, packet.tx_timestamp, 0);
+            s_cm.tx_timeouts++;
+            s_cm.tx_busy = false;
+        } else if (err == ESP_OK) {
+            gw_trace(GW_TRACE_TX_DONE, packet.tx_timestamp, 0);
+            if (timed) {
+                record_tx_timing(s_cm.tx_radio, start, fired, airtime);
+            }
         }
+
+        // Hops resume from the channel the RX radio was moved to
+        s_cm.coex_hold = false;
+
+        xSemaphoreGive(s_cm.tx_mutex);
     }
 
     ESP_LOGI(TAG, "TX task stopped");
     vTaskDelete(NULL);
 }
 
-// Internal: RX callback (called from ISR context)
+// Internal: RX callback (called from the RX radio service task)
 static void rx_callback(sx1276_rx_packet_t *packet, void *user_data)
 {
     if (!packet) {
         return;
     }
 
-    // Convert to gateway packet format
-    lora_rx_packet_t gw_packet = {0};
-    memcpy(gw_packet.payload, packet->data, packet->length);
-    gw_packet.payload_size = packet->length;
-    gw_packet.modulation.frequency = packet->frequency;
-    gw_packet.modulation.spreading_factor = packet->sf;
-    gw_packet.modulation.bandwidth = packet->bw;
-    gw_packet.modulation.coding_rate = packet->cr;
-    gw_packet.rssi = packet->rssi;
-    gw_packet.snr = packet->snr;
-    gw_packet.crc_ok = packet->crc_ok;
-    gw_packet.timestamp = packet->timestamp;
-    gw_packet.tmst = lora_gateway_get_timestamp();
-    gw_packet.rf_chain = 0;
+    // Convert to gateway packet format, straight into the RX ring slot
+    lora_rx_packet_t *gw_packet = lora_gateway_rx_slot();
+    if (gw_packet) {
+        memset(gw_packet, 0, sizeof(lora_rx_packet_t));
+        memcpy(gw_packet->payload, packet->data, packet->length);
+        gw_packet->payload_size = packet->length;
+        gw_packet->modulation.frequency = packet->frequency;
+        gw_packet->modulation.spreading_factor = packet->sf;
+        gw_packet->modulation.bandwidth = lora_gateway_bw_from_radio(packet->bw);
+        gw_packet->modulation.coding_rate = packet->cr;
+        gw_packet->rssi = packet->rssi;
+        gw_packet->snr = packet->snr;
+        gw_packet->freq_offset = packet->freq_error;
+        gw_packet->crc_ok = packet->crc_ok;
+        gw_packet->timestamp = packet->timestamp;
+        gw_packet->header_timestamp = packet->header_timestamp;
+        gw_packet->tmst = lora_gateway_get_timestamp();
+        deadline_monitor_check(GW_STAGE_RX_SERVICE, gw_packet->tmst - packet->timestamp);
+        gw_packet->rf_chain = 0;
+        gw_packet->if_chain = s_cm.current_channel;
+        coex_note_rx(gw_packet);
+
+        // Forward to gateway
+        lora_gateway_rx_commit();
+    }
 
-    // Forward to gateway
-    extern void lora_gateway_rx_handler(const lora_rx_packet_t *packet);
-    lora_gateway_rx_handler(&gw_packet);
+    // A hop held off for this packet can happen now, in the timer daemon
+    // like every other hop
+    if (s_cm.hop_pending) {
+        xTimerPendFunctionCall(pended_hop, NULL, 0, 0);
+    }
+}
+
+// Internal: ValidHeader callback (RX radio service task, before RxDone)
+static void header_callback(uint32_t header_time, void *user_data)
+{
+    lora_gateway_rx_header();
 }
 
 // Internal: TX done callback
@@ -321,13 +741,345 @@ static void tx_done_callback(bool success, void *user_data)
     }
 }
 
+// Internal: TX wake timer (esp_timer task context)
+static void tx_timer_callback(void *arg)
+{
+    xSemaphoreGive(s_cm.tx_wake);
+}
+
 // Internal: Channel hopping timer
 static void hop_timer_callback(TimerHandle_t timer)
 {
-    if (!s_cm.running || !s_cm.hopping_enabled) {
+    try_hop();
+    plan_listen();
+}
+
+// Internal: Leave a hop pending for the RX callback (timer daemon)
+static void defer_hop(void)
+{
+    if (!s_cm.hop_pending) {
+        s_cm.hops_deferred++;
+        gw_trace(GW_TRACE_HOP_DEFERRED, s_cm.current_channel, 0);
+    }
+    s_cm.hop_pending = true;
+}
+
+// Internal: Hop, or leave it pending for the RX callback (timer daemon).
+// Whether a packet is on air takes a RegModemStat read: the RX radio's
+// service task answers it and finish_hop() hops, so the timer daemon never
+// waits on the radio.
+static void try_hop(void)
+{
+    if (!s_cm.running || !s_cm.hopping_enabled || s_cm.listen_hold || s_cm.coex_hold) {
+        return;
+    }
+
+    // cm_tx_task is moving or borrowing the RX radio; a borrow posts the
+    // pending hop when it gives the radio back
+    if (xSemaphoreTake(s_cm.rx_ctl, 0) != pdTRUE) {
+        defer_hop();
+        return;
+    }
+
+    // Never retune under a packet being received; the RX callback hops
+    // once it is done (a header seen costs no SPI read)
+    if (s_cm.rx_borrowed || sx1276_rx_header_pending(s_cm.rx_radio)) {
+        defer_hop();
+    } else {
+        sx1276_rx_busy_async(s_cm.rx_radio, hop_probed, NULL);
+    }
+
+    xSemaphoreGive(s_cm.rx_ctl);
+}
+
+// Internal: Answer of the hop's busy probe (RX service task)
+static void hop_probed(bool busy, void *user_data)
+{
+    xTimerPendFunctionCall(finish_hop, NULL, busy, 0);
+}
+
+// Internal: Hop after the busy probe, unless the radio was taken or a
+// window opened meanwhile (timer daemon)
+static void finish_hop(void *arg, uint32_t busy)
+{
+    if (!s_cm.running || !s_cm.hopping_enabled || s_cm.listen_hold || s_cm.coex_hold) {
+        return;
+    }
+
+    bool locked = xSemaphoreTake(s_cm.rx_ctl, 0) == pdTRUE;
+
+    if (!locked || s_cm.rx_borrowed || busy) {
+        defer_hop();
+    } else {
+        do_hop();
+    }
+
+    if (locked) {
+        xSemaphoreGive(s_cm.rx_ctl);
+    }
+}
+
+// Internal: Hop held off for a packet, posted by the RX callback (timer daemon)
+static void pended_hop(void *arg, uint32_t unused)
+{
+    if (s_cm.hop_pending) {
+        try_hop();
+    }
+}
+
+// Internal: Report a downlink as it fires and move the RX radio away from
+// it when the coexistence manager finds a farther channel (cm_tx_task)
+static void coex_begin(uint32_t tx_freq, uint32_t start, uint32_t airtime)
+{
+    // A hopping RX radio can listen anywhere; a fixed channel, a listen
+    // window, a hop in progress or a packet being received stay put
+    bool locked = xSemaphoreTake(s_cm.rx_ctl, 0) == pdTRUE;
+    bool may_move = locked && s_cm.hopping_enabled && !s_cm.listen_hold &&
+                    !sx1276_rx_busy(s_cm.rx_radio);
+
+    uint8_t channel = coex_tx_start(tx_freq, start, airtime, s_cm.current_channel, may_move);
+    if (channel != s_cm.current_channel) {
+        s_cm.coex_hold = true;
+        s_cm.hop_pending = false;
+        s_cm.current_channel = channel;
+        sx1276_set_frequency_async(s_cm.rx_radio, gw_config_get_uplink_freq(channel));
+        gw_trace(GW_TRACE_HOP, channel, 0);
+    }
+
+    if (locked) {
+        xSemaphoreGive(s_cm.rx_ctl);
+    }
+}
+
+#ifdef CONFIG_LORA_DUAL_TX
+// Internal: TxDone of a downlink sent on the RX radio
+static void borrow_done_callback(bool success, void *user_data)
+{
+    s_cm.borrow_busy = false;
+}
+
+// Internal: Policy for taking the RX radio off air for this long
+static bool borrow_allowed(uint32_t blind_us)
+{
+    if (blind_us > CONFIG_LORA_DUAL_TX_MAX_BLIND_MS * 1000) {
+        return false;
+    }
+
+    uint32_t now = lora_gateway_get_timestamp();
+    if (now - s_cm.budget_start >= BORROW_BUDGET_PERIOD_US) {
+        s_cm.budget_start = now;
+        s_cm.budget_used_us = 0;
+    }
+    return s_cm.budget_used_us + blind_us <= CONFIG_LORA_DUAL_TX_BUDGET_MS * 1000;
+}
+
+// Internal: Send the next downlink on the RX radio when it starts while
+// the TX radio is still on air (cm_tx_task, right after the fire)
+static void borrow_rx_for_overlap(uint32_t busy_until)
+{
+    lora_tx_packet_t *next;
+    if (spsc_ring_peek(&s_cm.tx_ring, (void **)&next) == 0 || next->immediate) {
+        return;
+    }
+
+    // Only a start inside radio 1's time on air is an overlap; anything
+    // beyond the late limit is dropped by the main loop as usual
+    int32_t delay = (int32_t)(next->tx_timestamp - lora_gateway_get_timestamp());
+    if ((int32_t)(next->tx_timestamp - busy_until) >= 0 || delay < -TX_LATE_LIMIT_US) {
+        return;
+    }
+
+    uint32_t airtime = lora_codec_time_on_air_us(&next->modulation, next->payload_size,
+                                                 TX_PREAMBLE_SYMBOLS, false);
+    if (!borrow_allowed(TX_PREPARE_LEAD_US + airtime + BORROW_RESTORE_US)) {
+        s_cm.borrow_declined++;
+        return;
+    }
+
+    // Keep listening up to the prepare lead; an uplink on air or an
+    // expected one wins, and the downlink waits for radio 1
+    wait_until(next->tx_timestamp - TX_PREPARE_LEAD_US);
+
+    // Hops and listen windows are kept out before anything is checked:
+    // none can be half-way through retuning the radio it's about to use
+    if (xSemaphoreTake(s_cm.rx_ctl, 0) != pdTRUE) {
+        s_cm.borrow_declined++;
+        return;
+    }
+    s_cm.rx_borrowed = true;
+    if (s_cm.listen_hold || sx1276_rx_busy(s_cm.rx_radio)) {
+        s_cm.rx_borrowed = false;
+        xSemaphoreGive(s_cm.rx_ctl);
+        s_cm.borrow_declined++;
+        return;
+    }
+
+    lora_tx_packet_t *packet = &s_cm.borrow_packet;
+    memcpy(packet, next, sizeof(lora_tx_packet_t));
+    spsc_ring_release(&s_cm.tx_ring, 1);
+    note_dequeued(packet);
+
+    uint32_t blind_start = lora_gateway_get_timestamp();
+    gw_trace(GW_TRACE_RX_BORROW, packet->tx_timestamp, 0);
+
+    bool timed = (int32_t)(packet->tx_timestamp - blind_start) > 0;
+    uint32_t start = timed ? packet->tx_timestamp : blind_start;
+    uint32_t fired = 0;
+    build_sx_packet(packet, &s_cm.borrow_sx);
+
+    // Loading the FIFO ends RX (nothing on air, checked above)
+    s_cm.borrow_busy = true;
+    esp_err_t err = sx1276_tx_prepare(s_cm.rx_radio, &s_cm.borrow_sx, false,
+                                      borrow_done_callback, NULL);
+
+    // Posted retunes and modem changes run before the prepare: the RX
+    // settings to restore are final now
+    uint32_t rx_freq = sx1276_get_frequency(s_cm.rx_radio);
+    sx1276_spreading_factor_t sf;
+    sx1276_bandwidth_t bw;
+    sx1276_coding_rate_t cr;
+    sx1276_get_modulation(s_cm.rx_radio, &sf, &bw, &cr);
+
+    if (err == ESP_OK) {
+        err = sx1276_tx_fire(s_cm.rx_radio, start, &fired);
+        gw_trace(GW_TRACE_TX_FIRE, packet->tx_timestamp, 0);
+    }
+
+    if (err == ESP_OK) {
+        uint32_t timeout_ms = airtime / 1000 + TX_DONE_MARGIN_MS;
+        for (uint32_t waited = 0; s_cm.borrow_busy && waited < timeout_ms; waited++) {
+            vTaskDelay(pdMS_TO_TICKS(1));
+        }
+        if (s_cm.borrow_busy) {
+            ESP_LOGW(TAG, "TX timeout (RX radio)");
+            gw_trace(GW_TRACE_TX_TIMEOUT, packet->tx_timestamp, 0);
+            s_cm.tx_timeouts++;
+        } else {
+            gw_trace(GW_TRACE_TX_DONE, packet->tx_timestamp, 0);
+            if (timed) {
+                record_tx_timing(s_cm.rx_radio, start, fired, airtime);
+            }
+            s_cm.borrow_sent++;
+        }
+    } else {
+        ESP_LOGE(TAG, "TX on RX radio failed: %s", esp_err_to_name(err));
+    }
+    s_cm.borrow_busy = false;
+
+    // Back to listening: RX modem, frequency and continuous mode
+    sx1276_set_modulation(s_cm.rx_radio, sf, bw, cr);
+    sx1276_set_frequency(s_cm.rx_radio, rx_freq);
+    sx1276_start_rx(s_cm.rx_radio, rx_callback, NULL);
+    s_cm.rx_borrowed = false;
+    xSemaphoreGive(s_cm.rx_ctl);
+
+    // A hop that came due meanwhile
+    if (s_cm.hop_pending) {
+        xTimerPendFunctionCall(pended_hop, NULL, 0, 0);
+    }
+
+    uint32_t blind = lora_gateway_get_timestamp() - blind_start;
+    s_cm.blind_total_us += blind;
+    s_cm.budget_used_us += blind;
+    if (blind > s_cm.blind_max_us) {
+        s_cm.blind_max_us = blind;
+    }
+    gw_trace(GW_TRACE_RX_RESTORE, blind, 0);
+
+    ESP_LOGI(TAG, "TX on RX radio: freq=%lu, SF%d, %d bytes, RX blind %lu us",
+             s_cm.borrow_sx.frequency, s_cm.borrow_sx.sf, s_cm.borrow_sx.length, blind);
+}
+#endif
+
+// Internal: Arm the listen timer for the next expected uplink, if one
+// starts before the hop after next
+static void plan_listen(void)
+{
+#ifdef CONFIG_LORA_PREDICTIVE_LISTEN
+    if (!s_cm.listen_timer || s_cm.listen_hold || xTimerIsTimerActive(s_cm.listen_timer)) {
+        return;
+    }
+
+    int64_t now = esp_timer_get_time();
+    int64_t horizon = (int64_t)s_cm.hop_interval_ms * 1000 + 2 * LISTEN_LEAD_US;
+    if (!device_table_predict(now, horizon, &s_cm.listen)) {
+        return;
+    }
+
+    int64_t delay = s_cm.listen.start - LISTEN_LEAD_US - now;
+    TickType_t ticks = delay > 0 ? pdMS_TO_TICKS(delay / 1000) : 0;
+    xTimerChangePeriod(s_cm.listen_timer, ticks > 0 ? ticks : 1, 0);
+#endif
+}
+
+// Internal: Listen timer, opens a window on the predicted channel and SF
+// and closes it when the window ends
+static void listen_timer_callback(TimerHandle_t timer)
+{
+    if (!s_cm.running) {
+        return;
+    }
+
+    // cm_tx_task is moving the RX radio, or its modem holds a downlink's
+    // settings until it is restored
+    if (xSemaphoreTake(s_cm.rx_ctl, 0) != pdTRUE) {
+        xTimerChangePeriod(timer, 1, 0);
         return;
     }
 
+    // Modem changes are posted like the hops: the timer daemon never waits
+    // on the radio
+    if (s_cm.listen_hold) {
+        // Window over: back to the scan modulation and blind hops
+        if (s_cm.listen_sf_switched) {
+            sx1276_set_modulation_async(s_cm.rx_radio, s_cm.scan_sf, s_cm.scan_bw, s_cm.scan_cr);
+            s_cm.listen_sf_switched = false;
+        }
+        s_cm.listen_hold = false;
+        xSemaphoreGive(s_cm.rx_ctl);
+        plan_listen();
+        return;
+    }
+
+    // Let a packet on air finish first (cached ValidHeader, no SPI access)
+    if (sx1276_rx_header_pending(s_cm.rx_radio)) {
+        xSemaphoreGive(s_cm.rx_ctl);
+        xTimerChangePeriod(timer, 1, 0);
+        return;
+    }
+
+    s_cm.listen_hold = true;
+    s_cm.hop_pending = false;
+    s_cm.listen_windows++;
+
+    if (s_cm.listen.channel != s_cm.current_channel) {
+        s_cm.current_channel = s_cm.listen.channel;
+        sx1276_set_frequency_async(s_cm.rx_radio,
+                                   gw_config_get_uplink_freq(s_cm.current_channel));
+        gw_trace(GW_TRACE_HOP, s_cm.current_channel, 0);
+    }
+    // The restore posted when the last window closed has run by now: the
+    // service task outranks the timer daemon, and this is a later tick
+    sx1276_get_modulation(s_cm.rx_radio, &s_cm.scan_sf, &s_cm.scan_bw, &s_cm.scan_cr);
+    if (s_cm.listen.sf != s_cm.scan_sf) {
+        sx1276_set_modulation_async(s_cm.rx_radio, s_cm.listen.sf, s_cm.scan_bw, s_cm.scan_cr);
+        s_cm.listen_sf_switched = true;
+    }
+    xSemaphoreGive(s_cm.rx_ctl);
+
+    ESP_LOGD(TAG, "Listening on channel %d SF%d for %08lx",
+             s_cm.listen.channel, s_cm.listen.sf, s_cm.listen.devaddr);
+
+    int64_t remaining = s_cm.listen.end - esp_timer_get_time();
+    TickType_t ticks = remaining > 0 ? pdMS_TO_TICKS(remaining / 1000) : 0;
+    xTimerChangePeriod(timer, ticks > 0 ? ticks : 1, 0);
+}
+
+// Internal: Move the RX radio to the next channel (timer daemon, rx_ctl held)
+static void do_hop(void)
+{
+    s_cm.hop_pending = false;
+
     const gateway_config_t *config = gw_config_get();
     uint8_t num_channels = GATEWAY_MAX_CHANNELS;
 
@@ -337,8 +1089,10 @@ static void hop_timer_callback(TimerHandle_t timer)
     // Get frequency for this channel
     uint32_t freq = gw_config_get_uplink_freq(s_cm.current_channel);
 
-    // Update RX radio frequency
-    sx1276_set_frequency(s_cm.rx_radio, freq);
+    // Update RX radio frequency; posted, so the timer task never waits on
+    // the radio and a hop still pending is replaced by this one
+    sx1276_set_frequency_async(s_cm.rx_radio, freq);
+    gw_trace(GW_TRACE_HOP, s_cm.current_channel, 0);
 
     ESP_LOGD(TAG, "Hopped to channel %d (%.2f MHz)",
              s_cm.current_channel, freq / 1e6);
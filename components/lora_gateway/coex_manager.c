@@ -0,0 +1,135 @@
+/**
+ * @file coex_manager.c
+ * @brief TX/RX coexistence of the two radios
+ *
+ * The radios sit centimetres apart, so while radio 1 transmits, radio 0's
+ * receiver is desensitized, the more the closer its channel is to the
+ * downlink. The channel manager reports every downlink as it fires; when
+ * the RX radio is free to move and another RX channel is clearly farther
+ * from the TX frequency, it is moved there for the time on air. Uplinks
+ * whose time on air overlaps a downlink are tagged and their CRC outcome
+ * is counted apart, split by whether the RX radio had been moved, so the
+ * desense rate and what retuning buys can be read from the statistics.
+ */
+
+#include <string.h>
+#include "lora_gateway.h"
+#include "lora_codec.h"
+#include "gateway_config.h"
+#include "esp_log.h"
+
+static const char *TAG = "coex";
+
+#define COEX_TX_HISTORY         4       // Downlinks kept for overlap checks (power of two)
+#define COEX_MIN_GAIN_HZ        400000  // Move only for this much more separation
+#define COEX_GUARD_US           1000    // PA ramp and PLL settling around a downlink
+#define COEX_PREAMBLE_SYMBOLS   8       // LoRaWAN uplink preamble
+
+// One downlink on air (gateway timestamps)
+typedef struct {
+    uint32_t start;
+    uint32_t end;
+    bool retuned;               // RX radio moved away for it
+} coex_tx_window_t;
+
+// Coexistence state. Windows are written by cm_tx_task and read by the RX
+// service task; an entry is complete before head is advanced past it.
+typedef struct {
+    coex_tx_window_t windows[COEX_TX_HISTORY];
+    uint32_t head;              // Free-running write index
+
+    // Statistics
+    uint32_t retunes;
+    uint32_t rx_overlap;
+    uint32_t rx_overlap_bad;
+    uint32_t rx_overlap_retuned;
+    uint32_t rx_overlap_retuned_bad;
+} coex_state_t;
+
+static coex_state_t s_coex = {0};
+
+// Internal: Frequency separation (Hz)
+static uint32_t separation(uint32_t a, uint32_t b)
+{
+    return a > b ? a - b : b - a;
+}
+
+uint8_t coex_tx_start(uint32_t tx_freq, uint32_t start, uint32_t airtime,
+                      uint8_t rx_channel, bool may_move)
+{
+    uint8_t target = rx_channel;
+
+#ifdef CONFIG_LORA_COEX_RETUNE
+    if (may_move) {
+        uint32_t current = separation(gw_config_get_uplink_freq(rx_channel), tx_freq);
+        uint32_t best = current;
+
+        for (uint8_t ch = 0; ch < GATEWAY_RX_CHANNELS; ch++) {
+            uint32_t distance = separation(gw_config_get_uplink_freq(ch), tx_freq);
+            if (distance > best) {
+                best = distance;
+                target = ch;
+            }
+        }
+
+        // A few hundred kHz more buys little and costs the current channel
+        if (best < current + COEX_MIN_GAIN_HZ) {
+            target = rx_channel;
+        }
+    }
+#endif
+
+    uint32_t head = s_coex.head;
+    coex_tx_window_t *window = &s_coex.windows[head & (COEX_TX_HISTORY - 1)];
+    window->start = start - COEX_GUARD_US;
+    window->end = start + airtime + COEX_GUARD_US;
+    window->retuned = (target != rx_channel);
+    __atomic_store_n(&s_coex.head, head + 1, __ATOMIC_RELEASE);
+
+    if (target != rx_channel) {
+        s_coex.retunes++;
+        ESP_LOGD(TAG, "Downlink at %.2f MHz: RX channel %d -> %d",
+                 tx_freq / 1e6, rx_channel, target);
+    }
+
+    return target;
+}
+
+void coex_note_rx(lora_rx_packet_t *packet)
+{
+    uint32_t head = __atomic_load_n(&s_coex.head, __ATOMIC_ACQUIRE);
+    uint32_t end = packet->timestamp;
+    uint32_t start = end - lora_codec_time_on_air_us(&packet->modulation, packet->payload_size,
+                                                     COEX_PREAMBLE_SYMBOLS, true);
+
+    for (uint32_t i = 1; i <= COEX_TX_HISTORY && i <= head; i++) {
+        const coex_tx_window_t *window = &s_coex.windows[(head - i) & (COEX_TX_HISTORY - 1)];
+
+        // Interval overlap on wrapping timestamps
+        if ((int32_t)(start - window->end) >= 0 || (int32_t)(window->start - end) >= 0) {
+            continue;
+        }
+
+        packet->tx_overlap = true;
+        s_coex.rx_overlap++;
+        if (!packet->crc_ok) {
+            s_coex.rx_overlap_bad++;
+        }
+        if (window->retuned) {
+            s_coex.rx_overlap_retuned++;
+            if (!packet->crc_ok) {
+                s_coex.rx_overlap_retuned_bad++;
+            }
+        }
+        return;
+    }
+}
+
+void coex_get_stats(gateway_stats_t *stats)
+{
+    stats->coex_retunes = s_coex.retunes;
+    stats->rx_during_tx = s_coex.rx_overlap;
+    stats->rx_during_tx_bad = s_coex.rx_overlap_bad;
+    stats->rx_during_tx_retuned = s_coex.rx_overlap_retuned;
+    stats->rx_during_tx_retuned_bad = s_coex.rx_overlap_retuned_bad;
+}
@@ -0,0 +1,140 @@
+/**
+ * @file deadline_monitor.c
+ * @brief Latency budgets of the time-critical pipeline stages
+ *
+ * Each stage is owned by one module, which declares its budget at init and
+ * reports the measured latency every time the stage runs. Overruns are
+ * counted with the core that ran the stage and written to the trace ring;
+ * depending on CONFIG_GATEWAY_DEADLINE_ACTION they are also logged
+ * (rate-limited) or, after a streak, handed to the stage's self-heal hook.
+ * A long run within budget afterwards undoes the heal one step at a time.
+ */
+
+#include <string.h>
+#include "lora_gateway.h"
+#include "gw_trace.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+static const char *TAG = "deadline";
+
+#define DEADLINE_LOG_INTERVAL_US    1000000 // One overrun log per stage per second
+#define DEADLINE_HEAL_STREAK        3       // Consecutive overruns before healing
+#define DEADLINE_RELAX_STREAK       1000    // Consecutive checks in budget before relaxing
+
+// Stage state
+typedef struct {
+    gw_deadline_stats_t stats;
+    gw_deadline_heal_t heal;
+    gw_deadline_relax_t relax;
+    uint32_t streak;            // Consecutive overruns
+    uint32_t clean;             // Consecutive checks in budget
+    uint32_t healed;            // Heal steps not yet relaxed
+    uint32_t suppressed;        // Overruns not logged since the last log
+    int64_t last_log;
+} deadline_stage_t;
+
+static deadline_stage_t s_stages[GW_STAGE_COUNT] = {0};
+
+void deadline_monitor_register(gw_stage_t stage, const char *name, uint32_t budget_us,
+                               gw_deadline_heal_t heal, gw_deadline_relax_t relax)
+{
+    if (stage >= GW_STAGE_COUNT) {
+        return;
+    }
+
+    deadline_stage_t *st = &s_stages[stage];
+    memset(st, 0, sizeof(deadline_stage_t));
+    st->stats.name = name;
+    st->stats.budget_us = budget_us;
+    st->heal = heal;
+    st->relax = relax;
+}
+
+// Internal: Run the configured action for an overrun
+static void overrun_action(gw_stage_t stage, deadline_stage_t *st, uint32_t elapsed_us)
+{
+#ifndef CONFIG_GATEWAY_DEADLINE_ACTION_METRIC
+    int64_t now = esp_timer_get_time();
+    if (now - st->last_log >= DEADLINE_LOG_INTERVAL_US) {
+        ESP_LOGW(TAG, "%s over budget: %lu us > %lu us (core %d, %lu more since last log)",
+                 st->stats.name, elapsed_us, st->stats.budget_us,
+                 st->stats.last_core, st->suppressed);
+        st->last_log = now;
+        st->suppressed = 0;
+    } else {
+        st->suppressed++;
+    }
+#endif
+
+#ifdef CONFIG_GATEWAY_DEADLINE_ACTION_HEAL
+    if (st->heal && st->streak >= DEADLINE_HEAL_STREAK) {
+        st->streak = 0;
+        if (st->heal(stage)) {
+            st->stats.heals++;
+            st->healed++;
+            ESP_LOGW(TAG, "%s: self-heal applied", st->stats.name);
+        }
+    }
+#endif
+}
+
+// Internal: Undo one heal step after a long run within budget
+static void relax_action(gw_stage_t stage, deadline_stage_t *st)
+{
+#ifdef CONFIG_GATEWAY_DEADLINE_ACTION_HEAL
+    if (!st->relax || st->healed == 0 || ++st->clean < DEADLINE_RELAX_STREAK) {
+        return;
+    }
+
+    st->clean = 0;
+    if (st->relax(stage)) {
+        st->healed--;
+        ESP_LOGI(TAG, "%s: self-heal relaxed", st->stats.name);
+    }
+#endif
+}
+
+bool deadline_monitor_check(gw_stage_t stage, uint32_t elapsed_us)
+{
+    if (stage >= GW_STAGE_COUNT || s_stages[stage].stats.budget_us == 0) {
+        return true;
+    }
+
+    deadline_stage_t *st = &s_stages[stage];
+    st->stats.checks++;
+    if (elapsed_us > st->stats.max_us) {
+        st->stats.max_us = elapsed_us;
+    }
+
+    if (elapsed_us <= st->stats.budget_us) {
+        st->streak = 0;
+        relax_action(stage, st);
+        return true;
+    }
+
+    st->clean = 0;
+
+    uint32_t overrun = elapsed_us - st->stats.budget_us;
+    st->stats.overruns++;
+    st->stats.last_overrun_us = elapsed_us;
+    st->stats.last_core = xPortGetCoreID();
+    st->streak++;
+    gw_trace(GW_TRACE_DEADLINE, overrun, stage);
+
+    overrun_action(stage, st, elapsed_us);
+
+    return false;
+}
+
+esp_err_t deadline_monitor_get_stats(gw_stage_t stage, gw_deadline_stats_t *stats)
+{
+    if (stage >= GW_STAGE_COUNT || !stats) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memcpy(stats, &s_stages[stage].stats, sizeof(gw_deadline_stats_t));
+    return ESP_OK;
+}
@@ -0,0 +1,354 @@
+/**
+ * @file device_table.c
+ * @brief Per-device state learned from uplinks
+ *
+ * Keeps the crystal offset of each end device (from the radio's FEI) so
+ * its next downlink can be sent on the frequency the device will actually
+ * listen on. Entries are keyed by DevAddr; the least recently seen entry
+ * is replaced when the table is full.
+ *
+ * Also learns each device's reporting period, channel and SF. Intervals
+ * that are a small multiple of the period (uplinks missed while the RX
+ * radio listened elsewhere) still confirm it; once period and channel have
+ * repeated a few times, the channel manager can ask for the next expected
+ * uplink and listen for it.
+ */
+
+#include <string.h>
+#include "lora_gateway.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+static const char *TAG = "dev_table";
+
+#define OFFSET_EWMA_SHIFT       2       // Crystal offset smoothing (1/4)
+#define PERIOD_EWMA_SHIFT       2       // Period and jitter smoothing (1/4)
+#define PERIOD_MIN_MS           10000   // Shorter periods are not worth a retune
+#define PERIOD_MAX_MISSED       4       // Interval may span this many periods
+#define PERIOD_MIN_STREAK       3       // Confirmations before predicting
+#define PERIOD_TOLERANCE_SHIFT  3       // Interval within period/8 confirms it
+#define WINDOW_MIN_MS           500     // Half-width of a listening window
+#define WINDOW_JITTER_MULT      3       // Half-width in jitter units
+
+// Device entry
+typedef struct {
+    uint32_t devaddr;
+    int32_t offset_ppb;         // Crystal error, parts per billion (EWMA)
+    uint32_t uplinks;
+    int64_t last_seen;          // RxDone time of the last uplink
+    uint32_t period_ms;         // Reporting period (EWMA), 0 = unknown
+    uint32_t jitter_ms;         // Mean deviation from the period (EWMA)
+    uint8_t channel;            // IF channel and SF of the last uplink
+    uint8_t sf;
+    uint8_t streak;             // Consecutive uplinks matching period and channel
+    bool predicted;             // Listening window open for this device
+    int64_t window_start;
+    int64_t window_end;
+    uint8_t window_channel;     // Where the RX radio listens in the window
+    uint8_t window_sf;
+    bool confirmed_pending;     // Confirmed downlink sent, ACK expected
+    bool in_use;
+} device_entry_t;
+
+// Device table state
+typedef struct {
+    device_entry_t entries[DEVICE_TABLE_SIZE];
+    SemaphoreHandle_t mutex;
+    bool initialized;
+
+    // Statistics
+    uint32_t tracked;
+    uint32_t dl_compensated;
+    uint32_t dl_acked;
+    uint32_t dl_missed;
+    uint32_t predict_hits;
+    uint32_t predict_misses;
+} device_table_t;
+
+static device_table_t s_dt = {0};
+
+static uint32_t read_le32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Internal: DevAddr of a data frame, false for joins and short frames
+static bool frame_devaddr(const uint8_t *payload, int len, bool uplink, uint32_t *devaddr)
+{
+    if (len <= LORA_FCTRL_OFFSET) {
+        return false;
+    }
+
+    uint8_t mtype = payload[0] >> 5;
+    if (uplink && mtype != LORA_MTYPE_UNCONF_DATA_UP && mtype != LORA_MTYPE_CONF_DATA_UP) {
+        return false;
+    }
+    if (!uplink && mtype != LORA_MTYPE_UNCONF_DATA_DOWN && mtype != LORA_MTYPE_CONF_DATA_DOWN) {
+        return false;
+    }
+
+    *devaddr = read_le32(&payload[1]);
+    return true;
+}
+
+// Internal: Find entry (caller holds the mutex)
+static device_entry_t *find_entry(uint32_t devaddr)
+{
+    for (int i = 0; i < DEVICE_TABLE_SIZE; i++) {
+        if (s_dt.entries[i].in_use && s_dt.entries[i].devaddr == devaddr) {
+            return &s_dt.entries[i];
+        }
+    }
+    return NULL;
+}
+
+// Internal: Find or allocate entry, replacing the least recently seen
+static device_entry_t *get_entry(uint32_t devaddr)
+{
+    device_entry_t *entry = find_entry(devaddr);
+    if (entry) {
+        return entry;
+    }
+
+    device_entry_t *victim = &s_dt.entries[0];
+    for (int i = 0; i < DEVICE_TABLE_SIZE; i++) {
+        if (!s_dt.entries[i].in_use) {
+            victim = &s_dt.entries[i];
+            s_dt.tracked++;
+            break;
+        }
+        if (s_dt.entries[i].last_seen < victim->last_seen) {
+            victim = &s_dt.entries[i];
+        }
+    }
+
+    memset(victim, 0, sizeof(device_entry_t));
+    victim->devaddr = devaddr;
+    victim->in_use = true;
+    return victim;
+}
+
+// Internal: Learn the reporting period, channel and SF from a new uplink
+static void learn_period(device_entry_t *entry, const lora_rx_packet_t *packet, int64_t rx_time)
+{
+    uint8_t channel = packet->if_chain;
+    uint8_t sf = packet->modulation.spreading_factor;
+    uint32_t interval = (uint32_t)((rx_time - entry->last_seen) / 1000);
+    bool consistent = false;
+
+    if (entry->period_ms > 0) {
+        uint32_t k = (interval + entry->period_ms / 2) / entry->period_ms;
+        int32_t err = (int32_t)(interval - k * entry->period_ms);
+        uint32_t dev = err < 0 ? -err : err;
+        uint32_t tolerance = entry->period_ms >> PERIOD_TOLERANCE_SHIFT;
+
+        if (k >= 1 && k <= PERIOD_MAX_MISSED && dev <= tolerance) {
+            entry->period_ms += (err / (int32_t)k) >> PERIOD_EWMA_SHIFT;
+            entry->jitter_ms += ((int32_t)dev - (int32_t)entry->jitter_ms) >> PERIOD_EWMA_SHIFT;
+            consistent = true;
+        }
+    }
+
+    if (!consistent) {
+        // New or broken rhythm: start over from this interval
+        entry->period_ms = interval >= PERIOD_MIN_MS ? interval : 0;
+        entry->jitter_ms = 0;
+        entry->streak = 0;
+    } else if (channel == entry->channel && sf == entry->sf) {
+        if (entry->streak < UINT8_MAX) {
+            entry->streak++;
+        }
+    } else {
+        entry->streak = 0;      // Periodic, but not on a predictable channel
+    }
+
+    entry->channel = channel;
+    entry->sf = sf;
+}
+
+esp_err_t device_table_init(void)
+{
+    if (s_dt.initialized) {
+        return ESP_OK;
+    }
+
+    memset(&s_dt, 0, sizeof(device_table_t));
+
+    s_dt.mutex = xSemaphoreCreateMutex();
+    if (!s_dt.mutex) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    s_dt.initialized = true;
+    ESP_LOGI(TAG, "Device table initialized (%d entries)", DEVICE_TABLE_SIZE);
+
+    return ESP_OK;
+}
+
+void device_table_update(const lora_rx_packet_t *packet)
+{
+    uint32_t devaddr;
+
+    if (!s_dt.initialized || !packet->crc_ok || packet->modulation.frequency == 0 ||
+        !frame_devaddr(packet->payload, packet->payload_size, true, &devaddr)) {
+        return;
+    }
+
+    // Normalize to ppb so it scales to the downlink frequency
+    int32_t ppb = (int32_t)((int64_t)packet->freq_offset * 1000000000 /
+                            packet->modulation.frequency);
+    bool ack = packet->payload[LORA_FCTRL_OFFSET] & LORA_FCTRL_ACK;
+
+    xSemaphoreTake(s_dt.mutex, portMAX_DELAY);
+
+    // RxDone time on the 64-bit clock (the packet carries its low 32 bits)
+    int64_t now = esp_timer_get_time();
+    int64_t rx_time = now - (uint32_t)((uint32_t)now - packet->timestamp);
+
+    device_entry_t *entry = get_entry(devaddr);
+    if (entry->uplinks == 0) {
+        entry->offset_ppb = ppb;
+        entry->channel = packet->if_chain;
+        entry->sf = packet->modulation.spreading_factor;
+    } else {
+        entry->offset_ppb += (ppb - entry->offset_ppb) >> OFFSET_EWMA_SHIFT;
+        learn_period(entry, packet, rx_time);
+    }
+    entry->uplinks++;
+    entry->last_seen = rx_time;
+
+    // Caught inside the window, where the RX radio was listening for it
+    if (entry->predicted && rx_time >= entry->window_start && rx_time <= entry->window_end &&
+        packet->if_chain == entry->window_channel &&
+        packet->modulation.spreading_factor == entry->window_sf) {
+        s_dt.predict_hits++;
+        entry->predicted = false;
+    }
+
+    // The uplink after a confirmed downlink tells whether it arrived
+    if (entry->confirmed_pending) {
+        if (ack) {
+            s_dt.dl_acked++;
+        } else {
+            s_dt.dl_missed++;
+        }
+        entry->confirmed_pending = false;
+    }
+
+    xSemaphoreGive(s_dt.mutex);
+}
+
+int32_t device_table_downlink_offset(const lora_tx_packet_t *packet)
+{
+    uint32_t devaddr;
+    int32_t offset = 0;
+
+    if (!s_dt.initialized ||
+        !frame_devaddr(packet->payload, packet->payload_size, false, &devaddr)) {
+        return 0;
+    }
+
+    xSemaphoreTake(s_dt.mutex, portMAX_DELAY);
+
+    device_entry_t *entry = find_entry(devaddr);
+    if (entry) {
+        if ((packet->payload[0] >> 5) == LORA_MTYPE_CONF_DATA_DOWN) {
+            entry->confirmed_pending = true;
+        }
+#ifdef CONFIG_LORA_DOWNLINK_FREQ_COMPENSATION
+        offset = (int32_t)((int64_t)entry->offset_ppb * packet->modulation.frequency / 1000000000);
+        s_dt.dl_compensated++;
+#endif
+    }
+
+    xSemaphoreGive(s_dt.mutex);
+
+    return offset;
+}
+
+bool device_table_predict(int64_t now, int64_t horizon, gw_listen_prediction_t *prediction)
+{
+    bool found = false;
+
+    if (!s_dt.initialized || !prediction) {
+        return false;
+    }
+
+    xSemaphoreTake(s_dt.mutex, portMAX_DELAY);
+
+    for (int i = 0; i < DEVICE_TABLE_SIZE; i++) {
+        device_entry_t *entry = &s_dt.entries[i];
+        if (!entry->in_use) {
+            continue;
+        }
+
+        // A window that closed without the uplink
+        if (entry->predicted && now > entry->window_end) {
+            s_dt.predict_misses++;
+            entry->predicted = false;
+            entry->streak = PERIOD_MIN_STREAK - 1;  // One more confirmation first
+        }
+        if (entry->predicted || entry->period_ms == 0 || entry->streak < PERIOD_MIN_STREAK) {
+            continue;
+        }
+
+        // Next period boundary whose window has not closed yet
+        int64_t period = (int64_t)entry->period_ms * 1000;
+        int64_t half = (int64_t)(WINDOW_MIN_MS + WINDOW_JITTER_MULT * entry->jitter_ms) * 1000;
+        int64_t expected = entry->last_seen + period;
+        uint32_t periods = 1;
+        while (expected + half < now && periods < PERIOD_MAX_MISSED) {
+            expected += period;
+            periods++;
+        }
+        if (expected + half < now || expected - half > now + horizon) {
+            continue;
+        }
+
+        if (!found || expected - half < prediction->start) {
+            prediction->devaddr = entry->devaddr;
+            prediction->channel = entry->channel;
+            prediction->sf = entry->sf;
+            prediction->start = expected - half;
+            prediction->end = expected + half;
+            found = true;
+        }
+    }
+
+    if (found) {
+        device_entry_t *entry = find_entry(prediction->devaddr);
+        entry->predicted = true;
+        entry->window_start = prediction->start;
+        entry->window_end = prediction->end;
+        entry->window_channel = prediction->channel;
+        entry->window_sf = prediction->sf;
+    }
+
+    xSemaphoreGive(s_dt.mutex);
+
+    return found;
+}
+
+void device_table_get_stats(gateway_stats_t *stats)
+{
+    if (!stats) {
+        return;
+    }
+
+    uint32_t periodic = 0;
+    for (int i = 0; i < DEVICE_TABLE_SIZE; i++) {
+        if (s_dt.entries[i].in_use && s_dt.entries[i].streak >= PERIOD_MIN_STREAK) {
+            periodic++;
+        }
+    }
+
+    stats->devices_tracked = s_dt.tracked;
+    stats->dl_freq_compensated = s_dt.dl_compensated;
+    stats->dl_confirmed_acked = s_dt.dl_acked;
+    stats->dl_confirmed_missed = s_dt.dl_missed;
+    stats->devices_periodic = periodic;
+    stats->listen_hits = s_dt.predict_hits;
+    stats->listen_misses = s_dt.predict_misses;
+}
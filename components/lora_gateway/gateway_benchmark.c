@@ -0,0 +1,347 @@
+/**
+ * @file gateway_benchmark.c
+ * @brief Micro-benchmarks of the hot-path primitives
+ *
+ * Each case runs a fixed number of iterations and reports the mean cost
+ * per operation. Radio cases run on the idle TX radio and also report
+ * SPI transactions and wire bytes per operation from the driver
+ * counters. Results are printed as one JSON line with stable case names,
+ * so runs of two builds can be diffed directly.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "lora_gateway.h"
+#include "lora_codec.h"
+#include "spsc_ring.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+static const char *TAG = "benchmark";
+
+#define BENCH_MAX_RESULTS       24
+#define BENCH_OUTPUT_SIZE       4096
+#define BENCH_RING_CAPACITY     16
+#define BENCH_SIZES             3
+
+// Representative LoRaWAN frame sizes: empty MAC frame, DR0 and DR5 maximum
+static const uint8_t s_sizes[BENCH_SIZES] = {12, 51, 222};
+
+typedef void (*bench_fn_t)(uint32_t iterations, const void *arg);
+
+typedef struct {
+    const char *name;
+    uint32_t ns_per_op;
+    uint32_t spi_transactions;      // Per operation (radio cases)
+    uint32_t spi_wire_bytes;
+} bench_result_t;
+
+// Benchmark state (heap, only alive during a run)
+typedef struct {
+    uint32_t iterations;
+    sx1276_handle_t radio;
+    uint32_t frequency;
+    volatile uint32_t sink;         // Keeps results observable
+
+    uint8_t payload[LORA_MAX_PAYLOAD_SIZE];
+    char text[LORA_CODEC_RXPK_MAX_SIZE];
+    char b64[BENCH_SIZES][LORA_CODEC_RXPK_MAX_SIZE];
+    char txpk[BENCH_SIZES][LORA_CODEC_RXPK_MAX_SIZE];
+    lora_rx_packet_t rx[BENCH_SIZES];
+    lora_tx_packet_t tx;
+    sx1276_tx_packet_t radio_tx;
+    sx1276_modem_profile_t profiles[2];
+    gateway_stats_t stats;
+    spsc_ring_t ring;
+
+    bench_result_t results[BENCH_MAX_RESULTS];
+    int count;
+} bench_state_t;
+
+static bench_state_t *s_bench = NULL;
+
+// Internal: Time one case and record it
+static void run_case(const char *name, bench_fn_t fn, const void *arg, bool radio)
+{
+    if (s_bench->count >= BENCH_MAX_RESULTS) {
+        return;
+    }
+
+    sx1276_service_stats_t before = {0};
+    sx1276_service_stats_t after = {0};
+    uint32_t n = s_bench->iterations;
+
+    if (radio) {
+        sx1276_get_service_stats(s_bench->radio, &before);
+    }
+
+    int64_t start = esp_timer_get_time();
+    fn(n, arg);
+    int64_t elapsed = esp_timer_get_time() - start;
+
+    bench_result_t *result = &s_bench->results[s_bench->count++];
+    result->name = name;
+    result->ns_per_op = (uint32_t)(elapsed * 1000 / n);
+
+    if (radio) {
+        sx1276_get_service_stats(s_bench->radio, &after);
+        result->spi_transactions = (after.spi_transactions - before.spi_transactions) / n;
+        result->spi_wire_bytes = (after.spi_wire_bytes - before.spi_wire_bytes) / n;
+    }
+}
+
+static void bench_base64_encode(uint32_t iterations, const void *arg)
+{
+    int len = *(const uint8_t *)arg;
+    for (uint32_t i = 0; i < iterations; i++) {
+        lora_codec_base64_encode(s_bench->payload, len, s_bench->text);
+    }
+    s_bench->sink += s_bench->text[0];
+}
+
+static void bench_base64_decode(uint32_t iterations, const void *arg)
+{
+    int len = 0;
+    for (uint32_t i = 0; i < iterations; i++) {
+        len = lora_codec_base64_decode(arg, s_bench->payload, LORA_MAX_PAYLOAD_SIZE);
+    }
+    s_bench->sink += len;
+}
+
+static void bench_rxpk_encode(uint32_t iterations, const void *arg)
+{
+    int len = 0;
+    for (uint32_t i = 0; i < iterations; i++) {
+        len = lora_codec_encode_rxpk(arg, s_bench->text);
+    }
+    s_bench->sink += len;
+}
+
+static void bench_stat_encode(uint32_t iterations, const void *arg)
+{
+    int len = 0;
+    for (uint32_t i = 0; i < iterations; i++) {
+        len = lora_codec_encode_stat(arg, 100.0, NULL, s_bench->text, sizeof(s_bench->text));
+    }
+    s_bench->sink += len;
+}
+
+static void bench_txpk_parse(uint32_t iterations, const void *arg)
+{
+    for (uint32_t i = 0; i < iterations; i++) {
+        lora_codec_parse_txpk(arg, &s_bench->tx);
+    }
+    s_bench->sink += s_bench->tx.payload_size;
+}
+
+static void bench_time_on_air(uint32_t iterations, const void *arg)
+{
+    lora_modulation_t mod = {.frequency = 868100000, .bandwidth = 0, .coding_rate = 1};
+    uint32_t total = 0;
+    for (uint32_t i = 0; i < iterations; i++) {
+        mod.spreading_factor = 7 + i % 6;
+        total += lora_codec_time_on_air_us(&mod, 51, 8, true);
+    }
+    s_bench->sink += total;
+}
+
+static void bench_ring_handoff(uint32_t iterations, const void *arg)
+{
+    for (uint32_t i = 0; i < iterations; i++) {
+        spsc_ring_push(&s_bench->ring, arg);
+        spsc_ring_pop(&s_bench->ring, &s_bench->rx[0], 0);
+    }
+}
+
+static void bench_radio_rssi(uint32_t iterations, const void *arg)
+{
+    int32_t total = 0;
+    for (uint32_t i = 0; i < iterations; i++) {
+        total += sx1276_get_rssi(s_bench->radio);
+    }
+    s_bench->sink += total;
+}
+
+static void bench_radio_rx_busy(uint32_t iterations, const void *arg)
+{
+    // In RX with no header pending: every call reads the modem status
+    uint32_t busy = 0;
+    for (uint32_t i = 0; i < iterations; i++) {
+        busy += sx1276_rx_busy(s_bench->radio);
+    }
+    s_bench->sink += busy;
+}
+
+static void bench_radio_set_frequency(uint32_t iterations, const void *arg)
+{
+    for (uint32_t i = 0; i < iterations; i++) {
+        sx1276_set_frequency(s_bench->radio, s_bench->frequency);
+    }
+}
+
+static void bench_radio_tx_prepare(uint32_t iterations, const void *arg)
+{
+    // Loads the FIFO and stays in standby; nothing is transmitted
+    for (uint32_t i = 0; i < iterations; i++) {
+        sx1276_tx_prepare(s_bench->radio, arg, false, NULL, NULL);
+    }
+}
+
+static void bench_radio_profile_switch(uint32_t iterations, const void *arg)
+{
+    // Alternate SF7 and SF12, as an SF scan or per-downlink change would
+    for (uint32_t i = 0; i < iterations; i++) {
+        sx1276_profile_apply(s_bench->radio, &s_bench->profiles[i & 1]);
+    }
+}
+
+// Internal: Build the sample inputs once, outside the timed loops
+static void prepare_inputs(void)
+{
+    for (int i = 0; i < LORA_MAX_PAYLOAD_SIZE; i++) {
+        s_bench->payload[i] = (uint8_t)(i * 37 + 11);
+    }
+
+    for (int i = 0; i < BENCH_SIZES; i++) {
+        lora_codec_base64_encode(s_bench->payload, s_sizes[i], s_bench->b64[i]);
+
+        lora_rx_packet_t *rx = &s_bench->rx[i];
+        memcpy(rx->payload, s_bench->payload, s_sizes[i]);
+        rx->payload_size = s_sizes[i];
+        rx->modulation.frequency = 868100000;
+        rx->modulation.spreading_factor = 7;
+        rx->modulation.coding_rate = 1;
+        rx->rssi = -87;
+        rx->snr = 7.5f;
+        rx->freq_offset = -1250;
+        rx->crc_ok = true;
+        rx->tmst = 123456789;
+
+        snprintf(s_bench->txpk[i], sizeof(s_bench->txpk[i]),
+                 "{\"txpk\":{\"imme\":false,\"tmst\":123456789,\"freq\":869.525,"
+                 "\"rfch\":0,\"powe\":14,\"modu\":\"LORA\",\"datr\":\"SF9BW125\","
+                 "\"codr\":\"4/5\",\"ipol\":true,\"size\":%d,\"data\":\"%s\"}}",
+                 s_sizes[i], s_bench->b64[i]);
+    }
+
+    s_bench->stats.rx_total = 1234;
+    s_bench->stats.rx_ok = 1200;
+    s_bench->stats.rx_forwarded = 1200;
+    s_bench->stats.tx_total = 56;
+    s_bench->stats.tx_ok = 55;
+
+    memcpy(s_bench->radio_tx.data, s_bench->payload, 51);
+    s_bench->radio_tx.length = 51;
+    s_bench->radio_tx.frequency = s_bench->frequency;
+    s_bench->radio_tx.power = 14;
+    s_bench->radio_tx.invert_iq = true;
+
+    sx1276_modem_params_t params = {
+        .sf = SX1276_SF_7,
+        .bw = SX1276_BW_125_KHZ,
+        .cr = SX1276_CR_4_5,
+        .preamble_length = 8,
+        .payload_length = SX1276_MAX_PACKET_SIZE,
+        .crc_on = true,
+    };
+    sx1276_profile_compile(&params, &s_bench->profiles[0]);
+    params.sf = SX1276_SF_12;
+    sx1276_profile_compile(&params, &s_bench->profiles[1]);
+}
+
+// Internal: Print all results as one JSON line
+static void print_results(void)
+{
+    char *out = malloc(BENCH_OUTPUT_SIZE);
+    if (!out) {
+        return;
+    }
+
+    sx1276_service_stats_t radio_stats = {0};
+    sx1276_get_service_stats(s_bench->radio, &radio_stats);
+
+    int len = snprintf(out, BENCH_OUTPUT_SIZE,
+                       "{\"benchmark\":\"gateway_hotpath\",\"version\":1,"
+                       "\"iterations\":%lu,\"spi_clock_hz\":%lu,\"results\":[",
+                       s_bench->iterations, radio_stats.spi_clock_hz);
+
+    for (int i = 0; i < s_bench->count && len < BENCH_OUTPUT_SIZE; i++) {
+        const bench_result_t *r = &s_bench->results[i];
+        len += snprintf(&out[len], BENCH_OUTPUT_SIZE - len,
+                        "%s{\"name\":\"%s\",\"ns_per_op\":%lu,"
+                        "\"spi_trans_per_op\":%lu,\"spi_bytes_per_op\":%lu}",
+                        i ? "," : "", r->name, r->ns_per_op,
+                        r->spi_transactions, r->spi_wire_bytes);
+    }
+
+    if (len < BENCH_OUTPUT_SIZE) {
+        snprintf(&out[len], BENCH_OUTPUT_SIZE - len, "]}");
+    }
+
+    // Plain stdout so the line can be captured without log prefixes
+    printf("%s\n", out);
+    free(out);
+}
+
+esp_err_t gateway_benchmark_run(sx1276_handle_t radio, uint32_t frequency, uint32_t iterations)
+{
+    if (!radio || iterations == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    s_bench = calloc(1, sizeof(bench_state_t));
+    if (!s_bench) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t ret = spsc_ring_init(&s_bench->ring, BENCH_RING_CAPACITY, sizeof(lora_rx_packet_t));
+    if (ret != ESP_OK) {
+        free(s_bench);
+        s_bench = NULL;
+        return ret;
+    }
+
+    s_bench->radio = radio;
+    s_bench->frequency = frequency;
+    s_bench->iterations = iterations;
+    prepare_inputs();
+
+    ESP_LOGI(TAG, "Running hot-path benchmarks (%lu iterations)...", iterations);
+
+    run_case("codec.base64_encode.12", bench_base64_encode, &s_sizes[0], false);
+    run_case("codec.base64_encode.51", bench_base64_encode, &s_sizes[1], false);
+    run_case("codec.base64_encode.222", bench_base64_encode, &s_sizes[2], false);
+    run_case("codec.base64_decode.12", bench_base64_decode, s_bench->b64[0], false);
+    run_case("codec.base64_decode.51", bench_base64_decode, s_bench->b64[1], false);
+    run_case("codec.base64_decode.222", bench_base64_decode, s_bench->b64[2], false);
+    run_case("codec.rxpk_encode.12", bench_rxpk_encode, &s_bench->rx[0], false);
+    run_case("codec.rxpk_encode.51", bench_rxpk_encode, &s_bench->rx[1], false);
+    run_case("codec.rxpk_encode.222", bench_rxpk_encode, &s_bench->rx[2], false);
+    run_case("codec.stat_encode", bench_stat_encode, &s_bench->stats, false);
+    run_case("codec.txpk_parse.12", bench_txpk_parse, s_bench->txpk[0], false);
+    run_case("codec.txpk_parse.51", bench_txpk_parse, s_bench->txpk[1], false);
+    run_case("codec.txpk_parse.222", bench_txpk_parse, s_bench->txpk[2], false);
+    run_case("codec.time_on_air", bench_time_on_air, NULL, false);
+    run_case("ring.handoff", bench_ring_handoff, &s_bench->rx[1], false);
+    run_case("sx1276.get_rssi", bench_radio_rssi, NULL, true);
+    // rx_busy answers false without SPI outside RX
+    sx1276_start_rx(radio, NULL, NULL);
+    run_case("sx1276.rx_busy", bench_radio_rx_busy, NULL, true);
+    sx1276_stop_rx(radio);
+    run_case("sx1276.set_frequency", bench_radio_set_frequency, NULL, true);
+    run_case("sx1276.tx_prepare.51", bench_radio_tx_prepare, &s_bench->radio_tx, true);
+    // Drop the loaded frame so a later fire can't send it
+    sx1276_set_mode(radio, SX1276_MODE_STANDBY);
+    run_case("sx1276.profile_switch", bench_radio_profile_switch, NULL, true);
+
+    sx1276_set_mode(radio, SX1276_MODE_STANDBY);
+
+    print_results();
+
+    spsc_ring_deinit(&s_bench->ring);
+    free(s_bench);
+    s_bench = NULL;
+
+    return ESP_OK;
+}
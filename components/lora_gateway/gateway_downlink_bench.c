@@ -0,0 +1,241 @@
+/**
+ * @file gateway_downlink_bench.c
+ * @brief Downlink timing accuracy under load
+ *
+ * Drives the running gateway's downlink path the way the forwarder does:
+ * txpk JSON is parsed and handed to lora_gateway_send(), so cm_tx_task,
+ * the TX ring and the TX radio are the real ones. The stream mixes
+ * immediate (class C) and timestamped RX1/RX2 downlinks; each timestamp
+ * is planned relative to an uplink that happened one network round trip
+ * ago, with WiFi-like jitter (a few tens of ms, occasional spikes of a
+ * second), so some downlinks arrive with little lead and some too late.
+ * Meanwhile a task on cm_tx_task's core encodes bursts of uplinks at
+ * gw_rx_task's priority. The result is one JSON line with the start error
+ * histogram, late and skipped counts and the TX queue wait, to compare
+ * scheduler and timing changes against.
+ *
+ * The downlinks are really transmitted (at BENCH_TX_POWER): run it with an
+ * antenna or a dummy load on the TX radio.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "lora_gateway.h"
+#include "lora_codec.h"
+#include "gateway_config.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_random.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+static const char *TAG = "dl_bench";
+
+#define BENCH_TX_POWER          2       // dBm
+#define BENCH_IMMEDIATE_RATIO   4       // One class C downlink in 4
+#define BENCH_RX1_DELAY_US      1000000
+#define BENCH_RX2_DELAY_US      2000000
+#define BENCH_GAP_MIN_MS        30      // Between PULL_RESP arrivals
+#define BENCH_GAP_SPAN_MS       300
+#define BENCH_NET_MIN_US        20000   // Uplink-to-PULL_RESP round trip
+#define BENCH_NET_SPAN_US       60000
+#define BENCH_SPIKE_RATIO       20      // One jitter spike in 20
+#define BENCH_SPIKE_MIN_US      300000  // Retries, power save
+#define BENCH_SPIKE_SPAN_US     900000
+#define BENCH_BURST_SIZE        8       // Uplinks per burst
+#define BENCH_BURST_GAP_MIN_MS  20
+#define BENCH_BURST_GAP_SPAN_MS 180
+#define BENCH_UPLINK_PRIORITY   10      // Like gw_rx_task
+#define BENCH_DRAIN_MS          3000    // Longest horizon plus SF12 time on air
+#define BENCH_SIZES             3
+
+// Downlink sizes: empty MAC frame, MAC commands, small application payload
+static const uint8_t s_sizes[BENCH_SIZES] = {12, 17, 33};
+
+// Benchmark state (heap, only alive during a run)
+typedef struct {
+    char b64[BENCH_SIZES][LORA_CODEC_RXPK_MAX_SIZE];
+    char txpk[LORA_CODEC_RXPK_MAX_SIZE];
+    char rxpk[LORA_CODEC_RXPK_MAX_SIZE];
+    lora_tx_packet_t tx;
+    lora_rx_packet_t rx;
+
+    volatile bool running;
+    volatile bool burst_done;
+    uint32_t uplinks;
+
+    uint32_t immediate;
+    uint32_t timed;
+    uint32_t rejected;          // TX ring full or parse failure
+    uint32_t spikes;
+    uint32_t lead_min_us;       // Shortest lead of a timed downlink on arrival
+    bool lead_seen;             // lead_min_us holds a timed downlink's lead
+} dl_bench_state_t;
+
+static dl_bench_state_t *s_bench = NULL;
+
+// Internal: Uniform random value in [0, span)
+static uint32_t random_below(uint32_t span)
+{
+    return esp_random() % span;
+}
+
+// Internal: Uplink bursts competing with cm_tx_task for its core
+static void uplink_burst_task(void *arg)
+{
+    lora_rx_packet_t *rx = &s_bench->rx;
+
+    while (s_bench->running) {
+        for (int i = 0; i < BENCH_BURST_SIZE; i++) {
+            rx->payload_size = s_sizes[i % BENCH_SIZES] + 10;
+            rx->payload[0] = (uint8_t)i;
+            rx->tmst = lora_gateway_get_timestamp();
+            rx->modulation.spreading_factor = 7 + i % 6;
+            lora_codec_encode_rxpk(rx, s_bench->rxpk);
+            s_bench->uplinks++;
+        }
+        vTaskDelay(pdMS_TO_TICKS(BENCH_BURST_GAP_MIN_MS + random_below(BENCH_BURST_GAP_SPAN_MS)));
+    }
+
+    s_bench->burst_done = true;
+    vTaskDelete(NULL);
+}
+
+// Internal: Deliver one PULL_RESP, as the forwarder's handle_pull_resp() does
+static void deliver_downlink(uint32_t i)
+{
+    bool immediate = (i % BENCH_IMMEDIATE_RATIO) == 0;
+    uint32_t tmst = 0;
+
+    if (!immediate) {
+        // Planned by the server from the uplink one round trip ago
+        uint32_t round_trip = BENCH_NET_MIN_US + random_below(BENCH_NET_SPAN_US);
+        if (random_below(BENCH_SPIKE_RATIO) == 0) {
+            round_trip += BENCH_SPIKE_MIN_US + random_below(BENCH_SPIKE_SPAN_US);
+            s_bench->spikes++;
+        }
+        uint32_t window = (i % 3 == 2) ? BENCH_RX2_DELAY_US : BENCH_RX1_DELAY_US;
+        int32_t lead = (int32_t)window - (int32_t)round_trip;
+        tmst = lora_gateway_get_timestamp() + lead;
+        // Rejected ones included: a lead too short to schedule is the point
+        if (!s_bench->lead_seen || lead < (int32_t)s_bench->lead_min_us) {
+            s_bench->lead_min_us = lead > 0 ? lead : 0;
+            s_bench->lead_seen = true;
+        }
+    }
+
+    int size = i % BENCH_SIZES;
+    uint32_t freq = gw_config_get_downlink_freq(gw_config_get_uplink_freq(i % GATEWAY_RX_CHANNELS));
+    snprintf(s_bench->txpk, sizeof(s_bench->txpk),
+             "{\"txpk\":{\"imme\":%s,\"tmst\":%lu,\"freq\":%.3f,\"rfch\":0,\"powe\":%d,"
+             "\"modu\":\"LORA\",\"datr\":\"SF%dBW500\",\"codr\":\"4/5\",\"ipol\":true,"
+             "\"size\":%d,\"data\":\"%s\"}}",
+             immediate ? "true" : "false", tmst, freq / 1e6, BENCH_TX_POWER,
+             7 + (int)(i % 6), s_sizes[size], s_bench->b64[size]);
+
+    if (lora_codec_parse_txpk(s_bench->txpk, &s_bench->tx) != ESP_OK ||
+        lora_gateway_send(&s_bench->tx) != ESP_OK) {
+        s_bench->rejected++;
+        return;
+    }
+
+    if (immediate) {
+        s_bench->immediate++;
+    } else {
+        s_bench->timed++;
+    }
+}
+
+esp_err_t gateway_downlink_bench_run(uint32_t downlinks)
+{
+    if (!lora_gateway_is_running()) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (downlinks == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    s_bench = calloc(1, sizeof(dl_bench_state_t));
+    if (!s_bench) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    uint8_t payload[LORA_MAX_PAYLOAD_SIZE];
+    for (int i = 0; i < LORA_MAX_PAYLOAD_SIZE; i++) {
+        payload[i] = (uint8_t)(i * 37 + 11);
+    }
+    for (int i = 0; i < BENCH_SIZES; i++) {
+        lora_codec_base64_encode(payload, s_sizes[i], s_bench->b64[i]);
+    }
+    memcpy(s_bench->rx.payload, payload, LORA_MAX_PAYLOAD_SIZE);
+    s_bench->rx.modulation.frequency = gw_config_get_uplink_freq(0);
+    s_bench->rx.modulation.coding_rate = 1;
+    s_bench->rx.rssi = -87;
+    s_bench->rx.snr = 7.5f;
+    s_bench->rx.crc_ok = true;
+
+    ESP_LOGW(TAG, "Downlink timing benchmark: %lu downlinks at %d dBm", downlinks, BENCH_TX_POWER);
+
+    s_bench->running = true;
+    if (xTaskCreatePinnedToCore(uplink_burst_task, "dl_bench_up", 4096, NULL,
+                                BENCH_UPLINK_PRIORITY, NULL, 1) != pdPASS) {
+        free(s_bench);
+        s_bench = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+
+    channel_manager_reset_tx_timing_stats();
+    int64_t start = esp_timer_get_time();
+
+    for (uint32_t i = 0; i < downlinks; i++) {
+        vTaskDelay(pdMS_TO_TICKS(BENCH_GAP_MIN_MS + random_below(BENCH_GAP_SPAN_MS)));
+        deliver_downlink(i);
+    }
+
+    // Let the last timed downlinks go out, then stop the uplink load
+    vTaskDelay(pdMS_TO_TICKS(BENCH_DRAIN_MS));
+    s_bench->running = false;
+    while (!s_bench->burst_done) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+
+    gw_tx_timing_stats_t timing;
+    channel_manager_get_tx_timing_stats(&timing);
+
+    // One JSON line on stdout, like the other benchmarks
+    printf("{\"benchmark\":\"downlink_timing\",\"version\":1,\"downlinks\":%lu,"
+           "\"elapsed_ms\":%lld,\"prelock\":%s,\"immediate\":%lu,\"timed\":%lu,"
+           "\"rejected\":%lu,\"jitter_spikes\":%lu,\"min_lead_us\":%lu,\"uplinks\":%lu,"
+           "\"measured\":%lu,\"skipped\":%lu,\"late\":%lu,\"late_threshold_us\":%d,"
+           "\"timeouts\":%lu,\"start_err_us\":{\"avg\":%ld,\"min\":%ld,\"max\":%ld,\"hist\":[",
+           downlinks, (esp_timer_get_time() - start) / 1000, timing.prelock ? "true" : "false",
+           s_bench->immediate, s_bench->timed, s_bench->rejected, s_bench->spikes,
+           s_bench->lead_min_us, s_bench->uplinks, timing.scheduled, timing.late,
+           timing.late_starts, GW_TX_LATE_START_US, timing.timeouts,
+           timing.start_err_avg_us, timing.start_err_min_us, timing.start_err_max_us);
+    for (int i = 0; i < GW_TX_ERR_BUCKETS; i++) {
+        if (i < GW_TX_ERR_BUCKETS - 1) {
+            printf("%s{\"le\":%lu,\"count\":%lu}", i ? "," : "", gw_tx_err_edges[i],
+                   timing.start_err_hist[i]);
+        } else {
+            printf(",{\"le\":null,\"count\":%lu}", timing.start_err_hist[i]);
+        }
+    }
+    printf("]},\"fire_err_us\":{\"avg\":%ld,\"max\":%lu},"
+           "\"queue_wait_us\":{\"count\":%lu,\"avg\":%lu,\"max\":%lu}}\n",
+           timing.fire_err_avg_us, timing.fire_err_max_us,
+           timing.dequeued, timing.queue_wait_avg_us, timing.queue_wait_max_us);
+
+    ESP_LOGI(TAG, "Downlink timing: %lu measured, %lu skipped, %lu late, start error %ld..%ld us",
+             timing.scheduled, timing.late, timing.late_starts,
+             timing.start_err_min_us, timing.start_err_max_us);
+
+    // Normal operation starts from clean counters
+    channel_manager_reset_tx_timing_stats();
+    lora_gateway_reset_stats();
+    free(s_bench);
+    s_bench = NULL;
+
+    return ESP_OK;
+}
@@ -0,0 +1,484 @@
+/**
+ * @file gateway_soak.c
+ * @brief Accelerated soak test of the forwarding hot paths
+ *
+ * Replays the message mix of a busy gateway (uplink encoding and ring
+ * handoff, PULL_RESP parsing and TX_ACK, periodic stat) for a number of
+ * simulated days as fast as the CPU allows. The UDP forwarder is also
+ * run end to end against a network server on the loopback interface:
+ * uplinks go in through pkt_fwd_send_uplink() and come back as PUSH_DATA,
+ * downlinks go out as PULL_RESP and come back as TX_ACK (the gateway is
+ * not started, so they are refused).
+ *
+ * Around every subsystem batch the heap is sampled. Other tasks allocate
+ * meanwhile, so a single delta proves nothing: each day, a subsystem is
+ * charged the smallest delta of its 24 batches, which a leak raises in
+ * every batch and unrelated traffic hardly ever does. Leaks rarer than
+ * one per batch show in the allocated block count at the end of each
+ * day, taken after the forwarder has gone quiet. After a one-day
+ * warm-up, any retained allocation, block count growth, txpk parse that
+ * overflowed its arena or shrinking largest free block fails the run.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "lora_gateway.h"
+#include "lora_codec.h"
+#include "spsc_ring.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#ifndef CONFIG_PKT_FWD_BACKEND_MQTT
+#include "packet_forwarder.h"
+#include "lwip/sockets.h"
+#endif
+
+static const char *TAG = "soak";
+
+#define SOAK_WARMUP_DAYS        1
+#define SOAK_STATS_PER_HOUR     120     // One stat every 30 s
+#define SOAK_DOWNLINK_RATIO     10      // One downlink per 10 uplinks
+#define SOAK_FRAG_TOLERANCE     1024    // Largest block wobble from other tasks (bytes)
+#define SOAK_RING_CAPACITY      8
+#define SOAK_HEAP_CAPS          (MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL)
+#define SOAK_BLOCK_TOLERANCE    16      // Day-end block count wobble from other tasks
+#define SOAK_SETTLE_MS          100     // Before the day-end sample
+
+#ifndef CONFIG_PKT_FWD_BACKEND_MQTT
+#define SOAK_FWD_PORT           17000   // Loopback network server
+#define SOAK_FWD_QUIET_MS       20      // Forwarder done once nothing arrives for this long
+#define SOAK_UDP_BUFFER_SIZE    2048
+#endif
+
+typedef enum {
+    SOAK_UPLINK = 0,
+    SOAK_DOWNLINK,
+    SOAK_STAT,
+#ifndef CONFIG_PKT_FWD_BACKEND_MQTT
+    SOAK_FWD_UPLINK,
+    SOAK_FWD_DOWNLINK,
+#endif
+    SOAK_SUBSYSTEMS
+} soak_subsystem_t;
+
+static const char *s_subsystem_names[SOAK_SUBSYSTEMS] = {
+    "uplink", "downlink", "stat",
+#ifndef CONFIG_PKT_FWD_BACKEND_MQTT
+    "fwd_uplink", "fwd_downlink",
+#endif
+};
+
+// Uplink sizes cycled through (MAC-only to DR5 maximum)
+static const uint8_t s_sizes[] = {12, 23, 51, 115, 222};
+#define SOAK_SIZES              (sizeof(s_sizes) / sizeof(s_sizes[0]))
+
+typedef struct {
+    uint32_t messages;
+    int32_t blocks_retained;    // Allocated blocks left behind (after warm-up)
+    int32_t bytes_retained;
+    int32_t day_blocks;         // Smallest batch delta of the current day
+    int32_t day_bytes;
+} soak_subsystem_stats_t;
+
+// Soak state (heap, only alive during a run)
+typedef struct {
+    uint8_t payload[LORA_MAX_PAYLOAD_SIZE];
+    char b64[SOAK_SIZES][LORA_CODEC_RXPK_MAX_SIZE];
+    char text[LORA_CODEC_RXPK_MAX_SIZE];
+    lora_rx_packet_t rx;
+    lora_rx_packet_t rx_out;
+    lora_tx_packet_t tx;
+    gateway_stats_t stats;
+    spsc_ring_t ring;
+
+    soak_subsystem_stats_t subsystems[SOAK_SUBSYSTEMS];
+    bool warm;
+
+#ifndef CONFIG_PKT_FWD_BACKEND_MQTT
+    // Loopback network server
+    bool fwd;
+    int sock;
+    struct sockaddr_in pull_addr;   // Forwarder's downstream socket, from its PULL_DATA
+    bool pull_known;
+    uint16_t token;
+    uint32_t push_data;
+    uint32_t tx_acks;
+    uint8_t udp[SOAK_UDP_BUFFER_SIZE];
+#endif
+} soak_state_t;
+
+static soak_state_t *s_soak = NULL;
+
+static void soak_uplinks(uint32_t count, uint32_t hour)
+{
+    for (uint32_t i = 0; i < count; i++) {
+        lora_rx_packet_t *rx = &s_soak->rx;
+        rx->payload_size = s_sizes[i % SOAK_SIZES];
+        rx->payload[0] = (uint8_t)i;
+        rx->tmst = hour * 3600000000UL + i;
+        rx->modulation.spreading_factor = 7 + i % 6;
+
+        lora_codec_encode_rxpk(rx, s_soak->text);
+        spsc_ring_push(&s_soak->ring, rx);
+        spsc_ring_pop(&s_soak->ring, &s_soak->rx_out, 0);
+
+        s_soak->stats.rx_total++;
+        s_soak->stats.rx_ok++;
+        s_soak->stats.rx_forwarded++;
+    }
+}
+
+// Internal: The i-th PULL_RESP body of the hour
+static int format_txpk(char *out, size_t size, uint32_t i, uint32_t hour)
+{
+    int n = i % SOAK_SIZES;
+    return snprintf(out, size,
+                    "{\"txpk\":{\"imme\":false,\"tmst\":%lu,\"freq\":869.525,"
+                    "\"rfch\":0,\"powe\":14,\"modu\":\"LORA\",\"datr\":\"SF%dBW125\","
+                    "\"codr\":\"4/5\",\"ipol\":true,\"size\":%d,\"data\":\"%s\"}}",
+                    hour * 3600000000UL + i, 7 + (int)(i % 6), s_sizes[n], s_soak->b64[n]);
+}
+
+static void soak_downlinks(uint32_t count, uint32_t hour)
+{
+    for (uint32_t i = 0; i < count; i++) {
+        format_txpk(s_soak->text, sizeof(s_soak->text), i, hour);
+
+        lora_codec_parse_txpk(s_soak->text, &s_soak->tx);
+        lora_codec_encode_tx_ack((i % 4) ? NULL : "TOO_LATE", s_soak->text, sizeof(s_soak->text));
+
+        s_soak->stats.tx_total++;
+        s_soak->stats.tx_ok++;
+    }
+}
+
+static void soak_stats(uint32_t count, uint32_t hour)
+{
+    for (uint32_t i = 0; i < count; i++) {
+        lora_codec_encode_stat(&s_soak->stats, 99.5, NULL, s_soak->text, sizeof(s_soak->text));
+    }
+}
+
+#ifndef CONFIG_PKT_FWD_BACKEND_MQTT
+// Internal: Answer the forwarder as a network server would, until it has
+// been quiet for SOAK_FWD_QUIET_MS
+static void fwd_serve(void)
+{
+    struct sockaddr_in from;
+    socklen_t from_len;
+
+    while (1) {
+        from_len = sizeof(from);
+        int len = recvfrom(s_soak->sock, s_soak->udp, sizeof(s_soak->udp), 0,
+                           (struct sockaddr *)&from, &from_len);
+        if (len < 0) {
+            return;
+        }
+        if (len < 4 || s_soak->udp[0] != 2) {
+            continue;
+        }
+
+        uint8_t ack[4] = {2, s_soak->udp[1], s_soak->udp[2], 0};
+        switch (s_soak->udp[3]) {
+            case 0x00:      // PUSH_DATA (uplinks or stat)
+                ack[3] = 0x01;
+                s_soak->push_data++;
+                sendto(s_soak->sock, ack, sizeof(ack), 0, (struct sockaddr *)&from, from_len);
+                break;
+            case 0x02:      // PULL_DATA
+                ack[3] = 0x04;
+                s_soak->pull_addr = from;
+                s_soak->pull_known = true;
+                sendto(s_soak->sock, ack, sizeof(ack), 0, (struct sockaddr *)&from, from_len);
+                break;
+            case 0x05:      // TX_ACK
+                s_soak->tx_acks++;
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+static void soak_fwd_uplinks(uint32_t count, uint32_t hour)
+{
+    for (uint32_t i = 0; i < count; i++) {
+        lora_rx_packet_t *rx = &s_soak->rx;
+        rx->payload_size = s_sizes[i % SOAK_SIZES];
+        rx->payload[0] = (uint8_t)i;
+        rx->tmst = hour * 3600000000UL + i;
+        rx->timestamp = (uint32_t)esp_timer_get_time();
+        rx->modulation.spreading_factor = 7 + i % 6;
+
+        // Ring full: let the forwarder send what it has
+        while (pkt_fwd_send_uplink(rx) == ESP_ERR_NO_MEM) {
+            fwd_serve();
+        }
+    }
+    fwd_serve();
+}
+
+static void soak_fwd_downlinks(uint32_t count, uint32_t hour)
+{
+    if (!s_soak->pull_known) {
+        fwd_serve();
+    }
+    if (!s_soak->pull_known) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint8_t *resp = s_soak->udp;
+        s_soak->token++;
+        resp[0] = 2;
+        resp[1] = s_soak->token >> 8;
+        resp[2] = s_soak->token & 0xFF;
+        resp[3] = 0x03;     // PULL_RESP
+        int len = format_txpk((char *)&resp[4], sizeof(s_soak->udp) - 4, i, hour);
+
+        sendto(s_soak->sock, resp, 4 + len, 0,
+               (struct sockaddr *)&s_soak->pull_addr, sizeof(s_soak->pull_addr));
+        fwd_serve();
+    }
+}
+
+// Internal: Start the UDP forwarder against the loopback server
+static bool fwd_start(void)
+{
+    s_soak->sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (s_soak->sock < 0) {
+        return false;
+    }
+
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(SOAK_FWD_PORT),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    struct timeval timeout = {.tv_sec = 0, .tv_usec = SOAK_FWD_QUIET_MS * 1000};
+    if (bind(s_soak->sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        setsockopt(s_soak->sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) < 0) {
+        close(s_soak->sock);
+        return false;
+    }
+
+    pkt_fwd_config_t config = {
+        .num_servers = 1,
+        .keepalive_interval_ms = 10000,
+        .stat_interval_ms = 30000,
+    };
+    strcpy(config.servers[0].host, "127.0.0.1");
+    config.servers[0].port = SOAK_FWD_PORT;
+
+    // One log line per PUSH_DATA and PULL_RESP would pace the run
+    esp_log_level_set("pkt_fwd", ESP_LOG_ERROR);
+    if (pkt_fwd_init(&config) != ESP_OK || pkt_fwd_start() != ESP_OK) {
+        pkt_fwd_deinit();
+        esp_log_level_set("pkt_fwd", ESP_LOG_INFO);
+        close(s_soak->sock);
+        return false;
+    }
+
+    return true;
+}
+
+// Internal: Release the forwarder for the real configuration
+static void fwd_stop(void)
+{
+    pkt_fwd_deinit();
+    esp_log_level_set("pkt_fwd", ESP_LOG_INFO);
+    close(s_soak->sock);
+}
+#endif
+
+// Internal: Run one subsystem batch, keeping the day's smallest heap delta
+static void run_batch(soak_subsystem_t id, void (*fn)(uint32_t, uint32_t),
+                      uint32_t count, uint32_t hour)
+{
+    multi_heap_info_t before, after;
+
+    heap_caps_get_info(&before, SOAK_HEAP_CAPS);
+    fn(count, hour);
+    heap_caps_get_info(&after, SOAK_HEAP_CAPS);
+
+    soak_subsystem_stats_t *sub = &s_soak->subsystems[id];
+    int32_t blocks = (int32_t)(after.allocated_blocks - before.allocated_blocks);
+    int32_t bytes = (int32_t)(after.total_allocated_bytes - before.total_allocated_bytes);
+
+    sub->messages += count;
+    if (blocks < sub->day_blocks) {
+        sub->day_blocks = blocks;
+    }
+    if (bytes < sub->day_bytes) {
+        sub->day_bytes = bytes;
+    }
+}
+
+// Internal: Allocated blocks once the forwarder and the network are idle
+static uint32_t settled_blocks(void)
+{
+    multi_heap_info_t info;
+
+    vTaskDelay(pdMS_TO_TICKS(SOAK_SETTLE_MS));
+    heap_caps_get_info(&info, SOAK_HEAP_CAPS);
+    return info.allocated_blocks;
+}
+
+esp_err_t gateway_soak_run(uint32_t days, uint32_t uplinks_per_hour)
+{
+    if (days <= SOAK_WARMUP_DAYS || uplinks_per_hour == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    s_soak = calloc(1, sizeof(soak_state_t));
+    if (!s_soak) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t ret = spsc_ring_init(&s_soak->ring, SOAK_RING_CAPACITY, sizeof(lora_rx_packet_t));
+    if (ret != ESP_OK) {
+        free(s_soak);
+        s_soak = NULL;
+        return ret;
+    }
+
+    for (int i = 0; i < LORA_MAX_PAYLOAD_SIZE; i++) {
+        s_soak->payload[i] = (uint8_t)(i * 37 + 11);
+    }
+    memcpy(s_soak->rx.payload, s_soak->payload, LORA_MAX_PAYLOAD_SIZE);
+    s_soak->rx.modulation.frequency = 868100000;
+    s_soak->rx.modulation.coding_rate = 1;
+    s_soak->rx.rssi = -87;
+    s_soak->rx.snr = 7.5f;
+    s_soak->rx.crc_ok = true;
+    for (int i = 0; i < SOAK_SIZES; i++) {
+        lora_codec_base64_encode(s_soak->payload, s_sizes[i], s_soak->b64[i]);
+    }
+
+    ESP_LOGI(TAG, "Soak test: %lu simulated days, %lu uplinks/h", days, uplinks_per_hour);
+
+#ifndef CONFIG_PKT_FWD_BACKEND_MQTT
+    s_soak->fwd = fwd_start();
+    if (!s_soak->fwd) {
+        ESP_LOGW(TAG, "Loopback forwarder unavailable, codec paths only");
+    }
+#endif
+
+    lora_codec_alloc_stats_t codec_start = {0};
+    lora_codec_alloc_stats_t codec_end;
+    uint32_t largest_baseline = 0;
+    uint32_t largest_day = 0;
+    uint32_t blocks_baseline = 0;
+    uint32_t blocks_day = 0;
+    uint32_t downlinks_per_hour = (uplinks_per_hour + SOAK_DOWNLINK_RATIO - 1) / SOAK_DOWNLINK_RATIO;
+    int64_t start = esp_timer_get_time();
+
+    for (uint32_t day = 0; day < days; day++) {
+        largest_day = UINT32_MAX;
+        for (int i = 0; i < SOAK_SUBSYSTEMS; i++) {
+            s_soak->subsystems[i].day_blocks = INT32_MAX;
+            s_soak->subsystems[i].day_bytes = INT32_MAX;
+        }
+
+        for (uint32_t h = 0; h < 24; h++) {
+            uint32_t hour = day * 24 + h;
+
+            run_batch(SOAK_UPLINK, soak_uplinks, uplinks_per_hour, hour);
+            run_batch(SOAK_DOWNLINK, soak_downlinks, downlinks_per_hour, hour);
+            run_batch(SOAK_STAT, soak_stats, SOAK_STATS_PER_HOUR, hour);
+#ifndef CONFIG_PKT_FWD_BACKEND_MQTT
+            if (s_soak->fwd) {
+                run_batch(SOAK_FWD_UPLINK, soak_fwd_uplinks, uplinks_per_hour, hour);
+                run_batch(SOAK_FWD_DOWNLINK, soak_fwd_downlinks, downlinks_per_hour, hour);
+            }
+#endif
+
+            uint32_t largest = heap_caps_get_largest_free_block(SOAK_HEAP_CAPS);
+            if (largest < largest_day) {
+                largest_day = largest;
+            }
+
+            // Let the network and idle tasks run
+            vTaskDelay(1);
+        }
+
+        if (s_soak->warm) {
+            for (int i = 0; i < SOAK_SUBSYSTEMS; i++) {
+                soak_subsystem_stats_t *sub = &s_soak->subsystems[i];
+                if (sub->day_blocks != INT32_MAX) {
+                    sub->blocks_retained += sub->day_blocks;
+                    sub->bytes_retained += sub->day_bytes;
+                }
+            }
+        }
+        blocks_day = settled_blocks();
+
+        ESP_LOGI(TAG, "Day %lu: free=%u largest=%lu min_free=%u blocks=%lu",
+                 day + 1, heap_caps_get_free_size(SOAK_HEAP_CAPS), largest_day,
+                 heap_caps_get_minimum_free_size(SOAK_HEAP_CAPS), blocks_day);
+
+        if (day + 1 == SOAK_WARMUP_DAYS) {
+            s_soak->warm = true;
+            largest_baseline = largest_day;
+            blocks_baseline = blocks_day;
+            lora_codec_get_alloc_stats(&codec_start);
+        }
+    }
+
+    lora_codec_get_alloc_stats(&codec_end);
+
+    // Pass criteria: nothing retained, no block count growth, no arena
+    // overflow, no fragmentation growth
+    int32_t blocks_retained = 0;
+    for (int i = 0; i < SOAK_SUBSYSTEMS; i++) {
+        blocks_retained += s_soak->subsystems[i].blocks_retained;
+    }
+    int32_t blocks_growth = (int32_t)(blocks_day - blocks_baseline);
+    uint32_t overflow = codec_end.heap_allocs - codec_start.heap_allocs;
+    bool fragmented = largest_day + SOAK_FRAG_TOLERANCE < largest_baseline;
+    bool pass = blocks_retained <= 0 && blocks_growth <= SOAK_BLOCK_TOLERANCE &&
+                overflow == 0 && !fragmented;
+
+    uint32_t push_data = 0;
+    uint32_t tx_acks = 0;
+#ifndef CONFIG_PKT_FWD_BACKEND_MQTT
+    if (s_soak->fwd) {
+        fwd_stop();
+        push_data = s_soak->push_data;
+        tx_acks = s_soak->tx_acks;
+    }
+#endif
+
+    // One JSON line on stdout, like the benchmark
+    printf("{\"soak\":\"gateway_hotpath\",\"version\":2,\"days\":%lu,\"uplinks_per_hour\":%lu,"
+           "\"elapsed_ms\":%lld,\"subsystems\":[",
+           days, uplinks_per_hour, (esp_timer_get_time() - start) / 1000);
+    for (int i = 0; i < SOAK_SUBSYSTEMS; i++) {
+        const soak_subsystem_stats_t *sub = &s_soak->subsystems[i];
+        printf("%s{\"name\":\"%s\",\"messages\":%lu,\"blocks_retained\":%ld,\"bytes_retained\":%ld}",
+               i ? "," : "", s_subsystem_names[i], sub->messages,
+               sub->blocks_retained, sub->bytes_retained);
+    }
+    printf("],\"push_data\":%lu,\"tx_acks\":%lu,\"blocks_growth\":%ld,"
+           "\"arena_peak\":%lu,\"arena_overflows\":%lu,\"largest_free_baseline\":%lu,"
+           "\"largest_free_end\":%lu,\"result\":\"%s\"}\n",
+           push_data, tx_acks, blocks_growth, codec_end.arena_peak, overflow,
+           largest_baseline, largest_day, pass ? "PASS" : "FAIL");
+
+    if (pass) {
+        ESP_LOGI(TAG, "Soak test passed");
+    } else {
+        ESP_LOGE(TAG, "Soak test failed: %ld blocks retained, %ld blocks grown, "
+                 "%lu arena overflows, largest free block %lu -> %lu",
+                 blocks_retained, blocks_growth, overflow, largest_baseline, largest_day);
+    }
+
+    spsc_ring_deinit(&s_soak->ring);
+    free(s_soak);
+    s_soak = NULL;
+
+    return pass ? ESP_OK : ESP_FAIL;
+}
@@ -0,0 +1,179 @@
+/**
+ * @file gw_trace.c
+ * @brief Crash-surviving pipeline trace
+ *
+ * The ring lives in RTC slow memory with RTC_NOINIT_ATTR, so it keeps its
+ * contents across panics, watchdog and software resets (not power loss).
+ * Writers claim a slot with an atomic increment of the free-running head
+ * and tag the entry with the low bits of its index; on recovery an entry
+ * is only trusted if its tag matches the slot it was expected in, which
+ * drops slots claimed but not finished when the reset hit.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "gw_trace.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#ifdef CONFIG_GATEWAY_TRACE_RING
+
+static const char *TAG = "gw_trace";
+
+#define TRACE_MAGIC             0x47545243  // "GTRC"
+#define TRACE_VERSION           1
+#define TRACE_SIZE              128         // Entries (power of two)
+#define TRACE_UPLOAD_EVENTS     32          // Most recent events kept after a reset
+#define TRACE_JSON_SIZE         (64 + TRACE_UPLOAD_EVENTS * 40)
+
+// One event (12 bytes)
+typedef struct {
+    uint32_t time;              // esp_timer, low 32 bits (us)
+    uint32_t arg;
+    uint16_t seq;               // Low bits of the write index
+    uint8_t event;
+    uint8_t core_depth;         // Core in bit 7, depth (saturated) in bits 0-6
+} trace_entry_t;
+
+// Ring in RTC slow memory
+typedef struct {
+    uint32_t magic;
+    uint32_t layout;            // Version and geometry, rejects stale layouts
+    uint32_t boot_count;
+    uint32_t head;              // Free-running write index
+    trace_entry_t entries[TRACE_SIZE];
+} trace_ring_t;
+
+#define TRACE_LAYOUT            ((TRACE_VERSION << 24) | (TRACE_SIZE << 8) | sizeof(trace_entry_t))
+
+static RTC_NOINIT_ATTR trace_ring_t s_ring;
+
+// Recovered trace (normal RAM, freed once uploaded)
+static char *s_postmortem = NULL;
+
+static const char *reset_reason_name(esp_reset_reason_t reason)
+{
+    switch (reason) {
+        case ESP_RST_POWERON:   return "POWERON";
+        case ESP_RST_EXT:       return "EXT";
+        case ESP_RST_SW:        return "SW";
+        case ESP_RST_PANIC:     return "PANIC";
+        case ESP_RST_INT_WDT:   return "INT_WDT";
+        case ESP_RST_TASK_WDT:  return "TASK_WDT";
+        case ESP_RST_WDT:       return "WDT";
+        case ESP_RST_DEEPSLEEP: return "DEEPSLEEP";
+        case ESP_RST_BROWNOUT:  return "BROWNOUT";
+        default:                return "UNKNOWN";
+    }
+}
+
+// Internal: Copy the valid tail of the old ring and format it for upload
+static void recover(esp_reset_reason_t reason)
+{
+    trace_entry_t events[TRACE_UPLOAD_EVENTS];
+    int count = 0;
+    uint32_t head = s_ring.head;
+
+    // Walk back from the newest slot, stop at the first untrusted entry
+    for (uint32_t i = 1; i <= TRACE_SIZE && count < TRACE_UPLOAD_EVENTS; i++) {
+        uint32_t index = head - i;
+        const trace_entry_t *entry = &s_ring.entries[index & (TRACE_SIZE - 1)];
+        if (entry->seq != (uint16_t)index || entry->event >= GW_TRACE_EVENT_COUNT) {
+            if (count > 0) {
+                break;
+            }
+            continue;   // Newest slot(s) may have been claimed but not written
+        }
+        events[count++] = *entry;
+    }
+
+    if (count == 0) {
+        return;
+    }
+
+    s_postmortem = malloc(TRACE_JSON_SIZE);
+    if (!s_postmortem) {
+        return;
+    }
+
+    // Oldest first, times relative to the last event before the reset
+    uint32_t last = events[0].time;
+    int len = snprintf(s_postmortem, TRACE_JSON_SIZE,
+                       "\"pm\":{\"reset\":\"%s\",\"boot\":%lu,\"ev\":[",
+                       reset_reason_name(reason), s_ring.boot_count);
+
+    ESP_LOGW(TAG, "Recovered %d trace events from before %s reset:", count,
+             reset_reason_name(reason));
+
+    for (int i = count - 1; i >= 0 && len < TRACE_JSON_SIZE; i--) {
+        const trace_entry_t *e = &events[i];
+        int32_t dt = (int32_t)(e->time - last);
+        int core = e->core_depth >> 7;
+        int depth = e->core_depth & 0x7F;
+
+        len += snprintf(&s_postmortem[len], TRACE_JSON_SIZE - len, "%s[%ld,%d,%d,%d,%lu]",
+                        (i == count - 1) ? "" : ",", dt, e->event, core, depth, e->arg);
+        ESP_LOGW(TAG, "  %8ld us  ev=%2d core=%d depth=%3d arg=%lu",
+                 dt, e->event, core, depth, e->arg);
+    }
+
+    if (len < TRACE_JSON_SIZE - 2) {
+        strcpy(&s_postmortem[len], "]}");
+    } else {
+        free(s_postmortem);
+        s_postmortem = NULL;
+    }
+}
+
+esp_err_t gw_trace_init(void)
+{
+    esp_reset_reason_t reason = esp_reset_reason();
+    bool valid = s_ring.magic == TRACE_MAGIC && s_ring.layout == TRACE_LAYOUT;
+
+    if (valid && reason != ESP_RST_POWERON && reason != ESP_RST_BROWNOUT) {
+        recover(reason);
+    }
+
+    uint32_t boot_count = valid ? s_ring.boot_count + 1 : 0;
+
+    memset(&s_ring, 0, sizeof(trace_ring_t));
+    s_ring.layout = TRACE_LAYOUT;
+    s_ring.boot_count = boot_count;
+    s_ring.magic = TRACE_MAGIC;
+
+    gw_trace(GW_TRACE_BOOT, boot_count, 0);
+
+    return ESP_OK;
+}
+
+void gw_trace(gw_trace_event_t event, uint32_t arg, uint32_t depth)
+{
+    uint32_t index = __atomic_fetch_add(&s_ring.head, 1, __ATOMIC_RELAXED);
+    trace_entry_t *entry = &s_ring.entries[index & (TRACE_SIZE - 1)];
+
+    // Invalidate first, so a half-written entry never carries a valid tag
+    entry->seq = (uint16_t)(index - TRACE_SIZE);
+    entry->time = (uint32_t)esp_timer_get_time();
+    entry->arg = arg;
+    entry->event = event;
+    entry->core_depth = (xPortGetCoreID() << 7) | (depth > 0x7F ? 0x7F : depth);
+    __atomic_store_n(&entry->seq, (uint16_t)index, __ATOMIC_RELEASE);
+}
+
+const char *gw_trace_postmortem_json(void)
+{
+    return s_postmortem;
+}
+
+void gw_trace_postmortem_clear(void)
+{
+    free(s_postmortem);
+    s_postmortem = NULL;
+}
+
+#endif // CONFIG_GATEWAY_TRACE_RING
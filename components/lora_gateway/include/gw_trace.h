@@ -0,0 +1,96 @@
+/**
+ * @file gw_trace.h
+ * @brief Crash-surviving pipeline trace
+ *
+ * Pipeline stages record small events (stage, core, queue depth, packet
+ * id) into a ring kept in RTC slow memory that is not initialized at
+ * boot. After a panic, watchdog or software reset, the events from before
+ * the reset are recovered, logged and uploaded with the first stat.
+ *
+ * Recording is lock-free and safe from any task on either core.
+ */
+
+#ifndef GW_TRACE_H
+#define GW_TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sdkconfig.h"
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Trace events (values are uploaded, append only)
+ */
+typedef enum {
+    GW_TRACE_BOOT = 0,          // arg = boot count
+    GW_TRACE_RX_HEADER,         // ValidHeader, depth = RX ring fill
+    GW_TRACE_RX_DONE,           // arg = tmst, depth = RX ring fill
+    GW_TRACE_RX_PROCESS,        // gw_rx_task batch, arg = first tmst, depth = batch size
+    GW_TRACE_RX_DROP,           // RX ring full
+    GW_TRACE_UPLINK_QUEUED,     // Encoded for a server, arg = tmst, depth = uplink ring fill
+    GW_TRACE_PUSH_SENT,         // arg = packets in PUSH_DATA, depth = server
+    GW_TRACE_PULL_RESP,         // arg = requested tx tmst, depth = server
+    GW_TRACE_TX_QUEUED,         // arg = tx tmst, depth = TX ring fill
+    GW_TRACE_TX_WAKE,           // cm_tx_task woke for a timed TX, arg = tx tmst
+    GW_TRACE_TX_FIRE,           // arg = tx tmst
+    GW_TRACE_TX_DONE,           // arg = tx tmst
+    GW_TRACE_TX_LATE,           // arg = tx tmst
+    GW_TRACE_TX_TIMEOUT,        // arg = tx tmst
+    GW_TRACE_HOP,               // arg = new channel
+    GW_TRACE_HOP_DEFERRED,      // arg = channel held
+    GW_TRACE_DEADLINE,          // Budget overrun, arg = overrun (us), depth = stage
+    GW_TRACE_RX_BORROW,         // RX radio taken for an overlapping downlink, arg = tx tmst
+    GW_TRACE_RX_RESTORE,        // RX radio listening again, arg = blind time (us)
+    GW_TRACE_EVENT_COUNT
+} gw_trace_event_t;
+
+#ifdef CONFIG_GATEWAY_TRACE_RING
+
+/**
+ * @brief Recover the previous boot's trace and start a new one
+ *
+ * Call once, early in app_main().
+ *
+ * @return ESP_OK (a trace was recovered or not)
+ */
+esp_err_t gw_trace_init(void);
+
+/**
+ * @brief Record an event
+ *
+ * @param event Event
+ * @param arg Event argument (usually a packet tmst)
+ * @param depth Queue depth or small event detail
+ */
+void gw_trace(gw_trace_event_t event, uint32_t arg, uint32_t depth);
+
+/**
+ * @brief Recovered trace as a JSON member ("pm":{...}), NULL if none
+ *
+ * @return JSON text valid until gw_trace_postmortem_clear()
+ */
+const char *gw_trace_postmortem_json(void);
+
+/**
+ * @brief Drop the recovered trace once it has been uploaded
+ */
+void gw_trace_postmortem_clear(void);
+
+#else
+
+static inline esp_err_t gw_trace_init(void) { return ESP_OK; }
+static inline void gw_trace(gw_trace_event_t event, uint32_t arg, uint32_t depth) {}
+static inline const char *gw_trace_postmortem_json(void) { return NULL; }
+static inline void gw_trace_postmortem_clear(void) {}
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // GW_TRACE_H
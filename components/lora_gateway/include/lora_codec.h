@@ -0,0 +1,125 @@
+/**
+ * @file lora_codec.h
+ * @brief Semtech UDP payload encoding and LoRa airtime
+ *
+ * Helpers shared by the packet forwarder, the channel manager and the
+ * diagnostics: base64, rxpk/stat/TX_ACK JSON encoding, txpk parsing and
+ * time on air. None of them block or touch the radios, and none allocate
+ * from the heap: encoders write into caller buffers and the txpk parser
+ * builds its cJSON tree in a static arena.
+ */
+
+#ifndef LORA_CODEC_H
+#define LORA_CODEC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "lora_packet.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LORA_CODEC_RXPK_META_SIZE   256     // rxpk fields before "data"
+#define LORA_CODEC_RXPK_MAX_SIZE    (LORA_CODEC_RXPK_META_SIZE + \
+                                     4 * ((LORA_MAX_PAYLOAD_SIZE + 2) / 3) + 4)
+
+/**
+ * @brief txpk parse allocation statistics
+ */
+typedef struct {
+    uint32_t parses;            // Parses that used the arena
+    uint32_t arena_size;
+    uint32_t arena_peak;        // Largest cJSON tree (bytes)
+    uint32_t heap_allocs;       // Allocations that overflowed to the heap
+} lora_codec_alloc_stats_t;
+
+/**
+ * @brief Base64 encode
+ *
+ * @param data Input bytes
+ * @param len Input length
+ * @param output Output buffer, at least 4 * ((len + 2) / 3) + 1 bytes
+ */
+void lora_codec_base64_encode(const uint8_t *data, int len, char *output);
+
+/**
+ * @brief Base64 decode
+ *
+ * @param input NUL-terminated base64 string
+ * @param output Output buffer
+ * @param max_len Output buffer size
+ * @return Number of bytes decoded
+ */
+int lora_codec_base64_decode(const char *input, uint8_t *output, int max_len);
+
+/**
+ * @brief Encode one uplink as an rxpk JSON object
+ *
+ * @param packet Received packet
+ * @param output Output buffer of at least LORA_CODEC_RXPK_MAX_SIZE bytes
+ * @return Encoded length (without NUL)
+ */
+int lora_codec_encode_rxpk(const lora_rx_packet_t *packet, char *output);
+
+/**
+ * @brief Encode a stat object ({"stat":{...}})
+ *
+ * @param stats Gateway statistics
+ * @param ackr PUSH_DATA acknowledge ratio (%)
+ * @param extra Extra members appended inside "stat" (e.g. "\"pm\":{...}"), or NULL
+ * @param output Output buffer
+ * @param size Output buffer size
+ * @return Encoded length, or -1 if it did not fit
+ */
+int lora_codec_encode_stat(const gateway_stats_t *stats, double ackr, const char *extra,
+                           char *output, int size);
+
+/**
+ * @brief Encode a TX_ACK payload ({"txpk_ack":{"error":...}})
+ *
+ * @param error Error string, NULL for success (empty payload)
+ * @param output Output buffer
+ * @param size Output buffer size
+ * @return Encoded length, or -1 if it did not fit
+ */
+int lora_codec_encode_tx_ack(const char *error, char *output, int size);
+
+/**
+ * @brief Parse the txpk object of a PULL_RESP
+ *
+ * Uses the static arena when no other task is parsing; a concurrent
+ * caller falls back to the heap.
+ *
+ * @param json NUL-terminated PULL_RESP JSON
+ * @param packet Output downlink
+ * @return ESP_OK, ESP_ERR_INVALID_ARG on malformed JSON,
+ *         ESP_ERR_NOT_FOUND if txpk is missing
+ */
+esp_err_t lora_codec_parse_txpk(const char *json, lora_tx_packet_t *packet);
+
+/**
+ * @brief Get txpk parse allocation statistics
+ *
+ * @param stats Output statistics
+ */
+void lora_codec_get_alloc_stats(lora_codec_alloc_stats_t *stats);
+
+/**
+ * @brief LoRa time on air (explicit header)
+ *
+ * @param mod Modulation
+ * @param payload_size Payload length in bytes
+ * @param preamble Preamble length in symbols
+ * @param crc Payload CRC present
+ * @return Time on air in microseconds
+ */
+uint32_t lora_codec_time_on_air_us(const lora_modulation_t *mod, uint8_t payload_size,
+                                   uint16_t preamble, bool crc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LORA_CODEC_H
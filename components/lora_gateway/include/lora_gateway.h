@@ -11,13 +11,19 @@
 #include "esp_err.h"
 #include "lora_packet.h"
 #include "sx1276.h"
+#include "spsc_ring.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-#define GATEWAY_RX_QUEUE_SIZE   32
-#define GATEWAY_TX_QUEUE_SIZE   16
+#define GATEWAY_RX_QUEUE_SIZE   32      // Power of two (SPSC ring)
+#define GATEWAY_TX_QUEUE_SIZE   16      // Power of two (SPSC ring)
+#define DEVICE_TABLE_SIZE       64      // End devices tracked by DevAddr
+#define GATEWAY_RX_CHANNELS     8       // RX hop channels (GATEWAY_MAX_CHANNELS)
+#define GAIN_PROFILE_COUNT      4       // RX gain profiles, most sensitive first
+#define UPLINK_BUS_POOL_SIZE    24      // Uplinks shared by the bus subscribers
+#define UPLINK_BUS_MAX_SUBSCRIBERS 4
 
 /**
  * @brief Gateway radio role
@@ -38,6 +44,120 @@ typedef void (*gw_rx_callback_t)(const lora_rx_packet_t *packet, void *user_data
  */
 typedef void (*gw_tx_callback_t)(bool success, void *user_data);
 
+/**
+ * @brief Packet bandwidth (0=125kHz, 1=250kHz, 2=500kHz) to radio setting
+ */
+static inline sx1276_bandwidth_t lora_gateway_bw_to_radio(uint8_t bw)
+{
+    return (bw == 2) ? SX1276_BW_500_KHZ : (bw == 1) ? SX1276_BW_250_KHZ : SX1276_BW_125_KHZ;
+}
+
+/**
+ * @brief Radio bandwidth setting to packet bandwidth (0=125kHz, 1=250kHz, 2=500kHz)
+ */
+static inline uint8_t lora_gateway_bw_from_radio(uint8_t bw)
+{
+    return (bw == SX1276_BW_500_KHZ) ? 2 : (bw == SX1276_BW_250_KHZ) ? 1 : 0;
+}
+
+/**
+ * @brief Stage handoff statistics
+ */
+typedef struct {
+    spsc_ring_stats_t rx_ring;          // Radio service task -> gw_rx_task
+    spsc_ring_stats_t tx_ring;          // Downlink scheduling -> cm_tx_task
+    sx1276_service_stats_t rx_radio;    // DIO0 ISR -> RX radio service task
+    sx1276_service_stats_t tx_radio;    // DIO0 ISR -> TX radio service task
+    sx1276_cmd_stats_t rx_cmds[SX1276_CMD_COUNT];   // RX radio executor, per command
+    sx1276_cmd_stats_t tx_cmds[SX1276_CMD_COUNT];   // TX radio executor, per command
+} gw_pipeline_stats_t;
+
+#define GW_TX_ERR_BUCKETS       7   // |start error| <= 10, 25, 50, 100, 250, 1000, above (us)
+#define GW_TX_LATE_START_US     100 // Later start counted as late
+
+// Upper edges of the |start error| histogram buckets (us), the last is open
+extern const uint32_t gw_tx_err_edges[GW_TX_ERR_BUCKETS - 1];
+
+/**
+ * @brief Downlink start timing statistics
+ *
+ * Errors are relative to the requested start time. The fire error is the
+ * CPU-side trigger write; the start error is the on-air start estimated
+ * as TxDone minus time on air, so it includes PLL lock and PA ramp when
+ * the radio is not pre-locked. The queue wait is from scheduling to
+ * cm_tx_task picking the downlink up, for every downlink.
+ */
+typedef struct {
+    bool prelock;               // FSTX pre-lock enabled
+    uint32_t scheduled;         // Timed downlinks measured
+    uint32_t late;              // Dropped, too late to send
+    uint32_t late_starts;       // Sent, started over GW_TX_LATE_START_US late
+    uint32_t timeouts;          // No TxDone within time on air + margin
+    int32_t fire_err_avg_us;
+    uint32_t fire_err_max_us;   // Largest |fire error|
+    int32_t start_err_avg_us;
+    int32_t start_err_min_us;
+    int32_t start_err_max_us;   // max - min = start jitter
+    uint32_t start_err_hist[GW_TX_ERR_BUCKETS];
+    uint32_t dequeued;          // Downlinks picked up by cm_tx_task
+    uint32_t queue_wait_avg_us;
+    uint32_t queue_wait_max_us;
+} gw_tx_timing_stats_t;
+
+/**
+ * @brief Time-critical pipeline stages with a latency budget
+ */
+typedef enum {
+    GW_STAGE_RX_SERVICE = 0,    // DIO0 to packet committed to the RX ring
+    GW_STAGE_RX_PROCESS,        // RX ring commit to gw_rx_task processing
+    GW_STAGE_UPLINK_FORWARD,    // DIO0 to PUSH_DATA handed to the network stack
+    GW_STAGE_TX_WAKE,           // cm_tx_task wake-up after the prepare time
+    GW_STAGE_TX_START,          // |fire error| of a timed downlink
+    GW_STAGE_COUNT
+} gw_stage_t;
+
+/**
+ * @brief Deadline statistics of one stage
+ */
+typedef struct {
+    const char *name;
+    uint32_t budget_us;
+    uint32_t checks;
+    uint32_t overruns;
+    uint32_t max_us;            // Largest elapsed time seen
+    uint32_t last_overrun_us;   // Elapsed time of the last overrun
+    uint8_t last_core;          // Core that ran the stage at the last overrun
+    uint32_t heals;             // Self-heal actions taken
+} gw_deadline_stats_t;
+
+/**
+ * @brief Self-heal hook, called after repeated overruns of a stage
+ *
+ * @return true if an action was taken
+ */
+typedef bool (*gw_deadline_heal_t)(gw_stage_t stage);
+
+/**
+ * @brief Relax hook, called after a long run of a stage within budget
+ *
+ * Undoes one step of a previous self-heal.
+ *
+ * @return true if an action was taken
+ */
+typedef bool (*gw_deadline_relax_t)(gw_stage_t stage);
+
+/**
+ * @brief Per-channel RX gain control statistics
+ */
+typedef struct {
+    uint8_t profile;                        // Selected gain profile
+    int16_t noise_floor;                    // Channel noise floor (dBm)
+    uint8_t blocking_pct;                   // Idle samples well above the floor (%)
+    uint32_t switches;                      // Profile changes on this channel
+    uint32_t rx_ok[GAIN_PROFILE_COUNT];     // CRC-OK packets per profile
+    uint32_t rx_total[GAIN_PROFILE_COUNT];  // Packets per profile
+} gw_channel_gain_stats_t;
+
 /**
  * @brief Gateway configuration
  */
@@ -92,6 +212,8 @@ esp_err_t lora_gateway_stop(void);
 /**
  * @brief Queue a packet for transmission
  *
+ * Single producer: only the packet forwarder RX task may call this.
+ *
  * @param packet Packet to transmit
  * @return ESP_OK if queued successfully
  */
@@ -105,6 +227,16 @@ esp_err_t lora_gateway_send(const lora_tx_packet_t *packet);
  */
 esp_err_t lora_gateway_get_stats(gateway_stats_t *stats);
 
+/**
+ * @brief Get stage handoff statistics
+ *
+ * wakeups / pushed is the number of consumer context switches per packet.
+ *
+ * @param stats Output statistics
+ * @return ESP_OK on success
+ */
+esp_err_t lora_gateway_get_pipeline_stats(gw_pipeline_stats_t *stats);
+
 /**
  * @brief Reset gateway statistics
  */
@@ -121,8 +253,10 @@ esp_err_t lora_gateway_set_rx_frequency(uint32_t frequency);
 /**
  * @brief Set RX parameters
  *
+ * Switches spreading factor and bandwidth with one modem profile write.
+ *
  * @param sf Spreading factor (7-12)
- * @param bw Bandwidth
+ * @param bw Bandwidth (0=125kHz, 1=250kHz, 2=500kHz)
  * @return ESP_OK on success
  */
 esp_err_t lora_gateway_set_rx_params(uint8_t sf, uint8_t bw);
@@ -141,6 +275,37 @@ uint32_t lora_gateway_get_timestamp(void);
  */
 bool lora_gateway_is_running(void);
 
+/**
+ * @brief Run the hot-path micro-benchmarks
+ *
+ * Times the codec primitives, the ring handoff and the SX1276 register
+ * layer (on the idle TX radio) and prints the results as one JSON line.
+ * Call after lora_gateway_init() and before lora_gateway_start().
+ *
+ * @param iterations Iterations per case
+ * @return ESP_OK on success, ESP_ERR_INVALID_STATE if the gateway is running
+ */
+esp_err_t lora_gateway_benchmark(uint32_t iterations);
+
+/**
+ * @brief Reserve the next RX ring slot ahead of RxDone (ValidHeader)
+ *
+ * RX radio service task only, like the two functions below.
+ */
+void lora_gateway_rx_header(void);
+
+/**
+ * @brief Get the reserved RX ring slot, reserving one if needed
+ *
+ * @return Slot to fill in place, NULL if the ring is full
+ */
+lora_rx_packet_t *lora_gateway_rx_slot(void);
+
+/**
+ * @brief Account and hand the filled RX slot to the processing task
+ */
+void lora_gateway_rx_commit(void);
+
 // Channel Manager API
 
 /**
@@ -169,11 +334,51 @@ esp_err_t channel_manager_stop(void);
 /**
  * @brief Schedule downlink transmission
  *
+ * Single producer: only the packet forwarder RX task may call this.
+ *
  * @param packet Packet to transmit
  * @return ESP_OK if scheduled
  */
 esp_err_t channel_manager_schedule_tx(const lora_tx_packet_t *packet);
 
+/**
+ * @brief Get TX ring statistics
+ *
+ * @param stats Output statistics
+ */
+void channel_manager_get_tx_ring_stats(spsc_ring_stats_t *stats);
+
+/**
+ * @brief Get downlink start timing statistics
+ *
+ * @param stats Output statistics
+ */
+void channel_manager_get_tx_timing_stats(gw_tx_timing_stats_t *stats);
+
+/**
+ * @brief Clear downlink start timing statistics
+ */
+void channel_manager_reset_tx_timing_stats(void);
+
+/**
+ * @brief Add channel manager counters to gateway statistics
+ *
+ * @param stats Statistics to fill in
+ */
+void channel_manager_get_stats(gateway_stats_t *stats);
+
+/**
+ * @brief Check that neither radio needs the CPU for a while
+ *
+ * False while a header is being received or an uplink is predicted, or
+ * when a downlink is queued, on air, or due within window_us. Used as the
+ * flash scheduler's idle check.
+ *
+ * @param window_us Time from now the radios must stay quiet
+ * @return true if window_us of flash work would not cost a packet
+ */
+bool channel_manager_radio_idle_for(uint32_t window_us);
+
 /**
  * @brief Set channel hopping mode
  *
@@ -183,6 +388,331 @@ esp_err_t channel_manager_schedule_tx(const lora_tx_packet_t *packet);
  */
 esp_err_t channel_manager_set_hopping(bool enabled, uint32_t interval_ms);
 
+// Uplink Bus API
+
+#define GW_BUS_NAME_LEN         16
+
+/**
+ * @brief What a subscriber loses when its backlog is full
+ */
+typedef enum {
+    GW_BUS_DROP_NEWEST = 0,     // Keep the backlog, skip the new uplink
+    GW_BUS_DROP_OLDEST          // Evict the oldest queued uplink
+} gw_bus_drop_t;
+
+/**
+ * @brief Per-subscriber statistics
+ */
+typedef struct {
+    char name[GW_BUS_NAME_LEN];
+    uint32_t delivered;         // Uplinks received by the consumer
+    uint32_t dropped;           // Lost to a full backlog
+    uint32_t backlog;           // Queued now
+    uint32_t high_water;
+} gw_bus_sub_stats_t;
+
+/**
+ * @brief Uplink bus statistics
+ */
+typedef struct {
+    uint32_t published;         // Uplinks queued to at least one subscriber
+    uint32_t pool_exhausted;    // Uplinks lost to all subscribers (no free entry)
+    uint32_t pool_in_use_max;
+    int subscribers;
+    gw_bus_sub_stats_t subs[UPLINK_BUS_MAX_SUBSCRIBERS];
+} gw_bus_stats_t;
+
+/**
+ * @brief Allocate the shared packet pool (called by lora_gateway_init)
+ *
+ * @return ESP_OK on success
+ */
+esp_err_t uplink_bus_init(void);
+
+/**
+ * @brief Free the pool and the subscriber backlogs (gateway stopped)
+ */
+void uplink_bus_deinit(void);
+
+/**
+ * @brief Register a consumer of received uplinks
+ *
+ * Call after lora_gateway_init() and before lora_gateway_start(). The
+ * backlog plus one packet being processed is reserved in the pool.
+ *
+ * @param name Name shown in statistics
+ * @param backlog Uplinks queued at most
+ * @param drop Drop policy when the backlog is full
+ * @param crc_ok_only Skip uplinks with a CRC error
+ * @return Subscriber id, or -1 if out of subscribers or pool space
+ */
+int uplink_bus_subscribe(const char *name, uint32_t backlog, gw_bus_drop_t drop, bool crc_ok_only);
+
+/**
+ * @brief Publish an uplink to every subscriber (gw_rx_task only)
+ *
+ * @param packet Received packet, copied once into the shared pool
+ */
+void uplink_bus_publish(const lora_rx_packet_t *packet);
+
+/**
+ * @brief Take the next uplink of a subscriber
+ *
+ * One task per subscriber. The packet is shared and read-only; hand it
+ * back with uplink_bus_release() before the next receive.
+ *
+ * @param sub_id Subscriber id
+ * @param packet Output: shared packet
+ * @param timeout Wait for an uplink
+ * @return true if a packet was taken
+ */
+bool uplink_bus_receive(int sub_id, const lora_rx_packet_t **packet, TickType_t timeout);
+
+/**
+ * @brief Release a packet taken with uplink_bus_receive()
+ *
+ * @param packet Shared packet
+ */
+void uplink_bus_release(const lora_rx_packet_t *packet);
+
+/**
+ * @brief Get uplink bus statistics
+ *
+ * @param stats Output statistics
+ * @return ESP_OK on success, ESP_ERR_INVALID_STATE before init
+ */
+esp_err_t uplink_bus_get_stats(gw_bus_stats_t *stats);
+
+// Radio Monitor API
+
+/**
+ * @brief Initialize radio monitor
+ *
+ * Calibrates both radios at the operating band and records the
+ * reference temperature. Call before RX starts.
+ *
+ * @param rx_handle RX radio handle
+ * @param tx_handle TX radio handle
+ * @return ESP_OK on success
+ */
+esp_err_t radio_monitor_init(sx1276_handle_t rx_handle, sx1276_handle_t tx_handle);
+
+/**
+ * @brief Check the TX radio's temperature, recalibrate it on drift
+ *
+ * Must only be called in an idle gap (no downlink pending). Also starts
+ * each periodic temperature check.
+ */
+void radio_monitor_poll_tx(void);
+
+/**
+ * @brief Sample noise floor and RX temperature, recalibrate on drift
+ *
+ * Must only be called in an idle gap, by the holder of RX channel control
+ * (no hop, listen window or borrow can move the RX radio meanwhile).
+ * Temperature reads, recalibration and gain switches are further deferred
+ * while a packet is being received.
+ *
+ * @param channel Channel the RX radio is currently tuned to
+ */
+void radio_monitor_poll_rx(uint8_t channel);
+
+/**
+ * @brief Account a received packet to the active gain profile
+ *
+ * @param packet Received packet (if_chain = RX channel)
+ */
+void radio_monitor_note_rx(const lora_rx_packet_t *packet);
+
+/**
+ * @brief Get gain control statistics of one RX channel
+ *
+ * @param channel Channel index
+ * @param stats Output statistics
+ * @return ESP_OK on success
+ */
+esp_err_t radio_monitor_get_channel_stats(uint8_t channel, gw_channel_gain_stats_t *stats);
+
+/**
+ * @brief Fill radio health fields of gateway statistics
+ *
+ * @param stats Statistics to update
+ */
+void radio_monitor_get_stats(gateway_stats_t *stats);
+
+// Coexistence API
+
+/**
+ * @brief Record a downlink and pick the RX channel for its time on air
+ *
+ * Called by the channel manager as the downlink fires. With
+ * CONFIG_LORA_COEX_RETUNE and may_move set, returns the RX channel
+ * farthest from the downlink if it adds enough separation.
+ *
+ * @param tx_freq Downlink frequency (Hz)
+ * @param start Downlink start (gateway timestamp, us)
+ * @param airtime Time on air (us)
+ * @param rx_channel Channel the RX radio is tuned to
+ * @param may_move RX radio is free to change channel (hopping, idle)
+ * @return Channel to move the RX radio to, rx_channel to stay
+ */
+uint8_t coex_tx_start(uint32_t tx_freq, uint32_t start, uint32_t airtime,
+                      uint8_t rx_channel, bool may_move);
+
+/**
+ * @brief Tag an uplink whose time on air overlapped a recent downlink
+ *
+ * Sets tx_overlap and counts the CRC outcome of overlapping uplinks.
+ *
+ * @param packet Received packet (timestamp = RxDone)
+ */
+void coex_note_rx(lora_rx_packet_t *packet);
+
+/**
+ * @brief Fill coexistence fields of gateway statistics
+ *
+ * @param stats Statistics to update
+ */
+void coex_get_stats(gateway_stats_t *stats);
+
+// Deadline Monitor API
+
+/**
+ * @brief Declare the latency budget of a stage
+ *
+ * Called by the module that owns the stage, before it starts checking.
+ *
+ * @param stage Stage
+ * @param name Short name for logs
+ * @param budget_us Budget (us)
+ * @param heal Self-heal hook (NULL if the stage has none)
+ * @param relax Hook undoing a self-heal step (NULL if the stage has none)
+ */
+void deadline_monitor_register(gw_stage_t stage, const char *name, uint32_t budget_us,
+                               gw_deadline_heal_t heal, gw_deadline_relax_t relax);
+
+/**
+ * @brief Check a measured stage latency against its budget
+ *
+ * On overrun the stage and core are recorded, a trace event is written
+ * and the action selected in Kconfig (log, metric only, self-heal) runs.
+ * Each stage must be checked from a single task.
+ *
+ * @param stage Stage
+ * @param elapsed_us Measured latency (us)
+ * @return true if within budget
+ */
+bool deadline_monitor_check(gw_stage_t stage, uint32_t elapsed_us);
+
+/**
+ * @brief Get deadline statistics of a stage
+ *
+ * @param stage Stage
+ * @param stats Output statistics
+ * @return ESP_OK on success
+ */
+esp_err_t deadline_monitor_get_stats(gw_stage_t stage, gw_deadline_stats_t *stats);
+
+// Diagnostics API
+
+/**
+ * @brief Run the micro-benchmarks against one idle radio
+ *
+ * @param radio Radio for the register-layer cases (left in standby)
+ * @param frequency Frequency the radio is tuned to (Hz)
+ * @param iterations Iterations per case
+ * @return ESP_OK on success
+ */
+esp_err_t gateway_benchmark_run(sx1276_handle_t radio, uint32_t frequency, uint32_t iterations);
+
+/**
+ * @brief Replay simulated days of traffic through the forwarding hot paths
+ *
+ * Prints one JSON result line with per-subsystem retained allocations and
+ * the largest free block before and after. With the UDP backend, the
+ * forwarder is run against a loopback server and released afterwards:
+ * call it before pkt_fwd_init() and before the gateway starts.
+ *
+ * @param days Simulated days (the first one is warm-up)
+ * @param uplinks_per_hour Simulated uplink rate
+ * @return ESP_OK if the run passed, ESP_FAIL on leaks or fragmentation growth
+ */
+esp_err_t gateway_soak_run(uint32_t days, uint32_t uplinks_per_hour);
+
+/**
+ * @brief Measure downlink start timing under load on the running gateway
+ *
+ * Feeds a stream of immediate and timestamped txpk (with network jitter)
+ * through lora_gateway_send() while uplink bursts load cm_tx_task's core,
+ * and prints one JSON result line. The downlinks are transmitted. Call
+ * after lora_gateway_start() and before the forwarder starts, which is
+ * the other TX ring producer. Timing and gateway statistics are cleared.
+ *
+ * @param downlinks Downlinks to send
+ * @return ESP_OK on success, ESP_ERR_INVALID_STATE if the gateway is not running
+ */
+esp_err_t gateway_downlink_bench_run(uint32_t downlinks);
+
+// Device Table API
+
+/**
+ * @brief Next expected uplink of a periodic device
+ */
+typedef struct {
+    uint32_t devaddr;
+    uint8_t channel;            // IF channel (channel manager index)
+    uint8_t sf;
+    int64_t start;              // Listening window (esp_timer time, us)
+    int64_t end;
+} gw_listen_prediction_t;
+
+/**
+ * @brief Initialize device table
+ *
+ * @return ESP_OK on success
+ */
+esp_err_t device_table_init(void);
+
+/**
+ * @brief Learn from a received data uplink (crystal offset, downlink ACK)
+ *
+ * @param packet Received packet
+ */
+void device_table_update(const lora_rx_packet_t *packet);
+
+/**
+ * @brief Frequency correction for a downlink
+ *
+ * Also records that a confirmed downlink awaits its ACK. Returns 0 unless
+ * CONFIG_LORA_DOWNLINK_FREQ_COMPENSATION is enabled and the device is known.
+ *
+ * @param packet Downlink about to be sent
+ * @return Offset in Hz to add to the downlink frequency
+ */
+int32_t device_table_downlink_offset(const lora_tx_packet_t *packet);
+
+/**
+ * @brief Earliest expected uplink starting within a horizon
+ *
+ * Only devices whose period, channel and SF have repeated are considered.
+ * The returned device's window is marked open; an uplink from it inside
+ * the window, on the predicted channel and SF, counts as a hit; a window
+ * that closes without one counts as a miss.
+ *
+ * @param now Current esp_timer time (us)
+ * @param horizon How far ahead to look (us)
+ * @param prediction Output
+ * @return true if an uplink is expected
+ */
+bool device_table_predict(int64_t now, int64_t horizon, gw_listen_prediction_t *prediction);
+
+/**
+ * @brief Fill device tracking fields of gateway statistics
+ *
+ * @param stats Statistics to update
+ */
+void device_table_get_stats(gateway_stats_t *stats);
+
 #ifdef __cplusplus
 }
 #endif
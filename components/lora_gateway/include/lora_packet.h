@@ -16,6 +16,18 @@ extern "C" {
 #define LORA_MAX_PAYLOAD_SIZE   255
 #define LORA_EUI_SIZE           8
 
+// LoRaWAN MAC header message types (MHDR[7:5])
+#define LORA_MTYPE_JOIN_REQUEST     0x00
+#define LORA_MTYPE_JOIN_ACCEPT      0x01
+#define LORA_MTYPE_UNCONF_DATA_UP   0x02
+#define LORA_MTYPE_UNCONF_DATA_DOWN 0x03
+#define LORA_MTYPE_CONF_DATA_UP     0x04
+#define LORA_MTYPE_CONF_DATA_DOWN   0x05
+
+// Data frame layout: MHDR | DevAddr (LE) | FCtrl | ...
+#define LORA_FCTRL_OFFSET           5
+#define LORA_FCTRL_ACK              0x20
+
 /**
  * @brief LoRa modulation parameters
  */
@@ -41,10 +53,13 @@ typedef struct {
     // Reception quality
     int16_t rssi;           // RSSI in dBm
     float snr;              // SNR in dB
+    int32_t freq_offset;    // Frequency error in Hz (device crystal)
     bool crc_ok;            // CRC status
+    bool tx_overlap;        // On air while the TX radio was transmitting
 
     // Timing
     uint32_t timestamp;     // Internal timestamp (microseconds)
+    uint32_t header_timestamp;  // ValidHeader time (us), 0 if not captured
     uint32_t tmst;          // Gateway timestamp for packet forwarder
 
     // Channel info
@@ -68,6 +83,7 @@ typedef struct {
     int8_t tx_power;        // TX power in dBm
     bool immediate;         // TX immediately or use timestamp
     uint32_t tx_timestamp;  // Timestamp for TX (if not immediate)
+    uint32_t queued_at;     // Set when queued to the TX radio (gateway timestamp)
 
     // For Class B/C
     uint8_t rf_chain;       // RF chain to use
@@ -95,6 +111,42 @@ typedef struct {
     int64_t last_rx_time;   // Last RX timestamp
     int64_t last_tx_time;   // Last TX timestamp
 
+    // Radio health
+    int16_t noise_floor;        // RX noise floor in dBm (idle RSSI average)
+    int8_t rx_temperature;      // RX radio die temperature (relative, C)
+    int8_t tx_temperature;      // TX radio die temperature (relative, C)
+    uint32_t image_cal;         // Image recalibrations (both radios)
+    uint32_t image_cal_deferred;    // Recalibrations postponed by RX activity
+    uint32_t image_cal_failed;
+    int16_t cal_noise_delta;    // Noise floor change after last RX recal (dB)
+    uint32_t gain_switches;     // RX gain profile changes
+    uint32_t hops_deferred;     // Channel hops postponed by a packet in progress
+
+    // Device frequency offset tracking
+    uint32_t devices_tracked;       // DevAddrs in the offset cache
+    uint32_t dl_freq_compensated;   // Downlinks sent with FRF pre-compensation
+    uint32_t dl_confirmed_acked;    // Confirmed downlinks ACKed in the next uplink
+    uint32_t dl_confirmed_missed;   // Confirmed downlinks not ACKed
+
+    // Predictive listening
+    uint32_t devices_periodic;      // Devices with a confirmed period and channel
+    uint32_t listen_windows;        // RX radio pre-tuned for an expected uplink
+    uint32_t listen_hits;           // Expected uplink received inside its window
+    uint32_t listen_misses;         // Window closed without it
+
+    // TX/RX coexistence
+    uint32_t coex_retunes;              // RX radio moved away from a downlink
+    uint32_t rx_during_tx;              // Uplinks overlapping a downlink
+    uint32_t rx_during_tx_bad;          // ... with a CRC error
+    uint32_t rx_during_tx_retuned;      // ... while the RX radio was moved away
+    uint32_t rx_during_tx_retuned_bad;
+
+    // Dual TX (RX radio borrowed for overlapping downlinks)
+    uint32_t dual_tx_sent;              // Downlinks sent on the RX radio
+    uint32_t dual_tx_declined;          // Overlaps left to the TX radio (policy, RX busy)
+    uint32_t rx_blind_ms;               // RX time lost to them
+    uint32_t rx_blind_max_us;           // Longest single interruption
+
 } gateway_stats_t;
 
 /**
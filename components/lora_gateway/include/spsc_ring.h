@@ -0,0 +1,178 @@
+/**
+ * @file spsc_ring.h
+ * @brief Lock-free single-producer/single-consumer ring
+ *
+ * Fixed-size slots handed between two pipeline stages without critical
+ * sections. The producer fills a slot in place (reserve/commit), the
+ * consumer reads a batch in place (peek/release). The consumer task is
+ * only notified when the ring goes from empty to non-empty, so a burst
+ * costs one wakeup instead of one per packet.
+ *
+ * Exactly one task may produce and one task may consume.
+ */
+
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Ring statistics
+ */
+typedef struct {
+    uint32_t pushed;            // Items committed by the producer
+    uint32_t dropped;           // Items dropped (ring full)
+    uint32_t wakeups;           // Consumer notifications (empty -> non-empty)
+    uint32_t high_water;        // Maximum fill level seen
+    uint32_t handoff_avg_us;    // Commit to consumer release
+    uint32_t handoff_max_us;
+} spsc_ring_stats_t;
+
+/**
+ * @brief SPSC ring (fields are private)
+ */
+typedef struct {
+    uint8_t *slots;
+    uint32_t *stamps;           // Commit time per slot (us)
+    uint32_t item_size;
+    uint32_t mask;              // Capacity - 1
+    uint32_t head;              // Written by producer only
+    uint32_t tail;              // Written by consumer only
+    TaskHandle_t consumer;
+
+    // Producer-owned statistics
+    uint32_t pushed;
+    uint32_t dropped;
+    uint32_t wakeups;
+    uint32_t high_water;
+
+    // Consumer-owned statistics
+    uint32_t released;
+    uint64_t handoff_us_total;
+    uint32_t handoff_us_max;
+} spsc_ring_t;
+
+/**
+ * @brief Allocate ring storage
+ *
+ * @param ring Ring to initialize
+ * @param capacity Number of slots (power of two)
+ * @param item_size Slot size in bytes
+ * @return ESP_OK on success
+ */
+esp_err_t spsc_ring_init(spsc_ring_t *ring, uint32_t capacity, uint32_t item_size);
+
+/**
+ * @brief Free ring storage
+ *
+ * @param ring Ring
+ */
+void spsc_ring_deinit(spsc_ring_t *ring);
+
+/**
+ * @brief Set the task notified on empty-to-non-empty transitions
+ *
+ * @param ring Ring
+ * @param consumer Consumer task (NULL to poll only)
+ */
+void spsc_ring_set_consumer(spsc_ring_t *ring, TaskHandle_t consumer);
+
+/**
+ * @brief Producer: get the next free slot
+ *
+ * @param ring Ring
+ * @return Slot to fill, or NULL if the ring is full (counted as drop)
+ */
+void *spsc_ring_reserve(spsc_ring_t *ring);
+
+/**
+ * @brief Producer: publish the slot returned by spsc_ring_reserve()
+ *
+ * @param ring Ring
+ */
+void spsc_ring_commit(spsc_ring_t *ring);
+
+/**
+ * @brief Producer: check for a free slot without counting a drop
+ *
+ * @param ring Ring
+ * @return true if spsc_ring_reserve() would fail
+ */
+bool spsc_ring_full(const spsc_ring_t *ring);
+
+/**
+ * @brief Number of committed items not yet released
+ *
+ * Either side may call this; the value is a snapshot.
+ *
+ * @param ring Ring
+ * @return Fill level
+ */
+uint32_t spsc_ring_count(const spsc_ring_t *ring);
+
+/**
+ * @brief Producer: copy an item into the ring
+ *
+ * @param ring Ring
+ * @param item Item of item_size bytes
+ * @return true if queued, false if the ring was full
+ */
+bool spsc_ring_push(spsc_ring_t *ring, const void *item);
+
+/**
+ * @brief Consumer: wait until the ring is non-empty
+ *
+ * @param ring Ring
+ * @param timeout Maximum wait
+ * @return Number of items available
+ */
+uint32_t spsc_ring_wait(spsc_ring_t *ring, TickType_t timeout);
+
+/**
+ * @brief Consumer: get contiguous ready items without copying
+ *
+ * @param ring Ring
+ * @param first Output: first ready slot
+ * @return Number of contiguous ready slots (0 if empty)
+ */
+uint32_t spsc_ring_peek(spsc_ring_t *ring, void **first);
+
+/**
+ * @brief Consumer: hand slots back to the producer
+ *
+ * @param ring Ring
+ * @param count Number of slots consumed from the last peek
+ */
+void spsc_ring_release(spsc_ring_t *ring, uint32_t count);
+
+/**
+ * @brief Consumer: copy one item out of the ring
+ *
+ * @param ring Ring
+ * @param item Output buffer of item_size bytes
+ * @param timeout Maximum wait if empty
+ * @return true if an item was copied
+ */
+bool spsc_ring_pop(spsc_ring_t *ring, void *item, TickType_t timeout);
+
+/**
+ * @brief Get ring statistics
+ *
+ * @param ring Ring
+ * @param stats Output statistics
+ */
+void spsc_ring_get_stats(const spsc_ring_t *ring, spsc_ring_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SPSC_RING_H
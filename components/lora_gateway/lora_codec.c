@@ -0,0 +1,313 @@
+/**
+ * @file lora_codec.c
+ * @brief Semtech UDP payload encoding and LoRa airtime
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "lora_codec.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "cJSON.h"
+
+#define CODEC_ARENA_SIZE        4096    // cJSON tree of the largest txpk (~1.5 KB) with margin
+
+// txpk parse arena: cJSON nodes and strings of one PULL_RESP are bumped
+// out of a static block and dropped together, so downlinks do not
+// allocate from (or fragment) the heap. The cJSON hooks are only
+// installed while the arena is held; other cJSON users get the defaults.
+typedef struct {
+    uint8_t buf[CODEC_ARENA_SIZE] __attribute__((aligned(8)));
+    uint32_t used;
+    TaskHandle_t owner;         // Task inside a parse, NULL when free
+
+    // Statistics
+    uint32_t parses;
+    uint32_t peak;
+    uint32_t heap_allocs;       // Allocations that did not fit
+} codec_arena_t;
+
+static codec_arena_t s_arena = {0};
+
+static const char b64_table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static const uint16_t s_bw_khz[] = {125, 250, 500};
+
+void lora_codec_base64_encode(const uint8_t *data, int len, char *output)
+{
+    int i, j;
+    for (i = 0, j = 0; i < len; i += 3) {
+        uint32_t n = ((uint32_t)data[i]) << 16;
+        if (i + 1 < len) n |= ((uint32_t)data[i + 1]) << 8;
+        if (i + 2 < len) n |= data[i + 2];
+
+        output[j++] = b64_table[(n >> 18) & 0x3F];
+        output[j++] = b64_table[(n >> 12) & 0x3F];
+        output[j++] = (i + 1 < len) ? b64_table[(n >> 6) & 0x3F] : '=';
+        output[j++] = (i + 2 < len) ? b64_table[n & 0x3F] : '=';
+    }
+    output[j] = '\0';
+}
+
+int lora_codec_base64_decode(const char *input, uint8_t *output, int max_len)
+{
+    int len = strlen(input);
+    int out_len = 0;
+
+    for (int i = 0; i < len && out_len < max_len; i += 4) {
+        uint32_t n = 0;
+        for (int j = 0; j < 4 && (i + j) < len; j++) {
+            char c = input[i + j];
+            uint8_t v = 0;
+            if (c >= 'A' && c <= 'Z') v = c - 'A';
+            else if (c >= 'a' && c <= 'z') v = c - 'a' + 26;
+            else if (c >= '0' && c <= '9') v = c - '0' + 52;
+            else if (c == '+') v = 62;
+            else if (c == '/') v = 63;
+            else if (c == '=') v = 0;
+            n = (n << 6) | v;
+        }
+
+        if (out_len < max_len) output[out_len++] = (n >> 16) & 0xFF;
+        if (out_len < max_len && input[i + 2] != '=') output[out_len++] = (n >> 8) & 0xFF;
+        if (out_len < max_len && input[i + 3] != '=') output[out_len++] = n & 0xFF;
+    }
+
+    return out_len;
+}
+
+int lora_codec_encode_rxpk(const lora_rx_packet_t *packet, char *output)
+{
+    const lora_modulation_t *mod = &packet->modulation;
+    int cr = (mod->coding_rate >= 1 && mod->coding_rate <= 4) ? mod->coding_rate : 1;
+
+    int len = snprintf(output, LORA_CODEC_RXPK_META_SIZE,
+                       "{\"tmst\":%lu,\"freq\":%lu.%06lu,\"chan\":%d,\"rfch\":%d,"
+                       "\"stat\":\"%s\",\"modu\":\"LORA\",\"datr\":\"SF%dBW%d\",\"codr\":\"4/%d\","
+                       "\"rssi\":%d,\"lsnr\":%.1f,\"foff\":%ld,\"size\":%d,\"data\":\"",
+                       packet->tmst,
+                       mod->frequency / 1000000,
+                       mod->frequency % 1000000,
+                       packet->if_chain,
+                       packet->rf_chain,
+                       packet->crc_ok ? "OK" : "CRC",
+                       mod->spreading_factor,
+                       s_bw_khz[mod->bandwidth < 3 ? mod->bandwidth : 0],
+                       cr + 4,
+                       packet->rssi,
+                       packet->snr,
+                       packet->freq_offset,
+                       packet->payload_size);
+
+    // Base64 payload straight into the fragment
+    lora_codec_base64_encode(packet->payload, packet->payload_size, &output[len]);
+    len += 4 * ((packet->payload_size + 2) / 3);
+
+    output[len++] = '"';
+    output[len++] = '}';
+    output[len] = '\0';
+
+    return len;
+}
+
+int lora_codec_encode_stat(const gateway_stats_t *stats, double ackr, const char *extra,
+                           char *output, int size)
+{
+    time_t now;
+    time(&now);
+    struct tm tm_utc;
+    gmtime_r(&now, &tm_utc);
+    char time_str[32];
+    strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S GMT", &tm_utc);
+
+    int len = snprintf(output, size,
+                       "{\"stat\":{\"time\":\"%s\",\"rxnb\":%lu,\"rxok\":%lu,\"rxfw\":%lu,"
+                       "\"ackr\":%.1f,\"dwnb\":%lu,\"txnb\":%lu%s%s}}",
+                       time_str, stats->rx_total, stats->rx_ok, stats->rx_forwarded,
+                       ackr, stats->tx_total, stats->tx_ok,
+                       extra ? "," : "", extra ? extra : "");
+
+    return (len < size) ? len : -1;
+}
+
+int lora_codec_encode_tx_ack(const char *error, char *output, int size)
+{
+    if (!error) {
+        output[0] = '\0';
+        return 0;
+    }
+
+    int len = snprintf(output, size, "{\"txpk_ack\":{\"error\":\"%s\"}}", error);
+    return (len < size) ? len : -1;
+}
+
+// Internal: cJSON allocator. Inside a parse the arena is bumped and never
+// freed piecewise; everything else goes to the heap.
+static void *arena_malloc(size_t size)
+{
+    if (s_arena.owner != xTaskGetCurrentTaskHandle()) {
+        return malloc(size);
+    }
+
+    size = (size + 7) & ~(size_t)7;
+    if (s_arena.used + size <= CODEC_ARENA_SIZE) {
+        void *ptr = &s_arena.buf[s_arena.used];
+        s_arena.used += size;
+        return ptr;
+    }
+
+    s_arena.heap_allocs++;
+    return malloc(size);
+}
+
+static void arena_free(void *ptr)
+{
+    if ((uint8_t *)ptr >= s_arena.buf && (uint8_t *)ptr < s_arena.buf + CODEC_ARENA_SIZE) {
+        return;
+    }
+    free(ptr);
+}
+
+// Internal: Take the arena for the calling task and hook cJSON to it
+// (false if another task holds it). A concurrent parse in another task
+// sees either set of hooks; both hand it heap memory.
+static bool arena_acquire(void)
+{
+    TaskHandle_t expected = NULL;
+    if (!__atomic_compare_exchange_n(&s_arena.owner, &expected, xTaskGetCurrentTaskHandle(),
+                                     false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return false;
+    }
+
+    cJSON_Hooks hooks = {
+        .malloc_fn = arena_malloc,
+        .free_fn = arena_free,
+    };
+    cJSON_InitHooks(&hooks);
+
+    s_arena.used = 0;
+    return true;
+}
+
+// Internal: Restore the default cJSON hooks and free the arena (the
+// tree has been deleted: nothing points into it)
+static void arena_release(void)
+{
+    cJSON_InitHooks(NULL);
+
+    s_arena.parses++;
+    if (s_arena.used > s_arena.peak) {
+        s_arena.peak = s_arena.used;
+    }
+    __atomic_store_n(&s_arena.owner, NULL, __ATOMIC_RELEASE);
+}
+
+// Internal: Parse a txpk (cJSON allocations go to the arena when held)
+static esp_err_t parse_txpk(const char *json, lora_tx_packet_t *packet)
+{
+    cJSON *root = cJSON_Parse(json);
+    if (!root) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    cJSON *txpk = cJSON_GetObjectItem(root, "txpk");
+    if (!txpk) {
+        cJSON_Delete(root);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    memset(packet, 0, sizeof(lora_tx_packet_t));
+
+    cJSON *imme = cJSON_GetObjectItem(txpk, "imme");
+    packet->immediate = imme && cJSON_IsTrue(imme);
+
+    cJSON *tmst = cJSON_GetObjectItem(txpk, "tmst");
+    if (tmst && cJSON_IsNumber(tmst)) {
+        packet->tx_timestamp = (uint32_t)tmst->valuedouble;
+    }
+
+    cJSON *freq = cJSON_GetObjectItem(txpk, "freq");
+    if (freq && cJSON_IsNumber(freq)) {
+        packet->modulation.frequency = (uint32_t)(freq->valuedouble * 1e6);
+    }
+
+    cJSON *powe = cJSON_GetObjectItem(txpk, "powe");
+    packet->tx_power = powe ? powe->valueint : 14;
+
+    cJSON *datr = cJSON_GetObjectItem(txpk, "datr");
+    if (datr && cJSON_IsString(datr)) {
+        // Parse "SF7BW125" format
+        int sf, bw;
+        if (sscanf(datr->valuestring, "SF%dBW%d", &sf, &bw) == 2) {
+            packet->modulation.spreading_factor = sf;
+            packet->modulation.bandwidth = (bw == 500) ? 2 : (bw == 250) ? 1 : 0;
+        }
+    }
+
+    cJSON *codr = cJSON_GetObjectItem(txpk, "codr");
+    if (codr && cJSON_IsString(codr)) {
+        // Parse "4/5" format
+        int num, den;
+        if (sscanf(codr->valuestring, "%d/%d", &num, &den) == 2) {
+            packet->modulation.coding_rate = den - 4;
+        }
+    }
+
+    cJSON *ipol = cJSON_GetObjectItem(txpk, "ipol");
+    packet->modulation.invert_polarity = ipol && cJSON_IsTrue(ipol);
+
+    cJSON *data_b64 = cJSON_GetObjectItem(txpk, "data");
+    if (data_b64 && cJSON_IsString(data_b64)) {
+        packet->payload_size = lora_codec_base64_decode(data_b64->valuestring,
+                                                        packet->payload,
+                                                        LORA_MAX_PAYLOAD_SIZE);
+    }
+
+    cJSON_Delete(root);
+    return ESP_OK;
+}
+
+esp_err_t lora_codec_parse_txpk(const char *json, lora_tx_packet_t *packet)
+{
+    bool arena = arena_acquire();
+    esp_err_t ret = parse_txpk(json, packet);
+    if (arena) {
+        arena_release();
+    }
+
+    return ret;
+}
+
+void lora_codec_get_alloc_stats(lora_codec_alloc_stats_t *stats)
+{
+    memset(stats, 0, sizeof(lora_codec_alloc_stats_t));
+
+    stats->parses = s_arena.parses;
+    stats->arena_size = CODEC_ARENA_SIZE;
+    stats->arena_peak = s_arena.peak;
+    stats->heap_allocs = s_arena.heap_allocs;
+}
+
+uint32_t lora_codec_time_on_air_us(const lora_modulation_t *mod, uint8_t payload_size,
+                                   uint16_t preamble, bool crc)
+{
+    uint32_t bw = s_bw_khz[mod->bandwidth < 3 ? mod->bandwidth : 0] * 1000;
+    int sf = mod->spreading_factor;
+    int cr = mod->coding_rate ? mod->coding_rate : 1;
+
+    // Low data rate optimization when a symbol lasts 16 ms or more
+    int de = ((1000000ULL << sf) / bw >= 16000) ? 1 : 0;
+
+    int num = 8 * payload_size - 4 * sf + 28 + (crc ? 16 : 0);
+    int den = 4 * (sf - 2 * de);
+    int payload_symbols = 8;
+    if (num > 0) {
+        payload_symbols += ((num + den - 1) / den) * (cr + 4);
+    }
+
+    // Preamble is n + 4.25 symbols; work in quarter symbols
+    uint64_t quarter_symbols = 4 * preamble + 17 + 4 * payload_symbols;
+    return (uint32_t)((quarter_symbols * (1000000ULL << sf)) / (4ULL * bw));
+}
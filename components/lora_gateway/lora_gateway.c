@@ -6,15 +6,21 @@
 #include <string.h>
 #include "lora_gateway.h"
 #include "gateway_config.h"
+#include "flash_scheduler.h"
 #include "esp_log.h"
 #include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "freertos/queue.h"
 #include "driver/spi_master.h"
+#include "spsc_ring.h"
+#include "gw_trace.h"
 
 static const char *TAG = "lora_gw";
 
+#define RX_TASK_PRIORITY        10
+#define RX_TASK_MAX_PRIORITY    11      // Self-heal limit, below the radio service tasks (12)
+#define RX_PROCESS_BUDGET_US    50000   // RX ring commit to gw_rx_task (eats into RX1)
+
 // Gateway state
 typedef struct {
     // Radio handles
@@ -24,8 +30,9 @@ typedef struct {
     // Configuration
     gateway_config_t config;
 
-    // RX packet queue
-    QueueHandle_t rx_queue;
+    // RX packet ring (radio service task -> gw_rx_task)
+    spsc_ring_t rx_ring;
+    lora_rx_packet_t *rx_slot;      // Reserved, filled by the next RxDone
 
     // Statistics
     gateway_stats_t stats;
@@ -45,11 +52,43 @@ static gateway_state_t s_gw = {0};
 // Forward declarations
 static void rx_process_task(void *arg);
 static esp_err_t init_spi_bus(spi_host_device_t host);
+static bool rx_task_heal(gw_stage_t stage);
+static bool rx_task_relax(gw_stage_t stage);
+
+// The functions below are called from channel_manager in the RX radio
+// service task, the ring's only producer
 
-// Called from channel_manager when packet received
-void lora_gateway_rx_handler(const lora_rx_packet_t *packet)
+void lora_gateway_rx_header(void)
 {
-    if (!s_gw.running || !packet) {
+    // Reserve while the payload is still on air; a full ring is not a
+    // drop yet, the consumer may catch up before RxDone
+    if (s_gw.running && !s_gw.rx_slot && !spsc_ring_full(&s_gw.rx_ring)) {
+        s_gw.rx_slot = spsc_ring_reserve(&s_gw.rx_ring);
+    }
+    gw_trace(GW_TRACE_RX_HEADER, 0, spsc_ring_count(&s_gw.rx_ring));
+}
+
+lora_rx_packet_t *lora_gateway_rx_slot(void)
+{
+    if (!s_gw.running) {
+        return NULL;
+    }
+
+    if (!s_gw.rx_slot) {
+        s_gw.rx_slot = spsc_ring_reserve(&s_gw.rx_ring);
+        if (!s_gw.rx_slot) {
+            ESP_LOGW(TAG, "RX ring full");
+            gw_trace(GW_TRACE_RX_DROP, 0, spsc_ring_count(&s_gw.rx_ring));
+        }
+    }
+
+    return s_gw.rx_slot;
+}
+
+void lora_gateway_rx_commit(void)
+{
+    lora_rx_packet_t *packet = s_gw.rx_slot;
+    if (!packet) {
         return;
     }
 
@@ -62,12 +101,10 @@ void lora_gateway_rx_handler(const lora_rx_packet_t *packet)
     }
     s_gw.stats.last_rx_time = esp_timer_get_time();
 
-    // Queue for processing
-    if (s_gw.rx_queue) {
-        if (xQueueSendFromISR(s_gw.rx_queue, packet, NULL) != pdTRUE) {
-            ESP_LOGW(TAG, "RX queue full");
-        }
-    }
+    // Hand off for processing
+    s_gw.rx_slot = NULL;
+    spsc_ring_commit(&s_gw.rx_ring);
+    gw_trace(GW_TRACE_RX_DONE, packet->tmst, spsc_ring_count(&s_gw.rx_ring));
 }
 
 esp_err_t lora_gateway_init(const gateway_config_t *config)
@@ -126,13 +163,34 @@ esp_err_t lora_gateway_init(const gateway_config_t *config)
         return ret;
     }
 
-    // Create RX queue
-    s_gw.rx_queue = xQueueCreate(GATEWAY_RX_QUEUE_SIZE, sizeof(lora_rx_packet_t));
-    if (!s_gw.rx_queue) {
-        ESP_LOGE(TAG, "Failed to create RX queue");
-        return ESP_ERR_NO_MEM;
+    // Calibrate radios at the operating band before RX starts
+    ret = radio_monitor_init(s_gw.rx_radio, s_gw.tx_radio);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Radio monitor init failed: %s", esp_err_to_name(ret));
+    }
+
+    ret = device_table_init();
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create device table");
+        return ret;
+    }
+
+    // Create RX ring
+    ret = spsc_ring_init(&s_gw.rx_ring, GATEWAY_RX_QUEUE_SIZE, sizeof(lora_rx_packet_t));
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create RX ring");
+        return ret;
     }
 
+    ret = uplink_bus_init();
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create uplink bus");
+        return ret;
+    }
+
+    deadline_monitor_register(GW_STAGE_RX_PROCESS, "rx_process", RX_PROCESS_BUDGET_US,
+                              rx_task_heal, rx_task_relax);
+
     s_gw.initialized = true;
     ESP_LOGI(TAG, "LoRa Gateway initialized");
 
@@ -153,14 +211,13 @@ esp_err_t lora_gateway_deinit(void)
 
     lora_gateway_stop();
 
-    if (s_gw.rx_queue) {
-        vQueueDelete(s_gw.rx_queue);
-    }
-
     channel_manager_stop();
     sx1276_deinit(s_gw.rx_radio);
     sx1276_deinit(s_gw.tx_radio);
 
+    spsc_ring_deinit(&s_gw.rx_ring);
+    uplink_bus_deinit();
+
     s_gw.initialized = false;
     ESP_LOGI(TAG, "Gateway deinitialized");
 
@@ -180,30 +237,39 @@ esp_err_t lora_gateway_start(void)
 
     ESP_LOGI(TAG, "Starting LoRa Gateway...");
 
+    // Set before creating the task, which loops while running
+    s_gw.running = true;
+
     // Create RX processing task
     BaseType_t ret = xTaskCreatePinnedToCore(rx_process_task,
                                               "gw_rx_task",
                                               4096,
                                               NULL,
-                                              10,
+                                              RX_TASK_PRIORITY,
                                               &s_gw.rx_process_task,
                                               1);  // Core 1
     if (ret != pdPASS) {
         ESP_LOGE(TAG, "Failed to create RX task");
+        s_gw.running = false;
         return ESP_FAIL;
     }
+    spsc_ring_set_consumer(&s_gw.rx_ring, s_gw.rx_process_task);
 
     // Start channel manager
     esp_err_t err = channel_manager_start();
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Failed to start channel manager");
+        spsc_ring_set_consumer(&s_gw.rx_ring, NULL);
         vTaskDelete(s_gw.rx_process_task);
+        s_gw.running = false;
         return err;
     }
 
-    s_gw.running = true;
     s_gw.start_time = esp_timer_get_time() / 1000000;
 
+    // Flash work from now on waits for the radios to be quiet
+    flash_sched_set_idle_check(channel_manager_radio_idle_for);
+
     ESP_LOGI(TAG, "LoRa Gateway started");
     return ESP_OK;
 }
@@ -218,9 +284,11 @@ esp_err_t lora_gateway_stop(void)
 
     s_gw.running = false;
 
+    flash_sched_set_idle_check(NULL);
     channel_manager_stop();
 
     if (s_gw.rx_process_task) {
+        spsc_ring_set_consumer(&s_gw.rx_ring, NULL);
         vTaskDelete(s_gw.rx_process_task);
         s_gw.rx_process_task = NULL;
     }
@@ -255,6 +323,31 @@ esp_err_t lora_gateway_get_stats(gateway_stats_t *stats)
 
     memcpy(stats, &s_gw.stats, sizeof(gateway_stats_t));
     stats->uptime = (esp_timer_get_time() / 1000000) - s_gw.start_time;
+    radio_monitor_get_stats(stats);
+    device_table_get_stats(stats);
+    channel_manager_get_stats(stats);
+    coex_get_stats(stats);
+
+    return ESP_OK;
+}
+
+esp_err_t lora_gateway_get_pipeline_stats(gw_pipeline_stats_t *stats)
+{
+    if (!stats) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (!s_gw.initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    memset(stats, 0, sizeof(gw_pipeline_stats_t));
+    spsc_ring_get_stats(&s_gw.rx_ring, &stats->rx_ring);
+    channel_manager_get_tx_ring_stats(&stats->tx_ring);
+    sx1276_get_service_stats(s_gw.rx_radio, &stats->rx_radio);
+    sx1276_get_service_stats(s_gw.tx_radio, &stats->tx_radio);
+    sx1276_get_cmd_stats(s_gw.rx_radio, stats->rx_cmds);
+    sx1276_get_cmd_stats(s_gw.tx_radio, stats->tx_cmds);
 
     return ESP_OK;
 }
@@ -281,12 +374,8 @@ esp_err_t lora_gateway_set_rx_params(uint8_t sf, uint8_t bw)
         return ESP_ERR_INVALID_STATE;
     }
 
-    esp_err_t ret = sx1276_set_spreading_factor(s_gw.rx_radio, sf);
-    if (ret != ESP_OK) {
-        return ret;
-    }
-
-    return sx1276_set_bandwidth(s_gw.rx_radio, bw);
+    // Coding rate is carried in the explicit header, any value receives
+    return sx1276_set_modulation(s_gw.rx_radio, sf, lora_gateway_bw_to_radio(bw), SX1276_CR_4_5);
 }
 
 uint32_t lora_gateway_get_timestamp(void)
@@ -299,33 +388,100 @@ bool lora_gateway_is_running(void)
     return s_gw.running;
 }
 
+esp_err_t lora_gateway_benchmark(uint32_t iterations)
+{
+    if (!s_gw.initialized || s_gw.running) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    return gateway_benchmark_run(s_gw.tx_radio, s_gw.config.radio[1].config.frequency,
+                                 iterations);
+}
+
 // Internal: RX processing task
 static void rx_process_task(void *arg)
 {
-    lora_rx_packet_t packet;
+    lora_rx_packet_t *batch;
 
     ESP_LOGI(TAG, "RX processing task started");
 
     while (s_gw.running) {
-        if (xQueueReceive(s_gw.rx_queue, &packet, pdMS_TO_TICKS(100)) == pdTRUE) {
+        if (spsc_ring_wait(&s_gw.rx_ring, pdMS_TO_TICKS(100)) == 0) {
+            continue;
+        }
+
+        // Process the ready batch in place, then hand the slots back
+        uint32_t count = spsc_ring_peek(&s_gw.rx_ring, (void **)&batch);
+        gw_trace(GW_TRACE_RX_PROCESS, count ? batch[0].tmst : 0, count);
+        for (uint32_t i = 0; i < count; i++) {
+            const lora_rx_packet_t *packet = &batch[i];
+
+            deadline_monitor_check(GW_STAGE_RX_PROCESS, lora_gateway_get_timestamp() - packet->tmst);
+
             // Log received packet
-            ESP_LOGI(TAG, "RX: %d bytes, RSSI=%d, SNR=%.1f, CRC=%s",
-                     packet.payload_size,
-                     packet.rssi,
-                     packet.snr,
-                     packet.crc_ok ? "OK" : "ERR");
-
-            // Call user callback if set
-            if (s_gw.config.rx_callback && packet.crc_ok) {
-                s_gw.config.rx_callback(&packet, s_gw.config.rx_user_data);
+            ESP_LOGI(TAG, "RX: %d bytes, RSSI=%d, SNR=%.1f, foff=%ld Hz, CRC=%s",
+                     packet->payload_size,
+                     packet->rssi,
+                     packet->snr,
+                     packet->freq_offset,
+                     packet->crc_ok ? "OK" : "ERR");
+
+            device_table_update(packet);
+            // Desensed by our own downlink, says nothing about the gain profile
+            if (!packet->tx_overlap) {
+                radio_monitor_note_rx(packet);
+            }
+
+            // Call user callback if set (inline: keep it short, slow
+            // consumers belong on the bus)
+            if (s_gw.config.rx_callback && packet->crc_ok) {
+                s_gw.config.rx_callback(packet, s_gw.config.rx_user_data);
             }
+
+            // Forwarders and other consumers, each from its own backlog
+            uplink_bus_publish(packet);
         }
+        spsc_ring_release(&s_gw.rx_ring, count);
     }
 
     ESP_LOGI(TAG, "RX processing task stopped");
     vTaskDelete(NULL);
 }
 
+// Internal: Self-heal for a lagging RX pipeline, raise gw_rx_task one step
+static bool rx_task_heal(gw_stage_t stage)
+{
+    if (!s_gw.rx_process_task) {
+        return false;
+    }
+
+    UBaseType_t priority = uxTaskPriorityGet(s_gw.rx_process_task);
+    if (priority >= RX_TASK_MAX_PRIORITY) {
+        return false;
+    }
+
+    vTaskPrioritySet(s_gw.rx_process_task, priority + 1);
+    ESP_LOGW(TAG, "gw_rx_task priority raised to %u", priority + 1);
+    return true;
+}
+
+// Internal: Lower gw_rx_task one step back towards its base priority
+static bool rx_task_relax(gw_stage_t stage)
+{
+    if (!s_gw.rx_process_task) {
+        return false;
+    }
+
+    UBaseType_t priority = uxTaskPriorityGet(s_gw.rx_process_task);
+    if (priority <= RX_TASK_PRIORITY) {
+        return false;
+    }
+
+    vTaskPrioritySet(s_gw.rx_process_task, priority - 1);
+    ESP_LOGI(TAG, "gw_rx_task priority back to %u", priority - 1);
+    return true;
+}
+
 // Internal: Initialize SPI bus
 static esp_err_t init_spi_bus(spi_host_device_t host)
 {
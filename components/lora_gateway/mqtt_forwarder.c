@@ -0,0 +1,865 @@
+/**
+ * @file mqtt_forwarder.c
+ * @brief MQTT forwarder backend
+ *
+ * Implements the packet forwarder interface on top of an MQTT broker
+ * instead of a Semtech UDP server. Uplinks are pre-encoded off the bus
+ * like in the UDP forwarder, batched into one {"rxpk":[...]} publish and
+ * sent with QoS 1. Up to CONFIG_PKT_FWD_MQTT_WINDOW publishes are in flight
+ * at once, so forwarding never waits a broker round trip per message;
+ * while the window is full, uplinks keep queuing and leave in larger
+ * batches. Downlinks arrive as txpk JSON on a subscribed topic and go
+ * straight to the TX scheduler.
+ *
+ * Topics, below <prefix>/<gateway EUI>/:
+ * - event/up      rxpk batches (QoS 1)
+ * - event/stats   stat object (QoS 0)
+ * - event/ack     txpk_ack, one per downlink, in downlink order (QoS 0)
+ * - command/down  txpk (subscribed, QoS 1)
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include "packet_forwarder.h"
+#include "lora_gateway.h"
+#include "lora_codec.h"
+#include "gw_trace.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "mqtt_client.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/timers.h"
+#include "freertos/semphr.h"
+
+#ifdef CONFIG_PKT_FWD_BACKEND_MQTT
+
+static const char *TAG = "mqtt_fwd";
+
+#define MQTT_BUFFER_SIZE        2048
+#define MQTT_TOPIC_SIZE         96
+#define MAX_UPLINK_BATCH        8
+#define UPLINK_QUEUE_SIZE       32
+#define WINDOW_WAIT_MS          100     // Wait for a PUBACK before rechecking
+#define UPLINK_FORWARD_BUDGET_US 200000 // Radio RX to publish (deadline monitor)
+#define MF_TX_TASK_PRIORITY     8
+#define BENCHMARK_CONNECT_MS    10000
+#define BENCHMARK_DRAIN_MS      10000
+#define BENCHMARK_PAYLOAD_SIZE  23      // Typical confirmed data uplink
+
+// Uplink pre-encoded as an rxpk JSON object by the bus subscriber
+typedef struct {
+    uint32_t rx_timestamp;      // Radio RX timestamp (us), for forward latency
+    uint16_t len;
+    char json[LORA_CODEC_RXPK_MAX_SIZE];
+} mf_uplink_t;
+
+// QoS 1 publish waiting for its PUBACK
+typedef struct {
+    int msg_id;                 // 0: free, -1: reserved, publish in progress
+    int64_t sent_at;
+} mf_inflight_t;
+
+// MQTT forwarder state
+typedef struct {
+    pkt_fwd_config_t config;
+    esp_mqtt_client_handle_t client;
+    char client_id[17];
+    char topic_up[MQTT_TOPIC_SIZE];
+    char topic_stats[MQTT_TOPIC_SIZE];
+    char topic_ack[MQTT_TOPIC_SIZE];
+    char topic_down[MQTT_TOPIC_SIZE];
+
+    // Uplink batching
+    TaskHandle_t tx_task;
+    TimerHandle_t stat_timer;
+    spsc_ring_t uplink_ring;    // Uplink bus subscriber -> TX task
+
+    // Publish window: one semaphore count per free slot
+    SemaphoreHandle_t window;
+    portMUX_TYPE lock;
+    mf_inflight_t inflight[CONFIG_PKT_FWD_MQTT_WINDOW];
+    int early_ack;              // PUBACK processed before its slot got the msg_id
+
+    // Downlink JSON, NUL-terminated (MQTT task only)
+    char downlink[MQTT_BUFFER_SIZE];
+
+    // Statistics
+    forwarder_status_t status;
+    uint32_t published;
+    uint32_t acked;
+    uint32_t lost;
+    uint32_t window_stalls;
+    uint64_t ack_us_total;
+    uint32_t ack_us_max;
+    uint32_t downlinks;
+    uint64_t tx_ack_us_total;
+    uint32_t tx_ack_us_max;
+
+    // Forwarding cost
+    uint32_t encoded;
+    uint64_t encode_us_total;
+    uint32_t encode_us_max;
+    uint32_t uplinks_sent;
+    uint64_t assemble_us_total;
+    uint32_t assemble_us_max;
+    uint64_t latency_us_total;
+    uint32_t latency_us_max;
+
+    // State
+    bool initialized;
+    bool running;
+    bool benchmarking;          // Live uplinks are refused during the benchmark
+    uint32_t producing;         // Bus subscriber inside pkt_fwd_send_uplink()
+
+} mqtt_fwd_state_t;
+
+static mqtt_fwd_state_t s_mf = {0};
+
+// Forward declarations
+static void tx_task(void *arg);
+static void stat_callback(TimerHandle_t timer);
+static void mqtt_event_handler(void *arg, esp_event_base_t base, int32_t event_id, void *event_data);
+static esp_err_t queue_uplink(const lora_rx_packet_t *packet);
+static void publish_uplinks(const char *buffer, int len, const uint32_t *rx_timestamps,
+                            int count, int64_t start);
+static void release_inflight(int msg_id, bool acked);
+static void handle_downlink(int len);
+static void publish_tx_ack(const char *error);
+
+esp_err_t pkt_fwd_init(const pkt_fwd_config_t *config)
+{
+    if (s_mf.initialized) {
+        return ESP_OK;
+    }
+
+    if (!config || config->num_servers == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    ESP_LOGI(TAG, "Initializing MQTT forwarder...");
+
+    memset(&s_mf, 0, sizeof(mqtt_fwd_state_t));
+    memcpy(&s_mf.config, config, sizeof(pkt_fwd_config_t));
+    s_mf.lock = (portMUX_TYPE)portMUX_INITIALIZER_UNLOCKED;
+
+    if (config->num_servers > 1 || config->num_routes > 0) {
+        ESP_LOGW(TAG, "Server routing does not apply to the MQTT backend, using the broker only");
+    }
+
+    const uint8_t *eui = config->gateway_eui;
+    snprintf(s_mf.client_id, sizeof(s_mf.client_id), "%02x%02x%02x%02x%02x%02x%02x%02x",
+             eui[0], eui[1], eui[2], eui[3], eui[4], eui[5], eui[6], eui[7]);
+    snprintf(s_mf.topic_up, MQTT_TOPIC_SIZE, "%s/%s/event/up",
+             CONFIG_PKT_FWD_MQTT_TOPIC_PREFIX, s_mf.client_id);
+    snprintf(s_mf.topic_stats, MQTT_TOPIC_SIZE, "%s/%s/event/stats",
+             CONFIG_PKT_FWD_MQTT_TOPIC_PREFIX, s_mf.client_id);
+    snprintf(s_mf.topic_ack, MQTT_TOPIC_SIZE, "%s/%s/event/ack",
+             CONFIG_PKT_FWD_MQTT_TOPIC_PREFIX, s_mf.client_id);
+    snprintf(s_mf.topic_down, MQTT_TOPIC_SIZE, "%s/%s/command/down",
+             CONFIG_PKT_FWD_MQTT_TOPIC_PREFIX, s_mf.client_id);
+
+    esp_err_t err = spsc_ring_init(&s_mf.uplink_ring, UPLINK_QUEUE_SIZE, sizeof(mf_uplink_t));
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create uplink ring");
+        return err;
+    }
+
+    s_mf.window = xSemaphoreCreateCounting(CONFIG_PKT_FWD_MQTT_WINDOW, CONFIG_PKT_FWD_MQTT_WINDOW);
+    if (!s_mf.window) {
+        spsc_ring_deinit(&s_mf.uplink_ring);
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_mqtt_client_config_t mqtt_config = {
+        .broker.address.uri = CONFIG_PKT_FWD_MQTT_BROKER_URI,
+        .credentials.client_id = s_mf.client_id,
+        .session.keepalive = config->keepalive_interval_ms / 1000,
+        .buffer.size = MQTT_BUFFER_SIZE,
+    };
+    s_mf.client = esp_mqtt_client_init(&mqtt_config);
+    if (!s_mf.client) {
+        ESP_LOGE(TAG, "Failed to create MQTT client");
+        vSemaphoreDelete(s_mf.window);
+        spsc_ring_deinit(&s_mf.uplink_ring);
+        return ESP_FAIL;
+    }
+    esp_mqtt_client_register_event(s_mf.client, MQTT_EVENT_ANY, mqtt_event_handler, NULL);
+
+    // Create statistics timer
+    s_mf.stat_timer = xTimerCreate("mf_stat",
+                                   pdMS_TO_TICKS(config->stat_interval_ms),
+                                   pdTRUE,
+                                   NULL,
+                                   stat_callback);
+
+    deadline_monitor_register(GW_STAGE_UPLINK_FORWARD, "uplink_forward",
+                              UPLINK_FORWARD_BUDGET_US, NULL, NULL);
+
+    s_mf.initialized = true;
+    ESP_LOGI(TAG, "MQTT forwarder initialized: %s, topics %s/%s/...",
+             CONFIG_PKT_FWD_MQTT_BROKER_URI, CONFIG_PKT_FWD_MQTT_TOPIC_PREFIX, s_mf.client_id);
+
+    return ESP_OK;
+}
+
+esp_err_t pkt_fwd_start(void)
+{
+    if (!s_mf.initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // The client reconnects by itself once started
+    if (s_mf.running) {
+        return ESP_OK;
+    }
+
+    ESP_LOGI(TAG, "Starting MQTT forwarder...");
+
+    s_mf.running = true;
+
+    xTaskCreatePinnedToCore(tx_task, "mf_tx", 8192, NULL, MF_TX_TASK_PRIORITY, &s_mf.tx_task, 0);
+    spsc_ring_set_consumer(&s_mf.uplink_ring, s_mf.tx_task);
+
+    esp_err_t ret = esp_mqtt_client_start(s_mf.client);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start MQTT client: %s", esp_err_to_name(ret));
+        s_mf.running = false;
+        spsc_ring_set_consumer(&s_mf.uplink_ring, NULL);
+        vTaskDelete(s_mf.tx_task);
+        s_mf.tx_task = NULL;
+        return ret;
+    }
+
+    xTimerStart(s_mf.stat_timer, 0);
+
+    ESP_LOGI(TAG, "MQTT forwarder started");
+    return ESP_OK;
+}
+
+esp_err_t pkt_fwd_stop(void)
+{
+    if (!s_mf.running) {
+        return ESP_OK;
+    }
+
+    ESP_LOGI(TAG, "Stopping MQTT forwarder...");
+
+    s_mf.running = false;
+
+    xTimerStop(s_mf.stat_timer, 0);
+    esp_mqtt_client_stop(s_mf.client);
+
+    if (s_mf.tx_task) {
+        spsc_ring_set_consumer(&s_mf.uplink_ring, NULL);
+        vTaskDelete(s_mf.tx_task);
+        s_mf.tx_task = NULL;
+    }
+
+    // Unacknowledged publishes stay in the client outbox and are resent
+    // after the next start
+    s_mf.status.connected = false;
+    ESP_LOGI(TAG, "MQTT forwarder stopped");
+
+    return ESP_OK;
+}
+
+esp_err_t pkt_fwd_deinit(void)
+{
+    if (!s_mf.initialized) {
+        return ESP_OK;
+    }
+
+    pkt_fwd_stop();
+
+    // Drops the outbox too: unacknowledged publishes are lost
+    esp_mqtt_client_destroy(s_mf.client);
+    xTimerDelete(s_mf.stat_timer, portMAX_DELAY);
+    vSemaphoreDelete(s_mf.window);
+    spsc_ring_deinit(&s_mf.uplink_ring);
+
+    s_mf.initialized = false;
+    ESP_LOGI(TAG, "MQTT forwarder released");
+
+    return ESP_OK;
+}
+
+esp_err_t pkt_fwd_send_uplink(const lora_rx_packet_t *packet)
+{
+    if (!s_mf.running || !packet) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // Announce before checking: the benchmark sets its flag, then waits
+    // for this to clear, so at most one of the two produces into the ring
+    __atomic_store_n(&s_mf.producing, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&s_mf.benchmarking, __ATOMIC_SEQ_CST)) {
+        __atomic_store_n(&s_mf.producing, 0, __ATOMIC_SEQ_CST);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    esp_err_t ret = queue_uplink(packet);
+    __atomic_store_n(&s_mf.producing, 0, __ATOMIC_SEQ_CST);
+    if (ret == ESP_ERR_NO_MEM) {
+        ESP_LOGW(TAG, "Uplink ring full");
+    }
+
+    return ret;
+}
+
+esp_err_t pkt_fwd_get_status(forwarder_status_t *status)
+{
+    if (!status) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memcpy(status, &s_mf.status, sizeof(forwarder_status_t));
+    return ESP_OK;
+}
+
+esp_err_t pkt_fwd_get_server_status(uint8_t server, forwarder_status_t *status)
+{
+    if (server != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    return pkt_fwd_get_status(status);
+}
+
+esp_err_t pkt_fwd_get_ring_stats(uint8_t server, spsc_ring_stats_t *stats)
+{
+    if (!stats || server != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    spsc_ring_get_stats(&s_mf.uplink_ring, stats);
+    return ESP_OK;
+}
+
+esp_err_t pkt_fwd_get_spool_stats(uint8_t server, pkt_fwd_spool_stats_t *stats)
+{
+    // The client outbox holds unacknowledged publishes instead
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t pkt_fwd_get_class_stats(uint8_t server, pkt_fwd_class_stats_t *stats)
+{
+    if (!stats || server != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // Uplinks are the push class; there is no keepalive round trip to measure
+    memset(stats, 0, sizeof(pkt_fwd_class_stats_t));
+    stats->push_rtts = s_mf.acked;
+    stats->push_rtt_max_us = s_mf.ack_us_max;
+    stats->tx_acks = s_mf.downlinks;
+    stats->tx_ack_max_us = s_mf.tx_ack_us_max;
+    stats->bulk_held = s_mf.window_stalls;
+    if (s_mf.acked > 0) {
+        stats->push_rtt_avg_us = s_mf.ack_us_total / s_mf.acked;
+    }
+    if (s_mf.downlinks > 0) {
+        stats->tx_ack_avg_us = s_mf.tx_ack_us_total / s_mf.downlinks;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t pkt_fwd_get_mqtt_stats(pkt_fwd_mqtt_stats_t *stats)
+{
+    if (!stats) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memset(stats, 0, sizeof(pkt_fwd_mqtt_stats_t));
+
+    portENTER_CRITICAL(&s_mf.lock);
+    for (int i = 0; i < CONFIG_PKT_FWD_MQTT_WINDOW; i++) {
+        if (s_mf.inflight[i].msg_id != 0) {
+            stats->in_flight++;
+        }
+    }
+    stats->acked = s_mf.acked;
+    stats->lost = s_mf.lost;
+    stats->ack_max_us = s_mf.ack_us_max;
+    if (s_mf.acked > 0) {
+        stats->ack_avg_us = s_mf.ack_us_total / s_mf.acked;
+    }
+    portEXIT_CRITICAL(&s_mf.lock);
+
+    stats->published = s_mf.published;
+    stats->window = CONFIG_PKT_FWD_MQTT_WINDOW;
+    stats->window_stalls = s_mf.window_stalls;
+    stats->downlinks = s_mf.downlinks;
+
+    return ESP_OK;
+}
+
+esp_err_t pkt_fwd_get_perf(pkt_fwd_perf_t *perf)
+{
+    if (!perf) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memset(perf, 0, sizeof(pkt_fwd_perf_t));
+
+    perf->encoded = s_mf.encoded;
+    perf->encode_max_us = s_mf.encode_us_max;
+    if (s_mf.encoded > 0) {
+        perf->encode_avg_us = s_mf.encode_us_total / s_mf.encoded;
+    }
+
+    perf->uplinks = s_mf.uplinks_sent;
+    perf->datagrams = s_mf.published;
+    perf->assemble_max_us = s_mf.assemble_us_max;
+    perf->latency_max_us = s_mf.latency_us_max;
+    if (s_mf.published > 0) {
+        perf->assemble_avg_us = s_mf.assemble_us_total / s_mf.published;
+    }
+    if (s_mf.uplinks_sent > 0) {
+        perf->latency_avg_us = s_mf.latency_us_total / s_mf.uplinks_sent;
+    }
+
+    return ESP_OK;
+}
+
+bool pkt_fwd_is_connected(void)
+{
+    return s_mf.status.connected;
+}
+
+esp_err_t pkt_fwd_route_from_netid(uint32_t netid, uint8_t server, pkt_fwd_route_t *route)
+{
+    // A broker gets every uplink; routing is up to its subscribers
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t pkt_fwd_mqtt_benchmark(uint32_t uplinks)
+{
+    if (!s_mf.running || uplinks == 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    int64_t deadline = esp_timer_get_time() + BENCHMARK_CONNECT_MS * 1000LL;
+    while (!s_mf.status.connected) {
+        if (esp_timer_get_time() > deadline) {
+            ESP_LOGE(TAG, "Benchmark: broker %s unreachable", CONFIG_PKT_FWD_MQTT_BROKER_URI);
+            return ESP_ERR_TIMEOUT;
+        }
+        vTaskDelay(pdMS_TO_TICKS(100));
+    }
+
+    // The ring has a single producer: keep the bus subscriber out, and wait for a
+    // call already past the check to finish
+    __atomic_store_n(&s_mf.benchmarking, true, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&s_mf.producing, __ATOMIC_SEQ_CST)) {
+        vTaskDelay(1);
+    }
+
+    lora_rx_packet_t packet;
+    memset(&packet, 0, sizeof(packet));
+    for (int i = 0; i < BENCHMARK_PAYLOAD_SIZE; i++) {
+        packet.payload[i] = (uint8_t)(i * 37 + 11);
+    }
+    packet.payload_size = BENCHMARK_PAYLOAD_SIZE;
+    packet.modulation.frequency = 916800000;
+    packet.modulation.spreading_factor = 7;
+    packet.modulation.coding_rate = 1;
+    packet.rssi = -87;
+    packet.snr = 7.5f;
+    packet.crc_ok = true;
+
+    portENTER_CRITICAL(&s_mf.lock);
+    uint32_t acked_start = s_mf.acked;
+    uint32_t lost_start = s_mf.lost;
+    uint64_t ack_total_start = s_mf.ack_us_total;
+    s_mf.ack_us_max = 0;
+    portEXIT_CRITICAL(&s_mf.lock);
+    uint32_t published_start = s_mf.published;
+    uint32_t stalls_start = s_mf.window_stalls;
+
+    ESP_LOGI(TAG, "Benchmark: %lu uplinks, window %d", uplinks, CONFIG_PKT_FWD_MQTT_WINDOW);
+
+    int64_t start = esp_timer_get_time();
+    for (uint32_t i = 0; i < uplinks; i++) {
+        packet.payload[0] = (uint8_t)i;
+        packet.tmst = i;
+        packet.timestamp = (uint32_t)esp_timer_get_time();
+        while (queue_uplink(&packet) == ESP_ERR_NO_MEM) {
+            vTaskDelay(1);
+        }
+    }
+
+    // Drain: every publish acknowledged (or dropped by the client)
+    deadline = esp_timer_get_time() + BENCHMARK_DRAIN_MS * 1000LL;
+    bool drained = false;
+    while (esp_timer_get_time() < deadline) {
+        pkt_fwd_mqtt_stats_t stats;
+        pkt_fwd_get_mqtt_stats(&stats);
+        if (spsc_ring_count(&s_mf.uplink_ring) == 0 && stats.in_flight == 0) {
+            drained = true;
+            break;
+        }
+        vTaskDelay(1);
+    }
+    int64_t elapsed = esp_timer_get_time() - start;
+
+    __atomic_store_n(&s_mf.benchmarking, false, __ATOMIC_SEQ_CST);
+
+    portENTER_CRITICAL(&s_mf.lock);
+    uint32_t acked = s_mf.acked - acked_start;
+    uint32_t lost = s_mf.lost - lost_start;
+    uint64_t ack_total = s_mf.ack_us_total - ack_total_start;
+    uint32_t ack_max = s_mf.ack_us_max;
+    portEXIT_CRITICAL(&s_mf.lock);
+    uint32_t published = s_mf.published - published_start;
+
+    // One JSON line on stdout, like the hot-path benchmark
+    printf("{\"benchmark\":\"mqtt_forwarder\",\"version\":1,\"uplinks\":%lu,\"window\":%d,"
+           "\"max_batch\":%d,\"elapsed_ms\":%lld,\"uplinks_per_s\":%lu,\"publishes\":%lu,"
+           "\"acked\":%lu,\"lost\":%lu,\"ack_avg_us\":%lu,\"ack_max_us\":%lu,"
+           "\"window_stalls\":%lu,\"drained\":%s}\n",
+           uplinks, CONFIG_PKT_FWD_MQTT_WINDOW, MAX_UPLINK_BATCH, elapsed / 1000,
+           (uint32_t)(uplinks * 1000000ULL / (elapsed > 0 ? elapsed : 1)), published,
+           acked, lost, acked > 0 ? (uint32_t)(ack_total / acked) : 0, ack_max,
+           s_mf.window_stalls - stalls_start, drained ? "true" : "false");
+
+    return drained ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+// Internal: Encode an uplink into the ring (single producer)
+static esp_err_t queue_uplink(const lora_rx_packet_t *packet)
+{
+    // Encode straight into the ring slot
+    mf_uplink_t *uplink = spsc_ring_reserve(&s_mf.uplink_ring);
+    if (!uplink) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    // Encode once here, in the bus subscriber (core 1), so the forwarder only concatenates
+    int64_t start = esp_timer_get_time();
+    uplink->len = lora_codec_encode_rxpk(packet, uplink->json);
+    uplink->rx_timestamp = packet->timestamp;
+    uint32_t elapsed = esp_timer_get_time() - start;
+
+    s_mf.encoded++;
+    s_mf.encode_us_total += elapsed;
+    if (elapsed > s_mf.encode_us_max) {
+        s_mf.encode_us_max = elapsed;
+    }
+
+    spsc_ring_commit(&s_mf.uplink_ring);
+    gw_trace(GW_TRACE_UPLINK_QUEUED, packet->tmst, spsc_ring_count(&s_mf.uplink_ring));
+
+    return ESP_OK;
+}
+
+// Internal: TX task - batches queued uplinks into QoS 1 publishes
+static void tx_task(void *arg)
+{
+    char buffer[MQTT_BUFFER_SIZE];
+    uint32_t rx_timestamps[MAX_UPLINK_BATCH];
+    mf_uplink_t *batch;
+
+    ESP_LOGI(TAG, "TX task started");
+
+    while (s_mf.running) {
+        if (spsc_ring_wait(&s_mf.uplink_ring, pdMS_TO_TICKS(100)) == 0) {
+            continue;
+        }
+
+        // A free slot in the window first; uplinks keep queuing meanwhile
+        if (xSemaphoreTake(s_mf.window, pdMS_TO_TICKS(WINDOW_WAIT_MS)) != pdTRUE) {
+            s_mf.window_stalls++;
+            continue;
+        }
+
+        int64_t start = esp_timer_get_time();
+        int offset = 0;
+        int count = 0;
+
+        memcpy(buffer, "{\"rxpk\":[", 9);
+        offset += 9;
+
+        // Concatenate pre-encoded fragments in place (batch up to MAX_UPLINK_BATCH)
+        uint32_t ready = spsc_ring_peek(&s_mf.uplink_ring, (void **)&batch);
+        while (count < ready && count < MAX_UPLINK_BATCH) {
+            const mf_uplink_t *uplink = &batch[count];
+
+            // Keep room for the separator and the closing "]}"
+            if (offset + uplink->len + 3 > MQTT_BUFFER_SIZE) {
+                break;
+            }
+            if (count > 0) {
+                buffer[offset++] = ',';
+            }
+            memcpy(&buffer[offset], uplink->json, uplink->len);
+            offset += uplink->len;
+            rx_timestamps[count++] = uplink->rx_timestamp;
+        }
+        spsc_ring_release(&s_mf.uplink_ring, count);
+
+        buffer[offset++] = ']';
+        buffer[offset++] = '}';
+
+        publish_uplinks(buffer, offset, rx_timestamps, count, start);
+    }
+
+    ESP_LOGI(TAG, "TX task stopped");
+    vTaskDelete(NULL);
+}
+
+// Internal: Publish one uplink batch into the reserved window slot
+static void publish_uplinks(const char *buffer, int len, const uint32_t *rx_timestamps,
+                            int count, int64_t start)
+{
+    // Reserve a slot before publishing, the PUBACK may race the return
+    mf_inflight_t *slot = NULL;
+    portENTER_CRITICAL(&s_mf.lock);
+    for (int i = 0; i < CONFIG_PKT_FWD_MQTT_WINDOW; i++) {
+        if (s_mf.inflight[i].msg_id == 0) {
+            slot = &s_mf.inflight[i];
+            slot->msg_id = -1;
+            slot->sent_at = esp_timer_get_time();
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&s_mf.lock);
+
+    int msg_id = slot ? esp_mqtt_client_publish(s_mf.client, s_mf.topic_up, buffer, len, 1, 0) : -1;
+
+    int64_t now = esp_timer_get_time();
+    uint32_t elapsed = now - start;
+    s_mf.assemble_us_total += elapsed;
+    if (elapsed > s_mf.assemble_us_max) {
+        s_mf.assemble_us_max = elapsed;
+    }
+
+    if (msg_id < 0) {
+        ESP_LOGE(TAG, "Uplink publish failed (%d packets)", count);
+        if (slot) {
+            portENTER_CRITICAL(&s_mf.lock);
+            slot->msg_id = 0;
+            portEXIT_CRITICAL(&s_mf.lock);
+        }
+        xSemaphoreGive(s_mf.window);
+        return;
+    }
+
+    bool acked = false;
+    portENTER_CRITICAL(&s_mf.lock);
+    if (s_mf.early_ack == msg_id) {
+        s_mf.early_ack = 0;
+        acked = true;
+    } else {
+        slot->msg_id = msg_id;
+    }
+    portEXIT_CRITICAL(&s_mf.lock);
+
+    // The PUBACK handler released the window count but could not find the slot
+    if (acked) {
+        portENTER_CRITICAL(&s_mf.lock);
+        uint32_t rtt = now - slot->sent_at;
+        slot->msg_id = 0;
+        s_mf.acked++;
+        s_mf.ack_us_total += rtt;
+        if (rtt > s_mf.ack_us_max) {
+            s_mf.ack_us_max = rtt;
+        }
+        portEXIT_CRITICAL(&s_mf.lock);
+    }
+
+    // Forward latency: radio RX to publish handed to the client
+    for (int i = 0; i < count; i++) {
+        uint32_t latency = (uint32_t)now - rx_timestamps[i];
+        s_mf.latency_us_total += latency;
+        if (latency > s_mf.latency_us_max) {
+            s_mf.latency_us_max = latency;
+        }
+    }
+    deadline_monitor_check(GW_STAGE_UPLINK_FORWARD, (uint32_t)now - rx_timestamps[0]);
+
+    s_mf.published++;
+    s_mf.uplinks_sent += count;
+    gw_trace(GW_TRACE_PUSH_SENT, count, 0);
+    ESP_LOGD(TAG, "Uplinks published (msg %d, %d packets, %d bytes)", msg_id, count, len);
+}
+
+// Internal: Free the window slot of an acknowledged or dropped publish
+static void release_inflight(int msg_id, bool acked)
+{
+    int64_t now = esp_timer_get_time();
+    bool found = false;
+
+    portENTER_CRITICAL(&s_mf.lock);
+    for (int i = 0; i < CONFIG_PKT_FWD_MQTT_WINDOW; i++) {
+        mf_inflight_t *slot = &s_mf.inflight[i];
+        if (slot->msg_id != msg_id) {
+            continue;
+        }
+
+        if (acked) {
+            uint32_t rtt = now - slot->sent_at;
+            s_mf.acked++;
+            s_mf.ack_us_total += rtt;
+            if (rtt > s_mf.ack_us_max) {
+                s_mf.ack_us_max = rtt;
+            }
+        } else {
+            s_mf.lost++;
+        }
+        slot->msg_id = 0;
+        found = true;
+        break;
+    }
+    if (!found && acked) {
+        s_mf.early_ack = msg_id;
+    }
+    portEXIT_CRITICAL(&s_mf.lock);
+
+    if (found || acked) {
+        xSemaphoreGive(s_mf.window);
+    }
+}
+
+// Internal: MQTT client events (MQTT task)
+static void mqtt_event_handler(void *arg, esp_event_base_t base, int32_t event_id, void *event_data)
+{
+    esp_mqtt_event_handle_t event = event_data;
+
+    switch ((esp_mqtt_event_id_t)event_id) {
+        case MQTT_EVENT_CONNECTED:
+            ESP_LOGI(TAG, "Connected to broker");
+            esp_mqtt_client_subscribe(s_mf.client, s_mf.topic_down, 1);
+            s_mf.status.connected = true;
+            break;
+
+        case MQTT_EVENT_DISCONNECTED:
+            if (s_mf.status.connected) {
+                ESP_LOGW(TAG, "Broker connection lost");
+            }
+            s_mf.status.connected = false;
+            break;
+
+        case MQTT_EVENT_PUBLISHED:
+            s_mf.status.push_ack++;
+            release_inflight(event->msg_id, true);
+            break;
+
+        case MQTT_EVENT_DELETED:
+            ESP_LOGW(TAG, "Publish %d expired unacknowledged", event->msg_id);
+            release_inflight(event->msg_id, false);
+            break;
+
+        case MQTT_EVENT_DATA:
+            if (event->topic_len != (int)strlen(s_mf.topic_down) ||
+                strncmp(event->topic, s_mf.topic_down, event->topic_len) != 0) {
+                break;
+            }
+            // A txpk always fits the client buffer, fragments are not reassembled
+            if (event->current_data_offset != 0 || event->data_len != event->total_data_len ||
+                event->data_len >= MQTT_BUFFER_SIZE) {
+                ESP_LOGE(TAG, "Downlink too large (%d bytes)", event->total_data_len);
+                publish_tx_ack("INVALID_JSON");
+                break;
+            }
+            memcpy(s_mf.downlink, event->data, event->data_len);
+            s_mf.downlink[event->data_len] = '\0';
+            handle_downlink(event->data_len);
+            break;
+
+        case MQTT_EVENT_ERROR:
+            ESP_LOGW(TAG, "MQTT error");
+            break;
+
+        default:
+            break;
+    }
+}
+
+// Internal: Hand a txpk to the TX scheduler and acknowledge it
+static void handle_downlink(int len)
+{
+    int64_t received = esp_timer_get_time();
+
+    ESP_LOGI(TAG, "Downlink JSON: %s", s_mf.downlink);
+
+    lora_tx_packet_t tx_pkt;
+    esp_err_t err = lora_codec_parse_txpk(s_mf.downlink, &tx_pkt);
+    if (err == ESP_ERR_INVALID_ARG) {
+        ESP_LOGE(TAG, "Invalid JSON in downlink");
+        publish_tx_ack("INVALID_JSON");
+        return;
+    }
+    if (err == ESP_ERR_NOT_FOUND) {
+        ESP_LOGE(TAG, "Missing txpk in downlink");
+        publish_tx_ack("MISSING_TXPK");
+        return;
+    }
+    gw_trace(GW_TRACE_PULL_RESP, tx_pkt.tx_timestamp, 0);
+
+    ESP_LOGI(TAG, "TX request: freq=%.2f MHz, SF%d, %d bytes, %s",
+             tx_pkt.modulation.frequency / 1e6,
+             tx_pkt.modulation.spreading_factor,
+             tx_pkt.payload_size,
+             tx_pkt.immediate ? "immediate" : "scheduled");
+
+    // Send to gateway
+    esp_err_t ret = lora_gateway_send(&tx_pkt);
+    publish_tx_ack(ret == ESP_OK ? NULL : "TX_FAILED");
+
+    uint32_t turnaround = esp_timer_get_time() - received;
+    s_mf.downlinks++;
+    s_mf.tx_ack_us_total += turnaround;
+    if (turnaround > s_mf.tx_ack_us_max) {
+        s_mf.tx_ack_us_max = turnaround;
+    }
+}
+
+// Internal: Publish the txpk_ack of the last downlink
+static void publish_tx_ack(const char *error)
+{
+    char buffer[128];
+
+    // Unlike TX_ACK, every ack carries a body so subscribers can count them
+    int len = lora_codec_encode_tx_ack(error ? error : "NONE", buffer, sizeof(buffer));
+    if (len <= 0) {
+        return;
+    }
+
+    esp_mqtt_client_publish(s_mf.client, s_mf.topic_ack, buffer, len, 0, 0);
+    ESP_LOGD(TAG, "TX ack published (error: %s)", error ? error : "none");
+}
+
+// Internal: Statistics timer callback
+static void stat_callback(TimerHandle_t timer)
+{
+    if (!s_mf.running || !s_mf.status.connected) {
+        return;
+    }
+
+    // Static: the timer daemon's stack is small (only this callback uses them)
+    static char buffer[MQTT_BUFFER_SIZE];
+    static gateway_stats_t gw_stats;
+    lora_gateway_get_stats(&gw_stats);
+
+    // Share of uplink publishes the broker acknowledged
+    double ackr = (s_mf.published > 0) ? (100.0 * s_mf.acked / s_mf.published) : 100.0;
+
+    // A trace recovered from before the last reset rides along once
+    const char *postmortem = gw_trace_postmortem_json();
+
+    int len = lora_codec_encode_stat(&gw_stats, ackr, postmortem, buffer, sizeof(buffer));
+    if (len < 0) {
+        return;
+    }
+
+    if (esp_mqtt_client_publish(s_mf.client, s_mf.topic_stats, buffer, len, 0, 0) >= 0 &&
+        postmortem) {
+        gw_trace_postmortem_clear();
+    }
+
+    ESP_LOGD(TAG, "Stats published: rx=%lu, tx=%lu", gw_stats.rx_total, gw_stats.tx_total);
+}
+
+#endif // CONFIG_PKT_FWD_BACKEND_MQTT
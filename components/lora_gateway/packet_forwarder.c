@@ -9,14 +9,22 @@
  * - PULL_RESP (0x03): Server -> Gateway (downlink data)
  * - PULL_ACK  (0x04): Server -> Gateway (acknowledge)
  * - TX_ACK    (0x05): Gateway -> Server (TX confirm)
+ *
+ * Like the reference forwarder, each server gets an upstream socket
+ * (PUSH_DATA, stat) and a downstream socket (PULL_DATA, PULL_RESP, TX_ACK).
+ * The downstream one is DSCP-marked for the WiFi voice access category,
+ * and bulk sends hold off while a pull-path packet is being handled.
  */
 
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <time.h>
 #include <sys/time.h>
 #include "packet_forwarder.h"
 #include "lora_gateway.h"
+#include "lora_codec.h"
+#include "gw_trace.h"
 #include "network_manager.h"
 #include "esp_log.h"
 #include "esp_timer.h"
@@ -24,9 +32,12 @@
 #include "lwip/netdb.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "freertos/queue.h"
 #include "freertos/timers.h"
-#include "cJSON.h"
+#ifdef CONFIG_PKT_FWD_PSRAM_SPOOL
+#include "esp_heap_caps.h"
+#endif
+
+#ifndef CONFIG_PKT_FWD_BACKEND_MQTT
 
 static const char *TAG = "pkt_fwd";
 
@@ -43,27 +54,79 @@ static const char *TAG = "pkt_fwd";
 #define UDP_BUFFER_SIZE         2048
 #define JSON_BUFFER_SIZE        1024
 #define MAX_UPLINK_BATCH        8
+#define UPLINK_QUEUE_SIZE       32
+#define PUSH_ACK_WINDOW         8       // Outstanding PUSH_DATA tokens still accepted
+#define UPLINK_FORWARD_BUDGET_US 200000 // Radio RX to PUSH_DATA sent (deadline monitor)
+#define PF_RX_TASK_PRIORITY     9       // Pull path above the bulk senders
+#define PF_TX_TASK_PRIORITY     8
+#define BULK_HOLD_MAX_MS        20      // Longest a bulk send waits for the pull path
+
+#ifdef CONFIG_PKT_FWD_BURST_BENCHMARK
+#define BENCHMARK_CONNECT_MS    10000
+#define BENCHMARK_DRAIN_MS      10000
+#define BENCHMARK_PAYLOAD_SIZE  23      // Typical confirmed data uplink
+#define BENCHMARK_BURST_GAP_MS  200     // Between bursts, longer than a batch takes to leave
+#define BENCHMARK_TASK_PRIORITY 9       // Like the uplink bus forwarder subscriber
+#endif
+
+// DevAddr routing trie (8-bit stride, at most 4 levels)
+#define ROUTE_NONE              0x7F    // No route, use default server
+#define ROUTE_CHILD             0x80    // Entry points to a child node
+#define ROUTE_MAX_NODES         (1 + 3 * PKT_FWD_MAX_ROUTES)
 
-// Packet forwarder state
 typedef struct {
-    pkt_fwd_config_t config;
+    uint8_t next[256];
+} route_node_t;
+
+// Uplink pre-encoded as an rxpk JSON object by the bus subscriber
+typedef struct {
+    uint32_t rx_timestamp;      // Radio RX timestamp (us), for forward latency
+    uint16_t len;
+    char json[LORA_CODEC_RXPK_MAX_SIZE];
+} pf_uplink_t;
+
+#ifdef CONFIG_PKT_FWD_PSRAM_SPOOL
+#define SPOOL_HDR_SIZE          6       // uint16 len + uint32 rx_timestamp
+#define SPOOL_REPLAY_INTERVAL_MS 20     // Pace replay so live uplinks go first
 
-    // Socket
-    int sock;
-    struct sockaddr_in server_addr;
+// Outage spool: record bytes in PSRAM, indices and counters in internal RAM.
+// Only touched by the owning server's TX task.
+typedef struct {
+    uint8_t *data;              // PSRAM
+    uint32_t size;
+    uint32_t head;              // Free-running byte offsets
+    uint32_t tail;
+    uint32_t count;
+
+    uint32_t spooled;
+    uint32_t replayed;
+    uint32_t overwritten;
+    uint32_t high_water;
+    uint32_t replay_batches;
+    uint64_t replay_us_total;
+} pf_spool_t;
+#endif
+
+// Upstream server state
+typedef struct {
+    pkt_fwd_server_t config;
+    uint8_t index;
+
+    // Sockets: upstream (bulk) and downstream (pull path)
+    int push_sock;
+    int pull_sock;
+    struct sockaddr_in addr;
 
     // Token management
     uint16_t push_token;
     uint16_t pull_token;
 
-    // Tasks and timers
-    TaskHandle_t rx_task;
+    // Uplink batching
     TaskHandle_t tx_task;
-    TimerHandle_t keepalive_timer;
-    TimerHandle_t stat_timer;
-
-    // Uplink queue
-    QueueHandle_t uplink_queue;
+    spsc_ring_t uplink_ring;    // Uplink bus subscriber -> this server's TX task
+#ifdef CONFIG_PKT_FWD_PSRAM_SPOOL
+    pf_spool_t spool;           // Uplinks held while the server is unreachable
+#endif
 
     // Statistics
     forwarder_status_t status;
@@ -71,9 +134,59 @@ typedef struct {
     uint32_t pull_sent;
     int64_t last_pull_ack;
 
+    // Round trips per traffic class
+    int64_t pull_sent_at;                       // Last PULL_DATA (pull_token)
+    int64_t push_sent_at[PUSH_ACK_WINDOW];      // By push token
+    uint32_t pull_rtts;
+    uint64_t pull_rtt_total;
+    uint32_t pull_rtt_max;
+    uint32_t push_rtts;
+    uint64_t push_rtt_total;
+    uint32_t push_rtt_max;
+    uint32_t tx_acks;                           // PULL_RESP in to TX_ACK out
+    uint64_t tx_ack_us_total;
+    uint32_t tx_ack_us_max;
+    uint32_t bulk_held;                         // Bulk sends held for the pull path
+
+    // Forwarding cost (this server's TX task, core 0)
+    uint32_t batches_sent;
+    uint32_t uplinks_sent;
+    uint64_t assemble_us_total;
+    uint32_t assemble_us_max;
+    uint64_t latency_us_total;
+    uint32_t latency_us_max;
+
+} pf_server_t;
+
+// Packet forwarder state
+typedef struct {
+    pkt_fwd_config_t config;
+
+    // Upstream servers
+    pf_server_t servers[PKT_FWD_MAX_SERVERS];
+
+    // Compiled routing table
+    route_node_t *route_nodes;
+    uint8_t route_node_count;
+
+    // Tasks and timers
+    TaskHandle_t rx_task;
+    TimerHandle_t keepalive_timer;
+    TimerHandle_t stat_timer;
+
+    // Pull-path packets being handled; bulk sends wait while non-zero
+    volatile uint32_t pull_busy;
+
+    // rxpk encoding cost (bus subscriber, core 1)
+    uint32_t encoded;
+    uint64_t encode_us_total;
+    uint32_t encode_us_max;
+
     // State
     bool initialized;
     bool running;
+    bool benchmarking;          // Live uplinks are refused during the benchmark
+    uint32_t producing;         // Bus subscriber inside pkt_fwd_send_uplink()
 
 } pkt_fwd_state_t;
 
@@ -84,14 +197,29 @@ static void rx_task(void *arg);
 static void tx_task(void *arg);
 static void keepalive_callback(TimerHandle_t timer);
 static void stat_callback(TimerHandle_t timer);
-static esp_err_t send_push_data(const lora_rx_packet_t *packets, int count);
-static esp_err_t send_pull_data(void);
-static esp_err_t send_tx_ack(uint16_t token, const char *error);
-static void handle_pull_resp(const uint8_t *data, int len);
-static void encode_base64(const uint8_t *data, int len, char *output);
-static int decode_base64(const char *input, uint8_t *output, int max_len);
-static const char *get_datr_string(uint8_t sf, uint8_t bw);
-static const char *get_codr_string(uint8_t cr);
+static int push_data_header(pf_server_t *srv, uint8_t *buffer);
+static int open_socket(int dscp);
+static void close_sockets(pf_server_t *srv);
+static void pull_path_begin(void);
+static void pull_path_end(void);
+static int send_bulk(pf_server_t *srv, const uint8_t *buffer, int len);
+static void record_rtt(int64_t *sent_at, uint32_t *count, uint64_t *total, uint32_t *max);
+#ifdef CONFIG_PKT_FWD_PSRAM_SPOOL
+static esp_err_t spool_init(pf_spool_t *spool, uint32_t size);
+static void spool_store(pf_spool_t *spool, const pf_uplink_t *uplink);
+static void spool_replay(pf_server_t *srv, uint8_t *buffer);
+#endif
+static esp_err_t send_push_data(pf_server_t *srv, const uint8_t *buffer, int len,
+                                const uint32_t *rx_timestamps, int count, int64_t start);
+static esp_err_t send_pull_data(pf_server_t *srv);
+static esp_err_t send_tx_ack(pf_server_t *srv, uint16_t token, const char *error);
+static void handle_pull_resp(pf_server_t *srv, const uint8_t *data, int len);
+static esp_err_t queue_uplink(pf_server_t *srv, const lora_rx_packet_t *packet);
+static esp_err_t compile_routes(void);
+static int route_lookup_devaddr(uint32_t devaddr);
+static int route_lookup_join_eui(uint64_t join_eui);
+static uint8_t route_uplink(const lora_rx_packet_t *packet);
+static int route_downlink(const uint8_t *payload, int len);
 
 esp_err_t pkt_fwd_init(const pkt_fwd_config_t *config)
 {
@@ -99,22 +227,47 @@ esp_err_t pkt_fwd_init(const pkt_fwd_config_t *config)
         return ESP_OK;
     }
 
-    if (!config) {
+    if (!config || config->num_servers == 0 || config->num_servers > PKT_FWD_MAX_SERVERS ||
+        config->default_server >= config->num_servers ||
+        config->num_routes > PKT_FWD_MAX_ROUTES) {
         return ESP_ERR_INVALID_ARG;
     }
 
     ESP_LOGI(TAG, "Initializing Packet Forwarder...");
-    ESP_LOGI(TAG, "Server: %s:%d", config->server_host, config->server_port);
 
     memset(&s_pf, 0, sizeof(pkt_fwd_state_t));
     memcpy(&s_pf.config, config, sizeof(pkt_fwd_config_t));
-    s_pf.sock = -1;
 
-    // Create uplink queue
-    s_pf.uplink_queue = xQueueCreate(32, sizeof(lora_rx_packet_t));
-    if (!s_pf.uplink_queue) {
-        ESP_LOGE(TAG, "Failed to create uplink queue");
-        return ESP_ERR_NO_MEM;
+    for (int i = 0; i < config->num_servers; i++) {
+        pf_server_t *srv = &s_pf.servers[i];
+
+        srv->config = config->servers[i];
+        srv->index = i;
+        srv->push_sock = -1;
+        srv->pull_sock = -1;
+
+        ESP_LOGI(TAG, "Server %d: %s:%d%s", i, srv->config.host, srv->config.port,
+                 (i == config->default_server) ? " (default)" : "");
+
+        // Each server batches its own uplinks
+        esp_err_t err = spsc_ring_init(&srv->uplink_ring, UPLINK_QUEUE_SIZE, sizeof(pf_uplink_t));
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to create uplink ring");
+            return err;
+        }
+
+#ifdef CONFIG_PKT_FWD_PSRAM_SPOOL
+        // Not fatal: without a spool uplinks are sent (and lost) as before
+        if (spool_init(&srv->spool, CONFIG_PKT_FWD_SPOOL_SIZE_KB * 1024 / config->num_servers) != ESP_OK) {
+            ESP_LOGW(TAG, "No PSRAM spool for server %d", i);
+        }
+#endif
+    }
+
+    esp_err_t ret = compile_routes();
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to compile routing table: %s", esp_err_to_name(ret));
+        return ret;
     }
 
     // Create keepalive timer
@@ -131,6 +284,9 @@ esp_err_t pkt_fwd_init(const pkt_fwd_config_t *config)
                                     NULL,
                                     stat_callback);
 
+    deadline_monitor_register(GW_STAGE_UPLINK_FORWARD, "uplink_forward",
+                              UPLINK_FORWARD_BUDGET_US, NULL, NULL);
+
     s_pf.initialized = true;
     ESP_LOGI(TAG, "Packet Forwarder initialized");
 
@@ -149,46 +305,65 @@ esp_err_t pkt_fwd_start(void)
 
     ESP_LOGI(TAG, "Starting Packet Forwarder...");
 
-    // Resolve server address
-    struct hostent *server = gethostbyname(s_pf.config.server_host);
-    if (!server) {
-        ESP_LOGE(TAG, "DNS lookup failed for %s", s_pf.config.server_host);
-        return ESP_FAIL;
-    }
+    int active = 0;
+    for (int i = 0; i < s_pf.config.num_servers; i++) {
+        pf_server_t *srv = &s_pf.servers[i];
 
-    memset(&s_pf.server_addr, 0, sizeof(s_pf.server_addr));
-    s_pf.server_addr.sin_family = AF_INET;
-    s_pf.server_addr.sin_port = htons(s_pf.config.server_port);
-    memcpy(&s_pf.server_addr.sin_addr.s_addr, server->h_addr, server->h_length);
+        // Resolve server address
+        struct hostent *server = gethostbyname(srv->config.host);
+        if (!server) {
+            ESP_LOGE(TAG, "DNS lookup failed for %s", srv->config.host);
+            continue;
+        }
+
+        memset(&srv->addr, 0, sizeof(srv->addr));
+        srv->addr.sin_family = AF_INET;
+        srv->addr.sin_port = htons(srv->config.port);
+        memcpy(&srv->addr.sin_addr.s_addr, server->h_addr, server->h_length);
+
+        ESP_LOGI(TAG, "Server %d resolved: %s", i, inet_ntoa(srv->addr.sin_addr));
 
-    ESP_LOGI(TAG, "Server resolved: %s", inet_ntoa(s_pf.server_addr.sin_addr));
+        // Create UDP sockets, one per traffic class
+        srv->push_sock = open_socket(CONFIG_PKT_FWD_PUSH_DSCP);
+        srv->pull_sock = open_socket(CONFIG_PKT_FWD_PULL_DSCP);
+        if (srv->push_sock < 0 || srv->pull_sock < 0) {
+            ESP_LOGE(TAG, "Failed to create sockets for server %d", i);
+            close_sockets(srv);
+            continue;
+        }
+        active++;
+    }
 
-    // Create UDP socket
-    s_pf.sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
-    if (s_pf.sock < 0) {
-        ESP_LOGE(TAG, "Failed to create socket");
+    if (active == 0) {
+        ESP_LOGE(TAG, "No server reachable");
         return ESP_FAIL;
     }
 
-    // Set socket timeout for receiving
-    struct timeval timeout = {.tv_sec = 1, .tv_usec = 0};
-    setsockopt(s_pf.sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    s_pf.running = true;
+
+    // Create RX task (receives from all servers)
+    xTaskCreatePinnedToCore(rx_task, "pf_rx", 4096, NULL, PF_RX_TASK_PRIORITY, &s_pf.rx_task, 0);
+
+    // Create one TX task per server (separate PUSH_DATA batching)
+    for (int i = 0; i < s_pf.config.num_servers; i++) {
+        pf_server_t *srv = &s_pf.servers[i];
+        if (srv->push_sock < 0) {
+            continue;
+        }
 
-    // Create RX task (receives from server)
-    xTaskCreatePinnedToCore(rx_task, "pf_rx", 4096, NULL, 7, &s_pf.rx_task, 0);
+        char name[configMAX_TASK_NAME_LEN];
+        snprintf(name, sizeof(name), "pf_tx%d", i);
+        xTaskCreatePinnedToCore(tx_task, name, 8192, srv, PF_TX_TASK_PRIORITY, &srv->tx_task, 0);
+        spsc_ring_set_consumer(&srv->uplink_ring, srv->tx_task);
 
-    // Create TX task (sends to server)
-    xTaskCreatePinnedToCore(tx_task, "pf_tx", 8192, NULL, 8, &s_pf.tx_task, 0);
+        // Send initial PULL_DATA
+        send_pull_data(srv);
+    }
 
     // Start timers
     xTimerStart(s_pf.keepalive_timer, 0);
     xTimerStart(s_pf.stat_timer, 0);
 
-    s_pf.running = true;
-
-    // Send initial PULL_DATA
-    send_pull_data();
-
     ESP_LOGI(TAG, "Packet Forwarder started");
     return ESP_OK;
 }
@@ -212,19 +387,47 @@ esp_err_t pkt_fwd_stop(void)
         vTaskDelete(s_pf.rx_task);
         s_pf.rx_task = NULL;
     }
-    if (s_pf.tx_task) {
-        vTaskDelete(s_pf.tx_task);
-        s_pf.tx_task = NULL;
+    for (int i = 0; i < s_pf.config.num_servers; i++) {
+        pf_server_t *srv = &s_pf.servers[i];
+
+        if (srv->tx_task) {
+            spsc_ring_set_consumer(&srv->uplink_ring, NULL);
+            vTaskDelete(srv->tx_task);
+            srv->tx_task = NULL;
+        }
+
+        close_sockets(srv);
+
+        srv->status.connected = false;
     }
+    ESP_LOGI(TAG, "Packet Forwarder stopped");
+
+    return ESP_OK;
+}
 
-    // Close socket
-    if (s_pf.sock >= 0) {
-        close(s_pf.sock);
-        s_pf.sock = -1;
+esp_err_t pkt_fwd_deinit(void)
+{
+    if (!s_pf.initialized) {
+        return ESP_OK;
     }
 
-    s_pf.status.connected = false;
-    ESP_LOGI(TAG, "Packet Forwarder stopped");
+    pkt_fwd_stop();
+
+    xTimerDelete(s_pf.keepalive_timer, portMAX_DELAY);
+    xTimerDelete(s_pf.stat_timer, portMAX_DELAY);
+
+    for (int i = 0; i < s_pf.config.num_servers; i++) {
+        pf_server_t *srv = &s_pf.servers[i];
+
+        spsc_ring_deinit(&srv->uplink_ring);
+#ifdef CONFIG_PKT_FWD_PSRAM_SPOOL
+        heap_caps_free(srv->spool.data);
+#endif
+    }
+    free(s_pf.route_nodes);
+
+    memset(&s_pf, 0, sizeof(pkt_fwd_state_t));
+    ESP_LOGI(TAG, "Packet Forwarder released");
 
     return ESP_OK;
 }
@@ -235,11 +438,48 @@ esp_err_t pkt_fwd_send_uplink(const lora_rx_packet_t *packet)
         return ESP_ERR_INVALID_STATE;
     }
 
-    if (xQueueSend(s_pf.uplink_queue, packet, pdMS_TO_TICKS(100)) != pdTRUE) {
-        ESP_LOGW(TAG, "Uplink queue full");
+    // Announce before checking: the benchmark sets its flag, then waits
+    // for this to clear, so at most one of the two produces into the rings
+    __atomic_store_n(&s_pf.producing, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&s_pf.benchmarking, __ATOMIC_SEQ_CST)) {
+        __atomic_store_n(&s_pf.producing, 0, __ATOMIC_SEQ_CST);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    pf_server_t *srv = &s_pf.servers[route_uplink(packet)];
+    esp_err_t ret = queue_uplink(srv, packet);
+    __atomic_store_n(&s_pf.producing, 0, __ATOMIC_SEQ_CST);
+    if (ret == ESP_ERR_NO_MEM) {
+        ESP_LOGW(TAG, "Uplink ring full (server %d)", srv->index);
+    }
+
+    return ret;
+}
+
+// Internal: Encode an uplink into its server's ring (single producer)
+static esp_err_t queue_uplink(pf_server_t *srv, const lora_rx_packet_t *packet)
+{
+    // Encode straight into the ring slot
+    pf_uplink_t *uplink = spsc_ring_reserve(&srv->uplink_ring);
+    if (!uplink) {
         return ESP_ERR_NO_MEM;
     }
 
+    // Encode once here, in the bus subscriber (core 1), so the forwarder only concatenates
+    int64_t start = esp_timer_get_time();
+    uplink->len = lora_codec_encode_rxpk(packet, uplink->json);
+    uplink->rx_timestamp = packet->timestamp;
+    uint32_t elapsed = esp_timer_get_time() - start;
+
+    s_pf.encoded++;
+    s_pf.encode_us_total += elapsed;
+    if (elapsed > s_pf.encode_us_max) {
+        s_pf.encode_us_max = elapsed;
+    }
+
+    spsc_ring_commit(&srv->uplink_ring);
+    gw_trace(GW_TRACE_UPLINK_QUEUED, packet->tmst, spsc_ring_count(&srv->uplink_ring));
+
     return ESP_OK;
 }
 
@@ -249,62 +489,487 @@ esp_err_t pkt_fwd_get_status(forwarder_status_t *status)
         return ESP_ERR_INVALID_ARG;
     }
 
-    memcpy(status, &s_pf.status, sizeof(forwarder_status_t));
+    // Aggregate over all servers
+    memset(status, 0, sizeof(forwarder_status_t));
+    int latency_count = 0;
+    for (int i = 0; i < s_pf.config.num_servers; i++) {
+        const forwarder_status_t *st = &s_pf.servers[i].status;
+        status->connected |= st->connected;
+        status->push_ack += st->push_ack;
+        status->pull_ack += st->pull_ack;
+        if (st->latency_ms > 0) {
+            status->latency_ms += st->latency_ms;
+            latency_count++;
+        }
+    }
+    if (latency_count > 0) {
+        status->latency_ms /= latency_count;
+    }
+
     return ESP_OK;
 }
 
+esp_err_t pkt_fwd_get_server_status(uint8_t server, forwarder_status_t *status)
+{
+    if (!status || server >= s_pf.config.num_servers) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memcpy(status, &s_pf.servers[server].status, sizeof(forwarder_status_t));
+    return ESP_OK;
+}
+
+esp_err_t pkt_fwd_get_ring_stats(uint8_t server, spsc_ring_stats_t *stats)
+{
+    if (!stats || server >= s_pf.config.num_servers) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    spsc_ring_get_stats(&s_pf.servers[server].uplink_ring, stats);
+    return ESP_OK;
+}
+
+esp_err_t pkt_fwd_get_spool_stats(uint8_t server, pkt_fwd_spool_stats_t *stats)
+{
+    if (!stats || server >= s_pf.config.num_servers) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+#ifdef CONFIG_PKT_FWD_PSRAM_SPOOL
+    const pf_spool_t *spool = &s_pf.servers[server].spool;
+    if (!spool->data) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    memset(stats, 0, sizeof(pkt_fwd_spool_stats_t));
+    stats->records = spool->count;
+    stats->bytes_used = spool->head - spool->tail;
+    stats->capacity = spool->size;
+    stats->spooled = spool->spooled;
+    stats->replayed = spool->replayed;
+    stats->overwritten = spool->overwritten;
+    stats->high_water = spool->high_water;
+    if (spool->replay_batches > 0) {
+        stats->replay_avg_us = spool->replay_us_total / spool->replay_batches;
+    }
+
+    return ESP_OK;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+esp_err_t pkt_fwd_get_class_stats(uint8_t server, pkt_fwd_class_stats_t *stats)
+{
+    if (!stats || server >= s_pf.config.num_servers) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    const pf_server_t *srv = &s_pf.servers[server];
+
+    memset(stats, 0, sizeof(pkt_fwd_class_stats_t));
+    stats->pull_rtts = srv->pull_rtts;
+    stats->pull_rtt_max_us = srv->pull_rtt_max;
+    stats->push_rtts = srv->push_rtts;
+    stats->push_rtt_max_us = srv->push_rtt_max;
+    stats->tx_acks = srv->tx_acks;
+    stats->tx_ack_max_us = srv->tx_ack_us_max;
+    stats->bulk_held = srv->bulk_held;
+    if (srv->pull_rtts > 0) {
+        stats->pull_rtt_avg_us = srv->pull_rtt_total / srv->pull_rtts;
+    }
+    if (srv->push_rtts > 0) {
+        stats->push_rtt_avg_us = srv->push_rtt_total / srv->push_rtts;
+    }
+    if (srv->tx_acks > 0) {
+        stats->tx_ack_avg_us = srv->tx_ack_us_total / srv->tx_acks;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t pkt_fwd_get_mqtt_stats(pkt_fwd_mqtt_stats_t *stats)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t pkt_fwd_get_perf(pkt_fwd_perf_t *perf)
+{
+    if (!perf) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memset(perf, 0, sizeof(pkt_fwd_perf_t));
+
+    perf->encoded = s_pf.encoded;
+    perf->encode_max_us = s_pf.encode_us_max;
+    if (s_pf.encoded > 0) {
+        perf->encode_avg_us = s_pf.encode_us_total / s_pf.encoded;
+    }
+
+    uint64_t assemble_total = 0;
+    uint64_t latency_total = 0;
+    for (int i = 0; i < s_pf.config.num_servers; i++) {
+        const pf_server_t *srv = &s_pf.servers[i];
+
+        perf->uplinks += srv->uplinks_sent;
+        perf->datagrams += srv->batches_sent;
+        assemble_total += srv->assemble_us_total;
+        latency_total += srv->latency_us_total;
+        if (srv->assemble_us_max > perf->assemble_max_us) {
+            perf->assemble_max_us = srv->assemble_us_max;
+        }
+        if (srv->latency_us_max > perf->latency_max_us) {
+            perf->latency_max_us = srv->latency_us_max;
+        }
+    }
+    if (perf->datagrams > 0) {
+        perf->assemble_avg_us = assemble_total / perf->datagrams;
+    }
+    if (perf->uplinks > 0) {
+        perf->latency_avg_us = latency_total / perf->uplinks;
+    }
+
+    return ESP_OK;
+}
+
+#ifdef CONFIG_PKT_FWD_BURST_BENCHMARK
+// Burst benchmark run, shared with its producer task
+typedef struct {
+    uint32_t bursts;
+    uint32_t burst_size;
+    TaskHandle_t caller;
+} pf_bench_run_t;
+
+// Internal: Idle task run time of each core and the run time clock
+static void sample_idle(uint32_t idle[2], uint32_t *clock)
+{
+    UBaseType_t count = uxTaskGetNumberOfTasks() + 4;
+    TaskStatus_t *tasks = malloc(count * sizeof(TaskStatus_t));
+
+    idle[0] = idle[1] = 0;
+    *clock = 0;
+    if (!tasks) {
+        return;
+    }
+
+    count = uxTaskGetSystemState(tasks, count, clock);
+    for (UBaseType_t i = 0; i < count; i++) {
+        for (int core = 0; core < 2; core++) {
+            if (tasks[i].xHandle == xTaskGetIdleTaskHandleForCPU(core)) {
+                idle[core] = tasks[i].ulRunTimeCounter;
+            }
+        }
+    }
+    free(tasks);
+}
+
+// Internal: Benchmark producer, on core 1 like the uplink bus subscriber
+static void bench_producer(void *arg)
+{
+    pf_bench_run_t *run = (pf_bench_run_t *)arg;
+    lora_rx_packet_t packet;
+
+    memset(&packet, 0, sizeof(packet));
+    for (int i = 0; i < BENCHMARK_PAYLOAD_SIZE; i++) {
+        packet.payload[i] = (uint8_t)(i * 37 + 11);
+    }
+    packet.payload[0] = 0x80;   // Confirmed data up
+    packet.payload_size = BENCHMARK_PAYLOAD_SIZE;
+    packet.modulation.frequency = 916800000;
+    packet.modulation.spreading_factor = 7;
+    packet.modulation.coding_rate = 1;
+    packet.rssi = -87;
+    packet.snr = 7.5f;
+    packet.crc_ok = true;
+
+    for (uint32_t b = 0; b < run->bursts; b++) {
+        // Back to back, as fast as a burst of frames would be processed
+        for (uint32_t i = 0; i < run->burst_size; i++) {
+            packet.payload[6] = (uint8_t)i;     // FCnt
+            packet.tmst = b * run->burst_size + i;
+            packet.timestamp = (uint32_t)esp_timer_get_time();
+
+            pf_server_t *srv = &s_pf.servers[route_uplink(&packet)];
+            while (queue_uplink(srv, &packet) == ESP_ERR_NO_MEM) {
+                vTaskDelay(1);
+            }
+        }
+        vTaskDelay(pdMS_TO_TICKS(BENCHMARK_BURST_GAP_MS));
+    }
+
+    xTaskNotifyGive(run->caller);
+    vTaskDelete(NULL);
+}
+
+esp_err_t pkt_fwd_burst_benchmark(uint32_t bursts, uint32_t burst_size)
+{
+    if (!s_pf.running || bursts == 0 || burst_size == 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    int64_t deadline = esp_timer_get_time() + BENCHMARK_CONNECT_MS * 1000LL;
+    while (!pkt_fwd_is_connected()) {
+        if (esp_timer_get_time() > deadline) {
+            ESP_LOGE(TAG, "Benchmark: no server reachable");
+            return ESP_ERR_TIMEOUT;
+        }
+        vTaskDelay(pdMS_TO_TICKS(100));
+    }
+
+    // The rings have a single producer: keep the bus subscriber out, and
+    // wait for a call already past the check to finish
+    __atomic_store_n(&s_pf.benchmarking, true, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&s_pf.producing, __ATOMIC_SEQ_CST)) {
+        vTaskDelay(1);
+    }
+
+    pkt_fwd_perf_t before;
+    pkt_fwd_get_perf(&before);
+    s_pf.encode_us_max = 0;
+    for (int i = 0; i < s_pf.config.num_servers; i++) {
+        s_pf.servers[i].assemble_us_max = 0;
+        s_pf.servers[i].latency_us_max = 0;
+    }
+    uint64_t encode_start = s_pf.encode_us_total;
+    uint64_t assemble_start = 0;
+    uint64_t latency_start = 0;
+    for (int i = 0; i < s_pf.config.num_servers; i++) {
+        assemble_start += s_pf.servers[i].assemble_us_total;
+        latency_start += s_pf.servers[i].latency_us_total;
+    }
+
+    ESP_LOGI(TAG, "Benchmark: %lu bursts of %lu uplinks", bursts, burst_size);
+
+    uint32_t idle_start[2];
+    uint32_t idle_end[2];
+    uint32_t clock_start;
+    uint32_t clock_end;
+    sample_idle(idle_start, &clock_start);
+    int64_t start = esp_timer_get_time();
+
+    pf_bench_run_t run = {
+        .bursts = bursts,
+        .burst_size = burst_size,
+        .caller = xTaskGetCurrentTaskHandle(),
+    };
+    if (xTaskCreatePinnedToCore(bench_producer, "pf_bench", 4096, &run,
+                                BENCHMARK_TASK_PRIORITY, NULL, 1) != pdPASS) {
+        __atomic_store_n(&s_pf.benchmarking, false, __ATOMIC_SEQ_CST);
+        return ESP_ERR_NO_MEM;
+    }
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    // Drain: every uplink handed to the network stack
+    uint32_t total = bursts * burst_size;
+    pkt_fwd_perf_t after;
+    deadline = esp_timer_get_time() + BENCHMARK_DRAIN_MS * 1000LL;
+    bool drained = false;
+    while (esp_timer_get_time() < deadline) {
+        pkt_fwd_get_perf(&after);
+        if (after.uplinks - before.uplinks >= total) {
+            drained = true;
+            break;
+        }
+        vTaskDelay(1);
+    }
+    int64_t elapsed = esp_timer_get_time() - start;
+    sample_idle(idle_end, &clock_end);
+
+    __atomic_store_n(&s_pf.benchmarking, false, __ATOMIC_SEQ_CST);
+
+    pkt_fwd_get_perf(&after);
+    uint32_t uplinks = after.uplinks - before.uplinks;
+    uint32_t datagrams = after.datagrams - before.datagrams;
+    uint32_t encoded = after.encoded - before.encoded;
+    uint64_t assemble_total = 0;
+    uint64_t latency_total = 0;
+    for (int i = 0; i < s_pf.config.num_servers; i++) {
+        assemble_total += s_pf.servers[i].assemble_us_total;
+        latency_total += s_pf.servers[i].latency_us_total;
+    }
+
+    // Busy share of each core: the rest of the run time went to its idle task
+    uint32_t clock = clock_end - clock_start;
+    uint32_t load[2] = {0, 0};
+    for (int core = 0; core < 2 && clock > 0; core++) {
+        uint32_t idle = idle_end[core] - idle_start[core];
+        load[core] = idle < clock ? (uint32_t)(100ULL * (clock - idle) / clock) : 0;
+    }
+
+    // One JSON line on stdout, like the hot-path benchmark
+    printf("{\"benchmark\":\"udp_forwarder_burst\",\"version\":1,\"bursts\":%lu,"
+           "\"burst_size\":%lu,\"elapsed_ms\":%lld,\"uplinks\":%lu,\"datagrams\":%lu,"
+           "\"encode_avg_us\":%lu,\"encode_max_us\":%lu,\"assemble_avg_us\":%lu,"
+           "\"assemble_max_us\":%lu,\"latency_avg_us\":%lu,\"latency_max_us\":%lu,"
+           "\"core0_load_pct\":%lu,\"core1_load_pct\":%lu,\"drained\":%s}\n",
+           bursts, burst_size, elapsed / 1000, uplinks, datagrams,
+           encoded > 0 ? (uint32_t)((s_pf.encode_us_total - encode_start) / encoded) : 0,
+           s_pf.encode_us_max,
+           datagrams > 0 ? (uint32_t)((assemble_total - assemble_start) / datagrams) : 0,
+           after.assemble_max_us,
+           uplinks > 0 ? (uint32_t)((latency_total - latency_start) / uplinks) : 0,
+           after.latency_max_us, load[0], load[1], drained ? "true" : "false");
+
+    return drained ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+#endif
+
 bool pkt_fwd_is_connected(void)
 {
-    return s_pf.status.connected;
+    for (int i = 0; i < s_pf.config.num_servers; i++) {
+        if (s_pf.servers[i].status.connected) {
+            return true;
+        }
+    }
+    return false;
+}
+
+esp_err_t pkt_fwd_route_from_netid(uint32_t netid, uint8_t server, pkt_fwd_route_t *route)
+{
+    // NwkID length per NetID type (LoRaWAN Backend Interfaces, DevAddr format)
+    static const uint8_t nwkid_bits[8] = {6, 6, 9, 11, 12, 13, 15, 17};
+
+    if (!route || netid > 0xFFFFFF) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    uint8_t type = netid >> 21;
+    uint8_t type_len = (type == 7) ? 8 : type + 1;
+    uint32_t type_prefix = ((1u << type) - 1) << 1;  // 'type' ones followed by a zero
+    uint32_t nwkid = netid & ((1u << nwkid_bits[type]) - 1);
+
+    memset(route, 0, sizeof(pkt_fwd_route_t));
+    route->type = PKT_FWD_ROUTE_DEVADDR;
+    route->prefix_len = type_len + nwkid_bits[type];
+    route->devaddr_prefix = (type_prefix << (32 - type_len)) |
+                            (nwkid << (32 - route->prefix_len));
+    route->server = server;
+
+    return ESP_OK;
+}
+
+// Internal: Handle one datagram received on a server socket
+static void handle_server_packet(pf_server_t *srv, uint8_t *buffer, int len)
+{
+    if (len < 4) {
+        return;
+    }
+
+    // Validate protocol version
+    if (buffer[0] != PROTOCOL_VERSION) {
+        ESP_LOGW(TAG, "Invalid protocol version: %d", buffer[0]);
+        return;
+    }
+
+    uint16_t token = (buffer[1] << 8) | buffer[2];
+    uint8_t type = buffer[3];
+
+    switch (type) {
+        case PKT_PUSH_ACK:
+            // Only count ACKs for PUSH_DATA we actually have outstanding
+            if ((uint16_t)(srv->push_token - token) < PUSH_ACK_WINDOW) {
+                ESP_LOGD(TAG, "PUSH_ACK received (server %d, token: %04X)", srv->index, token);
+                srv->status.push_ack++;
+                record_rtt(&srv->push_sent_at[token % PUSH_ACK_WINDOW], &srv->push_rtts,
+                           &srv->push_rtt_total, &srv->push_rtt_max);
+            } else {
+                ESP_LOGD(TAG, "Stale PUSH_ACK (server %d, token: %04X)", srv->index, token);
+            }
+            break;
+
+        case PKT_PULL_ACK:
+            ESP_LOGD(TAG, "PULL_ACK received (server %d, token: %04X)", srv->index, token);
+            srv->status.pull_ack++;
+            srv->status.connected = true;
+            srv->last_pull_ack = esp_timer_get_time();
+            if (token == srv->pull_token) {
+                record_rtt(&srv->pull_sent_at, &srv->pull_rtts, &srv->pull_rtt_total,
+                           &srv->pull_rtt_max);
+                srv->status.latency_ms = srv->pull_rtt_total / srv->pull_rtts / 1000;
+            }
+            break;
+
+        case PKT_PULL_RESP:
+            ESP_LOGI(TAG, "PULL_RESP received (server %d, %d bytes)", srv->index, len);
+            handle_pull_resp(srv, buffer, len);
+            break;
+
+        default:
+            ESP_LOGW(TAG, "Unknown packet type: %d", type);
+            break;
+    }
 }
 
-// Internal: RX task - receives packets from server
+// Internal: RX task - receives packets from all servers
 static void rx_task(void *arg)
 {
     uint8_t buffer[UDP_BUFFER_SIZE];
     struct sockaddr_in from_addr;
-    socklen_t from_len = sizeof(from_addr);
+    socklen_t from_len;
 
     ESP_LOGI(TAG, "RX task started");
 
     while (s_pf.running) {
-        int len = recvfrom(s_pf.sock, buffer, sizeof(buffer), 0,
-                          (struct sockaddr *)&from_addr, &from_len);
-
-        if (len < 4) {
-            continue;
+        fd_set read_fds;
+        int max_fd = -1;
+
+        FD_ZERO(&read_fds);
+        for (int i = 0; i < s_pf.config.num_servers; i++) {
+            const pf_server_t *srv = &s_pf.servers[i];
+            if (srv->push_sock < 0) {
+                continue;
+            }
+            FD_SET(srv->push_sock, &read_fds);
+            FD_SET(srv->pull_sock, &read_fds);
+            if (srv->push_sock > max_fd) {
+                max_fd = srv->push_sock;
+            }
+            if (srv->pull_sock > max_fd) {
+                max_fd = srv->pull_sock;
+            }
         }
 
-        // Validate protocol version
-        if (buffer[0] != PROTOCOL_VERSION) {
-            ESP_LOGW(TAG, "Invalid protocol version: %d", buffer[0]);
+        struct timeval timeout = {.tv_sec = 1, .tv_usec = 0};
+        if (select(max_fd + 1, &read_fds, NULL, NULL, &timeout) <= 0) {
             continue;
         }
 
-        uint16_t token = (buffer[1] << 8) | buffer[2];
-        uint8_t type = buffer[3];
-
-        switch (type) {
-            case PKT_PUSH_ACK:
-                ESP_LOGD(TAG, "PUSH_ACK received (token: %04X)", token);
-                s_pf.status.push_ack++;
-                break;
-
-            case PKT_PULL_ACK:
-                ESP_LOGD(TAG, "PULL_ACK received (token: %04X)", token);
-                s_pf.status.pull_ack++;
-                s_pf.status.connected = true;
-                s_pf.last_pull_ack = esp_timer_get_time();
-                break;
-
-            case PKT_PULL_RESP:
-                ESP_LOGI(TAG, "PULL_RESP received (%d bytes)", len);
-                handle_pull_resp(buffer, len);
-                break;
-
-            default:
-                ESP_LOGW(TAG, "Unknown packet type: %d", type);
-                break;
+        // Pull sockets first, so a PULL_RESP never waits behind PUSH_ACKs
+        for (int pass = 0; pass < 2; pass++) {
+            bool pull = (pass == 0);
+
+            for (int i = 0; i < s_pf.config.num_servers; i++) {
+                pf_server_t *srv = &s_pf.servers[i];
+                int sock = pull ? srv->pull_sock : srv->push_sock;
+                if (sock < 0 || !FD_ISSET(sock, &read_fds)) {
+                    continue;
+                }
+
+                from_len = sizeof(from_addr);
+                int len = recvfrom(sock, buffer, sizeof(buffer) - 1, 0,
+                                   (struct sockaddr *)&from_addr, &from_len);
+                if (len < 0) {
+                    continue;
+                }
+                buffer[len] = '\0';  // JSON payload is parsed as a C string
+
+                // Downlinks are only accepted from the server this socket talks to
+                if (from_addr.sin_addr.s_addr != srv->addr.sin_addr.s_addr ||
+                    from_addr.sin_port != srv->addr.sin_port) {
+                    ESP_LOGW(TAG, "Ignoring datagram from unexpected source %s",
+                             inet_ntoa(from_addr.sin_addr));
+                    continue;
+                }
+
+                if (pull) {
+                    pull_path_begin();
+                }
+                handle_server_packet(srv, buffer, len);
+                if (pull) {
+                    pull_path_end();
+                }
+            }
         }
     }
 
@@ -312,30 +977,77 @@ static void rx_task(void *arg)
     vTaskDelete(NULL);
 }
 
-// Internal: TX task - sends packets to server
+// Internal: TX task - sends packets to one server
 static void tx_task(void *arg)
 {
-    lora_rx_packet_t packets[MAX_UPLINK_BATCH];
-    int batch_count = 0;
+    pf_server_t *srv = (pf_server_t *)arg;
+    uint8_t buffer[UDP_BUFFER_SIZE];
+    uint32_t rx_timestamps[MAX_UPLINK_BATCH];
+    pf_uplink_t *batch;
 
-    ESP_LOGI(TAG, "TX task started");
+    ESP_LOGI(TAG, "TX task started (server %d)", srv->index);
 
     while (s_pf.running) {
-        batch_count = 0;
+#ifdef CONFIG_PKT_FWD_PSRAM_SPOOL
+        bool replay = srv->status.connected && srv->spool.count > 0;
+        TickType_t wait = pdMS_TO_TICKS(replay ? SPOOL_REPLAY_INTERVAL_MS : 100);
+
+        if (spsc_ring_wait(&srv->uplink_ring, wait) == 0) {
+            // Idle: drain the outage backlog
+            if (replay) {
+                spool_replay(srv, buffer);
+            }
+            continue;
+        }
 
-        // Collect packets (batch up to MAX_UPLINK_BATCH)
-        while (batch_count < MAX_UPLINK_BATCH) {
-            TickType_t wait = (batch_count == 0) ? pdMS_TO_TICKS(100) : 0;
-            if (xQueueReceive(s_pf.uplink_queue, &packets[batch_count], wait) == pdTRUE) {
-                batch_count++;
-            } else {
+        // Server unreachable: hold uplinks instead of sending them into the void
+        if (!srv->status.connected && srv->spool.data) {
+            uint32_t ready = spsc_ring_peek(&srv->uplink_ring, (void **)&batch);
+            for (uint32_t i = 0; i < ready; i++) {
+                spool_store(&srv->spool, &batch[i]);
+            }
+            spsc_ring_release(&srv->uplink_ring, ready);
+            continue;
+        }
+#else
+        if (spsc_ring_wait(&srv->uplink_ring, pdMS_TO_TICKS(100)) == 0) {
+            continue;
+        }
+#endif
+
+        int64_t start = esp_timer_get_time();
+        int offset = push_data_header(srv, buffer);
+        int count = 0;
+
+        memcpy(&buffer[offset], "{\"rxpk\":[", 9);
+        offset += 9;
+
+        // Concatenate pre-encoded fragments in place (batch up to MAX_UPLINK_BATCH)
+        uint32_t ready = spsc_ring_peek(&srv->uplink_ring, (void **)&batch);
+        while (count < ready && count < MAX_UPLINK_BATCH) {
+            const pf_uplink_t *uplink = &batch[count];
+
+            // Keep room for the separator and the closing "]}"
+            if (offset + uplink->len + 3 > UDP_BUFFER_SIZE) {
                 break;
             }
+            if (count > 0) {
+                buffer[offset++] = ',';
+            }
+            memcpy(&buffer[offset], uplink->json, uplink->len);
+            offset += uplink->len;
+            rx_timestamps[count++] = uplink->rx_timestamp;
         }
+        spsc_ring_release(&srv->uplink_ring, count);
+
+        buffer[offset++] = ']';
+        buffer[offset++] = '}';
 
-        // Send batch if we have packets
-        if (batch_count > 0) {
-            send_push_data(packets, batch_count);
+        // Spool replays are late by design, only live batches have a budget;
+        // the first uplink is the oldest
+        if (send_push_data(srv, buffer, offset, rx_timestamps, count, start) == ESP_OK) {
+            deadline_monitor_check(GW_STAGE_UPLINK_FORWARD,
+                                   (uint32_t)esp_timer_get_time() - rx_timestamps[0]);
         }
     }
 
@@ -343,119 +1055,304 @@ static void tx_task(void *arg)
     vTaskDelete(NULL);
 }
 
-// Internal: Send PUSH_DATA packet
-static esp_err_t send_push_data(const lora_rx_packet_t *packets, int count)
+#ifdef CONFIG_PKT_FWD_PSRAM_SPOOL
+// Internal: Allocate spool storage in PSRAM
+static esp_err_t spool_init(pf_spool_t *spool, uint32_t size)
 {
-    if (s_pf.sock < 0 || count == 0) {
-        return ESP_ERR_INVALID_STATE;
+    memset(spool, 0, sizeof(pf_spool_t));
+
+    spool->data = heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!spool->data) {
+        return ESP_ERR_NO_MEM;
     }
+    spool->size = size;
 
-    uint8_t buffer[UDP_BUFFER_SIZE];
+    ESP_LOGI(TAG, "PSRAM spool: %lu KB (~%lu uplinks)", size / 1024,
+             size / (SPOOL_HDR_SIZE + LORA_CODEC_RXPK_META_SIZE));
+
+    return ESP_OK;
+}
+
+// Internal: Copy into the spool, split at the wrap point.
+// Whole records move with memcpy so PSRAM sees sequential bursts
+// instead of one cache miss per byte.
+static void spool_write(pf_spool_t *spool, uint32_t pos, const void *src, uint32_t len)
+{
+    uint32_t offset = pos % spool->size;
+    uint32_t first = spool->size - offset;
+
+    if (first >= len) {
+        memcpy(&spool->data[offset], src, len);
+    } else {
+        memcpy(&spool->data[offset], src, first);
+        memcpy(spool->data, (const uint8_t *)src + first, len - first);
+    }
+}
+
+// Internal: Copy out of the spool, split at the wrap point
+static void spool_read(const pf_spool_t *spool, uint32_t pos, void *dst, uint32_t len)
+{
+    uint32_t offset = pos % spool->size;
+    uint32_t first = spool->size - offset;
+
+    if (first >= len) {
+        memcpy(dst, &spool->data[offset], len);
+    } else {
+        memcpy(dst, &spool->data[offset], first);
+        memcpy((uint8_t *)dst + first, spool->data, len - first);
+    }
+}
+
+// Internal: Read the header of the oldest record
+static uint16_t spool_peek_header(const pf_spool_t *spool, uint32_t *rx_timestamp)
+{
+    uint8_t hdr[SPOOL_HDR_SIZE];
+    spool_read(spool, spool->tail, hdr, SPOOL_HDR_SIZE);
+
+    memcpy(rx_timestamp, &hdr[2], sizeof(uint32_t));
+    return hdr[0] | (hdr[1] << 8);
+}
+
+// Internal: Append an uplink, dropping the oldest records if full
+static void spool_store(pf_spool_t *spool, const pf_uplink_t *uplink)
+{
+    uint32_t need = SPOOL_HDR_SIZE + uplink->len;
+    uint32_t rx_timestamp;
+
+    while (spool->count > 0 && spool->size - (spool->head - spool->tail) < need) {
+        spool->tail += SPOOL_HDR_SIZE + spool_peek_header(spool, &rx_timestamp);
+        spool->count--;
+        spool->overwritten++;
+    }
+
+    uint8_t hdr[SPOOL_HDR_SIZE];
+    hdr[0] = uplink->len & 0xFF;
+    hdr[1] = (uplink->len >> 8) & 0xFF;
+    memcpy(&hdr[2], &uplink->rx_timestamp, sizeof(uint32_t));
+
+    spool_write(spool, spool->head, hdr, SPOOL_HDR_SIZE);
+    spool_write(spool, spool->head + SPOOL_HDR_SIZE, uplink->json, uplink->len);
+    spool->head += need;
+    spool->count++;
+    spool->spooled++;
+
+    if (spool->count > spool->high_water) {
+        spool->high_water = spool->count;
+    }
+}
+
+// Internal: Send one PUSH_DATA of spooled uplinks, oldest first
+static void spool_replay(pf_server_t *srv, uint8_t *buffer)
+{
+    pf_spool_t *spool = &srv->spool;
+    uint32_t rx_timestamps[MAX_UPLINK_BATCH];
+    int64_t start = esp_timer_get_time();
+    int offset = push_data_header(srv, buffer);
+    uint32_t pos = spool->tail;
+    int count = 0;
+
+    memcpy(&buffer[offset], "{\"rxpk\":[", 9);
+    offset += 9;
+
+    while (count < MAX_UPLINK_BATCH && count < spool->count) {
+        uint8_t hdr[SPOOL_HDR_SIZE];
+        spool_read(spool, pos, hdr, SPOOL_HDR_SIZE);
+        uint16_t len = hdr[0] | (hdr[1] << 8);
+
+        if (offset + len + 3 > UDP_BUFFER_SIZE) {
+            break;
+        }
+        if (count > 0) {
+            buffer[offset++] = ',';
+        }
+        // Fragment goes straight from PSRAM into the datagram
+        spool_read(spool, pos + SPOOL_HDR_SIZE, &buffer[offset], len);
+        offset += len;
+        memcpy(&rx_timestamps[count++], &hdr[2], sizeof(uint32_t));
+        pos += SPOOL_HDR_SIZE + len;
+    }
+
+    buffer[offset++] = ']';
+    buffer[offset++] = '}';
+
+    spool->replay_us_total += esp_timer_get_time() - start;
+    spool->replay_batches++;
+
+    // Keep the records if the send failed; the next attempt retries them
+    if (send_push_data(srv, buffer, offset, rx_timestamps, count, start) == ESP_OK) {
+        spool->tail = pos;
+        spool->count -= count;
+        spool->replayed += count;
+    }
+}
+#endif
+
+// Internal: UDP socket with the given DSCP in its IP header
+static int open_socket(int dscp)
+{
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0) {
+        return sock;
+    }
+
+    int tos = dscp << 2;
+    if (setsockopt(sock, IPPROTO_IP, IP_TOS, &tos, sizeof(tos)) != 0) {
+        ESP_LOGW(TAG, "Failed to set DSCP %d", dscp);
+    }
+
+    return sock;
+}
+
+static void close_sockets(pf_server_t *srv)
+{
+    if (srv->push_sock >= 0) {
+        close(srv->push_sock);
+        srv->push_sock = -1;
+    }
+    if (srv->pull_sock >= 0) {
+        close(srv->pull_sock);
+        srv->pull_sock = -1;
+    }
+}
+
+static void pull_path_begin(void)
+{
+    __atomic_add_fetch(&s_pf.pull_busy, 1, __ATOMIC_ACQ_REL);
+}
+
+static void pull_path_end(void)
+{
+    __atomic_sub_fetch(&s_pf.pull_busy, 1, __ATOMIC_ACQ_REL);
+}
+
+// Internal: Send on the upstream socket once the pull path is idle
+static int send_bulk(pf_server_t *srv, const uint8_t *buffer, int len)
+{
+    uint32_t held = 0;
+    while (__atomic_load_n(&s_pf.pull_busy, __ATOMIC_ACQUIRE) > 0 && held < BULK_HOLD_MAX_MS) {
+        vTaskDelay(pdMS_TO_TICKS(1));
+        held++;
+    }
+    if (held > 0) {
+        srv->bulk_held++;
+    }
+
+    return sendto(srv->push_sock, buffer, len, 0,
+                  (struct sockaddr *)&srv->addr, sizeof(srv->addr));
+}
+
+// Internal: Account a round trip from its send time, which is then cleared
+static void record_rtt(int64_t *sent_at, uint32_t *count, uint64_t *total, uint32_t *max)
+{
+    if (*sent_at == 0) {
+        return;
+    }
+
+    uint32_t rtt = esp_timer_get_time() - *sent_at;
+    *sent_at = 0;
+    (*count)++;
+    *total += rtt;
+    if (rtt > *max) {
+        *max = rtt;
+    }
+}
+
+// Internal: Write PUSH_DATA header (version, token, type, EUI)
+static int push_data_header(pf_server_t *srv, uint8_t *buffer)
+{
     int offset = 0;
 
-    // Header
     buffer[offset++] = PROTOCOL_VERSION;
-    s_pf.push_token++;
-    buffer[offset++] = (s_pf.push_token >> 8) & 0xFF;
-    buffer[offset++] = s_pf.push_token & 0xFF;
+    srv->push_token++;
+    srv->push_sent_at[srv->push_token % PUSH_ACK_WINDOW] = esp_timer_get_time();
+    buffer[offset++] = (srv->push_token >> 8) & 0xFF;
+    buffer[offset++] = srv->push_token & 0xFF;
     buffer[offset++] = PKT_PUSH_DATA;
 
     // Gateway EUI
     memcpy(&buffer[offset], s_pf.config.gateway_eui, 8);
     offset += 8;
 
-    // Build JSON payload
-    cJSON *root = cJSON_CreateObject();
-    cJSON *rxpk = cJSON_CreateArray();
+    return offset;
+}
 
-    for (int i = 0; i < count; i++) {
-        const lora_rx_packet_t *pkt = &packets[i];
-
-        cJSON *item = cJSON_CreateObject();
-        cJSON_AddNumberToObject(item, "tmst", pkt->tmst);
-        cJSON_AddNumberToObject(item, "freq", pkt->modulation.frequency / 1e6);
-        cJSON_AddNumberToObject(item, "chan", pkt->rf_chain);
-        cJSON_AddNumberToObject(item, "rfch", pkt->rf_chain);
-        cJSON_AddStringToObject(item, "stat", pkt->crc_ok ? "OK" : "CRC");
-        cJSON_AddStringToObject(item, "modu", "LORA");
-        cJSON_AddStringToObject(item, "datr", get_datr_string(pkt->modulation.spreading_factor,
-                                                              pkt->modulation.bandwidth));
-        cJSON_AddStringToObject(item, "codr", get_codr_string(pkt->modulation.coding_rate));
-        cJSON_AddNumberToObject(item, "rssi", pkt->rssi);
-        cJSON_AddNumberToObject(item, "lsnr", pkt->snr);
-        cJSON_AddNumberToObject(item, "size", pkt->payload_size);
-
-        // Base64 encode payload
-        char b64[512];
-        encode_base64(pkt->payload, pkt->payload_size, b64);
-        cJSON_AddStringToObject(item, "data", b64);
-
-        cJSON_AddItemToArray(rxpk, item);
-    }
-
-    cJSON_AddItemToObject(root, "rxpk", rxpk);
-
-    char *json = cJSON_PrintUnformatted(root);
-    int json_len = strlen(json);
-    cJSON_Delete(root);
-
-    if (offset + json_len >= UDP_BUFFER_SIZE) {
-        ESP_LOGE(TAG, "PUSH_DATA too large");
-        free(json);
-        return ESP_ERR_NO_MEM;
+// Internal: Send assembled PUSH_DATA packet
+static esp_err_t send_push_data(pf_server_t *srv, const uint8_t *buffer, int len,
+                                const uint32_t *rx_timestamps, int count, int64_t start)
+{
+    if (srv->push_sock < 0 || count == 0) {
+        return ESP_ERR_INVALID_STATE;
     }
 
-    memcpy(&buffer[offset], json, json_len);
-    offset += json_len;
-    free(json);
+    int sent = send_bulk(srv, buffer, len);
+
+    int64_t now = esp_timer_get_time();
+    uint32_t elapsed = now - start;
+    srv->assemble_us_total += elapsed;
+    if (elapsed > srv->assemble_us_max) {
+        srv->assemble_us_max = elapsed;
+    }
 
-    // Send
-    int sent = sendto(s_pf.sock, buffer, offset, 0,
-                      (struct sockaddr *)&s_pf.server_addr, sizeof(s_pf.server_addr));
-    if (sent != offset) {
-        ESP_LOGE(TAG, "PUSH_DATA send failed");
+    if (sent != len) {
+        ESP_LOGE(TAG, "PUSH_DATA send failed (server %d)", srv->index);
         return ESP_FAIL;
     }
 
-    s_pf.push_sent++;
-    ESP_LOGI(TAG, "PUSH_DATA sent (%d packets, %d bytes)", count, offset);
+    // Forward latency: radio RX to datagram handed to the network stack
+    for (int i = 0; i < count; i++) {
+        uint32_t latency = (uint32_t)now - rx_timestamps[i];
+        srv->latency_us_total += latency;
+        if (latency > srv->latency_us_max) {
+            srv->latency_us_max = latency;
+        }
+    }
+
+    srv->push_sent++;
+    srv->batches_sent++;
+    srv->uplinks_sent += count;
+    gw_trace(GW_TRACE_PUSH_SENT, count, srv->index);
+    ESP_LOGI(TAG, "PUSH_DATA sent (server %d, %d packets, %d bytes)", srv->index, count, len);
 
     return ESP_OK;
 }
 
 // Internal: Send PULL_DATA packet
-static esp_err_t send_pull_data(void)
+static esp_err_t send_pull_data(pf_server_t *srv)
 {
-    if (s_pf.sock < 0) {
+    if (srv->pull_sock < 0) {
         return ESP_ERR_INVALID_STATE;
     }
 
     uint8_t buffer[12];
 
     buffer[0] = PROTOCOL_VERSION;
-    s_pf.pull_token++;
-    buffer[1] = (s_pf.pull_token >> 8) & 0xFF;
-    buffer[2] = s_pf.pull_token & 0xFF;
+    srv->pull_token++;
+    buffer[1] = (srv->pull_token >> 8) & 0xFF;
+    buffer[2] = srv->pull_token & 0xFF;
     buffer[3] = PKT_PULL_DATA;
     memcpy(&buffer[4], s_pf.config.gateway_eui, 8);
 
-    int sent = sendto(s_pf.sock, buffer, 12, 0,
-                      (struct sockaddr *)&s_pf.server_addr, sizeof(s_pf.server_addr));
+    // Runs in the timer task: hold the bulk senders that would preempt it
+    pull_path_begin();
+    srv->pull_sent_at = esp_timer_get_time();
+    int sent = sendto(srv->pull_sock, buffer, 12, 0,
+                      (struct sockaddr *)&srv->addr, sizeof(srv->addr));
+    pull_path_end();
     if (sent != 12) {
-        ESP_LOGE(TAG, "PULL_DATA send failed");
+        ESP_LOGE(TAG, "PULL_DATA send failed (server %d)", srv->index);
         return ESP_FAIL;
     }
 
-    s_pf.pull_sent++;
-    ESP_LOGD(TAG, "PULL_DATA sent (token: %04X)", s_pf.pull_token);
+    srv->pull_sent++;
+    ESP_LOGD(TAG, "PULL_DATA sent (server %d, token: %04X)", srv->index, srv->pull_token);
 
     return ESP_OK;
 }
 
 // Internal: Send TX_ACK packet
-static esp_err_t send_tx_ack(uint16_t token, const char *error)
+static esp_err_t send_tx_ack(pf_server_t *srv, uint16_t token, const char *error)
 {
-    if (s_pf.sock < 0) {
+    if (srv->pull_sock < 0) {
         return ESP_ERR_INVALID_STATE;
     }
 
@@ -470,28 +1367,20 @@ static esp_err_t send_tx_ack(uint16_t token, const char *error)
     offset += 8;
 
     // Add JSON payload with error if present
-    if (error) {
-        cJSON *root = cJSON_CreateObject();
-        cJSON *txpk_ack = cJSON_CreateObject();
-        cJSON_AddStringToObject(txpk_ack, "error", error);
-        cJSON_AddItemToObject(root, "txpk_ack", txpk_ack);
-
-        char *json = cJSON_PrintUnformatted(root);
-        strcpy((char *)&buffer[offset], json);
-        offset += strlen(json);
-        free(json);
-        cJSON_Delete(root);
+    int len = lora_codec_encode_tx_ack(error, (char *)&buffer[offset], sizeof(buffer) - offset);
+    if (len > 0) {
+        offset += len;
     }
 
-    sendto(s_pf.sock, buffer, offset, 0,
-           (struct sockaddr *)&s_pf.server_addr, sizeof(s_pf.server_addr));
+    sendto(srv->pull_sock, buffer, offset, 0,
+           (struct sockaddr *)&srv->addr, sizeof(srv->addr));
 
-    ESP_LOGD(TAG, "TX_ACK sent (error: %s)", error ? error : "none");
+    ESP_LOGD(TAG, "TX_ACK sent (server %d, error: %s)", srv->index, error ? error : "none");
     return ESP_OK;
 }
 
 // Internal: Handle PULL_RESP (downlink)
-static void handle_pull_resp(const uint8_t *data, int len)
+static void handle_pull_resp(pf_server_t *srv, const uint8_t *data, int len)
 {
     if (len < 4) {
         return;
@@ -499,74 +1388,33 @@ static void handle_pull_resp(const uint8_t *data, int len)
 
     uint16_t token = (data[1] << 8) | data[2];
     const char *json_str = (const char *)&data[4];
+    int64_t received = esp_timer_get_time();
 
     ESP_LOGI(TAG, "PULL_RESP JSON: %s", json_str);
 
-    cJSON *root = cJSON_Parse(json_str);
-    if (!root) {
+    lora_tx_packet_t tx_pkt;
+    esp_err_t err = lora_codec_parse_txpk(json_str, &tx_pkt);
+    if (err == ESP_ERR_INVALID_ARG) {
         ESP_LOGE(TAG, "Invalid JSON in PULL_RESP");
-        send_tx_ack(token, "INVALID_JSON");
+        send_tx_ack(srv, token, "INVALID_JSON");
         return;
     }
-
-    cJSON *txpk = cJSON_GetObjectItem(root, "txpk");
-    if (!txpk) {
+    if (err == ESP_ERR_NOT_FOUND) {
         ESP_LOGE(TAG, "Missing txpk in PULL_RESP");
-        cJSON_Delete(root);
-        send_tx_ack(token, "MISSING_TXPK");
+        send_tx_ack(srv, token, "MISSING_TXPK");
         return;
     }
-
-    // Parse downlink parameters
-    lora_tx_packet_t tx_pkt = {0};
-
-    cJSON *imme = cJSON_GetObjectItem(txpk, "imme");
-    tx_pkt.immediate = imme && cJSON_IsTrue(imme);
-
-    cJSON *tmst = cJSON_GetObjectItem(txpk, "tmst");
-    if (tmst && cJSON_IsNumber(tmst)) {
-        tx_pkt.tx_timestamp = (uint32_t)tmst->valuedouble;
-    }
-
-    cJSON *freq = cJSON_GetObjectItem(txpk, "freq");
-    if (freq && cJSON_IsNumber(freq)) {
-        tx_pkt.modulation.frequency = (uint32_t)(freq->valuedouble * 1e6);
-    }
-
-    cJSON *powe = cJSON_GetObjectItem(txpk, "powe");
-    tx_pkt.tx_power = powe ? powe->valueint : 14;
-
-    cJSON *datr = cJSON_GetObjectItem(txpk, "datr");
-    if (datr && cJSON_IsString(datr)) {
-        // Parse "SF7BW125" format
-        int sf, bw;
-        if (sscanf(datr->valuestring, "SF%dBW%d", &sf, &bw) == 2) {
-            tx_pkt.modulation.spreading_factor = sf;
-            tx_pkt.modulation.bandwidth = (bw == 500) ? 2 : (bw == 250) ? 1 : 0;
-        }
-    }
-
-    cJSON *codr = cJSON_GetObjectItem(txpk, "codr");
-    if (codr && cJSON_IsString(codr)) {
-        // Parse "4/5" format
-        int num, den;
-        if (sscanf(codr->valuestring, "%d/%d", &num, &den) == 2) {
-            tx_pkt.modulation.coding_rate = den - 4;
-        }
-    }
-
-    cJSON *ipol = cJSON_GetObjectItem(txpk, "ipol");
-    tx_pkt.modulation.invert_polarity = ipol && cJSON_IsTrue(ipol);
-
-    cJSON *data_b64 = cJSON_GetObjectItem(txpk, "data");
-    if (data_b64 && cJSON_IsString(data_b64)) {
-        tx_pkt.payload_size = decode_base64(data_b64->valuestring,
-                                            tx_pkt.payload,
-                                            LORA_MAX_PAYLOAD_SIZE);
+    gw_trace(GW_TRACE_PULL_RESP, tx_pkt.tx_timestamp, srv->index);
+
+    // Only the server that owns the device may schedule its downlinks
+    int owner = route_downlink(tx_pkt.payload, tx_pkt.payload_size);
+    if (owner >= 0 && owner != srv->index) {
+        ESP_LOGW(TAG, "Downlink from server %d for device owned by server %d rejected",
+                 srv->index, owner);
+        send_tx_ack(srv, token, "ROUTE_MISMATCH");
+        return;
     }
 
-    cJSON_Delete(root);
-
     ESP_LOGI(TAG, "TX request: freq=%.2f MHz, SF%d, %d bytes, %s",
              tx_pkt.modulation.frequency / 1e6,
              tx_pkt.modulation.spreading_factor,
@@ -576,9 +1424,16 @@ static void handle_pull_resp(const uint8_t *data, int len)
     // Send to gateway
     esp_err_t ret = lora_gateway_send(&tx_pkt);
     if (ret == ESP_OK) {
-        send_tx_ack(token, NULL);
+        send_tx_ack(srv, token, NULL);
     } else {
-        send_tx_ack(token, "TX_FAILED");
+        send_tx_ack(srv, token, "TX_FAILED");
+    }
+
+    uint32_t turnaround = esp_timer_get_time() - received;
+    srv->tx_acks++;
+    srv->tx_ack_us_total += turnaround;
+    if (turnaround > srv->tx_ack_us_max) {
+        srv->tx_ack_us_max = turnaround;
     }
 }
 
@@ -589,18 +1444,53 @@ static void keepalive_callback(TimerHandle_t timer)
         return;
     }
 
-    send_pull_data();
-
-    // Check connection status
     int64_t now = esp_timer_get_time();
-    if (now - s_pf.last_pull_ack > 30000000) {  // 30 seconds
-        if (s_pf.status.connected) {
-            ESP_LOGW(TAG, "Server connection lost");
-            s_pf.status.connected = false;
+
+    for (int i = 0; i < s_pf.config.num_servers; i++) {
+        pf_server_t *srv = &s_pf.servers[i];
+
+        send_pull_data(srv);
+
+        // Check connection status
+        if (now - srv->last_pull_ack > 30000000) {  // 30 seconds
+            if (srv->status.connected) {
+                ESP_LOGW(TAG, "Server %d connection lost", i);
+                srv->status.connected = false;
+            }
         }
     }
 }
 
+// Internal: Send gateway statistics to one server
+static void send_stat(pf_server_t *srv, const gateway_stats_t *gw_stats, const char *extra)
+{
+    if (srv->push_sock < 0) {
+        return;
+    }
+
+    // Static: the timer daemon's stack is small (only stat_callback calls this)
+    static uint8_t buffer[UDP_BUFFER_SIZE];
+    int offset = push_data_header(srv, buffer);
+
+    // ACK ratio of this server's PUSH_DATA
+    double ackr = (srv->push_sent > 0) ?
+                  (100.0 * srv->status.push_ack / srv->push_sent) : 100.0;
+
+    int len = lora_codec_encode_stat(gw_stats, ackr, extra, (char *)&buffer[offset],
+                                     sizeof(buffer) - offset);
+    if (len < 0) {
+        return;
+    }
+    offset += len;
+
+    // Not send_bulk(): this runs on the timer daemon, which must not wait
+    sendto(srv->push_sock, buffer, offset, 0, (struct sockaddr *)&srv->addr, sizeof(srv->addr));
+
+    srv->push_sent++;
+    ESP_LOGD(TAG, "Stats sent to server %d: rx=%lu, tx=%lu",
+             srv->index, gw_stats->rx_total, gw_stats->tx_total);
+}
+
 // Internal: Statistics timer callback
 static void stat_callback(TimerHandle_t timer)
 {
@@ -608,114 +1498,196 @@ static void stat_callback(TimerHandle_t timer)
         return;
     }
 
-    // Send gateway statistics
-    gateway_stats_t gw_stats;
+    // Send gateway statistics to every server (static, as in send_stat)
+    static gateway_stats_t gw_stats;
     lora_gateway_get_stats(&gw_stats);
 
-    uint8_t buffer[UDP_BUFFER_SIZE];
-    int offset = 0;
+    // A trace recovered from before the last reset rides along once
+    const char *postmortem = gw_trace_postmortem_json();
 
-    buffer[offset++] = PROTOCOL_VERSION;
-    s_pf.push_token++;
-    buffer[offset++] = (s_pf.push_token >> 8) & 0xFF;
-    buffer[offset++] = s_pf.push_token & 0xFF;
-    buffer[offset++] = PKT_PUSH_DATA;
-    memcpy(&buffer[offset], s_pf.config.gateway_eui, 8);
-    offset += 8;
+    for (int i = 0; i < s_pf.config.num_servers; i++) {
+        send_stat(&s_pf.servers[i], &gw_stats, postmortem);
+    }
 
-    // Build stats JSON
-    cJSON *root = cJSON_CreateObject();
-    cJSON *stat = cJSON_CreateObject();
+    if (postmortem) {
+        gw_trace_postmortem_clear();
+    }
+}
 
-    // Get current time
-    time_t now;
-    time(&now);
-    char time_str[32];
-    strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S GMT", gmtime(&now));
-    cJSON_AddStringToObject(stat, "time", time_str);
+// Internal: Insert a DevAddr prefix into the routing trie
+static esp_err_t route_insert(uint32_t prefix, uint8_t len, uint8_t server)
+{
+    route_node_t *nodes = s_pf.route_nodes;
+    uint8_t node = 0;
+    int shift = 24;
+
+    // Walk/create full 8-bit levels
+    while (len > 8) {
+        uint8_t idx = (prefix >> shift) & 0xFF;
+        uint8_t entry = nodes[node].next[idx];
+
+        if (!(entry & ROUTE_CHILD)) {
+            if (s_pf.route_node_count >= ROUTE_MAX_NODES) {
+                return ESP_ERR_NO_MEM;
+            }
+            // Child inherits the shorter prefix that covered this slot
+            uint8_t child = s_pf.route_node_count++;
+            memset(nodes[child].next, entry, sizeof(nodes[child].next));
+            nodes[node].next[idx] = ROUTE_CHILD | child;
+            entry = nodes[node].next[idx];
+        }
 
-    cJSON_AddNumberToObject(stat, "rxnb", gw_stats.rx_total);
-    cJSON_AddNumberToObject(stat, "rxok", gw_stats.rx_ok);
-    cJSON_AddNumberToObject(stat, "rxfw", gw_stats.rx_forwarded);
-    cJSON_AddNumberToObject(stat, "ackr", 100.0);  // ACK ratio
-    cJSON_AddNumberToObject(stat, "dwnb", gw_stats.tx_total);
-    cJSON_AddNumberToObject(stat, "txnb", gw_stats.tx_ok);
+        node = entry & ~ROUTE_CHILD;
+        len -= 8;
+        shift -= 8;
+    }
 
-    cJSON_AddItemToObject(root, "stat", stat);
+    // Expand the remaining 1-8 bits over all matching slots
+    uint8_t first = ((prefix >> shift) & 0xFF) & (uint8_t)(0xFF << (8 - len));
+    int span = 1 << (8 - len);
+    for (int i = first; i < first + span; i++) {
+        if (!(nodes[node].next[i] & ROUTE_CHILD)) {
+            nodes[node].next[i] = server;
+        }
+    }
 
-    char *json = cJSON_PrintUnformatted(root);
-    strcpy((char *)&buffer[offset], json);
-    offset += strlen(json);
-    free(json);
-    cJSON_Delete(root);
+    return ESP_OK;
+}
 
-    sendto(s_pf.sock, buffer, offset, 0,
-           (struct sockaddr *)&s_pf.server_addr, sizeof(s_pf.server_addr));
+// Internal: Compile routes into the DevAddr trie
+static esp_err_t compile_routes(void)
+{
+    bool has_devaddr = false;
 
-    ESP_LOGD(TAG, "Stats sent: rx=%lu, tx=%lu", gw_stats.rx_total, gw_stats.tx_total);
-}
+    for (int i = 0; i < s_pf.config.num_routes; i++) {
+        const pkt_fwd_route_t *route = &s_pf.config.routes[i];
+        if (route->server >= s_pf.config.num_servers) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        if (route->type == PKT_FWD_ROUTE_DEVADDR) {
+            if (route->prefix_len == 0 || route->prefix_len > 32) {
+                return ESP_ERR_INVALID_ARG;
+            }
+            has_devaddr = true;
+        }
+    }
 
-// Internal: Base64 encoding
-static const char b64_table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    if (!has_devaddr) {
+        return ESP_OK;
+    }
 
-static void encode_base64(const uint8_t *data, int len, char *output)
-{
-    int i, j;
-    for (i = 0, j = 0; i < len; i += 3) {
-        uint32_t n = ((uint32_t)data[i]) << 16;
-        if (i + 1 < len) n |= ((uint32_t)data[i + 1]) << 8;
-        if (i + 2 < len) n |= data[i + 2];
+    s_pf.route_nodes = calloc(ROUTE_MAX_NODES, sizeof(route_node_t));
+    if (!s_pf.route_nodes) {
+        return ESP_ERR_NO_MEM;
+    }
+    memset(s_pf.route_nodes[0].next, ROUTE_NONE, sizeof(s_pf.route_nodes[0].next));
+    s_pf.route_node_count = 1;
+
+    // Shorter prefixes first, so more specific routes override them
+    for (uint8_t len = 1; len <= 32; len++) {
+        for (int i = 0; i < s_pf.config.num_routes; i++) {
+            const pkt_fwd_route_t *route = &s_pf.config.routes[i];
+            if (route->type != PKT_FWD_ROUTE_DEVADDR || route->prefix_len != len) {
+                continue;
+            }
 
-        output[j++] = b64_table[(n >> 18) & 0x3F];
-        output[j++] = b64_table[(n >> 12) & 0x3F];
-        output[j++] = (i + 1 < len) ? b64_table[(n >> 6) & 0x3F] : '=';
-        output[j++] = (i + 2 < len) ? b64_table[n & 0x3F] : '=';
+            esp_err_t ret = route_insert(route->devaddr_prefix, len, route->server);
+            if (ret != ESP_OK) {
+                free(s_pf.route_nodes);
+                s_pf.route_nodes = NULL;
+                return ret;
+            }
+
+            ESP_LOGI(TAG, "Route: DevAddr %08lX/%d -> server %d",
+                     route->devaddr_prefix, len, route->server);
+        }
     }
-    output[j] = '\0';
+
+    ESP_LOGI(TAG, "Routing table compiled (%d nodes)", s_pf.route_node_count);
+    return ESP_OK;
 }
 
-static int decode_base64(const char *input, uint8_t *output, int max_len)
+// Internal: Constant-time DevAddr lookup, -1 if no route matches
+static int route_lookup_devaddr(uint32_t devaddr)
 {
-    int len = strlen(input);
-    int out_len = 0;
+    if (!s_pf.route_nodes) {
+        return -1;
+    }
 
-    for (int i = 0; i < len && out_len < max_len; i += 4) {
-        uint32_t n = 0;
-        for (int j = 0; j < 4 && (i + j) < len; j++) {
-            char c = input[i + j];
-            uint8_t v = 0;
-            if (c >= 'A' && c <= 'Z') v = c - 'A';
-            else if (c >= 'a' && c <= 'z') v = c - 'a' + 26;
-            else if (c >= '0' && c <= '9') v = c - '0' + 52;
-            else if (c == '+') v = 62;
-            else if (c == '/') v = 63;
-            else if (c == '=') v = 0;
-            n = (n << 6) | v;
+    uint8_t node = 0;
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        uint8_t entry = s_pf.route_nodes[node].next[(devaddr >> shift) & 0xFF];
+        if (!(entry & ROUTE_CHILD)) {
+            return (entry == ROUTE_NONE) ? -1 : entry;
         }
+        node = entry & ~ROUTE_CHILD;
+    }
 
-        if (out_len < max_len) output[out_len++] = (n >> 16) & 0xFF;
-        if (out_len < max_len && input[i + 2] != '=') output[out_len++] = (n >> 8) & 0xFF;
-        if (out_len < max_len && input[i + 3] != '=') output[out_len++] = n & 0xFF;
+    return -1;
+}
+
+// Internal: JoinEUI range lookup (join requests are rare, ranges are few)
+static int route_lookup_join_eui(uint64_t join_eui)
+{
+    for (int i = 0; i < s_pf.config.num_routes; i++) {
+        const pkt_fwd_route_t *route = &s_pf.config.routes[i];
+        if (route->type == PKT_FWD_ROUTE_JOIN_EUI &&
+            join_eui >= route->join_eui_min && join_eui <= route->join_eui_max) {
+            return route->server;
+        }
     }
 
-    return out_len;
+    return -1;
+}
+
+static uint32_t read_le32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
 }
 
-static const char *get_datr_string(uint8_t sf, uint8_t bw)
+// Internal: Select the server for an uplink
+static uint8_t route_uplink(const lora_rx_packet_t *packet)
 {
-    static char datr[16];
-    int bw_khz = (bw == 2) ? 500 : (bw == 1) ? 250 : 125;
-    snprintf(datr, sizeof(datr), "SF%dBW%d", sf, bw_khz);
-    return datr;
+    int server = -1;
+
+    if (packet->payload_size >= 5) {
+        switch (packet->payload[0] >> 5) {
+            case LORA_MTYPE_JOIN_REQUEST:
+                if (packet->payload_size >= 9) {
+                    uint64_t join_eui = read_le32(&packet->payload[1]) |
+                                        ((uint64_t)read_le32(&packet->payload[5]) << 32);
+                    server = route_lookup_join_eui(join_eui);
+                }
+                break;
+
+            case LORA_MTYPE_UNCONF_DATA_UP:
+            case LORA_MTYPE_CONF_DATA_UP:
+                server = route_lookup_devaddr(read_le32(&packet->payload[1]));
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    return (server < 0) ? s_pf.config.default_server : server;
 }
 
-static const char *get_codr_string(uint8_t cr)
+// Internal: Owning server of a downlink, -1 if any server may send it
+static int route_downlink(const uint8_t *payload, int len)
 {
-    switch (cr) {
-        case 1: return "4/5";
-        case 2: return "4/6";
-        case 3: return "4/7";
-        case 4: return "4/8";
-        default: return "4/5";
+    if (len < 5) {
+        return -1;
+    }
+
+    uint8_t mtype = payload[0] >> 5;
+    if (mtype != LORA_MTYPE_UNCONF_DATA_DOWN && mtype != LORA_MTYPE_CONF_DATA_DOWN) {
+        // Join accepts are encrypted, ownership cannot be checked
+        return -1;
     }
+
+    int server = route_lookup_devaddr(read_le32(&payload[1]));
+    return (server < 0) ? s_pf.config.default_server : server;
 }
+
+#endif // !CONFIG_PKT_FWD_BACKEND_MQTT
@@ -1,6 +1,9 @@
 /**
  * @file packet_forwarder.h
- * @brief Semtech UDP Packet Forwarder Protocol
+ * @brief Packet forwarder interface
+ *
+ * Implemented by the Semtech UDP forwarder (packet_forwarder.c) or, with
+ * CONFIG_PKT_FWD_BACKEND_MQTT, by the MQTT backend (mqtt_forwarder.c).
  */
 
 #ifndef PACKET_FORWARDER_H
@@ -10,17 +13,115 @@
 #include <stdbool.h>
 #include "esp_err.h"
 #include "lora_packet.h"
+#include "spsc_ring.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+#define PKT_FWD_MAX_SERVERS     2
+#define PKT_FWD_MAX_ROUTES      8
+
+/**
+ * @brief Upstream network server
+ */
+typedef struct {
+    char host[64];
+    uint16_t port;
+} pkt_fwd_server_t;
+
+/**
+ * @brief Uplink route match type
+ */
+typedef enum {
+    PKT_FWD_ROUTE_DEVADDR = 0,  // Data frames matched by DevAddr prefix (NetID)
+    PKT_FWD_ROUTE_JOIN_EUI      // Join requests matched by JoinEUI range
+} pkt_fwd_route_type_t;
+
+/**
+ * @brief Uplink routing rule
+ */
+typedef struct {
+    pkt_fwd_route_type_t type;
+    uint32_t devaddr_prefix;    // DevAddr prefix, left-aligned (DEVADDR)
+    uint8_t prefix_len;         // Prefix length in bits, 1-32 (DEVADDR)
+    uint64_t join_eui_min;      // First JoinEUI of the range (JOIN_EUI)
+    uint64_t join_eui_max;      // Last JoinEUI of the range (JOIN_EUI)
+    uint8_t server;             // Index into pkt_fwd_config_t.servers
+} pkt_fwd_route_t;
+
+/**
+ * @brief Uplink forwarding cost, split by pipeline stage
+ */
+typedef struct {
+    uint32_t encoded;           // Uplinks encoded to rxpk (bus subscriber, core 1)
+    uint32_t encode_avg_us;
+    uint32_t encode_max_us;
+    uint32_t uplinks;           // Uplinks sent in PUSH_DATA
+    uint32_t datagrams;         // PUSH_DATA rxpk datagrams sent
+    uint32_t assemble_avg_us;   // Assembly + sendto per datagram (forwarder, core 0)
+    uint32_t assemble_max_us;
+    uint32_t latency_avg_us;    // Radio RX to PUSH_DATA sent
+    uint32_t latency_max_us;
+} pkt_fwd_perf_t;
+
+/**
+ * @brief Outage spool statistics (CONFIG_PKT_FWD_PSRAM_SPOOL)
+ */
+typedef struct {
+    uint32_t records;           // Uplinks currently held
+    uint32_t bytes_used;
+    uint32_t capacity;          // Spool size in bytes
+    uint32_t spooled;           // Uplinks stored while disconnected
+    uint32_t replayed;          // Uplinks sent after reconnect
+    uint32_t overwritten;       // Oldest uplinks dropped when full
+    uint32_t high_water;        // Maximum records held
+    uint32_t replay_avg_us;     // PSRAM read + assembly per replay datagram
+} pkt_fwd_spool_stats_t;
+
+/**
+ * @brief Latency per traffic class of a server
+ *
+ * The pull path (PULL_DATA, PULL_RESP, TX_ACK) uses its own DSCP-marked
+ * socket; the push path (PUSH_DATA, stat) is the bulk class.
+ */
+typedef struct {
+    uint32_t pull_rtts;         // PULL_DATA to PULL_ACK
+    uint32_t pull_rtt_avg_us;
+    uint32_t pull_rtt_max_us;
+    uint32_t push_rtts;         // PUSH_DATA to PUSH_ACK
+    uint32_t push_rtt_avg_us;
+    uint32_t push_rtt_max_us;
+    uint32_t tx_acks;           // PULL_RESP received to TX_ACK sent
+    uint32_t tx_ack_avg_us;
+    uint32_t tx_ack_max_us;
+    uint32_t bulk_held;         // Bulk sends held back for the pull path
+} pkt_fwd_class_stats_t;
+
+/**
+ * @brief MQTT backend statistics (CONFIG_PKT_FWD_BACKEND_MQTT)
+ */
+typedef struct {
+    uint32_t published;         // QoS 1 uplink publishes
+    uint32_t acked;             // PUBACKs received
+    uint32_t lost;              // Dropped from the client outbox unacknowledged
+    uint32_t in_flight;         // Publishes waiting for their PUBACK
+    uint32_t window;            // Maximum publishes in flight
+    uint32_t window_stalls;     // Waits for a free slot in the window
+    uint32_t ack_avg_us;        // Publish to PUBACK
+    uint32_t ack_max_us;
+    uint32_t downlinks;         // txpk received on the command topic
+} pkt_fwd_mqtt_stats_t;
+
 /**
  * @brief Packet forwarder configuration
  */
 typedef struct {
-    char server_host[64];
-    uint16_t server_port;
+    pkt_fwd_server_t servers[PKT_FWD_MAX_SERVERS];
+    uint8_t num_servers;
+    uint8_t default_server;     // Server for frames no route matches
+    pkt_fwd_route_t routes[PKT_FWD_MAX_ROUTES];
+    uint8_t num_routes;
     uint8_t gateway_eui[8];
     uint32_t keepalive_interval_ms;
     uint32_t stat_interval_ms;
@@ -49,7 +150,22 @@ esp_err_t pkt_fwd_start(void);
 esp_err_t pkt_fwd_stop(void);
 
 /**
- * @brief Send uplink packet to server
+ * @brief Stop the packet forwarder and release it
+ *
+ * pkt_fwd_init() may be called again afterwards, with another
+ * configuration (the soak test runs it against a loopback server first).
+ *
+ * @return ESP_OK on success
+ */
+esp_err_t pkt_fwd_deinit(void);
+
+/**
+ * @brief Send uplink packet to the server that owns it
+ *
+ * The rxpk JSON is encoded in the caller's context (the uplink bus
+ * forwarder subscriber, on core 1), so the forwarder task only
+ * concatenates pre-encoded fragments. Single producer: call it from that
+ * one task only.
  *
  * @param packet Received packet
  * @return ESP_OK on success
@@ -64,13 +180,112 @@ esp_err_t pkt_fwd_send_uplink(const lora_rx_packet_t *packet);
  */
 esp_err_t pkt_fwd_get_status(forwarder_status_t *status);
 
+/**
+ * @brief Get uplink forwarding cost per stage
+ *
+ * @param perf Output counters
+ * @return ESP_OK on success
+ */
+esp_err_t pkt_fwd_get_perf(pkt_fwd_perf_t *perf);
+
+/**
+ * @brief Get uplink ring statistics of a single server
+ *
+ * @param server Server index
+ * @param stats Output statistics (gw_rx_task -> server TX task handoff)
+ * @return ESP_OK on success
+ */
+esp_err_t pkt_fwd_get_ring_stats(uint8_t server, spsc_ring_stats_t *stats);
+
+/**
+ * @brief Get outage spool statistics of a single server
+ *
+ * While a server is disconnected its uplinks are held in a PSRAM spool
+ * and replayed, oldest first, once PULL_ACKs resume.
+ *
+ * @param server Server index
+ * @param stats Output statistics
+ * @return ESP_OK on success, ESP_ERR_NOT_SUPPORTED without a spool
+ */
+esp_err_t pkt_fwd_get_spool_stats(uint8_t server, pkt_fwd_spool_stats_t *stats);
+
+/**
+ * @brief Get pull and push path latencies of a single server
+ *
+ * @param server Server index
+ * @param stats Output statistics
+ * @return ESP_OK on success
+ */
+esp_err_t pkt_fwd_get_class_stats(uint8_t server, pkt_fwd_class_stats_t *stats);
+
+/**
+ * @brief Get MQTT publish window statistics
+ *
+ * @param stats Output statistics
+ * @return ESP_OK on success, ESP_ERR_NOT_SUPPORTED with the UDP backend
+ */
+esp_err_t pkt_fwd_get_mqtt_stats(pkt_fwd_mqtt_stats_t *stats);
+
+#ifdef CONFIG_PKT_FWD_BACKEND_MQTT
+/**
+ * @brief Measure MQTT uplink throughput and PUBACK latency
+ *
+ * Pushes synthetic uplinks through the normal forwarding path as fast as
+ * the uplink ring accepts them, waits for every publish to be acknowledged
+ * and prints the result as one JSON line on the console. Meant to be run
+ * against a local broker (e.g. mosquitto) with the forwarder started.
+ *
+ * @param uplinks Number of uplinks to send
+ * @return ESP_OK on success, ESP_ERR_TIMEOUT if the broker is unreachable
+ *         or acknowledgements are missing
+ */
+esp_err_t pkt_fwd_mqtt_benchmark(uint32_t uplinks);
+#endif
+
+#ifdef CONFIG_PKT_FWD_BURST_BENCHMARK
+/**
+ * @brief Measure UDP forwarding cost and CPU load per core under bursts
+ *
+ * A task on core 1 encodes bursts of synthetic uplinks back to back, as
+ * the uplink bus subscriber would, while the forwarder on core 0 sends
+ * them. Prints encode and assembly cost, RX-to-send latency and the busy
+ * share of each core (from the idle tasks' run time) as one JSON line.
+ * Meant to be run against a test server with the forwarder started.
+ *
+ * @param bursts Number of bursts
+ * @param burst_size Uplinks per burst
+ * @return ESP_OK on success, ESP_ERR_TIMEOUT if no server is reachable or
+ *         uplinks were not sent
+ */
+esp_err_t pkt_fwd_burst_benchmark(uint32_t bursts, uint32_t burst_size);
+#endif
+
+/**
+ * @brief Get status of a single upstream server
+ *
+ * @param server Server index
+ * @param status Output status
+ * @return ESP_OK on success
+ */
+esp_err_t pkt_fwd_get_server_status(uint8_t server, forwarder_status_t *status);
+
 /**
  * @brief Check if connected to server
  *
- * @return true if connected
+ * @return true if at least one server is connected
  */
 bool pkt_fwd_is_connected(void);
 
+/**
+ * @brief Build a DevAddr route from a LoRaWAN NetID
+ *
+ * @param netid 24-bit NetID (type in the 3 MSBs)
+ * @param server Server index that owns the NetID
+ * @param route Output route
+ * @return ESP_OK on success
+ */
+esp_err_t pkt_fwd_route_from_netid(uint32_t netid, uint8_t server, pkt_fwd_route_t *route);
+
 #ifdef __cplusplus
 }
 #endif
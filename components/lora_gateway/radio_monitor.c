@@ -0,0 +1,371 @@
+/**
+ * @file radio_monitor.c
+ * @brief Radio health monitoring
+ *
+ * Tracks the RX noise floor and the die temperature of both radios, and
+ * re-runs image calibration when the temperature drifts. Also picks an
+ * LNA/AGC gain profile per RX channel from its noise floor and blocking
+ * rate, and keeps the CRC-OK rate each profile achieved. All radio
+ * access happens from radio_monitor_poll_tx() and radio_monitor_poll_rx(),
+ * which the channel manager calls only in idle gaps (no downlink pending);
+ * the RX part only while it holds RX channel control outside listen
+ * windows, and its FSK visits only while the RX modem is not busy.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include "lora_gateway.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+static const char *TAG = "radio_mon";
+
+#define NOISE_SAMPLES           4       // RSSI reads per noise measurement
+#define NOISE_EWMA_SHIFT        4       // Noise floor smoothing (1/16)
+#define NOISE_SETTLE_US         5000000 // Noise floor settle time after recal
+
+#define BLOCKING_MARGIN_DB      15      // Idle sample this far above floor = blocker
+#define BLOCKING_WINDOW         256     // Samples before blocking counters decay
+#define GAIN_HOLD_POLLS         50      // Target must persist this long (~5 s idle)
+#define GAIN_EVAL_PACKETS       32      // Packets before a profile's CRC rate counts
+#define GAIN_CRC_MARGIN_PCT     5       // CRC-OK advantage needed to override noise rule
+
+enum { MON_RX = 0, MON_TX, MON_RADIOS };
+
+// Gain profiles, from most sensitive to most linear
+static const sx1276_rx_gain_t s_profiles[GAIN_PROFILE_COUNT] = {
+    { SX1276_LNA_AGC, true },   // Quiet sites: AGC with LNA boost
+    { SX1276_LNA_AGC, false },  // AGC, boost off
+    { SX1276_LNA_G2, false },   // Fixed -6 dB
+    { SX1276_LNA_G3, false },   // Fixed -12 dB: strong nearby interferers
+};
+
+// Per-channel gain control state
+typedef struct {
+    int32_t noise_x16;          // Noise floor, dBm * 16
+    bool noise_valid;
+    uint32_t samples;
+    uint32_t blocked;           // Samples BLOCKING_MARGIN_DB above floor
+
+    uint8_t profile;            // Selected profile
+    uint8_t target;             // Candidate profile
+    uint16_t target_polls;      // How long the candidate has been stable
+    uint32_t switches;
+
+    uint32_t rx_ok[GAIN_PROFILE_COUNT];
+    uint32_t rx_total[GAIN_PROFILE_COUNT];
+} channel_gain_t;
+
+// Monitor state
+typedef struct {
+    sx1276_handle_t radio[MON_RADIOS];
+    bool initialized;
+
+    // Temperature tracking
+    int64_t last_temp_check;
+    bool temp_due[MON_RADIOS];
+    int8_t temperature[MON_RADIOS];
+    int8_t cal_temperature[MON_RADIOS];
+    bool cal_pending[MON_RADIOS];
+
+    // Noise floor (dBm * 16)
+    int32_t noise_floor_x16;
+    bool noise_valid;
+
+    // Sensitivity effect of the last RX recalibration
+    int16_t noise_before_cal;
+    int64_t cal_time;
+    bool cal_settling;
+
+    // Statistics
+    uint32_t image_cal;
+    uint32_t cal_deferred;
+    uint32_t cal_failed;
+    int16_t cal_noise_delta;
+
+    // Gain control
+    channel_gain_t channels[GATEWAY_RX_CHANNELS];
+    uint8_t applied_profile;    // Profile currently set on the RX radio
+    uint32_t gain_switches;
+
+} radio_monitor_t;
+
+static radio_monitor_t s_mon = {0};
+
+// Internal: Sample RSSI on the RX radio while nothing is being received
+static void sample_noise(channel_gain_t *ch)
+{
+    sx1276_handle_t rx = s_mon.radio[MON_RX];
+    int32_t sum = 0;
+
+    if (sx1276_rx_busy(rx)) {
+        return;
+    }
+    for (int i = 0; i < NOISE_SAMPLES; i++) {
+        sum += sx1276_get_rssi(rx);
+    }
+    // A packet started during sampling: discard
+    if (sx1276_rx_busy(rx)) {
+        return;
+    }
+
+    int32_t sample_x16 = (sum * 16) / NOISE_SAMPLES;
+    if (!s_mon.noise_valid) {
+        s_mon.noise_floor_x16 = sample_x16;
+        s_mon.noise_valid = true;
+    } else {
+        s_mon.noise_floor_x16 += (sample_x16 - s_mon.noise_floor_x16) >> NOISE_EWMA_SHIFT;
+    }
+
+    // Per channel: floor plus how often a strong signal sits on top of it
+    if (!ch->noise_valid) {
+        ch->noise_x16 = sample_x16;
+        ch->noise_valid = true;
+        return;
+    }
+    if (sample_x16 > ch->noise_x16 + BLOCKING_MARGIN_DB * 16) {
+        ch->blocked++;
+    } else {
+        ch->noise_x16 += (sample_x16 - ch->noise_x16) >> NOISE_EWMA_SHIFT;
+    }
+    if (++ch->samples >= BLOCKING_WINDOW) {
+        ch->samples /= 2;
+        ch->blocked /= 2;
+    }
+}
+
+// Internal: Profile suggested by the channel's noise floor and blocking rate
+static uint8_t noise_profile(const channel_gain_t *ch)
+{
+    int32_t floor = ch->noise_x16 / 16;
+    uint32_t blocking_pct = ch->samples ? (100 * ch->blocked / ch->samples) : 0;
+
+    if (floor < -115 && blocking_pct < 2) {
+        return 0;
+    }
+    if (floor < -105 && blocking_pct < 5) {
+        return 1;
+    }
+    if (floor < -95 && blocking_pct < 15) {
+        return 2;
+    }
+    return 3;
+}
+
+// Internal: Choose the gain profile of one channel
+static void update_gain(channel_gain_t *ch)
+{
+    uint8_t target = noise_profile(ch);
+
+    // Measured decode rate wins over the noise rule when clearly better
+    uint32_t best_rate = 0;
+    int best = -1;
+    for (int p = 0; p < GAIN_PROFILE_COUNT; p++) {
+        if (ch->rx_total[p] >= GAIN_EVAL_PACKETS) {
+            uint32_t rate = 100 * ch->rx_ok[p] / ch->rx_total[p];
+            if (best < 0 || rate > best_rate) {
+                best_rate = rate;
+                best = p;
+            }
+        }
+    }
+    if (best >= 0 && ch->rx_total[target] >= GAIN_EVAL_PACKETS &&
+        best_rate >= 100 * ch->rx_ok[target] / ch->rx_total[target] + GAIN_CRC_MARGIN_PCT) {
+        target = best;
+    }
+
+    // Hysteresis: the candidate must hold for a while before switching
+    if (target != ch->target) {
+        ch->target = target;
+        ch->target_polls = 0;
+        return;
+    }
+    if (target != ch->profile && ++ch->target_polls >= GAIN_HOLD_POLLS) {
+        ch->profile = target;
+        ch->switches++;
+        s_mon.gain_switches++;
+    }
+}
+
+// Internal: Calibrate one radio and record the reference temperature
+static void calibrate(int idx)
+{
+    esp_err_t ret = sx1276_calibrate_image(s_mon.radio[idx]);
+    if (ret != ESP_OK) {
+        s_mon.cal_failed++;
+        return;
+    }
+
+    s_mon.cal_temperature[idx] = s_mon.temperature[idx];
+    s_mon.cal_pending[idx] = false;
+    s_mon.image_cal++;
+}
+
+esp_err_t radio_monitor_init(sx1276_handle_t rx_handle, sx1276_handle_t tx_handle)
+{
+    if (!rx_handle || !tx_handle) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memset(&s_mon, 0, sizeof(radio_monitor_t));
+    s_mon.radio[MON_RX] = rx_handle;
+    s_mon.radio[MON_TX] = tx_handle;
+
+    // Power-on calibration runs at 434 MHz; redo it at the operating band
+    // before RX starts, and take the reference temperature
+    for (int i = 0; i < MON_RADIOS; i++) {
+        sx1276_read_temperature(s_mon.radio[i], &s_mon.temperature[i]);
+        calibrate(i);
+    }
+
+    s_mon.last_temp_check = esp_timer_get_time();
+    s_mon.initialized = true;
+
+    ESP_LOGI(TAG, "Radio monitor initialized (RX %d C, TX %d C, recal at +/-%d C)",
+             s_mon.temperature[MON_RX], s_mon.temperature[MON_TX],
+             CONFIG_LORA_IMAGE_CAL_TEMP_DELTA);
+
+    return ESP_OK;
+}
+
+// Internal: Read a radio's temperature and flag a recalibration on drift
+static void check_temperature(int idx)
+{
+    if (sx1276_read_temperature(s_mon.radio[idx], &s_mon.temperature[idx]) != ESP_OK) {
+        return;
+    }
+    s_mon.temp_due[idx] = false;
+
+    if (abs(s_mon.temperature[idx] - s_mon.cal_temperature[idx]) >= CONFIG_LORA_IMAGE_CAL_TEMP_DELTA) {
+        if (!s_mon.cal_pending[idx]) {
+            ESP_LOGI(TAG, "Radio %d drifted %d -> %d C, recalibration pending",
+                     idx, s_mon.cal_temperature[idx], s_mon.temperature[idx]);
+        }
+        s_mon.cal_pending[idx] = true;
+    }
+}
+
+void radio_monitor_poll_tx(void)
+{
+    if (!s_mon.initialized) {
+        return;
+    }
+
+    // Periodic temperature check; the RX radio's read waits for its poll
+    int64_t now = esp_timer_get_time();
+    if ((now - s_mon.last_temp_check) >= (int64_t)CONFIG_LORA_RADIO_MONITOR_INTERVAL_S * 1000000) {
+        s_mon.last_temp_check = now;
+        s_mon.temp_due[MON_RX] = true;
+        s_mon.temp_due[MON_TX] = true;
+    }
+
+    // TX radio is idle whenever we are polled
+    if (s_mon.temp_due[MON_TX]) {
+        check_temperature(MON_TX);
+    }
+    if (s_mon.cal_pending[MON_TX]) {
+        calibrate(MON_TX);
+    }
+}
+
+void radio_monitor_poll_rx(uint8_t channel)
+{
+    if (!s_mon.initialized) {
+        return;
+    }
+
+    int64_t now = esp_timer_get_time();
+    channel_gain_t *ch = &s_mon.channels[channel % GATEWAY_RX_CHANNELS];
+
+    sample_noise(ch);
+
+#ifdef CONFIG_LORA_ADAPTIVE_GAIN
+    update_gain(ch);
+
+    // Apply the channel's profile between packets (also after a hop)
+    if (ch->profile != s_mon.applied_profile && !sx1276_rx_busy(s_mon.radio[MON_RX])) {
+        if (sx1276_set_rx_gain(s_mon.radio[MON_RX], &s_profiles[ch->profile]) == ESP_OK) {
+            ESP_LOGI(TAG, "Channel %d: gain profile %d -> %d (floor %ld dBm)",
+                     channel, s_mon.applied_profile, ch->profile, ch->noise_x16 / 16);
+            s_mon.applied_profile = ch->profile;
+        }
+    }
+#endif
+
+    // Sensitivity effect of the last recalibration, once the floor settled
+    if (s_mon.cal_settling && (now - s_mon.cal_time) > NOISE_SETTLE_US) {
+        s_mon.cal_noise_delta = (s_mon.noise_floor_x16 / 16) - s_mon.noise_before_cal;
+        s_mon.cal_settling = false;
+        ESP_LOGI(TAG, "Noise floor after recal: %ld dBm (%+d dB)",
+                 s_mon.noise_floor_x16 / 16, s_mon.cal_noise_delta);
+    }
+
+    // Reading the sensor also pauses RX briefly: only between packets
+    if (s_mon.temp_due[MON_RX] && !sx1276_rx_busy(s_mon.radio[MON_RX])) {
+        check_temperature(MON_RX);
+    }
+
+    // Recalibration, likewise
+    if (s_mon.cal_pending[MON_RX]) {
+        if (sx1276_rx_busy(s_mon.radio[MON_RX])) {
+            s_mon.cal_deferred++;
+            return;
+        }
+
+        s_mon.noise_before_cal = s_mon.noise_floor_x16 / 16;
+        calibrate(MON_RX);
+        if (!s_mon.cal_pending[MON_RX]) {
+            s_mon.cal_time = now;
+            s_mon.cal_settling = true;
+        }
+    }
+}
+
+void radio_monitor_note_rx(const lora_rx_packet_t *packet)
+{
+    if (!s_mon.initialized || !packet) {
+        return;
+    }
+
+    // Credit the profile that was active while the packet was received
+    channel_gain_t *ch = &s_mon.channels[packet->if_chain % GATEWAY_RX_CHANNELS];
+    ch->rx_total[s_mon.applied_profile]++;
+    if (packet->crc_ok) {
+        ch->rx_ok[s_mon.applied_profile]++;
+    }
+}
+
+esp_err_t radio_monitor_get_channel_stats(uint8_t channel, gw_channel_gain_stats_t *stats)
+{
+    if (!stats || channel >= GATEWAY_RX_CHANNELS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    const channel_gain_t *ch = &s_mon.channels[channel];
+
+    memset(stats, 0, sizeof(gw_channel_gain_stats_t));
+    stats->profile = ch->profile;
+    stats->noise_floor = ch->noise_x16 / 16;
+    stats->blocking_pct = ch->samples ? (100 * ch->blocked / ch->samples) : 0;
+    stats->switches = ch->switches;
+    memcpy(stats->rx_ok, ch->rx_ok, sizeof(stats->rx_ok));
+    memcpy(stats->rx_total, ch->rx_total, sizeof(stats->rx_total));
+
+    return ESP_OK;
+}
+
+void radio_monitor_get_stats(gateway_stats_t *stats)
+{
+    if (!stats) {
+        return;
+    }
+
+    stats->noise_floor = s_mon.noise_floor_x16 / 16;
+    stats->rx_temperature = s_mon.temperature[MON_RX];
+    stats->tx_temperature = s_mon.temperature[MON_TX];
+    stats->image_cal = s_mon.image_cal;
+    stats->image_cal_deferred = s_mon.cal_deferred;
+    stats->image_cal_failed = s_mon.cal_failed;
+    stats->cal_noise_delta = s_mon.cal_noise_delta;
+    stats->gain_switches = s_mon.gain_switches;
+}
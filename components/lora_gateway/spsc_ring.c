@@ -0,0 +1,215 @@
+/**
+ * @file spsc_ring.c
+ * @brief Lock-free single-producer/single-consumer ring
+ *
+ * head and tail are free-running counters; each side only writes its own
+ * index and reads the other with acquire semantics, so no critical
+ * section is needed across cores.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "spsc_ring.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+static const char *TAG = "spsc_ring";
+
+esp_err_t spsc_ring_init(spsc_ring_t *ring, uint32_t capacity, uint32_t item_size)
+{
+    if (!ring || capacity == 0 || (capacity & (capacity - 1)) != 0 || item_size == 0) {
+        ESP_LOGE(TAG, "Invalid ring geometry (%lu x %lu)", capacity, item_size);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memset(ring, 0, sizeof(spsc_ring_t));
+
+    ring->slots = calloc(capacity, item_size);
+    ring->stamps = calloc(capacity, sizeof(uint32_t));
+    if (!ring->slots || !ring->stamps) {
+        free(ring->slots);
+        free(ring->stamps);
+        ring->slots = NULL;
+        ring->stamps = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+
+    ring->item_size = item_size;
+    ring->mask = capacity - 1;
+
+    return ESP_OK;
+}
+
+void spsc_ring_deinit(spsc_ring_t *ring)
+{
+    if (!ring) {
+        return;
+    }
+
+    free(ring->slots);
+    free(ring->stamps);
+    memset(ring, 0, sizeof(spsc_ring_t));
+}
+
+void spsc_ring_set_consumer(spsc_ring_t *ring, TaskHandle_t consumer)
+{
+    __atomic_store_n(&ring->consumer, consumer, __ATOMIC_RELEASE);
+}
+
+void *spsc_ring_reserve(spsc_ring_t *ring)
+{
+    if (!ring->slots) {
+        return NULL;
+    }
+
+    uint32_t head = ring->head;
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+    if (head - tail > ring->mask) {
+        ring->dropped++;
+        return NULL;
+    }
+
+    return &ring->slots[(head & ring->mask) * ring->item_size];
+}
+
+bool spsc_ring_full(const spsc_ring_t *ring)
+{
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    return ring->head - tail > ring->mask;
+}
+
+uint32_t spsc_ring_count(const spsc_ring_t *ring)
+{
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    return head - tail;
+}
+
+void spsc_ring_commit(spsc_ring_t *ring)
+{
+    uint32_t head = ring->head;
+
+    ring->stamps[head & ring->mask] = (uint32_t)esp_timer_get_time();
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+
+    // Pairs with the fence in spsc_ring_wait(): either the consumer sees
+    // the new head, or we see the tail it published before sleeping
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+    ring->pushed++;
+    uint32_t fill = head + 1 - tail;
+    if (fill > ring->high_water) {
+        ring->high_water = fill;
+    }
+
+    // Wake the consumer only on the empty -> non-empty transition
+    TaskHandle_t consumer = __atomic_load_n(&ring->consumer, __ATOMIC_ACQUIRE);
+    if (tail == head && consumer) {
+        ring->wakeups++;
+        xTaskNotifyGive(consumer);
+    }
+}
+
+bool spsc_ring_push(spsc_ring_t *ring, const void *item)
+{
+    void *slot = spsc_ring_reserve(ring);
+    if (!slot) {
+        return false;
+    }
+
+    memcpy(slot, item, ring->item_size);
+    spsc_ring_commit(ring);
+
+    return true;
+}
+
+uint32_t spsc_ring_wait(spsc_ring_t *ring, TickType_t timeout)
+{
+    uint32_t tail = ring->tail;
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+    if (head == tail) {
+        // Notification is sticky, so a commit between the check and the
+        // take is not lost
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        if (head == tail) {
+            ulTaskNotifyTake(pdTRUE, timeout);
+            head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        }
+    }
+
+    return head - tail;
+}
+
+uint32_t spsc_ring_peek(spsc_ring_t *ring, void **first)
+{
+    uint32_t tail = ring->tail;
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint32_t ready = head - tail;
+
+    if (ready == 0) {
+        return 0;
+    }
+
+    // Stop at the wrap point so the batch is contiguous
+    uint32_t index = tail & ring->mask;
+    uint32_t contiguous = ring->mask + 1 - index;
+    if (ready > contiguous) {
+        ready = contiguous;
+    }
+
+    *first = &ring->slots[index * ring->item_size];
+    return ready;
+}
+
+void spsc_ring_release(spsc_ring_t *ring, uint32_t count)
+{
+    if (count == 0) {
+        return;
+    }
+
+    uint32_t tail = ring->tail;
+    uint32_t now = (uint32_t)esp_timer_get_time();
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t handoff = now - ring->stamps[(tail + i) & ring->mask];
+        ring->handoff_us_total += handoff;
+        if (handoff > ring->handoff_us_max) {
+            ring->handoff_us_max = handoff;
+        }
+    }
+    ring->released += count;
+
+    __atomic_store_n(&ring->tail, tail + count, __ATOMIC_RELEASE);
+}
+
+bool spsc_ring_pop(spsc_ring_t *ring, void *item, TickType_t timeout)
+{
+    void *slot;
+
+    if (spsc_ring_wait(ring, timeout) == 0 || spsc_ring_peek(ring, &slot) == 0) {
+        return false;
+    }
+
+    memcpy(item, slot, ring->item_size);
+    spsc_ring_release(ring, 1);
+
+    return true;
+}
+
+void spsc_ring_get_stats(const spsc_ring_t *ring, spsc_ring_stats_t *stats)
+{
+    memset(stats, 0, sizeof(spsc_ring_stats_t));
+
+    stats->pushed = ring->pushed;
+    stats->dropped = ring->dropped;
+    stats->wakeups = ring->wakeups;
+    stats->high_water = ring->high_water;
+    stats->handoff_max_us = ring->handoff_us_max;
+    if (ring->released > 0) {
+        stats->handoff_avg_us = ring->handoff_us_total / ring->released;
+    }
+}
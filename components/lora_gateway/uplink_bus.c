@@ -0,0 +1,306 @@
+/**
+ * @file uplink_bus.c
+ * @brief Fan-out of received uplinks to several consumers
+ *
+ * gw_rx_task publishes each uplink once: it is copied out of the RX ring
+ * (whose slot goes back to the radio) into a pool entry whose reference
+ * count is the number of subscribers it is queued to. Subscribers get a
+ * pointer to the shared packet from their own bounded backlog and release
+ * it when done; the entry is free again when the last one has. A full
+ * backlog only costs its own subscriber packets, by its drop policy, so
+ * a slow consumer never stalls reception.
+ *
+ * Subscriptions are made at init. The pool is sized so that every backlog
+ * can be full while each subscriber holds one more packet, with one entry
+ * to spare for the uplink being published (allocated before a full
+ * drop-oldest backlog gives its evicted entry back).
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include "lora_gateway.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+static const char *TAG = "uplink_bus";
+
+// Shared packet (the packet comes first: handles are packet pointers)
+typedef struct {
+    lora_rx_packet_t packet;
+    uint32_t refs;              // Backlogs and consumers holding it, 0 = free
+} bus_entry_t;
+
+// Subscriber backlog: ring of entry pointers
+typedef struct {
+    char name[GW_BUS_NAME_LEN];
+    bus_entry_t **slots;
+    uint32_t capacity;
+    uint32_t head;              // Pushes (free-running)
+    uint32_t tail;              // Pops (free-running)
+    gw_bus_drop_t drop;
+    bool crc_ok_only;
+    TaskHandle_t consumer;      // Task waiting in uplink_bus_receive()
+
+    // Statistics
+    uint32_t delivered;
+    uint32_t dropped;
+    uint32_t high_water;
+} bus_sub_t;
+
+// Bus state
+typedef struct {
+    bus_entry_t pool[UPLINK_BUS_POOL_SIZE];
+    uint32_t next_free;         // Allocation scan start (gw_rx_task only)
+    bus_sub_t subs[UPLINK_BUS_MAX_SUBSCRIBERS];
+    int sub_count;
+    uint32_t reserved;          // Pool entries promised to subscribers
+    portMUX_TYPE lock;          // Backlog indices (producer and consumers)
+
+    // Statistics
+    uint32_t published;
+    uint32_t pool_exhausted;
+    uint32_t in_use_max;
+} uplink_bus_t;
+
+static uplink_bus_t *s_bus = NULL;
+
+esp_err_t uplink_bus_init(void)
+{
+    if (s_bus) {
+        return ESP_OK;
+    }
+
+    s_bus = calloc(1, sizeof(uplink_bus_t));
+    if (!s_bus) {
+        return ESP_ERR_NO_MEM;
+    }
+    s_bus->lock = (portMUX_TYPE)portMUX_INITIALIZER_UNLOCKED;
+
+    ESP_LOGI(TAG, "Uplink bus: %d shared packets, up to %d subscribers",
+             UPLINK_BUS_POOL_SIZE, UPLINK_BUS_MAX_SUBSCRIBERS);
+    return ESP_OK;
+}
+
+void uplink_bus_deinit(void)
+{
+    if (!s_bus) {
+        return;
+    }
+
+    for (int i = 0; i < s_bus->sub_count; i++) {
+        free(s_bus->subs[i].slots);
+    }
+    free(s_bus);
+    s_bus = NULL;
+}
+
+int uplink_bus_subscribe(const char *name, uint32_t backlog, gw_bus_drop_t drop, bool crc_ok_only)
+{
+    if (!s_bus || !name || backlog == 0) {
+        return -1;
+    }
+    if (s_bus->sub_count >= UPLINK_BUS_MAX_SUBSCRIBERS) {
+        ESP_LOGE(TAG, "No subscriber slot for %s", name);
+        return -1;
+    }
+
+    // A full backlog plus the packet being processed must fit in the pool,
+    // leaving one entry free for publish()
+    if (s_bus->reserved + backlog + 1 >= UPLINK_BUS_POOL_SIZE) {
+        ESP_LOGE(TAG, "Backlog of %lu for %s exceeds the pool (%lu of %d reserved)",
+                 backlog, name, s_bus->reserved, UPLINK_BUS_POOL_SIZE);
+        return -1;
+    }
+
+    bus_sub_t *sub = &s_bus->subs[s_bus->sub_count];
+    sub->slots = calloc(backlog, sizeof(bus_entry_t *));
+    if (!sub->slots) {
+        return -1;
+    }
+    strncpy(sub->name, name, sizeof(sub->name) - 1);
+    sub->capacity = backlog;
+    sub->drop = drop;
+    sub->crc_ok_only = crc_ok_only;
+    s_bus->reserved += backlog + 1;
+
+    ESP_LOGI(TAG, "Subscriber %s: backlog %lu, drop %s%s", name, backlog,
+             drop == GW_BUS_DROP_OLDEST ? "oldest" : "newest",
+             crc_ok_only ? ", CRC OK only" : "");
+
+    return s_bus->sub_count++;
+}
+
+// Internal: Drop one reference, the last frees the entry
+static void entry_unref(bus_entry_t *entry)
+{
+    __atomic_sub_fetch(&entry->refs, 1, __ATOMIC_ACQ_REL);
+}
+
+// Internal: Find a free pool entry (gw_rx_task only)
+static bus_entry_t *entry_alloc(void)
+{
+    uint32_t in_use = 0;
+    bus_entry_t *found = NULL;
+
+    for (uint32_t i = 0; i < UPLINK_BUS_POOL_SIZE; i++) {
+        bus_entry_t *entry = &s_bus->pool[(s_bus->next_free + i) % UPLINK_BUS_POOL_SIZE];
+        if (__atomic_load_n(&entry->refs, __ATOMIC_ACQUIRE) != 0) {
+            in_use++;
+        } else if (!found) {
+            found = entry;
+            s_bus->next_free = (s_bus->next_free + i + 1) % UPLINK_BUS_POOL_SIZE;
+        }
+    }
+
+    if (in_use + 1 > s_bus->in_use_max) {
+        s_bus->in_use_max = in_use + 1;
+    }
+    return found;
+}
+
+// Internal: Queue an entry to a subscriber; false if dropped
+static bool sub_push(bus_sub_t *sub, bus_entry_t *entry)
+{
+    bus_entry_t *evicted = NULL;
+    TaskHandle_t wake = NULL;
+
+    portENTER_CRITICAL(&s_bus->lock);
+    uint32_t count = sub->head - sub->tail;
+    if (count == sub->capacity) {
+        if (sub->drop == GW_BUS_DROP_NEWEST) {
+            sub->dropped++;
+            portEXIT_CRITICAL(&s_bus->lock);
+            return false;
+        }
+        evicted = sub->slots[sub->tail % sub->capacity];
+        sub->tail++;
+        sub->dropped++;
+        count--;
+    }
+    sub->slots[sub->head % sub->capacity] = entry;
+    sub->head++;
+    if (count + 1 > sub->high_water) {
+        sub->high_water = count + 1;
+    }
+    if (count == 0) {
+        wake = sub->consumer;
+    }
+    portEXIT_CRITICAL(&s_bus->lock);
+
+    if (evicted) {
+        entry_unref(evicted);
+    }
+    if (wake) {
+        xTaskNotifyGive(wake);
+    }
+    return true;
+}
+
+void uplink_bus_publish(const lora_rx_packet_t *packet)
+{
+    if (!s_bus || !packet) {
+        return;
+    }
+
+    uint32_t targets = 0;
+    for (int i = 0; i < s_bus->sub_count; i++) {
+        if (packet->crc_ok || !s_bus->subs[i].crc_ok_only) {
+            targets++;
+        }
+    }
+    if (targets == 0) {
+        return;
+    }
+
+    bus_entry_t *entry = entry_alloc();
+    if (!entry) {
+        s_bus->pool_exhausted++;
+        return;
+    }
+
+    // The one copy: out of the RX ring slot, which the radio reuses
+    memcpy(&entry->packet, packet, sizeof(lora_rx_packet_t));
+    __atomic_store_n(&entry->refs, targets, __ATOMIC_RELEASE);
+    s_bus->published++;
+
+    for (int i = 0; i < s_bus->sub_count; i++) {
+        bus_sub_t *sub = &s_bus->subs[i];
+        if (!packet->crc_ok && sub->crc_ok_only) {
+            continue;
+        }
+        if (!sub_push(sub, entry)) {
+            entry_unref(entry);
+        }
+    }
+}
+
+bool uplink_bus_receive(int sub_id, const lora_rx_packet_t **packet, TickType_t timeout)
+{
+    if (!s_bus || sub_id < 0 || sub_id >= s_bus->sub_count || !packet) {
+        return false;
+    }
+
+    bus_sub_t *sub = &s_bus->subs[sub_id];
+    bus_entry_t *entry = NULL;
+
+    // Registered before looking, so a push in between leaves a notification
+    __atomic_store_n(&sub->consumer, xTaskGetCurrentTaskHandle(), __ATOMIC_RELEASE);
+
+    for (int attempt = 0; attempt < 2 && !entry; attempt++) {
+        portENTER_CRITICAL(&s_bus->lock);
+        if (sub->head != sub->tail) {
+            entry = sub->slots[sub->tail % sub->capacity];
+            sub->tail++;
+            sub->delivered++;
+        }
+        portEXIT_CRITICAL(&s_bus->lock);
+
+        if (!entry && attempt == 0 && ulTaskNotifyTake(pdTRUE, timeout) == 0) {
+            break;
+        }
+    }
+
+    if (!entry) {
+        return false;
+    }
+
+    *packet = &entry->packet;
+    return true;
+}
+
+void uplink_bus_release(const lora_rx_packet_t *packet)
+{
+    if (packet) {
+        entry_unref((bus_entry_t *)packet);
+    }
+}
+
+esp_err_t uplink_bus_get_stats(gw_bus_stats_t *stats)
+{
+    if (!stats) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!s_bus) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    memset(stats, 0, sizeof(gw_bus_stats_t));
+    stats->published = s_bus->published;
+    stats->pool_exhausted = s_bus->pool_exhausted;
+    stats->pool_in_use_max = s_bus->in_use_max;
+    stats->subscribers = s_bus->sub_count;
+
+    for (int i = 0; i < s_bus->sub_count; i++) {
+        const bus_sub_t *sub = &s_bus->subs[i];
+        gw_bus_sub_stats_t *out = &stats->subs[i];
+
+        memcpy(out->name, sub->name, sizeof(out->name));
+        out->delivered = sub->delivered;
+        out->dropped = sub->dropped;
+        out->backlog = sub->head - sub->tail;
+        out->high_water = sub->high_water;
+    }
+
+    return ESP_OK;
+}
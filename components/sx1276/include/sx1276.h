@@ -77,6 +77,27 @@ typedef enum {
     SX1276_MODE_CAD
 } sx1276_mode_t;
 
+/**
+ * @brief LNA gain settings (RegLna LnaGain)
+ */
+typedef enum {
+    SX1276_LNA_AGC = 0,     // Gain set by AGC
+    SX1276_LNA_G1,          // Maximum gain
+    SX1276_LNA_G2,          // -6 dB
+    SX1276_LNA_G3,          // -12 dB
+    SX1276_LNA_G4,          // -24 dB
+    SX1276_LNA_G5,          // -36 dB
+    SX1276_LNA_G6           // -48 dB
+} sx1276_lna_gain_t;
+
+/**
+ * @brief RX front-end gain profile
+ */
+typedef struct {
+    sx1276_lna_gain_t lna_gain;     // SX1276_LNA_AGC or a fixed gain
+    bool lna_boost;                 // LnaBoostHf (+~3 dB sensitivity, less linear)
+} sx1276_rx_gain_t;
+
 /**
  * @brief Received packet information
  */
@@ -85,8 +106,10 @@ typedef struct {
     uint8_t length;
     int16_t rssi;
     int8_t snr;
+    int32_t freq_error;     // Transmitter offset from nominal (Hz, FEI)
     uint32_t frequency;
     uint32_t timestamp;
+    uint32_t header_timestamp;  // ValidHeader time (us), 0 if DIO3 not wired
     uint8_t sf;
     uint8_t bw;
     uint8_t cr;
@@ -101,13 +124,60 @@ typedef struct {
     uint8_t length;
     uint32_t frequency;
     int8_t power;
-    uint8_t sf;
-    uint8_t bw;
-    uint8_t cr;
+    uint8_t sf;             // 0: configured modulation
+    uint8_t bw;             // sx1276_bandwidth_t
+    uint8_t cr;             // sx1276_coding_rate_t
     bool invert_iq;
     uint32_t tx_delay_us;  // Delay before TX (for precise timing)
 } sx1276_tx_packet_t;
 
+/**
+ * @brief IRQ service statistics
+ */
+typedef struct {
+    uint32_t irqs;                  // DIO0 interrupts serviced
+    uint32_t headers;               // DIO3 ValidHeader interrupts
+    uint32_t irq_latency_avg_us;    // ISR to service task wakeup
+    uint32_t irq_latency_max_us;
+    uint32_t fifo_reads;            // RX payloads read by DMA
+    uint32_t fifo_read_avg_us;      // DMA queue to completion (overlaps metadata work)
+    uint32_t fifo_read_max_us;
+    uint32_t spi_clock_hz;          // Current SPI clock (self-test result)
+    uint32_t spot_checks;           // RX payloads re-read for verification
+    uint32_t spi_errors;            // Re-reads that did not match
+    uint32_t spi_transactions;      // SPI transactions issued (free-running)
+    uint32_t spi_wire_bytes;        // Bytes clocked on the bus (free-running)
+} sx1276_service_stats_t;
+
+/**
+ * @brief Commands run by the radio's service task
+ *
+ * The service task owns the radio: the API functions below submit typed
+ * commands and wait for them (or run them inline when called from the
+ * service task, e.g. from a callback).
+ */
+typedef enum {
+    SX1276_CMD_RETUNE = 0,      // Set frequency (coalesced)
+    SX1276_CMD_MODEM,           // Apply a modem profile (coalesced)
+    SX1276_CMD_MODE,            // Set operating mode
+    SX1276_CMD_START_RX,        // Continuous RX
+    SX1276_CMD_TX_LOAD,         // Load FIFO and modem for a TX
+    SX1276_CMD_TX_FIRE,         // Trigger a loaded TX at a given time
+    SX1276_CMD_CAD,             // Channel activity detection
+    SX1276_CMD_STATUS,          // RSSI, last packet RSSI/SNR, modem status
+    SX1276_CMD_COUNT
+} sx1276_cmd_type_t;
+
+/**
+ * @brief Command executor statistics (per command type)
+ */
+typedef struct {
+    uint32_t executed;
+    uint32_t coalesced;             // Superseded by a newer command before running
+    uint32_t latency_avg_us;        // Submit to start of execution
+    uint32_t latency_max_us;
+} sx1276_cmd_stats_t;
+
 /**
  * @brief Callback for received packets
  */
@@ -118,6 +188,16 @@ typedef void (*sx1276_rx_callback_t)(sx1276_rx_packet_t *packet, void *user_data
  */
 typedef void (*sx1276_tx_callback_t)(bool success, void *user_data);
 
+/**
+ * @brief Callback on ValidHeader (packet arriving, payload not yet read)
+ */
+typedef void (*sx1276_header_callback_t)(uint32_t header_time, void *user_data);
+
+/**
+ * @brief Callback with the answer of sx1276_rx_busy_async()
+ */
+typedef void (*sx1276_busy_callback_t)(bool busy, void *user_data);
+
 /**
  * @brief SX1276 pin configuration
  */
@@ -127,6 +207,7 @@ typedef struct {
     gpio_num_t dio0;    // DIO0 (RX Done / TX Done)
     gpio_num_t dio1;    // DIO1 (RX Timeout / FHSS)
     gpio_num_t dio2;    // DIO2 (FHSS)
+    gpio_num_t dio3;    // DIO3 (ValidHeader), GPIO_NUM_NC if not wired
 } sx1276_pins_t;
 
 /**
@@ -146,6 +227,39 @@ typedef struct {
     bool invert_iq_tx;                  // Invert IQ for TX
 } sx1276_config_t;
 
+/**
+ * @brief Modem parameters compiled into a profile
+ *
+ * LowDataRateOptimize is derived (symbol time above 16 ms).
+ */
+typedef struct {
+    sx1276_spreading_factor_t sf;
+    sx1276_bandwidth_t bw;
+    sx1276_coding_rate_t cr;
+    uint16_t preamble_length;
+    uint8_t payload_length;             // Implicit header RX / TX length
+    bool crc_on;
+    bool implicit_header;
+    bool invert_iq_rx;
+    bool invert_iq_tx;
+} sx1276_modem_params_t;
+
+#define SX1276_PROFILE_REGS         10  // RegModemConfig1 (0x1D) .. RegModemConfig3 (0x26)
+
+/**
+ * @brief Precompiled modem register image
+ *
+ * Built once by sx1276_profile_compile(), written with one burst plus the
+ * registers outside the contiguous block that differ from the last profile.
+ */
+typedef struct {
+    uint8_t modem[SX1276_PROFILE_REGS];
+    uint8_t detect_optimize;
+    uint8_t detection_threshold;
+    uint8_t invert_iq;
+    uint8_t invert_iq_2;
+} sx1276_modem_profile_t;
+
 /**
  * @brief SX1276 device handle
  */
@@ -174,6 +288,8 @@ esp_err_t sx1276_deinit(sx1276_handle_t handle);
 /**
  * @brief Set operating mode
  *
+ * Any mode but FSTX and TX drops a downlink loaded by sx1276_tx_prepare().
+ *
  * @param handle Device handle
  * @param mode Operating mode
  * @return ESP_OK on success
@@ -198,6 +314,18 @@ esp_err_t sx1276_get_mode(sx1276_handle_t handle, sx1276_mode_t *mode);
  */
 esp_err_t sx1276_set_frequency(sx1276_handle_t handle, uint32_t frequency);
 
+/**
+ * @brief Set frequency without waiting
+ *
+ * A retune still queued is replaced by this one, so only the latest
+ * frequency is written.
+ *
+ * @param handle Device handle
+ * @param frequency Frequency in Hz
+ * @return ESP_OK if queued
+ */
+esp_err_t sx1276_set_frequency_async(sx1276_handle_t handle, uint32_t frequency);
+
 /**
  * @brief Set spreading factor
  *
@@ -234,6 +362,17 @@ esp_err_t sx1276_set_coding_rate(sx1276_handle_t handle, sx1276_coding_rate_t cr
  */
 esp_err_t sx1276_set_tx_power(sx1276_handle_t handle, int8_t power);
 
+/**
+ * @brief Set RX front-end gain
+ *
+ * Persists across sx1276_apply_config(). Default is AGC with LNA boost.
+ *
+ * @param handle Device handle
+ * @param gain Gain profile
+ * @return ESP_OK on success
+ */
+esp_err_t sx1276_set_rx_gain(sx1276_handle_t handle, const sx1276_rx_gain_t *gain);
+
 /**
  * @brief Set sync word
  *
@@ -253,11 +392,85 @@ esp_err_t sx1276_set_sync_word(sx1276_handle_t handle, uint8_t sync_word);
  */
 esp_err_t sx1276_set_invert_iq(sx1276_handle_t handle, bool invert_rx, bool invert_tx);
 
+/**
+ * @brief Set spreading factor, bandwidth and coding rate together
+ *
+ * One profile switch instead of three setters.
+ *
+ * @param handle Device handle
+ * @param sf Spreading factor (6-12)
+ * @param bw Bandwidth
+ * @param cr Coding rate
+ * @return ESP_OK on success
+ */
+esp_err_t sx1276_set_modulation(sx1276_handle_t handle, sx1276_spreading_factor_t sf,
+                                sx1276_bandwidth_t bw, sx1276_coding_rate_t cr);
+
+/**
+ * @brief Set spreading factor, bandwidth and coding rate without waiting
+ *
+ * A modem change still queued is replaced by this one. The configured
+ * modulation (sx1276_get_modulation) changes when it has been written.
+ *
+ * @param handle Device handle
+ * @param sf Spreading factor (6-12)
+ * @param bw Bandwidth
+ * @param cr Coding rate
+ * @return ESP_OK if queued
+ */
+esp_err_t sx1276_set_modulation_async(sx1276_handle_t handle, sx1276_spreading_factor_t sf,
+                                      sx1276_bandwidth_t bw, sx1276_coding_rate_t cr);
+
+/**
+ * @brief Get the configured (RX) frequency
+ *
+ * Not changed by a transmission's own frequency (sx1276_tx_prepare).
+ *
+ * @param handle Device handle
+ * @return Frequency in Hz, 0 for an invalid handle
+ */
+uint32_t sx1276_get_frequency(sx1276_handle_t handle);
+
+/**
+ * @brief Get the configured spreading factor, bandwidth and coding rate
+ *
+ * @param handle Device handle
+ * @param sf Output spreading factor
+ * @param bw Output bandwidth
+ * @param cr Output coding rate
+ * @return ESP_OK on success
+ */
+esp_err_t sx1276_get_modulation(sx1276_handle_t handle, sx1276_spreading_factor_t *sf,
+                                sx1276_bandwidth_t *bw, sx1276_coding_rate_t *cr);
+
+/**
+ * @brief Compile modem parameters into a register image (no SPI access)
+ *
+ * @param params Modem parameters
+ * @param profile Output profile
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG for out-of-range parameters
+ */
+esp_err_t sx1276_profile_compile(const sx1276_modem_params_t *params,
+                                 sx1276_modem_profile_t *profile);
+
+/**
+ * @brief Switch the modem to a precompiled profile
+ *
+ * Only changes the modem registers (frequency and mode are untouched) and
+ * skips writes that match the profile already applied. The AGC bit follows
+ * the current RX gain setting. Does not update the stored configuration.
+ *
+ * @param handle Device handle
+ * @param profile Profile to apply
+ * @return ESP_OK on success
+ */
+esp_err_t sx1276_profile_apply(sx1276_handle_t handle, const sx1276_modem_profile_t *profile);
+
 /**
  * @brief Start continuous RX mode
  *
  * @param handle Device handle
- * @param callback Callback for received packets (called from ISR context)
+ * @param callback Callback for received packets (called from the radio's service task)
  * @param user_data User data passed to callback
  * @return ESP_OK on success
  */
@@ -276,13 +489,53 @@ esp_err_t sx1276_stop_rx(sx1276_handle_t handle);
  *
  * @param handle Device handle
  * @param packet Packet to transmit
- * @param callback Callback when TX complete (can be NULL)
+ * @param callback Callback when TX complete (can be NULL, called from the service task)
  * @param user_data User data passed to callback
  * @return ESP_OK on success
  */
 esp_err_t sx1276_transmit(sx1276_handle_t handle, const sx1276_tx_packet_t *packet,
                           sx1276_tx_callback_t callback, void *user_data);
 
+/**
+ * @brief Load a packet for a timed transmission
+ *
+ * Writes frequency, the modem profile (packet SF/BW/CR when sf is set,
+ * otherwise the configured modulation, with TX IQ inversion) and FIFO so
+ * that sx1276_tx_fire() only has to switch the mode. With prelock the radio waits in FSTX, so PLL
+ * lock is already done when the trigger comes; the synthesizer must
+ * settle (~60 us) before firing. tx_delay_us is ignored.
+ *
+ * @param handle Device handle
+ * @param packet Packet to transmit
+ * @param prelock Enter FSTX instead of staying in standby
+ * @param callback Callback when TX complete (can be NULL, called from the service task)
+ * @param user_data User data passed to callback
+ * @return ESP_OK on success
+ */
+esp_err_t sx1276_tx_prepare(sx1276_handle_t handle, const sx1276_tx_packet_t *packet, bool prelock,
+                            sx1276_tx_callback_t callback, void *user_data);
+
+/**
+ * @brief Start the prepared transmission at a given time
+ *
+ * Busy-waits until start_time (esp_timer microseconds, low 32 bits) and
+ * issues the single OpMode write that starts TX.
+ *
+ * @param handle Device handle
+ * @param start_time Requested start time (us)
+ * @param fire_time Output: time the trigger write completed (can be NULL)
+ * @return ESP_OK on success, ESP_ERR_INVALID_STATE if nothing is prepared
+ */
+esp_err_t sx1276_tx_fire(sx1276_handle_t handle, uint32_t start_time, uint32_t *fire_time);
+
+/**
+ * @brief Get the DIO0 timestamp of the last TxDone
+ *
+ * @param handle Device handle
+ * @return esp_timer microseconds (low 32 bits)
+ */
+uint32_t sx1276_get_tx_done_time(sx1276_handle_t handle);
+
 /**
  * @brief Get last packet RSSI
  *
@@ -316,6 +569,81 @@ int16_t sx1276_get_rssi(sx1276_handle_t handle);
  */
 esp_err_t sx1276_channel_free(sx1276_handle_t handle, bool *is_free);
 
+/**
+ * @brief Check if the modem is currently receiving
+ *
+ * With DIO3 wired, a packet whose header has arrived is reported busy
+ * without an SPI access.
+ *
+ * @param handle Device handle
+ * @return true if a preamble, sync or valid header is in progress
+ */
+bool sx1276_rx_busy(sx1276_handle_t handle);
+
+/**
+ * @brief Check if the modem is receiving, without waiting
+ *
+ * Posts the check of sx1276_rx_busy() to the service task, which runs the
+ * callback with the answer (inline when called from the service task).
+ * A probe still pending is replaced by this one.
+ *
+ * @param handle Device handle
+ * @param callback Called with the answer, on the service task
+ * @param user_data User data for callback
+ * @return ESP_OK on success
+ */
+esp_err_t sx1276_rx_busy_async(sx1276_handle_t handle, sx1276_busy_callback_t callback,
+                               void *user_data);
+
+/**
+ * @brief Check for a received header whose packet has not completed
+ *
+ * The ValidHeader state kept by the service task, without an SPI access
+ * (always false without DIO3).
+ *
+ * @param handle Device handle
+ * @return true if a packet is being received
+ */
+bool sx1276_rx_header_pending(sx1276_handle_t handle);
+
+/**
+ * @brief Read the on-chip temperature sensor
+ *
+ * Briefly switches to FSK mode; the previous mode (e.g. continuous RX)
+ * is restored. The sensor offset is not calibrated, so the value is
+ * only meaningful relative to earlier readings.
+ *
+ * @param handle Device handle
+ * @param temperature Output temperature in degrees C (relative)
+ * @return ESP_OK on success, ESP_ERR_INVALID_STATE while transmitting
+ */
+esp_err_t sx1276_read_temperature(sx1276_handle_t handle, int8_t *temperature);
+
+/**
+ * @brief Run image and RSSI calibration at the current frequency
+ *
+ * Takes ~10 ms in FSK standby, during which nothing is received. The
+ * previous mode is restored afterwards.
+ *
+ * @param handle Device handle
+ * @return ESP_OK on success, ESP_ERR_TIMEOUT if calibration did not finish
+ */
+esp_err_t sx1276_calibrate_image(sx1276_handle_t handle);
+
+/**
+ * @brief Set the callback run when a valid header is received
+ *
+ * Needs DIO3 wired. The callback runs in the radio's service task before
+ * the packet's RxDone, so it can prepare buffers or hold off retuning.
+ *
+ * @param handle Device handle
+ * @param callback Callback (NULL to disable)
+ * @param user_data User data passed to callback
+ * @return ESP_OK on success, ESP_ERR_NOT_SUPPORTED without DIO3
+ */
+esp_err_t sx1276_set_header_callback(sx1276_handle_t handle, sx1276_header_callback_t callback,
+                                     void *user_data);
+
 /**
  * @brief Get chip version
  *
@@ -324,6 +652,35 @@ esp_err_t sx1276_channel_free(sx1276_handle_t handle, bool *is_free);
  */
 uint8_t sx1276_get_version(sx1276_handle_t handle);
 
+/**
+ * @brief Get IRQ service statistics
+ *
+ * DIO0/DIO3 interrupts only timestamp and wake a per-radio service task,
+ * which reads the FIFO, runs the callbacks and executes radio commands.
+ *
+ * @param handle Device handle
+ * @param stats Output statistics
+ * @return ESP_OK on success
+ */
+esp_err_t sx1276_get_service_stats(sx1276_handle_t handle, sx1276_service_stats_t *stats);
+
+/**
+ * @brief Get command executor statistics
+ *
+ * @param handle Device handle
+ * @param stats Output, one entry per sx1276_cmd_type_t
+ * @return ESP_OK on success
+ */
+esp_err_t sx1276_get_cmd_stats(sx1276_handle_t handle, sx1276_cmd_stats_t stats[SX1276_CMD_COUNT]);
+
+/**
+ * @brief Short name of a command type (for logs)
+ *
+ * @param type Command type
+ * @return Name
+ */
+const char *sx1276_cmd_name(sx1276_cmd_type_t type);
+
 /**
  * @brief Apply full configuration
  *
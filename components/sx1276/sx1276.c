@@ -3,20 +3,118 @@
  * @brief SX1276 LoRa Module Driver Implementation
  */
 
+#include <stdio.h>
 #include <string.h>
 #include "sx1276.h"
 #include "sx1276_regs.h"
 #include "esp_log.h"
 #include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "hal/gpio_ll.h"
+#include "soc/gpio_struct.h"
 #include "freertos/task.h"
 
 static const char *TAG = "sx1276";
 
+#define SPI_MAX_CLOCK_HZ        (10 * 1000 * 1000)  // SX1276 SCK limit
+#define SPI_TEST_ROUNDS         8       // FIFO pattern rounds per clock step
+#define SPI_TEST_FIFO_LEN       64
+#define SPI_SPOT_CHECK_INTERVAL 16      // Re-read one RX payload in N
+#define SPI_SPOT_ERROR_LIMIT    2       // Mismatches before stepping the clock down
+#define DMA_BUF_SIZE            ((SX1276_MAX_PACKET_SIZE + 3) & ~3)
+#define HEADER_RECHECK_US       500000  // Confirm an old ValidHeader via RegModemStat
+#define LDRO_SYMBOL_MS          16      // LowDataRateOptimize above this symbol time
+
+// Profile image offsets (RegModemConfig1 .. RegModemConfig3)
+#define PROFILE_MC1             (REG_MODEM_CONFIG_1 - REG_MODEM_CONFIG_1)
+#define PROFILE_MC2             (REG_MODEM_CONFIG_2 - REG_MODEM_CONFIG_1)
+#define PROFILE_SYMB_TIMEOUT    (REG_SYMB_TIMEOUT_LSB - REG_MODEM_CONFIG_1)
+#define PROFILE_PREAMBLE_MSB    (REG_PREAMBLE_MSB - REG_MODEM_CONFIG_1)
+#define PROFILE_PREAMBLE_LSB    (REG_PREAMBLE_LSB - REG_MODEM_CONFIG_1)
+#define PROFILE_PAYLOAD_LENGTH  (REG_PAYLOAD_LENGTH - REG_MODEM_CONFIG_1)
+#define PROFILE_MAX_PAYLOAD     (REG_MAX_PAYLOAD_LENGTH - REG_MODEM_CONFIG_1)
+#define PROFILE_MC3             (REG_MODEM_CONFIG_3 - REG_MODEM_CONFIG_1)
+
+static const uint32_t s_bw_hz[] = {
+    7800, 10400, 15600, 20800, 31250, 41700, 62500, 125000, 250000, 500000
+};
+
+// Service task notification bits
+#define EVT_DIO0                (1 << 0)
+#define EVT_HEADER              (1 << 1)
+#define EVT_CMD                 (1 << 2)
+
+#define CMD_QUEUE_LEN           4       // Ordered commands (one per waiting task)
+#define CMD_COALESCED           2       // RETUNE and MODEM: only the latest runs
+#define CMD_FIRE_HANDOFF_US     50      // Caller spins to here, the executor the rest
+
+// Clock steps for calibration (80 MHz / n). Steps above the chip limit
+// are only probed to find the failure edge.
+static const int s_spi_clocks[] = {
+    4000000, 5000000, 6666667, 8000000, 8888889, 10000000, 11428571, 13333333
+};
+#define SPI_CLOCK_STEPS         (sizeof(s_spi_clocks) / sizeof(s_spi_clocks[0]))
+#define SPI_DEFAULT_STEP        3       // 8 MHz
+
+// Radio command (see sx1276_cmd_type_t)
+typedef struct {
+    sx1276_cmd_type_t type;
+    union {
+        uint32_t frequency;
+        sx1276_mode_t mode;
+        struct {
+            sx1276_modem_profile_t profile;
+            sx1276_modem_params_t params;
+            bool store;                 // Also becomes the configured modulation
+        } modem;
+        struct {
+            sx1276_rx_callback_t callback;
+            void *user_data;
+        } rx;
+        struct {
+            const sx1276_tx_packet_t *packet;
+            sx1276_modem_profile_t profile;
+            bool prelock;
+            sx1276_tx_callback_t callback;
+            void *user_data;
+        } tx_load;
+        struct {
+            uint32_t start_time;
+            uint32_t fire_time;         // Output
+        } tx_fire;
+        bool is_free;                   // CAD output
+        uint8_t status[4];              // RegModemStat .. RegRssiValue (output)
+    };
+    uint32_t submitted;
+    esp_err_t *result;                  // NULL if posted without waiting
+    SemaphoreHandle_t done;             // Given on completion, NULL if posted
+} radio_cmd_t;
+
+typedef struct {
+    uint32_t executed;
+    uint32_t coalesced;
+    uint64_t latency_total;
+    uint32_t latency_max;
+} cmd_stats_t;
+
+static const char *s_cmd_names[SX1276_CMD_COUNT] = {
+    "retune", "modem", "mode", "start_rx", "tx_load", "tx_fire", "cad", "status"
+};
+
 /**
  * @brief Internal device structure
  */
 struct sx1276_dev_s {
     spi_device_handle_t spi;
+    spi_host_device_t host;
+    int spi_clock_hz;
+    int spi_clock_step;             // Index in s_spi_clocks
+    uint32_t spot_counter;
+    uint32_t spot_checks;
+    uint32_t spi_errors;            // Spot check mismatches
+    uint32_t spi_errors_at_step;
+    volatile uint32_t spi_transactions;     // Counted in spi_pre_cb
+    volatile uint32_t spi_wire_bytes;       // Address + data bytes clocked
     sx1276_pins_t pins;
     sx1276_config_t config;
     SemaphoreHandle_t mutex;
@@ -30,15 +128,87 @@ struct sx1276_dev_s {
     // State
     sx1276_mode_t current_mode;
     bool is_transmitting;
+    bool tx_prepared;               // FIFO loaded, waiting for sx1276_tx_fire()
+    uint32_t fire_latency_us;       // Duration of the TX trigger write
+    uint32_t tx_done_time;          // DIO0 time of the last TxDone
+    sx1276_rx_gain_t rx_gain;
+    sx1276_modem_profile_t profile; // Modem registers as last written
+    bool profile_valid;             // Cleared by reset and FSK visits
+
+    // Early packet detection (DIO3 = ValidHeader)
+    sx1276_header_callback_t header_callback;
+    void *header_user_data;
+    volatile bool rx_in_progress;   // Header seen, RxDone not yet
+    volatile uint32_t header_time;
+    uint32_t headers;
+
+    // IRQ service task (DIO ISRs only timestamp and notify), also the
+    // radio's command executor
+    TaskHandle_t service_task;
+    QueueHandle_t cmd_queue;        // radio_cmd_t pointers, callers wait
+    portMUX_TYPE cmd_lock;          // Guards the coalesced slots
+    radio_cmd_t coalesced[CMD_COALESCED];
+    bool coalesced_pending[CMD_COALESCED];
+    sx1276_busy_callback_t probe_callback;  // Busy probe posted without waiting
+    void *probe_user_data;
+    uint32_t probe_submitted;
+    bool probe_pending;
+    cmd_stats_t cmd_stats[SX1276_CMD_COUNT];
+    volatile uint32_t irq_time;
+    uint32_t irq_count;
+    uint64_t irq_latency_total;
+    uint32_t irq_latency_max;
+
+    // DMA transfers: buffers preallocated in DMA-capable memory; the RX
+    // packet is read by DMA in place and handed to the callback
+    sx1276_rx_packet_t *rx_packet;
+    uint8_t *tx_dma;
+    spi_transaction_ext_t fifo_trans;
+    uint32_t fifo_start;
+    uint32_t fifo_reads;
+    uint64_t fifo_us_total;
+    uint32_t fifo_us_max;
 };
 
 // Forward declarations
 static void IRAM_ATTR dio0_isr_handler(void *arg);
+static void IRAM_ATTR dio3_isr_handler(void *arg);
+static void service_task(void *arg);
+static void handle_irq(sx1276_handle_t handle);
 static esp_err_t sx1276_write_reg(sx1276_handle_t handle, uint8_t reg, uint8_t value);
+static esp_err_t write_reg_polling(sx1276_handle_t handle, uint8_t reg, uint8_t value);
 static uint8_t sx1276_read_reg(sx1276_handle_t handle, uint8_t reg);
+static esp_err_t read_burst(sx1276_handle_t handle, uint8_t reg, uint8_t *data, uint8_t len);
+static esp_err_t write_burst(sx1276_handle_t handle, uint8_t reg, const uint8_t *data, uint8_t len);
+static void apply_profile(sx1276_handle_t handle, const sx1276_modem_profile_t *profile);
+static void apply_config_profile(sx1276_handle_t handle);
+static esp_err_t run_cmd(sx1276_handle_t handle, radio_cmd_t *cmd);
+static void post_coalesced(sx1276_handle_t handle, const radio_cmd_t *cmd);
+static void run_pending_cmds(sx1276_handle_t handle);
+static void exec_cmd(sx1276_handle_t handle, radio_cmd_t *cmd);
+static bool probe_busy(sx1276_handle_t handle, uint32_t submitted);
+static esp_err_t write_mode(sx1276_handle_t handle, sx1276_mode_t mode);
+static void write_frequency(sx1276_handle_t handle, uint32_t frequency);
+static void write_tx_power(sx1276_handle_t handle, int8_t power);
+static esp_err_t set_config_modem(sx1276_handle_t handle, const sx1276_config_t *config);
+static void start_rx(sx1276_handle_t handle, sx1276_rx_callback_t callback, void *user_data);
+static void tx_load(sx1276_handle_t handle, const sx1276_tx_packet_t *packet,
+                    const sx1276_modem_profile_t *profile, bool prelock);
+static esp_err_t tx_fire(sx1276_handle_t handle, uint32_t start_time, uint32_t *fire_time);
+static esp_err_t run_cad(sx1276_handle_t handle, bool *is_free);
 static esp_err_t sx1276_write_fifo(sx1276_handle_t handle, const uint8_t *data, uint8_t len);
-static esp_err_t sx1276_read_fifo(sx1276_handle_t handle, uint8_t *data, uint8_t len);
+static esp_err_t fifo_read_start(sx1276_handle_t handle, uint8_t *dest, uint8_t len);
+static esp_err_t fifo_read_finish(sx1276_handle_t handle);
+static void IRAM_ATTR spi_pre_cb(spi_transaction_t *trans);
+static void IRAM_ATTR spi_post_cb(spi_transaction_t *trans);
+static esp_err_t attach_spi(sx1276_handle_t handle, int clock_hz);
+static void calibrate_spi_clock(sx1276_handle_t handle);
+static void spot_check(sx1276_handle_t handle, uint8_t fifo_addr, uint8_t len);
 static void sx1276_reset(sx1276_handle_t handle);
+static int32_t read_freq_error(sx1276_handle_t handle);
+static void enter_fsk(sx1276_handle_t handle, uint8_t fsk_mode);
+static void leave_fsk(sx1276_handle_t handle);
+static void resume_lora(sx1276_handle_t handle, sx1276_mode_t prev_mode);
 
 esp_err_t sx1276_init(spi_host_device_t spi_host, const sx1276_pins_t *pins,
                       const sx1276_config_t *config, sx1276_handle_t *handle)
@@ -54,8 +224,18 @@ esp_err_t sx1276_init(spi_host_device_t spi_host, const sx1276_pins_t *pins,
 
     dev->pins = *pins;
     dev->config = *config;
+    dev->rx_gain = (sx1276_rx_gain_t){ .lna_gain = SX1276_LNA_AGC, .lna_boost = true };
     dev->mutex = xSemaphoreCreateMutex();
-    if (!dev->mutex) {
+    dev->cmd_lock = (portMUX_TYPE)portMUX_INITIALIZER_UNLOCKED;
+    dev->rx_packet = heap_caps_calloc(1, sizeof(sx1276_rx_packet_t), MALLOC_CAP_DMA);
+    dev->tx_dma = heap_caps_malloc(DMA_BUF_SIZE, MALLOC_CAP_DMA);
+    if (!dev->mutex || !dev->rx_packet || !dev->tx_dma) {
+        ESP_LOGE(TAG, "Failed to allocate driver buffers");
+        if (dev->mutex) {
+            vSemaphoreDelete(dev->mutex);
+        }
+        free(dev->rx_packet);
+        free(dev->tx_dma);
         free(dev);
         return ESP_ERR_NO_MEM;
     }
@@ -93,19 +273,22 @@ esp_err_t sx1276_init(spi_host_device_t spi_host, const sx1276_pins_t *pins,
         gpio_config(&io_conf);
     }
 
-    // Configure SPI device
-    spi_device_interface_config_t spi_cfg = {
-        .clock_speed_hz = 8 * 1000 * 1000,  // 8 MHz
-        .mode = 0,
-        .spics_io_num = -1,  // Manual CS control
-        .queue_size = 1,
-        .flags = 0,
-    };
+    // Configure DIO3 (ValidHeader) as input with interrupt
+    if (pins->dio3 != GPIO_NUM_NC) {
+        io_conf.pin_bit_mask = (1ULL << pins->dio3);
+        io_conf.intr_type = GPIO_INTR_POSEDGE;
+        gpio_config(&io_conf);
+    }
 
-    esp_err_t ret = spi_bus_add_device(spi_host, &spi_cfg, &dev->spi);
+    // Configure SPI device
+    dev->host = spi_host;
+    dev->spi_clock_step = SPI_DEFAULT_STEP;
+    esp_err_t ret = attach_spi(dev, s_spi_clocks[SPI_DEFAULT_STEP]);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to add SPI device: %s", esp_err_to_name(ret));
         vSemaphoreDelete(dev->mutex);
+        free(dev->rx_packet);
+        free(dev->tx_dma);
         free(dev);
         return ret;
     }
@@ -119,6 +302,8 @@ esp_err_t sx1276_init(spi_host_device_t spi_host, const sx1276_pins_t *pins,
         ESP_LOGE(TAG, "Invalid chip version: 0x%02X (expected 0x%02X)", version, SX1276_VERSION);
         spi_bus_remove_device(dev->spi);
         vSemaphoreDelete(dev->mutex);
+        free(dev->rx_packet);
+        free(dev->tx_dma);
         free(dev);
         return ESP_ERR_NOT_FOUND;
     }
@@ -132,18 +317,49 @@ esp_err_t sx1276_init(spi_host_device_t spi_host, const sx1276_pins_t *pins,
     sx1276_write_reg(dev, REG_OP_MODE, MODE_LONG_RANGE_MODE | MODE_STDBY);
     vTaskDelay(pdMS_TO_TICKS(10));
 
+#ifdef CONFIG_SX1276_SPI_AUTOTUNE
+    // FIFO is accessible in standby; apply_config rewrites everything after
+    calibrate_spi_clock(dev);
+    sx1276_write_reg(dev, REG_OP_MODE, MODE_LONG_RANGE_MODE | MODE_STDBY);
+#endif
+
     // Apply configuration
     ret = sx1276_apply_config(dev, config);
     if (ret != ESP_OK) {
         spi_bus_remove_device(dev->spi);
         vSemaphoreDelete(dev->mutex);
+        free(dev->rx_packet);
+        free(dev->tx_dma);
         free(dev);
         return ret;
     }
 
+    // IRQ service task and command executor: from here on, SPI access
+    // happens there, never in the ISR or the calling tasks
+    char task_name[configMAX_TASK_NAME_LEN];
+    snprintf(task_name, sizeof(task_name), "sx1276_%d", pins->cs);
+    dev->cmd_queue = xQueueCreate(CMD_QUEUE_LEN, sizeof(radio_cmd_t *));
+    if (!dev->cmd_queue ||
+        xTaskCreatePinnedToCore(service_task, task_name, 4096, dev,
+                                12, &dev->service_task, 1) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create service task");
+        if (dev->cmd_queue) {
+            vQueueDelete(dev->cmd_queue);
+        }
+        spi_bus_remove_device(dev->spi);
+        vSemaphoreDelete(dev->mutex);
+        free(dev->rx_packet);
+        free(dev->tx_dma);
+        free(dev);
+        return ESP_ERR_NO_MEM;
+    }
+
     // Install ISR handler
     gpio_install_isr_service(0);
     gpio_isr_handler_add(pins->dio0, dio0_isr_handler, dev);
+    if (pins->dio3 != GPIO_NUM_NC) {
+        gpio_isr_handler_add(pins->dio3, dio3_isr_handler, dev);
+    }
 
     dev->current_mode = SX1276_MODE_STANDBY;
     *handle = dev;
@@ -161,9 +377,19 @@ esp_err_t sx1276_deinit(sx1276_handle_t handle)
     }
 
     gpio_isr_handler_remove(handle->pins.dio0);
+    if (handle->pins.dio3 != GPIO_NUM_NC) {
+        gpio_isr_handler_remove(handle->pins.dio3);
+    }
+    if (handle->service_task) {
+        vTaskDelete(handle->service_task);
+        handle->service_task = NULL;    // Commands run inline from here
+    }
     sx1276_set_mode(handle, SX1276_MODE_SLEEP);
+    vQueueDelete(handle->cmd_queue);
     spi_bus_remove_device(handle->spi);
     vSemaphoreDelete(handle->mutex);
+    free(handle->rx_packet);
+    free(handle->tx_dma);
     free(handle);
 
     return ESP_OK;
@@ -175,87 +401,307 @@ static void sx1276_reset(sx1276_handle_t handle)
     vTaskDelay(pdMS_TO_TICKS(1));
     gpio_set_level(handle->pins.reset, 1);
     vTaskDelay(pdMS_TO_TICKS(10));
+    handle->profile_valid = false;
 }
 
-static esp_err_t sx1276_write_reg(sx1276_handle_t handle, uint8_t reg, uint8_t value)
+// Internal: (Re)attach the radio to the bus at the given clock
+static esp_err_t attach_spi(sx1276_handle_t handle, int clock_hz)
+{
+    if (handle->spi) {
+        spi_bus_remove_device(handle->spi);
+        handle->spi = NULL;
+    }
+
+    spi_device_interface_config_t spi_cfg = {
+        .clock_speed_hz = clock_hz,
+        .mode = 0,
+        .spics_io_num = -1,  // Manual CS control (pre/post callbacks)
+        .queue_size = 2,
+        .flags = 0,
+        .pre_cb = spi_pre_cb,
+        .post_cb = spi_post_cb,
+    };
+
+    esp_err_t ret = spi_bus_add_device(handle->host, &spi_cfg, &handle->spi);
+    if (ret == ESP_OK) {
+        handle->spi_clock_hz = clock_hz;
+    }
+
+    return ret;
+}
+
+// Internal: Write and read back register and FIFO patterns at the current clock
+static bool spi_link_test(sx1276_handle_t handle)
+{
+    static const uint8_t patterns[] = {0x00, 0xFF, 0x55, 0xAA, 0x0F, 0xF0, 0x96, 0x69};
+    uint8_t fifo[SPI_TEST_FIFO_LEN];
+
+    // RegFifoAddrPtr is a plain read/write register
+    for (int i = 0; i < sizeof(patterns); i++) {
+        sx1276_write_reg(handle, REG_FIFO_ADDR_PTR, patterns[i]);
+        if (sx1276_read_reg(handle, REG_FIFO_ADDR_PTR) != patterns[i]) {
+            return false;
+        }
+    }
+
+    for (int round = 0; round < SPI_TEST_ROUNDS; round++) {
+        for (int i = 0; i < SPI_TEST_FIFO_LEN; i++) {
+            fifo[i] = (uint8_t)(i * 37 + round * 101) ^ (i & 1 ? 0xA5 : 0x5A);
+        }
+
+        sx1276_write_reg(handle, REG_FIFO_ADDR_PTR, 0);
+        sx1276_write_fifo(handle, fifo, SPI_TEST_FIFO_LEN);
+        sx1276_write_reg(handle, REG_FIFO_ADDR_PTR, 0);
+        fifo_read_start(handle, handle->rx_packet->data, SPI_TEST_FIFO_LEN);
+        fifo_read_finish(handle);
+
+        if (memcmp(fifo, handle->rx_packet->data, SPI_TEST_FIFO_LEN) != 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Internal: Pick the SPI clock one step below the fastest that passes,
+// capped at the chip limit
+static void calibrate_spi_clock(sx1276_handle_t handle)
+{
+    int highest = -1;
+
+    for (int i = 0; i < SPI_CLOCK_STEPS; i++) {
+        if (attach_spi(handle, s_spi_clocks[i]) != ESP_OK || !spi_link_test(handle)) {
+            break;
+        }
+        highest = i;
+    }
+
+    int pick = (highest > 0) ? highest - 1 : 0;
+    while (pick > 0 && s_spi_clocks[pick] > SPI_MAX_CLOCK_HZ) {
+        pick--;
+    }
+
+    if (attach_spi(handle, s_spi_clocks[pick]) != ESP_OK) {
+        attach_spi(handle, s_spi_clocks[SPI_DEFAULT_STEP]);
+        handle->spi_clock_step = SPI_DEFAULT_STEP;
+        return;
+    }
+    handle->spi_clock_step = pick;
+
+    // Test transfers are not RX traffic
+    handle->fifo_reads = 0;
+    handle->fifo_us_total = 0;
+    handle->fifo_us_max = 0;
+
+    if (highest < 0) {
+        ESP_LOGE(TAG, "SPI self-test failed at %d Hz, check wiring", s_spi_clocks[0]);
+    } else {
+        ESP_LOGI(TAG, "SPI self-test: passes up to %d Hz, using %d Hz",
+                 s_spi_clocks[highest], handle->spi_clock_hz);
+    }
+}
+
+// Internal: Re-read a received payload and compare (caller holds the mutex)
+static void spot_check(sx1276_handle_t handle, uint8_t fifo_addr, uint8_t len)
+{
+    sx1276_write_reg(handle, REG_FIFO_ADDR_PTR, fifo_addr);
+    fifo_read_start(handle, handle->tx_dma, len);
+    fifo_read_finish(handle);
+    handle->spot_checks++;
+
+    if (memcmp(handle->tx_dma, handle->rx_packet->data, len) == 0) {
+        return;
+    }
+
+    handle->spi_errors++;
+    handle->spi_errors_at_step++;
+    ESP_LOGW(TAG, "SPI spot check mismatch at %d Hz", handle->spi_clock_hz);
+
+    // Marginal link: give up one clock step
+    if (handle->spi_errors_at_step >= SPI_SPOT_ERROR_LIMIT && handle->spi_clock_step > 0) {
+        handle->spi_clock_step--;
+        handle->spi_errors_at_step = 0;
+        if (attach_spi(handle, s_spi_clocks[handle->spi_clock_step]) == ESP_OK) {
+            ESP_LOGW(TAG, "SPI clock lowered to %d Hz", handle->spi_clock_hz);
+        }
+    }
+}
+
+// Internal: Chip select for every transaction on this device (ISR or task).
+// gpio_ll is inlined, so CS still toggles while the flash cache is off;
+// gpio_set_level() lives in flash.
+static void IRAM_ATTR spi_pre_cb(spi_transaction_t *trans)
+{
+    sx1276_handle_t handle = (sx1276_handle_t)trans->user;
+
+    uint32_t bits = trans->length;
+    if (trans->flags & SPI_TRANS_VARIABLE_ADDR) {
+        bits += ((spi_transaction_ext_t *)trans)->address_bits;
+    }
+    handle->spi_transactions++;
+    handle->spi_wire_bytes += bits / 8;
+
+    gpio_ll_set_level(&GPIO, handle->pins.cs, 0);
+}
+
+static void IRAM_ATTR spi_post_cb(spi_transaction_t *trans)
 {
-    uint8_t tx_data[2] = {reg | 0x80, value};
-    uint8_t rx_data[2];
+    gpio_ll_set_level(&GPIO, ((sx1276_handle_t)trans->user)->pins.cs, 1);
+}
 
+static esp_err_t sx1276_write_reg(sx1276_handle_t handle, uint8_t reg, uint8_t value)
+{
     spi_transaction_t trans = {
+        .flags = SPI_TRANS_USE_TXDATA,
         .length = 16,
-        .tx_buffer = tx_data,
-        .rx_buffer = rx_data,
+        .tx_data = {reg | 0x80, value},
+        .user = handle,
     };
 
-    gpio_set_level(handle->pins.cs, 0);
-    esp_err_t ret = spi_device_transmit(handle->spi, &trans);
-    gpio_set_level(handle->pins.cs, 1);
+    return spi_device_transmit(handle->spi, &trans);
+}
 
-    return ret;
+// Internal: Register write without the interrupt/semaphore round trip of
+// spi_device_transmit(), for time-critical triggers
+static esp_err_t write_reg_polling(sx1276_handle_t handle, uint8_t reg, uint8_t value)
+{
+    spi_transaction_t trans = {
+        .flags = SPI_TRANS_USE_TXDATA,
+        .length = 16,
+        .tx_data = {reg | 0x80, value},
+        .user = handle,
+    };
+
+    return spi_device_polling_transmit(handle->spi, &trans);
 }
 
 static uint8_t sx1276_read_reg(sx1276_handle_t handle, uint8_t reg)
 {
-    uint8_t tx_data[2] = {reg & 0x7F, 0x00};
-    uint8_t rx_data[2];
-
     spi_transaction_t trans = {
+        .flags = SPI_TRANS_USE_TXDATA | SPI_TRANS_USE_RXDATA,
         .length = 16,
-        .tx_buffer = tx_data,
-        .rx_buffer = rx_data,
+        .tx_data = {reg & 0x7F, 0x00},
+        .user = handle,
     };
 
-    gpio_set_level(handle->pins.cs, 0);
     spi_device_transmit(handle->spi, &trans);
-    gpio_set_level(handle->pins.cs, 1);
 
-    return rx_data[1];
+    return trans.rx_data[1];
 }
 
-static esp_err_t sx1276_write_fifo(sx1276_handle_t handle, const uint8_t *data, uint8_t len)
+// Internal: Read up to 4 consecutive registers in one transaction
+static esp_err_t read_burst(sx1276_handle_t handle, uint8_t reg, uint8_t *data, uint8_t len)
 {
-    uint8_t tx_buf[257];
-    tx_buf[0] = REG_FIFO | 0x80;
-    memcpy(&tx_buf[1], data, len);
-
-    spi_transaction_t trans = {
-        .length = (len + 1) * 8,
-        .tx_buffer = tx_buf,
+    spi_transaction_ext_t trans = {
+        .base = {
+            .flags = SPI_TRANS_VARIABLE_ADDR | SPI_TRANS_USE_RXDATA,
+            .addr = reg & 0x7F,
+            .length = len * 8,
+            .user = handle,
+        },
+        .address_bits = 8,
     };
 
-    gpio_set_level(handle->pins.cs, 0);
-    esp_err_t ret = spi_device_transmit(handle->spi, &trans);
-    gpio_set_level(handle->pins.cs, 1);
+    esp_err_t ret = spi_device_transmit(handle->spi, &trans.base);
+    memcpy(data, trans.base.rx_data, len);
 
     return ret;
 }
 
-static esp_err_t sx1276_read_fifo(sx1276_handle_t handle, uint8_t *data, uint8_t len)
+// Internal: Write consecutive registers in one transaction (caller holds
+// the mutex; goes through the TX DMA buffer like the FIFO)
+static esp_err_t write_burst(sx1276_handle_t handle, uint8_t reg, const uint8_t *data, uint8_t len)
 {
-    uint8_t tx_buf[257] = {REG_FIFO & 0x7F};
-    uint8_t rx_buf[257];
+    memcpy(handle->tx_dma, data, len);
+
+    spi_transaction_ext_t trans = {
+        .base = {
+            .flags = SPI_TRANS_VARIABLE_ADDR,
+            .addr = reg | 0x80,
+            .length = len * 8,
+            .tx_buffer = handle->tx_dma,
+            .user = handle,
+        },
+        .address_bits = 8,
+    };
 
-    spi_transaction_t trans = {
-        .length = (len + 1) * 8,
-        .tx_buffer = tx_buf,
-        .rx_buffer = rx_buf,
+    return spi_device_transmit(handle->spi, &trans.base);
+}
+
+static esp_err_t sx1276_write_fifo(sx1276_handle_t handle, const uint8_t *data, uint8_t len)
+{
+    // Register address goes in the address phase, payload straight from
+    // the preallocated DMA buffer
+    memcpy(handle->tx_dma, data, len);
+
+    spi_transaction_ext_t trans = {
+        .base = {
+            .flags = SPI_TRANS_VARIABLE_ADDR,
+            .addr = REG_FIFO | 0x80,
+            .length = len * 8,
+            .tx_buffer = handle->tx_dma,
+            .user = handle,
+        },
+        .address_bits = 8,
+    };
+
+    return spi_device_transmit(handle->spi, &trans.base);
+}
+
+// Internal: Queue a FIFO read by DMA straight into dest. dest must be
+// DMA-capable and word-aligned; up to 3 bytes past len are written. No other
+// transaction may be issued on the device until fifo_read_finish().
+static esp_err_t fifo_read_start(sx1276_handle_t handle, uint8_t *dest, uint8_t len)
+{
+    // Whole words keep the driver from bouncing through a temporary buffer
+    uint32_t words = (len + 3) & ~3u;
+
+    handle->fifo_trans = (spi_transaction_ext_t){
+        .base = {
+            .flags = SPI_TRANS_VARIABLE_ADDR,
+            .addr = REG_FIFO & 0x7F,
+            .length = words * 8,
+            .rxlength = words * 8,
+            .rx_buffer = dest,
+            .user = handle,
+        },
+        .address_bits = 8,
     };
 
-    gpio_set_level(handle->pins.cs, 0);
-    esp_err_t ret = spi_device_transmit(handle->spi, &trans);
-    gpio_set_level(handle->pins.cs, 1);
+    handle->fifo_start = (uint32_t)esp_timer_get_time();
+    return spi_device_queue_trans(handle->spi, &handle->fifo_trans.base, portMAX_DELAY);
+}
+
+// Internal: Wait for the FIFO read queued by fifo_read_start()
+static esp_err_t fifo_read_finish(sx1276_handle_t handle)
+{
+    spi_transaction_t *done;
+
+    esp_err_t ret = spi_device_get_trans_result(handle->spi, &done, portMAX_DELAY);
+
+    uint32_t elapsed = (uint32_t)esp_timer_get_time() - handle->fifo_start;
+    handle->fifo_reads++;
+    handle->fifo_us_total += elapsed;
+    if (elapsed > handle->fifo_us_max) {
+        handle->fifo_us_max = elapsed;
+    }
 
-    memcpy(data, &rx_buf[1], len);
     return ret;
 }
 
 esp_err_t sx1276_set_mode(sx1276_handle_t handle, sx1276_mode_t mode)
 {
-    if (!handle) {
+    if (!handle || mode > SX1276_MODE_CAD) {
         return ESP_ERR_INVALID_ARG;
     }
 
+    radio_cmd_t cmd = {.type = SX1276_CMD_MODE, .mode = mode};
+    return run_cmd(handle, &cmd);
+}
+
+// Internal: Write RegOpMode (caller holds the mutex)
+static esp_err_t write_mode(sx1276_handle_t handle, sx1276_mode_t mode)
+{
     uint8_t op_mode = MODE_LONG_RANGE_MODE;
 
     switch (mode) {
@@ -287,10 +733,15 @@ esp_err_t sx1276_set_mode(sx1276_handle_t handle, sx1276_mode_t mode)
             return ESP_ERR_INVALID_ARG;
     }
 
-    xSemaphoreTake(handle->mutex, portMAX_DELAY);
     sx1276_write_reg(handle, REG_OP_MODE, op_mode);
     handle->current_mode = mode;
-    xSemaphoreGive(handle->mutex);
+    handle->rx_in_progress = false;
+
+    // Any other mode abandons a loaded or running downlink
+    if (mode != SX1276_MODE_FSTX && mode != SX1276_MODE_TX) {
+        handle->tx_prepared = false;
+        handle->is_transmitting = false;
+    }
 
     return ESP_OK;
 }
@@ -311,16 +762,35 @@ esp_err_t sx1276_set_frequency(sx1276_handle_t handle, uint32_t frequency)
         return ESP_ERR_INVALID_ARG;
     }
 
+    radio_cmd_t cmd = {.type = SX1276_CMD_RETUNE, .frequency = frequency};
+    return run_cmd(handle, &cmd);
+}
+
+esp_err_t sx1276_set_frequency_async(sx1276_handle_t handle, uint32_t frequency)
+{
+    if (!handle) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    radio_cmd_t cmd = {.type = SX1276_CMD_RETUNE, .frequency = frequency};
+    if (!handle->service_task || xTaskGetCurrentTaskHandle() == handle->service_task) {
+        return run_cmd(handle, &cmd);
+    }
+
+    cmd.submitted = (uint32_t)esp_timer_get_time();
+    post_coalesced(handle, &cmd);
+    return ESP_OK;
+}
+
+// Internal: Write RegFrf (caller holds the mutex)
+static void write_frequency(sx1276_handle_t handle, uint32_t frequency)
+{
     uint64_t frf = ((uint64_t)frequency << 19) / 32000000;
 
-    xSemaphoreTake(handle->mutex, portMAX_DELAY);
     sx1276_write_reg(handle, REG_FRF_MSB, (uint8_t)(frf >> 16));
     sx1276_write_reg(handle, REG_FRF_MID, (uint8_t)(frf >> 8));
     sx1276_write_reg(handle, REG_FRF_LSB, (uint8_t)(frf >> 0));
     handle->config.frequency = frequency;
-    xSemaphoreGive(handle->mutex);
-
-    return ESP_OK;
 }
 
 esp_err_t sx1276_set_spreading_factor(sx1276_handle_t handle, sx1276_spreading_factor_t sf)
@@ -329,69 +799,215 @@ esp_err_t sx1276_set_spreading_factor(sx1276_handle_t handle, sx1276_spreading_f
         return ESP_ERR_INVALID_ARG;
     }
 
-    xSemaphoreTake(handle->mutex, portMAX_DELAY);
+    sx1276_config_t config = handle->config;
+    config.sf = sf;
+    return set_config_modem(handle, &config);
+}
 
-    uint8_t config2 = sx1276_read_reg(handle, REG_MODEM_CONFIG_2);
-    config2 = (config2 & 0x0F) | (sf << 4);
-    sx1276_write_reg(handle, REG_MODEM_CONFIG_2, config2);
+esp_err_t sx1276_set_bandwidth(sx1276_handle_t handle, sx1276_bandwidth_t bw)
+{
+    if (!handle || bw > SX1276_BW_500_KHZ) {
+        return ESP_ERR_INVALID_ARG;
+    }
 
-    // SF6 requires special settings
-    if (sf == SX1276_SF_6) {
-        sx1276_write_reg(handle, REG_DETECT_OPTIMIZE, DETECT_OPTIMIZE_SF6);
-        sx1276_write_reg(handle, REG_DETECTION_THRESHOLD, DETECTION_THRESHOLD_SF6);
-    } else {
-        sx1276_write_reg(handle, REG_DETECT_OPTIMIZE, DETECT_OPTIMIZE_SF7_12);
-        sx1276_write_reg(handle, REG_DETECTION_THRESHOLD, DETECTION_THRESHOLD_SF7_12);
+    sx1276_config_t config = handle->config;
+    config.bw = bw;
+    return set_config_modem(handle, &config);
+}
+
+esp_err_t sx1276_set_coding_rate(sx1276_handle_t handle, sx1276_coding_rate_t cr)
+{
+    if (!handle || cr < SX1276_CR_4_5 || cr > SX1276_CR_4_8) {
+        return ESP_ERR_INVALID_ARG;
     }
 
-    // Enable LDR optimization for SF11/SF12 and low bandwidth
-    uint8_t config3 = sx1276_read_reg(handle, REG_MODEM_CONFIG_3);
-    if (sf >= SX1276_SF_11 && handle->config.bw <= SX1276_BW_125_KHZ) {
-        config3 |= 0x08;  // LowDataRateOptimize
-    } else {
-        config3 &= ~0x08;
+    sx1276_config_t config = handle->config;
+    config.cr = cr;
+    return set_config_modem(handle, &config);
+}
+
+esp_err_t sx1276_set_modulation(sx1276_handle_t handle, sx1276_spreading_factor_t sf,
+                                sx1276_bandwidth_t bw, sx1276_coding_rate_t cr)
+{
+    if (!handle || sf < SX1276_SF_6 || sf > SX1276_SF_12 || bw > SX1276_BW_500_KHZ ||
+        cr < SX1276_CR_4_5 || cr > SX1276_CR_4_8) {
+        return ESP_ERR_INVALID_ARG;
     }
-    sx1276_write_reg(handle, REG_MODEM_CONFIG_3, config3);
 
-    handle->config.sf = sf;
-    xSemaphoreGive(handle->mutex);
+    sx1276_config_t config = handle->config;
+    config.sf = sf;
+    config.bw = bw;
+    config.cr = cr;
+    return set_config_modem(handle, &config);
+}
 
-    return ESP_OK;
+uint32_t sx1276_get_frequency(sx1276_handle_t handle)
+{
+    return handle ? handle->config.frequency : 0;
 }
 
-esp_err_t sx1276_set_bandwidth(sx1276_handle_t handle, sx1276_bandwidth_t bw)
+esp_err_t sx1276_get_modulation(sx1276_handle_t handle, sx1276_spreading_factor_t *sf,
+                                sx1276_bandwidth_t *bw, sx1276_coding_rate_t *cr)
 {
-    if (!handle || bw > SX1276_BW_500_KHZ) {
+    if (!handle || !sf || !bw || !cr) {
         return ESP_ERR_INVALID_ARG;
     }
 
-    xSemaphoreTake(handle->mutex, portMAX_DELAY);
+    *sf = handle->config.sf;
+    *bw = handle->config.bw;
+    *cr = handle->config.cr;
 
-    uint8_t config1 = sx1276_read_reg(handle, REG_MODEM_CONFIG_1);
-    config1 = (config1 & 0x0F) | (bw << 4);
-    sx1276_write_reg(handle, REG_MODEM_CONFIG_1, config1);
+    return ESP_OK;
+}
 
-    handle->config.bw = bw;
-    xSemaphoreGive(handle->mutex);
+esp_err_t sx1276_profile_compile(const sx1276_modem_params_t *params,
+                                 sx1276_modem_profile_t *profile)
+{
+    if (!params || !profile || params->sf < SX1276_SF_6 || params->sf > SX1276_SF_12 ||
+        params->bw > SX1276_BW_500_KHZ || params->cr < SX1276_CR_4_5 ||
+        params->cr > SX1276_CR_4_8) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    uint8_t *modem = profile->modem;
+    bool sf6 = params->sf == SX1276_SF_6;
+
+    // Symbol time 2^SF / BW above 16 ms (SF11/BW125, SF12/BW125 and BW250, ...)
+    bool ldro = ((uint32_t)1 << params->sf) * 1000 > LDRO_SYMBOL_MS * s_bw_hz[params->bw];
+
+    modem[PROFILE_MC1] = (params->bw << 4) | (params->cr << 1) |
+                         (params->implicit_header ? MODEM_CONFIG1_IMPLICIT_HEADER : 0);
+    modem[PROFILE_MC2] = (params->sf << 4) | (params->crc_on ? MODEM_CONFIG2_RX_CRC : 0);
+    modem[PROFILE_SYMB_TIMEOUT] = 0x64;     // Reset value, single RX only
+    modem[PROFILE_PREAMBLE_MSB] = params->preamble_length >> 8;
+    modem[PROFILE_PREAMBLE_LSB] = params->preamble_length & 0xFF;
+    modem[PROFILE_PAYLOAD_LENGTH] = params->payload_length ? params->payload_length : 1;
+    modem[PROFILE_MAX_PAYLOAD] = 0xFF;
+    modem[REG_HOP_PERIOD - REG_MODEM_CONFIG_1] = 0x00;          // No FHSS
+    modem[REG_FIFO_RX_BYTE_ADDR - REG_MODEM_CONFIG_1] = 0x00;   // Read-only
+    modem[PROFILE_MC3] = ldro ? MODEM_CONFIG3_LDRO : 0;         // AGC merged on apply
+
+    profile->detect_optimize = sf6 ? DETECT_OPTIMIZE_SF6 : DETECT_OPTIMIZE_SF7_12;
+    profile->detection_threshold = sf6 ? DETECTION_THRESHOLD_SF6 : DETECTION_THRESHOLD_SF7_12;
+    profile->invert_iq = INVERT_IQ_RESERVED | (params->invert_iq_rx ? INVERT_IQ_RX : 0) |
+                         (params->invert_iq_tx ? INVERT_IQ_TX : 0);
+    profile->invert_iq_2 = (params->invert_iq_rx || params->invert_iq_tx) ? 0x19 : 0x1D;
 
     return ESP_OK;
 }
 
-esp_err_t sx1276_set_coding_rate(sx1276_handle_t handle, sx1276_coding_rate_t cr)
+esp_err_t sx1276_profile_apply(sx1276_handle_t handle, const sx1276_modem_profile_t *profile)
 {
-    if (!handle || cr < SX1276_CR_4_5 || cr > SX1276_CR_4_8) {
+    if (!handle || !profile) {
         return ESP_ERR_INVALID_ARG;
     }
 
-    xSemaphoreTake(handle->mutex, portMAX_DELAY);
+    radio_cmd_t cmd = {.type = SX1276_CMD_MODEM, .modem.profile = *profile};
+    return run_cmd(handle, &cmd);
+}
 
-    uint8_t config1 = sx1276_read_reg(handle, REG_MODEM_CONFIG_1);
-    config1 = (config1 & 0xF1) | (cr << 1);
-    sx1276_write_reg(handle, REG_MODEM_CONFIG_1, config1);
+// Internal: Write a profile, skipping registers that already hold it
+// (caller holds the mutex)
+static void apply_profile(sx1276_handle_t handle, const sx1276_modem_profile_t *profile)
+{
+    sx1276_modem_profile_t next = *profile;
+    const sx1276_modem_profile_t *prev = &handle->profile;
+    bool all = !handle->profile_valid;
 
-    handle->config.cr = cr;
-    xSemaphoreGive(handle->mutex);
+    if (handle->rx_gain.lna_gain == SX1276_LNA_AGC) {
+        next.modem[PROFILE_MC3] |= MODEM_CONFIG3_AGC_AUTO;
+    } else {
+        next.modem[PROFILE_MC3] &= ~MODEM_CONFIG3_AGC_AUTO;
+    }
+
+    if (all || memcmp(next.modem, prev->modem, SX1276_PROFILE_REGS) != 0) {
+        write_burst(handle, REG_MODEM_CONFIG_1, next.modem, SX1276_PROFILE_REGS);
+    }
+    if (all || next.detect_optimize != prev->detect_optimize) {
+        sx1276_write_reg(handle, REG_DETECT_OPTIMIZE, next.detect_optimize);
+    }
+    if (all || next.detection_threshold != prev->detection_threshold) {
+        sx1276_write_reg(handle, REG_DETECTION_THRESHOLD, next.detection_threshold);
+    }
+    if (all || next.invert_iq != prev->invert_iq) {
+        sx1276_write_reg(handle, REG_INVERT_IQ, next.invert_iq);
+    }
+    if (all || next.invert_iq_2 != prev->invert_iq_2) {
+        sx1276_write_reg(handle, REG_INVERT_IQ_2, next.invert_iq_2);
+    }
+
+    handle->profile = next;
+    handle->profile_valid = true;
+}
+
+// Internal: Modem parameters of a configuration (RX image, maximum payload)
+static void config_params(const sx1276_config_t *config, sx1276_modem_params_t *params)
+{
+    *params = (sx1276_modem_params_t){
+        .sf = config->sf,
+        .bw = config->bw,
+        .cr = config->cr,
+        .preamble_length = config->preamble_length,
+        .payload_length = SX1276_MAX_PACKET_SIZE,
+        .crc_on = config->crc_on,
+        .implicit_header = config->implicit_header,
+        .invert_iq_rx = config->invert_iq_rx,
+        .invert_iq_tx = config->invert_iq_tx,
+    };
+}
+
+// Internal: Compile and apply the stored configuration (caller holds the mutex)
+static void apply_config_profile(sx1276_handle_t handle)
+{
+    sx1276_modem_params_t params;
+    sx1276_modem_profile_t profile;
+
+    config_params(&handle->config, &params);
+    if (sx1276_profile_compile(&params, &profile) == ESP_OK) {
+        apply_profile(handle, &profile);
+    }
+}
+
+// Internal: Make the modulation of a configuration the configured one
+static esp_err_t set_config_modem(sx1276_handle_t handle, const sx1276_config_t *config)
+{
+    radio_cmd_t cmd = {.type = SX1276_CMD_MODEM, .modem.store = true};
+
+    config_params(config, &cmd.modem.params);
+    esp_err_t ret = sx1276_profile_compile(&cmd.modem.params, &cmd.modem.profile);
+    if (ret != ESP_OK) {
+        return ret;
+    }
 
+    return run_cmd(handle, &cmd);
+}
+
+esp_err_t sx1276_set_modulation_async(sx1276_handle_t handle, sx1276_spreading_factor_t sf,
+                                      sx1276_bandwidth_t bw, sx1276_coding_rate_t cr)
+{
+    if (!handle || sf < SX1276_SF_6 || sf > SX1276_SF_12 || bw > SX1276_BW_500_KHZ ||
+        cr < SX1276_CR_4_5 || cr > SX1276_CR_4_8) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    sx1276_config_t config = handle->config;
+    config.sf = sf;
+    config.bw = bw;
+    config.cr = cr;
+
+    radio_cmd_t cmd = {.type = SX1276_CMD_MODEM, .modem.store = true};
+    config_params(&config, &cmd.modem.params);
+    esp_err_t ret = sx1276_profile_compile(&cmd.modem.params, &cmd.modem.profile);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    if (!handle->service_task || xTaskGetCurrentTaskHandle() == handle->service_task) {
+        return run_cmd(handle, &cmd);
+    }
+
+    cmd.submitted = (uint32_t)esp_timer_get_time();
+    post_coalesced(handle, &cmd);
     return ESP_OK;
 }
 
@@ -402,7 +1018,15 @@ esp_err_t sx1276_set_tx_power(sx1276_handle_t handle, int8_t power)
     }
 
     xSemaphoreTake(handle->mutex, portMAX_DELAY);
+    write_tx_power(handle, power);
+    xSemaphoreGive(handle->mutex);
+
+    return ESP_OK;
+}
 
+// Internal: Write the PA settings for a TX power (caller holds the mutex)
+static void write_tx_power(sx1276_handle_t handle, int8_t power)
+{
     if (power > 17) {
         // Use PA_BOOST with +20dBm capability
         sx1276_write_reg(handle, REG_PA_DAC, 0x87);  // Enable +20dBm
@@ -421,9 +1045,6 @@ esp_err_t sx1276_set_tx_power(sx1276_handle_t handle, int8_t power)
     sx1276_write_reg(handle, REG_OCP, 0x2B);  // 100mA
 
     handle->config.tx_power = power;
-    xSemaphoreGive(handle->mutex);
-
-    return ESP_OK;
 }
 
 esp_err_t sx1276_set_sync_word(sx1276_handle_t handle, uint8_t sync_word)
@@ -446,26 +1067,34 @@ esp_err_t sx1276_set_invert_iq(sx1276_handle_t handle, bool invert_rx, bool inve
         return ESP_ERR_INVALID_ARG;
     }
 
-    xSemaphoreTake(handle->mutex, portMAX_DELAY);
+    sx1276_config_t config = handle->config;
+    config.invert_iq_rx = invert_rx;
+    config.invert_iq_tx = invert_tx;
+    return set_config_modem(handle, &config);
+}
 
-    uint8_t val = sx1276_read_reg(handle, REG_INVERT_IQ);
-    if (invert_rx) {
-        val |= 0x40;
-    } else {
-        val &= ~0x40;
+esp_err_t sx1276_set_rx_gain(sx1276_handle_t handle, const sx1276_rx_gain_t *gain)
+{
+    if (!handle || !gain || gain->lna_gain > SX1276_LNA_G6) {
+        return ESP_ERR_INVALID_ARG;
     }
-    if (invert_tx) {
-        val |= 0x01;
+
+    xSemaphoreTake(handle->mutex, portMAX_DELAY);
+
+    // With AGC on, the LnaGain field is ignored; keep it at G1
+    uint8_t lna_gain = (gain->lna_gain == SX1276_LNA_AGC) ? SX1276_LNA_G1 : gain->lna_gain;
+    sx1276_write_reg(handle, REG_LNA, (lna_gain << LNA_GAIN_SHIFT) |
+                                      (gain->lna_boost ? LNA_BOOST_HF_ON : 0));
+
+    // AgcAutoOn lives in RegModemConfig3: re-apply the current profile
+    handle->rx_gain = *gain;
+    if (handle->profile_valid) {
+        sx1276_modem_profile_t profile = handle->profile;
+        apply_profile(handle, &profile);
     } else {
-        val &= ~0x01;
+        apply_config_profile(handle);
     }
-    sx1276_write_reg(handle, REG_INVERT_IQ, val);
 
-    // Also set INVERT_IQ_2 register
-    sx1276_write_reg(handle, REG_INVERT_IQ_2, (invert_rx || invert_tx) ? 0x19 : 0x1D);
-
-    handle->config.invert_iq_rx = invert_rx;
-    handle->config.invert_iq_tx = invert_tx;
     xSemaphoreGive(handle->mutex);
 
     return ESP_OK;
@@ -483,58 +1112,30 @@ esp_err_t sx1276_apply_config(sx1276_handle_t handle, const sx1276_config_t *con
     // Set frequency
     sx1276_set_frequency(handle, config->frequency);
 
-    // Set modulation parameters
-    sx1276_set_bandwidth(handle, config->bw);
-    sx1276_set_spreading_factor(handle, config->sf);
-    sx1276_set_coding_rate(handle, config->cr);
-
     // Set TX power
     sx1276_set_tx_power(handle, config->tx_power);
 
     // Set sync word
     sx1276_set_sync_word(handle, config->sync_word);
 
-    // Set preamble length
     xSemaphoreTake(handle->mutex, portMAX_DELAY);
-    sx1276_write_reg(handle, REG_PREAMBLE_MSB, (config->preamble_length >> 8) & 0xFF);
-    sx1276_write_reg(handle, REG_PREAMBLE_LSB, config->preamble_length & 0xFF);
 
-    // Set CRC and implicit header
-    uint8_t config1 = sx1276_read_reg(handle, REG_MODEM_CONFIG_1);
-    if (config->implicit_header) {
-        config1 |= MODEM_CONFIG1_IMPLICIT_HEADER;
-    } else {
-        config1 &= ~MODEM_CONFIG1_IMPLICIT_HEADER;
-    }
-    sx1276_write_reg(handle, REG_MODEM_CONFIG_1, config1);
+    // Modulation, preamble, CRC, header mode, LDRO, AGC and IQ in one profile
+    handle->config = *config;
+    apply_config_profile(handle);
 
-    uint8_t config2 = sx1276_read_reg(handle, REG_MODEM_CONFIG_2);
-    if (config->crc_on) {
-        config2 |= MODEM_CONFIG2_RX_CRC;
-    } else {
-        config2 &= ~MODEM_CONFIG2_RX_CRC;
-    }
-    sx1276_write_reg(handle, REG_MODEM_CONFIG_2, config2);
+    // LNA gain (AGC + boost unless a gain profile was selected)
+    uint8_t lna_gain = (handle->rx_gain.lna_gain == SX1276_LNA_AGC) ?
+                       SX1276_LNA_G1 : handle->rx_gain.lna_gain;
+    sx1276_write_reg(handle, REG_LNA, (lna_gain << LNA_GAIN_SHIFT) |
+                                      (handle->rx_gain.lna_boost ? LNA_BOOST_HF_ON : 0));
 
     // Set FIFO base addresses
     sx1276_write_reg(handle, REG_FIFO_TX_BASE_ADDR, 0x00);
     sx1276_write_reg(handle, REG_FIFO_RX_BASE_ADDR, 0x00);
 
-    // Enable AGC auto
-    uint8_t config3 = sx1276_read_reg(handle, REG_MODEM_CONFIG_3);
-    config3 |= 0x04;  // AGC auto on
-    sx1276_write_reg(handle, REG_MODEM_CONFIG_3, config3);
-
-    // Set LNA gain
-    sx1276_write_reg(handle, REG_LNA, 0x23);  // LNA gain max, LNA boost on
-
     xSemaphoreGive(handle->mutex);
 
-    // Set IQ inversion
-    sx1276_set_invert_iq(handle, config->invert_iq_rx, config->invert_iq_tx);
-
-    handle->config = *config;
-
     return ESP_OK;
 }
 
@@ -544,24 +1145,30 @@ esp_err_t sx1276_start_rx(sx1276_handle_t handle, sx1276_rx_callback_t callback,
         return ESP_ERR_INVALID_ARG;
     }
 
-    xSemaphoreTake(handle->mutex, portMAX_DELAY);
+    radio_cmd_t cmd = {
+        .type = SX1276_CMD_START_RX,
+        .rx = {.callback = callback, .user_data = user_data},
+    };
+    return run_cmd(handle, &cmd);
+}
 
+// Internal: Arm continuous RX (caller holds the mutex)
+static void start_rx(sx1276_handle_t handle, sx1276_rx_callback_t callback, void *user_data)
+{
     handle->rx_callback = callback;
     handle->rx_user_data = user_data;
 
     // Clear IRQ flags
     sx1276_write_reg(handle, REG_IRQ_FLAGS, 0xFF);
 
-    // Set DIO0 to RxDone
-    sx1276_write_reg(handle, REG_DIO_MAPPING_1, DIO0_RX_DONE);
+    // Set DIO0 to RxDone, DIO3 to ValidHeader
+    sx1276_write_reg(handle, REG_DIO_MAPPING_1, DIO0_RX_DONE | DIO3_VALID_HEADER);
 
     // Set FIFO address
     sx1276_write_reg(handle, REG_FIFO_ADDR_PTR, 0x00);
 
-    xSemaphoreGive(handle->mutex);
-
     // Start continuous RX
-    return sx1276_set_mode(handle, SX1276_MODE_RX_CONTINUOUS);
+    write_mode(handle, SX1276_MODE_RX_CONTINUOUS);
 }
 
 esp_err_t sx1276_stop_rx(sx1276_handle_t handle)
@@ -574,15 +1181,46 @@ esp_err_t sx1276_stop_rx(sx1276_handle_t handle)
     return sx1276_set_mode(handle, SX1276_MODE_STANDBY);
 }
 
-esp_err_t sx1276_transmit(sx1276_handle_t handle, const sx1276_tx_packet_t *packet,
-                          sx1276_tx_callback_t callback, void *user_data)
+esp_err_t sx1276_tx_prepare(sx1276_handle_t handle, const sx1276_tx_packet_t *packet, bool prelock,
+                            sx1276_tx_callback_t callback, void *user_data)
 {
     if (!handle || !packet || packet->length > SX1276_MAX_PACKET_SIZE) {
         return ESP_ERR_INVALID_ARG;
     }
 
-    xSemaphoreTake(handle->mutex, portMAX_DELAY);
+    // Downlink modulation with the payload length folded into the image
+    const sx1276_config_t *config = &handle->config;
+    sx1276_modem_params_t params = {
+        .sf = packet->sf ? packet->sf : config->sf,
+        .bw = packet->sf ? packet->bw : config->bw,
+        .cr = packet->sf ? packet->cr : config->cr,
+        .preamble_length = config->preamble_length,
+        .payload_length = packet->length,
+        .crc_on = config->crc_on,
+        .implicit_header = config->implicit_header,
+        .invert_iq_rx = packet->invert_iq,
+        .invert_iq_tx = packet->invert_iq,
+    };
+    radio_cmd_t cmd = {
+        .type = SX1276_CMD_TX_LOAD,
+        .tx_load = {
+            .packet = packet,
+            .prelock = prelock,
+            .callback = callback,
+            .user_data = user_data,
+        },
+    };
+    if (sx1276_profile_compile(&params, &cmd.tx_load.profile) != ESP_OK) {
+        return ESP_ERR_INVALID_ARG;
+    }
 
+    return run_cmd(handle, &cmd);
+}
+
+// Internal: Load a downlink into the FIFO (caller holds the mutex)
+static void tx_load(sx1276_handle_t handle, const sx1276_tx_packet_t *packet,
+                    const sx1276_modem_profile_t *profile, bool prelock)
+{
     // Go to standby mode
     sx1276_write_reg(handle, REG_OP_MODE, MODE_LONG_RANGE_MODE | MODE_STDBY);
 
@@ -594,11 +1232,8 @@ esp_err_t sx1276_transmit(sx1276_handle_t handle, const sx1276_tx_packet_t *pack
         sx1276_write_reg(handle, REG_FRF_LSB, (uint8_t)(frf >> 0));
     }
 
-    // Set IQ inversion for TX
-    if (packet->invert_iq) {
-        sx1276_write_reg(handle, REG_INVERT_IQ, 0x01 | 0x40);
-        sx1276_write_reg(handle, REG_INVERT_IQ_2, 0x19);
-    }
+    // Modulation, IQ inversion and payload length
+    apply_profile(handle, profile);
 
     // Clear IRQ flags
     sx1276_write_reg(handle, REG_IRQ_FLAGS, 0xFF);
@@ -613,85 +1248,399 @@ esp_err_t sx1276_transmit(sx1276_handle_t handle, const sx1276_tx_packet_t *pack
     // Write payload to FIFO
     sx1276_write_fifo(handle, packet->data, packet->length);
 
-    // Set payload length
-    sx1276_write_reg(handle, REG_PAYLOAD_LENGTH, packet->length);
-
-    handle->tx_callback = callback;
-    handle->tx_user_data = user_data;
     handle->is_transmitting = true;
+    handle->tx_prepared = true;
+    handle->rx_in_progress = false;
 
-    // Delay if specified
-    if (packet->tx_delay_us > 0) {
-        xSemaphoreGive(handle->mutex);
-        esp_rom_delay_us(packet->tx_delay_us);
-        xSemaphoreTake(handle->mutex, portMAX_DELAY);
+    // Lock the synthesizer now so PLL settling is outside the start window
+    if (prelock) {
+        sx1276_write_reg(handle, REG_OP_MODE, MODE_LONG_RANGE_MODE | MODE_FSTX);
+        handle->current_mode = SX1276_MODE_FSTX;
+    } else {
+        handle->current_mode = SX1276_MODE_STANDBY;
     }
+}
 
-    // Start transmission
-    sx1276_write_reg(handle, REG_OP_MODE, MODE_LONG_RANGE_MODE | MODE_TX);
+esp_err_t sx1276_tx_fire(sx1276_handle_t handle, uint32_t start_time, uint32_t *fire_time)
+{
+    if (!handle) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // Spin here, preemptible by the radios' service tasks, up to a short
+    // handoff margin; the executor spins the rest at its own priority
+    uint32_t handoff = start_time - handle->fire_latency_us - CMD_FIRE_HANDOFF_US;
+    while ((int32_t)(handoff - (uint32_t)esp_timer_get_time()) > 0) {
+    }
+
+    radio_cmd_t cmd = {.type = SX1276_CMD_TX_FIRE, .tx_fire.start_time = start_time};
+    esp_err_t ret = run_cmd(handle, &cmd);
+
+    if (fire_time) {
+        *fire_time = cmd.tx_fire.fire_time;
+    }
+
+    return ret;
+}
+
+// Internal: Start a loaded TX at the given time (caller holds the mutex)
+static esp_err_t tx_fire(sx1276_handle_t handle, uint32_t start_time, uint32_t *fire_time)
+{
+    if (!handle->tx_prepared) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // Spin to the start time, less the trigger write's own duration
+    uint32_t target = start_time - handle->fire_latency_us;
+    while ((int32_t)(target - (uint32_t)esp_timer_get_time()) > 0) {
+    }
+
+    uint32_t t0 = (uint32_t)esp_timer_get_time();
+    esp_err_t ret = write_reg_polling(handle, REG_OP_MODE, MODE_LONG_RANGE_MODE | MODE_TX);
+    uint32_t t1 = (uint32_t)esp_timer_get_time();
+
+    handle->fire_latency_us = t1 - t0;
     handle->current_mode = SX1276_MODE_TX;
+    handle->tx_prepared = false;
+    *fire_time = t1;
 
-    xSemaphoreGive(handle->mutex);
+    return ret;
+}
 
-    return ESP_OK;
+esp_err_t sx1276_transmit(sx1276_handle_t handle, const sx1276_tx_packet_t *packet,
+                          sx1276_tx_callback_t callback, void *user_data)
+{
+    esp_err_t ret = sx1276_tx_prepare(handle, packet, false, callback, user_data);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    return sx1276_tx_fire(handle, (uint32_t)esp_timer_get_time() + packet->tx_delay_us, NULL);
+}
+
+uint32_t sx1276_get_tx_done_time(sx1276_handle_t handle)
+{
+    return handle ? handle->tx_done_time : 0;
 }
 
 static void IRAM_ATTR dio0_isr_handler(void *arg)
 {
     sx1276_handle_t handle = (sx1276_handle_t)arg;
-    if (!handle) {
+    if (!handle || !handle->service_task) {
+        return;
+    }
+
+    BaseType_t higher_priority_task_woken = pdFALSE;
+
+    // Capture the event time here; the service task does the SPI work
+    handle->irq_time = esp_timer_get_time();
+    xTaskNotifyFromISR(handle->service_task, EVT_DIO0, eSetBits, &higher_priority_task_woken);
+
+    portYIELD_FROM_ISR(higher_priority_task_woken);
+}
+
+// DIO3 = ValidHeader: a packet is arriving, RxDone follows after the payload
+static void IRAM_ATTR dio3_isr_handler(void *arg)
+{
+    sx1276_handle_t handle = (sx1276_handle_t)arg;
+    if (!handle || !handle->service_task) {
         return;
     }
 
     BaseType_t higher_priority_task_woken = pdFALSE;
 
-    uint8_t irq_flags = sx1276_read_reg(handle, REG_IRQ_FLAGS);
+    handle->header_time = esp_timer_get_time();
+    handle->rx_in_progress = true;
+    xTaskNotifyFromISR(handle->service_task, EVT_HEADER, eSetBits, &higher_priority_task_woken);
+
+    portYIELD_FROM_ISR(higher_priority_task_woken);
+}
+
+// Internal: ValidHeader in task context
+static void handle_header(sx1276_handle_t handle)
+{
+    // DIO3 stays high until the flag is cleared; clear it for the next edge
+    xSemaphoreTake(handle->mutex, portMAX_DELAY);
+    sx1276_write_reg(handle, REG_IRQ_FLAGS, IRQ_VALID_HEADER);
+    xSemaphoreGive(handle->mutex);
+
+    handle->headers++;
+    if (handle->header_callback) {
+        handle->header_callback(handle->header_time, handle->header_user_data);
+    }
+}
+
+// Internal: DIO0 service task and command executor
+static void service_task(void *arg)
+{
+    sx1276_handle_t handle = (sx1276_handle_t)arg;
+
+    while (1) {
+        uint32_t events = 0;
+        xTaskNotifyWait(0, UINT32_MAX, &events, portMAX_DELAY);
+
+        // A header and its RxDone can arrive in one wakeup: header first
+        if (events & EVT_HEADER) {
+            handle_header(handle);
+        }
+
+        if (events & EVT_DIO0) {
+            // ISR-to-task wakeup cost
+            uint32_t latency = (uint32_t)esp_timer_get_time() - handle->irq_time;
+            handle->irq_count++;
+            handle->irq_latency_total += latency;
+            if (latency > handle->irq_latency_max) {
+                handle->irq_latency_max = latency;
+            }
+
+            handle_irq(handle);
+        }
+
+        // Commands after the radio events, so an RxDone is never held
+        // behind a queue of retunes
+        if (events & EVT_CMD) {
+            run_pending_cmds(handle);
+        }
+    }
+}
+
+// Internal: Execute a command on the radio's executor, or inline before the
+// executor exists, and wait for it
+static esp_err_t run_cmd(sx1276_handle_t handle, radio_cmd_t *cmd)
+{
+    esp_err_t result = ESP_OK;
+    cmd->result = &result;
+    cmd->submitted = (uint32_t)esp_timer_get_time();
+
+    if (!handle->service_task || xTaskGetCurrentTaskHandle() == handle->service_task) {
+        xSemaphoreTake(handle->mutex, portMAX_DELAY);
+        exec_cmd(handle, cmd);
+        xSemaphoreGive(handle->mutex);
+        return result;
+    }
+
+    StaticSemaphore_t done_buf;
+    cmd->done = xSemaphoreCreateBinaryStatic(&done_buf);
+
+    if (cmd->type < CMD_COALESCED) {
+        post_coalesced(handle, cmd);
+    } else {
+        xQueueSend(handle->cmd_queue, &cmd, portMAX_DELAY);
+        xTaskNotify(handle->service_task, EVT_CMD, eSetBits);
+    }
+
+    xSemaphoreTake(cmd->done, portMAX_DELAY);
+    vSemaphoreDelete(cmd->done);
+
+    return result;
+}
+
+// Internal: Post a retune or modem change, replacing one still pending.
+// The slot holds a copy; a caller waiting on the replaced command is
+// released, its setting superseded.
+static void post_coalesced(sx1276_handle_t handle, const radio_cmd_t *cmd)
+{
+    radio_cmd_t *slot = &handle->coalesced[cmd->type];
+    SemaphoreHandle_t superseded = NULL;
+
+    taskENTER_CRITICAL(&handle->cmd_lock);
+    if (handle->coalesced_pending[cmd->type]) {
+        handle->cmd_stats[cmd->type].coalesced++;
+        superseded = slot->done;
+        if (slot->result) {
+            *slot->result = ESP_OK;
+        }
+    }
+    *slot = *cmd;
+    handle->coalesced_pending[cmd->type] = true;
+    taskEXIT_CRITICAL(&handle->cmd_lock);
+
+    if (superseded) {
+        xSemaphoreGive(superseded);
+    }
+    xTaskNotify(handle->service_task, EVT_CMD, eSetBits);
+}
+
+// Internal: Run the coalesced slots, then the ordered queue, then a posted
+// busy probe (its callback after the mutex is released)
+static void run_pending_cmds(sx1276_handle_t handle)
+{
+    radio_cmd_t cmd;
+    radio_cmd_t *queued;
+    sx1276_busy_callback_t probe_callback = NULL;
+    void *probe_user_data = NULL;
+    bool busy = false;
+
+    xSemaphoreTake(handle->mutex, portMAX_DELAY);
+
+    for (int type = 0; type < CMD_COALESCED; type++) {
+        taskENTER_CRITICAL(&handle->cmd_lock);
+        bool pending = handle->coalesced_pending[type];
+        if (pending) {
+            cmd = handle->coalesced[type];
+            handle->coalesced_pending[type] = false;
+        }
+        taskEXIT_CRITICAL(&handle->cmd_lock);
+
+        if (pending) {
+            exec_cmd(handle, &cmd);
+        }
+    }
+
+    while (xQueueReceive(handle->cmd_queue, &queued, 0) == pdTRUE) {
+        exec_cmd(handle, queued);
+    }
+
+    uint32_t submitted = 0;
+    taskENTER_CRITICAL(&handle->cmd_lock);
+    if (handle->probe_pending) {
+        probe_callback = handle->probe_callback;
+        probe_user_data = handle->probe_user_data;
+        submitted = handle->probe_submitted;
+        handle->probe_pending = false;
+    }
+    taskEXIT_CRITICAL(&handle->cmd_lock);
+
+    if (probe_callback) {
+        busy = probe_busy(handle, submitted);
+    }
+
+    xSemaphoreGive(handle->mutex);
+
+    // The callback may issue commands, which run inline and take the mutex
+    if (probe_callback) {
+        probe_callback(busy, probe_user_data);
+    }
+}
+
+// Internal: Execute one command (caller holds the mutex)
+static void exec_cmd(sx1276_handle_t handle, radio_cmd_t *cmd)
+{
+    esp_err_t ret = ESP_OK;
+    uint32_t latency = (uint32_t)esp_timer_get_time() - cmd->submitted;
+
+    cmd_stats_t *stats = &handle->cmd_stats[cmd->type];
+    stats->executed++;
+    stats->latency_total += latency;
+    if (latency > stats->latency_max) {
+        stats->latency_max = latency;
+    }
+
+    switch (cmd->type) {
+        case SX1276_CMD_RETUNE:
+            write_frequency(handle, cmd->frequency);
+            break;
+        case SX1276_CMD_MODEM:
+            apply_profile(handle, &cmd->modem.profile);
+            if (cmd->modem.store) {
+                handle->config.sf = cmd->modem.params.sf;
+                handle->config.bw = cmd->modem.params.bw;
+                handle->config.cr = cmd->modem.params.cr;
+                handle->config.invert_iq_rx = cmd->modem.params.invert_iq_rx;
+                handle->config.invert_iq_tx = cmd->modem.params.invert_iq_tx;
+            }
+            break;
+        case SX1276_CMD_MODE:
+            ret = write_mode(handle, cmd->mode);
+            break;
+        case SX1276_CMD_START_RX:
+            start_rx(handle, cmd->rx.callback, cmd->rx.user_data);
+            break;
+        case SX1276_CMD_TX_LOAD:
+            tx_load(handle, cmd->tx_load.packet, &cmd->tx_load.profile, cmd->tx_load.prelock);
+            handle->tx_callback = cmd->tx_load.callback;
+            handle->tx_user_data = cmd->tx_load.user_data;
+            break;
+        case SX1276_CMD_TX_FIRE:
+            ret = tx_fire(handle, cmd->tx_fire.start_time, &cmd->tx_fire.fire_time);
+            break;
+        case SX1276_CMD_CAD:
+            ret = run_cad(handle, &cmd->is_free);
+            break;
+        case SX1276_CMD_STATUS:
+            // RegModemStat, RegPktSnrValue, RegPktRssiValue, RegRssiValue
+            ret = read_burst(handle, REG_MODEM_STAT, cmd->status, 4);
+            break;
+        default:
+            ret = ESP_ERR_INVALID_ARG;
+            break;
+    }
+
+    if (cmd->result) {
+        *cmd->result = ret;
+    }
+    if (cmd->done) {
+        xSemaphoreGive(cmd->done);
+    }
+}
+
+// Internal: Handle DIO0 (RxDone / TxDone) in task context
+static void handle_irq(sx1276_handle_t handle)
+{
+    sx1276_rx_packet_t *packet = handle->rx_packet;
+    bool rx_done = false;
+    bool tx_done = false;
+    uint8_t meta[2];
+
+    xSemaphoreTake(handle->mutex, portMAX_DELAY);
+
+    // RegIrqFlags and RegRxNbBytes are adjacent: one transaction
+    read_burst(handle, REG_IRQ_FLAGS, meta, 2);
+    uint8_t irq_flags = meta[0];
 
     if (irq_flags & IRQ_RX_DONE) {
         // Handle RX Done
         if (handle->rx_callback) {
-            sx1276_rx_packet_t packet = {0};
-
-            // Get payload length
-            packet.length = sx1276_read_reg(handle, REG_RX_NB_BYTES);
-
             // Set FIFO address to current RX address
             uint8_t fifo_addr = sx1276_read_reg(handle, REG_FIFO_RX_CURRENT_ADDR);
             sx1276_write_reg(handle, REG_FIFO_ADDR_PTR, fifo_addr);
 
-            // Read payload
-            sx1276_read_fifo(handle, packet.data, packet.length);
-
-            // Get RSSI and SNR
-            packet.rssi = sx1276_read_reg(handle, REG_PKT_RSSI_VALUE) - 157;
-            packet.snr = (int8_t)sx1276_read_reg(handle, REG_PKT_SNR_VALUE) / 4;
+            // Start the payload DMA, fill in metadata while it runs
+            fifo_read_start(handle, packet->data, meta[1]);
 
             // Check CRC
-            packet.crc_ok = !(irq_flags & IRQ_PAYLOAD_CRC_ERROR);
+            packet->crc_ok = !(irq_flags & IRQ_PAYLOAD_CRC_ERROR);
 
-            // Get timestamp
-            packet.timestamp = esp_timer_get_time();
+            // Timestamp of the RxDone interrupt, and of ValidHeader if seen
+            packet->timestamp = handle->irq_time;
+            packet->header_timestamp = handle->rx_in_progress ? handle->header_time : 0;
 
             // Store config info
-            packet.frequency = handle->config.frequency;
-            packet.sf = handle->config.sf;
-            packet.bw = handle->config.bw;
-            packet.cr = handle->config.cr;
+            packet->frequency = handle->config.frequency;
+            packet->sf = handle->config.sf;
+            packet->bw = handle->config.bw;
+            packet->cr = handle->config.cr;
+
+            fifo_read_finish(handle);
 
-            handle->rx_callback(&packet, handle->rx_user_data);
+            // Set after the DMA: a 255-byte read is rounded up into this field
+            packet->length = meta[1];
+
+            if (++handle->spot_counter >= SPI_SPOT_CHECK_INTERVAL) {
+                handle->spot_counter = 0;
+                spot_check(handle, fifo_addr, packet->length);
+            }
+
+            // RegPktSnrValue and RegPktRssiValue are adjacent
+            read_burst(handle, REG_PKT_SNR_VALUE, meta, 2);
+            packet->snr = (int8_t)meta[0] / 4;
+            packet->rssi = meta[1] - 157;
+
+            packet->freq_error = read_freq_error(handle);
+
+            rx_done = true;
         }
 
         // Clear RX Done flag and restart RX if in continuous mode
-        sx1276_write_reg(handle, REG_IRQ_FLAGS, IRQ_RX_DONE | IRQ_PAYLOAD_CRC_ERROR);
+        sx1276_write_reg(handle, REG_IRQ_FLAGS, IRQ_RX_DONE | IRQ_PAYLOAD_CRC_ERROR | IRQ_VALID_HEADER);
+        handle->rx_in_progress = false;
     }
 
     if (irq_flags & IRQ_TX_DONE) {
         // Handle TX Done
         handle->is_transmitting = false;
-
-        if (handle->tx_callback) {
-            handle->tx_callback(true, handle->tx_user_data);
-        }
+        handle->tx_done_time = handle->irq_time;
+        tx_done = true;
 
         // Clear TX Done flag
         sx1276_write_reg(handle, REG_IRQ_FLAGS, IRQ_TX_DONE);
@@ -701,31 +1650,120 @@ static void IRAM_ATTR dio0_isr_handler(void *arg)
         handle->current_mode = SX1276_MODE_STANDBY;
     }
 
-    portYIELD_FROM_ISR(higher_priority_task_woken);
+    xSemaphoreGive(handle->mutex);
+
+    // Callbacks run without the device lock so they may use the driver API
+    if (rx_done && handle->rx_callback) {
+        handle->rx_callback(packet, handle->rx_user_data);
+    }
+    if (tx_done && handle->tx_callback) {
+        handle->tx_callback(true, handle->tx_user_data);
+    }
+}
+
+// Internal: Frequency error of the last packet in Hz (caller holds the mutex)
+static int32_t read_freq_error(sx1276_handle_t handle)
+{
+    // 20-bit two's complement across RegFeiMsb[3:0], RegFeiMid, RegFeiLsb
+    uint8_t raw[3];
+    read_burst(handle, REG_FEI_MSB, raw, 3);
+    int32_t fei = ((raw[0] & 0x0F) << 16) | (raw[1] << 8) | raw[2];
+    if (fei & 0x80000) {
+        fei -= 0x100000;
+    }
+
+    // Ferr = FEI * 2^24 / Fxtal * BW / 500 kHz
+    uint32_t bw = (handle->config.bw <= SX1276_BW_500_KHZ) ? s_bw_hz[handle->config.bw] : 125000;
+    return (int32_t)((int64_t)fei * (1 << 24) * bw / (32000000LL * 500000));
+}
+
+esp_err_t sx1276_get_service_stats(sx1276_handle_t handle, sx1276_service_stats_t *stats)
+{
+    if (!handle || !stats) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memset(stats, 0, sizeof(sx1276_service_stats_t));
+    stats->irqs = handle->irq_count;
+    stats->irq_latency_max_us = handle->irq_latency_max;
+    if (handle->irq_count > 0) {
+        stats->irq_latency_avg_us = handle->irq_latency_total / handle->irq_count;
+    }
+    stats->headers = handle->headers;
+    stats->spi_clock_hz = handle->spi_clock_hz;
+    stats->spot_checks = handle->spot_checks;
+    stats->spi_errors = handle->spi_errors;
+    stats->spi_transactions = handle->spi_transactions;
+    stats->spi_wire_bytes = handle->spi_wire_bytes;
+    stats->fifo_reads = handle->fifo_reads;
+    stats->fifo_read_max_us = handle->fifo_us_max;
+    if (handle->fifo_reads > 0) {
+        stats->fifo_read_avg_us = handle->fifo_us_total / handle->fifo_reads;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t sx1276_get_cmd_stats(sx1276_handle_t handle, sx1276_cmd_stats_t stats[SX1276_CMD_COUNT])
+{
+    if (!handle || !stats) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    for (int i = 0; i < SX1276_CMD_COUNT; i++) {
+        const cmd_stats_t *cmd = &handle->cmd_stats[i];
+        stats[i].executed = cmd->executed;
+        stats[i].coalesced = cmd->coalesced;
+        stats[i].latency_max_us = cmd->latency_max;
+        stats[i].latency_avg_us = cmd->executed ? cmd->latency_total / cmd->executed : 0;
+    }
+
+    return ESP_OK;
+}
+
+const char *sx1276_cmd_name(sx1276_cmd_type_t type)
+{
+    return (type < SX1276_CMD_COUNT) ? s_cmd_names[type] : "unknown";
+}
+
+// Internal: Read RegModemStat .. RegRssiValue through the executor
+static esp_err_t read_status(sx1276_handle_t handle, uint8_t status[4])
+{
+    radio_cmd_t cmd = {.type = SX1276_CMD_STATUS};
+    esp_err_t ret = run_cmd(handle, &cmd);
+
+    memcpy(status, cmd.status, 4);
+    return ret;
 }
 
 int16_t sx1276_get_packet_rssi(sx1276_handle_t handle)
 {
-    if (!handle) {
+    uint8_t status[4];
+
+    if (!handle || read_status(handle, status) != ESP_OK) {
         return 0;
     }
-    return sx1276_read_reg(handle, REG_PKT_RSSI_VALUE) - 157;
+    return status[2] - 157;
 }
 
 int8_t sx1276_get_packet_snr(sx1276_handle_t handle)
 {
-    if (!handle) {
+    uint8_t status[4];
+
+    if (!handle || read_status(handle, status) != ESP_OK) {
         return 0;
     }
-    return (int8_t)sx1276_read_reg(handle, REG_PKT_SNR_VALUE) / 4;
+    return (int8_t)status[1] / 4;
 }
 
 int16_t sx1276_get_rssi(sx1276_handle_t handle)
 {
-    if (!handle) {
+    uint8_t status[4];
+
+    if (!handle || read_status(handle, status) != ESP_OK) {
         return 0;
     }
-    return sx1276_read_reg(handle, REG_RSSI_VALUE) - 157;
+    return status[3] - 157;
 }
 
 esp_err_t sx1276_channel_free(sx1276_handle_t handle, bool *is_free)
@@ -734,8 +1772,16 @@ esp_err_t sx1276_channel_free(sx1276_handle_t handle, bool *is_free)
         return ESP_ERR_INVALID_ARG;
     }
 
-    xSemaphoreTake(handle->mutex, portMAX_DELAY);
+    radio_cmd_t cmd = {.type = SX1276_CMD_CAD};
+    esp_err_t ret = run_cmd(handle, &cmd);
+
+    *is_free = cmd.is_free;
+    return ret;
+}
 
+// Internal: Channel activity detection (caller holds the mutex)
+static esp_err_t run_cad(sx1276_handle_t handle, bool *is_free)
+{
     // Clear IRQ flags
     sx1276_write_reg(handle, REG_IRQ_FLAGS, 0xFF);
 
@@ -746,7 +1792,6 @@ esp_err_t sx1276_channel_free(sx1276_handle_t handle, bool *is_free)
     uint32_t start = esp_timer_get_time();
     while (!(sx1276_read_reg(handle, REG_IRQ_FLAGS) & IRQ_CAD_DONE)) {
         if ((esp_timer_get_time() - start) > 100000) {  // 100ms timeout
-            xSemaphoreGive(handle->mutex);
             return ESP_ERR_TIMEOUT;
         }
         vTaskDelay(1);
@@ -757,12 +1802,229 @@ esp_err_t sx1276_channel_free(sx1276_handle_t handle, bool *is_free)
     // Clear flags and go to standby
     sx1276_write_reg(handle, REG_IRQ_FLAGS, IRQ_CAD_DONE | IRQ_CAD_DETECTED);
     sx1276_write_reg(handle, REG_OP_MODE, MODE_LONG_RANGE_MODE | MODE_STDBY);
+    handle->current_mode = SX1276_MODE_STANDBY;
+
+    return ESP_OK;
+}
+
+// Internal: Busy from RegModemStat; a lost packet's header is forgotten
+static bool status_busy(sx1276_handle_t handle, const uint8_t status[4])
+{
+    bool busy = (status[0] & (MODEM_STAT_SIGNAL_DETECTED | MODEM_STAT_SIGNAL_SYNC |
+                         MODEM_STAT_HEADER_VALID)) != 0;
+    if (!busy) {
+        handle->rx_in_progress = false;
+    }
+
+    return busy;
+}
+
+bool sx1276_rx_busy(sx1276_handle_t handle)
+{
+    if (!handle || handle->current_mode != SX1276_MODE_RX_CONTINUOUS) {
+        return false;
+    }
+
+    // ValidHeader seen and RxDone pending: busy without an SPI read, unless
+    // the header is old enough that the packet may have been lost
+    if (sx1276_rx_header_pending(handle)) {
+        return true;
+    }
+
+    uint8_t status[4];
+    if (read_status(handle, status) != ESP_OK) {
+        return false;
+    }
+
+    return status_busy(handle, status);
+}
+
+// Internal: sx1276_rx_busy() on the executor (caller holds the mutex)
+static bool probe_busy(sx1276_handle_t handle, uint32_t submitted)
+{
+    if (handle->current_mode != SX1276_MODE_RX_CONTINUOUS) {
+        return false;
+    }
+    if (sx1276_rx_header_pending(handle)) {
+        return true;
+    }
+
+    esp_err_t ret = ESP_OK;
+    radio_cmd_t cmd = {.type = SX1276_CMD_STATUS, .submitted = submitted, .result = &ret};
+    exec_cmd(handle, &cmd);
 
+    return ret == ESP_OK && status_busy(handle, cmd.status);
+}
+
+esp_err_t sx1276_rx_busy_async(sx1276_handle_t handle, sx1276_busy_callback_t callback,
+                               void *user_data)
+{
+    if (!handle || !callback) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (!handle->service_task || xTaskGetCurrentTaskHandle() == handle->service_task) {
+        callback(sx1276_rx_busy(handle), user_data);
+        return ESP_OK;
+    }
+
+    taskENTER_CRITICAL(&handle->cmd_lock);
+    handle->probe_callback = callback;
+    handle->probe_user_data = user_data;
+    handle->probe_submitted = (uint32_t)esp_timer_get_time();
+    handle->probe_pending = true;
+    taskEXIT_CRITICAL(&handle->cmd_lock);
+
+    xTaskNotify(handle->service_task, EVT_CMD, eSetBits);
+    return ESP_OK;
+}
+
+bool sx1276_rx_header_pending(sx1276_handle_t handle)
+{
+    return handle && handle->current_mode == SX1276_MODE_RX_CONTINUOUS &&
+           handle->rx_in_progress &&
+           (uint32_t)esp_timer_get_time() - handle->header_time < HEADER_RECHECK_US;
+}
+
+esp_err_t sx1276_set_header_callback(sx1276_handle_t handle, sx1276_header_callback_t callback,
+                                     void *user_data)
+{
+    if (!handle) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (handle->pins.dio3 == GPIO_NUM_NC) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    handle->header_user_data = user_data;
+    handle->header_callback = callback;
+
+    return ESP_OK;
+}
+
+// Internal: Switch to the FSK register page (caller holds the mutex)
+static void enter_fsk(sx1276_handle_t handle, uint8_t fsk_mode)
+{
+    // LongRangeMode can only change in sleep
+    sx1276_write_reg(handle, REG_OP_MODE, MODE_LONG_RANGE_MODE | MODE_SLEEP);
+    sx1276_write_reg(handle, REG_OP_MODE, MODE_SLEEP);
+    sx1276_write_reg(handle, REG_OP_MODE, fsk_mode);
+    handle->current_mode = SX1276_MODE_SLEEP;
+}
+
+// Internal: Back to the LoRa register page, in sleep (caller holds the mutex)
+static void leave_fsk(sx1276_handle_t handle)
+{
+    sx1276_write_reg(handle, REG_OP_MODE, MODE_SLEEP);
+    sx1276_write_reg(handle, REG_OP_MODE, MODE_LONG_RANGE_MODE | MODE_SLEEP);
+
+    // The FSK page shares these addresses; rewrite the whole profile next time
+    handle->profile_valid = false;
+}
+
+// Internal: Rewrite LoRa settings after an FSK visit and resume the previous
+// mode (caller holds the mutex). The settings come from the live
+// configuration under the same hold as the visit: a retune or modem change
+// posted meanwhile runs after this, on top, instead of being written over.
+static void resume_lora(sx1276_handle_t handle, sx1276_mode_t prev_mode)
+{
+    write_mode(handle, SX1276_MODE_STANDBY);
+    write_frequency(handle, handle->config.frequency);
+    write_tx_power(handle, handle->config.tx_power);
+    sx1276_write_reg(handle, REG_SYNC_WORD, handle->config.sync_word);
+    apply_config_profile(handle);
+
+    uint8_t lna_gain = (handle->rx_gain.lna_gain == SX1276_LNA_AGC) ?
+                       SX1276_LNA_G1 : handle->rx_gain.lna_gain;
+    sx1276_write_reg(handle, REG_LNA, (lna_gain << LNA_GAIN_SHIFT) |
+                                      (handle->rx_gain.lna_boost ? LNA_BOOST_HF_ON : 0));
+    sx1276_write_reg(handle, REG_FIFO_TX_BASE_ADDR, 0x00);
+    sx1276_write_reg(handle, REG_FIFO_RX_BASE_ADDR, 0x00);
+
+    if (prev_mode == SX1276_MODE_RX_CONTINUOUS) {
+        start_rx(handle, handle->rx_callback, handle->rx_user_data);
+    } else {
+        write_mode(handle, prev_mode);
+    }
+}
+
+esp_err_t sx1276_read_temperature(sx1276_handle_t handle, int8_t *temperature)
+{
+    if (!handle || !temperature) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    xSemaphoreTake(handle->mutex, portMAX_DELAY);
+
+    // The FSK visit would lose a loaded downlink's modulation
+    sx1276_mode_t prev_mode = handle->current_mode;
+    if (prev_mode == SX1276_MODE_TX || handle->tx_prepared) {
+        xSemaphoreGive(handle->mutex);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // The sensor runs in FSK FSRX with the temperature monitor on
+    enter_fsk(handle, MODE_FSRX);
+    uint8_t cal = sx1276_read_reg(handle, REG_FSK_IMAGE_CAL);
+    sx1276_write_reg(handle, REG_FSK_IMAGE_CAL, cal & ~IMAGE_CAL_TEMP_MONITOR_OFF);
+    esp_rom_delay_us(150);
+    sx1276_write_reg(handle, REG_FSK_IMAGE_CAL, cal | IMAGE_CAL_TEMP_MONITOR_OFF);
+    sx1276_write_reg(handle, REG_OP_MODE, MODE_SLEEP);
+
+    // Sign-magnitude, -1 LSB per degree; uncalibrated offset
+    uint8_t raw = sx1276_read_reg(handle, REG_FSK_TEMP);
+    *temperature = (raw & 0x80) ? (int8_t)(255 - raw) : -(int8_t)raw;
+
+    leave_fsk(handle);
+    resume_lora(handle, prev_mode);
     xSemaphoreGive(handle->mutex);
 
     return ESP_OK;
 }
 
+esp_err_t sx1276_calibrate_image(sx1276_handle_t handle)
+{
+    if (!handle) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t ret = ESP_OK;
+
+    xSemaphoreTake(handle->mutex, portMAX_DELAY);
+
+    // The FSK visit would lose a loaded downlink's modulation
+    sx1276_mode_t prev_mode = handle->current_mode;
+    if (prev_mode == SX1276_MODE_TX || handle->tx_prepared) {
+        xSemaphoreGive(handle->mutex);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // Image and RSSI calibration run in FSK standby at the current FRF
+    enter_fsk(handle, MODE_STDBY);
+    uint8_t cal = sx1276_read_reg(handle, REG_FSK_IMAGE_CAL);
+    sx1276_write_reg(handle, REG_FSK_IMAGE_CAL, cal | IMAGE_CAL_START);
+
+    int64_t start = esp_timer_get_time();
+    while (sx1276_read_reg(handle, REG_FSK_IMAGE_CAL) & IMAGE_CAL_RUNNING) {
+        if ((esp_timer_get_time() - start) > 20000) {  // Typically ~10 ms
+            ret = ESP_ERR_TIMEOUT;
+            break;
+        }
+        esp_rom_delay_us(100);
+    }
+
+    leave_fsk(handle);
+    resume_lora(handle, prev_mode);
+    xSemaphoreGive(handle->mutex);
+
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Image calibration timed out");
+    }
+
+    return ret;
+}
+
 uint8_t sx1276_get_version(sx1276_handle_t handle)
 {
     if (!handle) {
@@ -64,6 +64,29 @@
 #define REG_AGC_THRESH_3            0x64
 #define REG_PLL                     0x70
 
+// FSK/OOK page registers (only valid with LongRangeMode = 0)
+#define REG_FSK_IMAGE_CAL           0x3B
+#define REG_FSK_TEMP                0x3C
+
+// Image calibration (REG_FSK_IMAGE_CAL)
+#define IMAGE_CAL_START             0x40
+#define IMAGE_CAL_RUNNING           0x20
+#define IMAGE_CAL_TEMP_MONITOR_OFF  0x01
+
+// LNA (REG_LNA)
+#define LNA_GAIN_SHIFT              5
+#define LNA_BOOST_HF_ON             0x03
+
+// Modem config 3
+#define MODEM_CONFIG3_AGC_AUTO      0x04
+#define MODEM_CONFIG3_LDRO          0x08
+
+// Modem status (REG_MODEM_STAT)
+#define MODEM_STAT_SIGNAL_DETECTED  0x01
+#define MODEM_STAT_SIGNAL_SYNC      0x02
+#define MODEM_STAT_RX_ONGOING       0x04
+#define MODEM_STAT_HEADER_VALID     0x08
+
 // Operating modes (REG_OP_MODE)
 #define MODE_LONG_RANGE_MODE        0x80
 #define MODE_ACCESS_SHARED_REG      0x40
@@ -147,6 +170,11 @@
 #define DETECTION_THRESHOLD_SF7_12  0x0A
 #define DETECTION_THRESHOLD_SF6     0x0C
 
+// RegInvertIQ (reserved bits 5:1 keep their reset value 0x26)
+#define INVERT_IQ_RESERVED          0x26
+#define INVERT_IQ_RX                0x40
+#define INVERT_IQ_TX                0x01
+
 // LoRaWAN sync word
 #define LORA_MAC_PUBLIC_SYNCWORD    0x34
 #define LORA_MAC_PRIVATE_SYNCWORD   0x12
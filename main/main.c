@@ -14,6 +14,7 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -21,16 +22,25 @@
 #include "esp_log.h"
 #include "nvs_flash.h"
 #include "esp_timer.h"
+#include "esp_heap_caps.h"
 
 #include "gateway_config.h"
+#include "flash_scheduler.h"
 #include "network_manager.h"
 #include "lora_gateway.h"
+#include "lora_codec.h"
+#include "gw_trace.h"
 #include "packet_forwarder.h"
 
 static const char *TAG = "main";
 
+#define RX_LOG_BACKLOG          8       // Uplinks waiting for the serial log
+#define UPLINK_FWD_BACKLOG      8       // Uplinks waiting to be encoded for the forwarder
+#define UPLINK_FWD_PRIORITY     9       // Below gw_rx_task, above the forwarder senders
+
 // Forward declarations
-static void rx_packet_handler(const lora_rx_packet_t *packet, void *user_data);
+static void uplink_fwd_task(void *arg);
+static void rx_log_task(void *arg);
 static void network_event_handler(net_interface_t interface, net_status_t status, void *user_data);
 static void print_gateway_info(void);
 static void status_task(void *arg);
@@ -42,6 +52,9 @@ void app_main(void)
     ESP_LOGI(TAG, "  ESP32 + Dual SX1276");
     ESP_LOGI(TAG, "========================================");
 
+    // Recover the pipeline trace of the previous boot before anything records
+    gw_trace_init();
+
     // Initialize NVS
     esp_err_t ret = nvs_flash_init();
     if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
@@ -95,7 +108,7 @@ void app_main(void)
 
     gateway_config_t gw_config = {
         .spi_host = SPI2_HOST,
-        .rx_callback = rx_packet_handler,
+        .rx_callback = NULL,
         .rx_user_data = NULL,
         .tx_callback = NULL,
         .tx_user_data = NULL,
@@ -108,11 +121,12 @@ void app_main(void)
         .dio0 = CONFIG_SX1276_RX_DIO0_GPIO,
         .dio1 = CONFIG_SX1276_RX_DIO1_GPIO,
         .dio2 = CONFIG_SX1276_RX_DIO2_GPIO,
+        .dio3 = CONFIG_SX1276_RX_DIO3_GPIO,
     };
     gw_config.radio[0].config = (sx1276_config_t){
         .frequency = config->lora.channels[0].frequency,
         .sf = config->lora.rx_sf,
-        .bw = config->lora.rx_bw,
+        .bw = lora_gateway_bw_to_radio(config->lora.rx_bw),
         .cr = SX1276_CR_4_5,
         .tx_power = config->lora.tx_power,
         .sync_word = config->lora.sync_word,
@@ -131,6 +145,7 @@ void app_main(void)
         .dio0 = CONFIG_SX1276_TX_DIO0_GPIO,
         .dio1 = CONFIG_SX1276_TX_DIO1_GPIO,
         .dio2 = CONFIG_SX1276_TX_DIO2_GPIO,
+        .dio3 = GPIO_NUM_NC,
     };
     gw_config.radio[1].config = (sx1276_config_t){
         .frequency = 923300000,  // Default downlink frequency
@@ -153,16 +168,64 @@ void app_main(void)
         ESP_LOGE(TAG, "Check SX1276 connections!");
         // Continue to allow debugging
     } else {
+#ifdef CONFIG_GATEWAY_BENCHMARK
+        // Radios are idle until the gateway starts
+        lora_gateway_benchmark(CONFIG_GATEWAY_BENCHMARK_ITERATIONS);
+#endif
+#ifdef CONFIG_GATEWAY_SOAK_TEST
+        gateway_soak_run(CONFIG_GATEWAY_SOAK_DAYS, CONFIG_GATEWAY_SOAK_UPLINKS_PER_HOUR);
+#endif
+        // Forwarding: on a burst, the newest uplinks are worth more (RX1 is 1 s away)
+        int uplink_fwd = uplink_bus_subscribe("forwarder", UPLINK_FWD_BACKLOG,
+                                              GW_BUS_DROP_OLDEST, true);
+        if (uplink_fwd >= 0) {
+            // Core 1, like gw_rx_task: encoding stays off the network core
+            xTaskCreatePinnedToCore(uplink_fwd_task, "uplink_fwd", 4096,
+                                    (void *)(intptr_t)uplink_fwd, UPLINK_FWD_PRIORITY, NULL, 1);
+        }
+        // Serial logging is slow: let it lose old uplinks rather than hold up RX
+        int rx_log = uplink_bus_subscribe("rx_log", RX_LOG_BACKLOG, GW_BUS_DROP_OLDEST, true);
+        if (rx_log >= 0) {
+            xTaskCreate(rx_log_task, "rx_log", 3072, (void *)(intptr_t)rx_log, 3, NULL);
+        }
         // Start gateway
         ESP_ERROR_CHECK(lora_gateway_start());
         ESP_LOGI(TAG, "LoRa Gateway started");
+#ifdef CONFIG_GATEWAY_DOWNLINK_BENCHMARK
+        // Needs the TX path running, and must end before the forwarder starts
+        gateway_downlink_bench_run(CONFIG_GATEWAY_DOWNLINK_BENCHMARK_DOWNLINKS);
+#endif
     }
 
     // Initialize Packet Forwarder
     ESP_LOGI(TAG, "Initializing Packet Forwarder...");
     pkt_fwd_config_t pf_config = {0};
-    strncpy(pf_config.server_host, config->server.host, sizeof(pf_config.server_host) - 1);
-    pf_config.server_port = config->server.port;
+    strncpy(pf_config.servers[0].host, config->server.host, sizeof(pf_config.servers[0].host) - 1);
+    pf_config.servers[0].port = config->server.port;
+    pf_config.num_servers = 1;
+    pf_config.default_server = 0;
+#ifdef CONFIG_LORAWAN_SECONDARY_SERVER
+    // Second operator: its NetID and JoinEUI range go to its own server
+    strncpy(pf_config.servers[1].host, CONFIG_LORAWAN_SECONDARY_SERVER_HOST,
+            sizeof(pf_config.servers[1].host) - 1);
+    pf_config.servers[1].port = CONFIG_LORAWAN_SECONDARY_SERVER_PORT;
+    pf_config.num_servers = 2;
+
+    uint32_t netid = strtoul(CONFIG_LORAWAN_SECONDARY_NETID, NULL, 16);
+    if (pkt_fwd_route_from_netid(netid, 1, &pf_config.routes[pf_config.num_routes]) == ESP_OK) {
+        pf_config.num_routes++;
+    }
+
+    uint64_t join_eui_min = strtoull(CONFIG_LORAWAN_SECONDARY_JOINEUI_MIN, NULL, 16);
+    uint64_t join_eui_max = strtoull(CONFIG_LORAWAN_SECONDARY_JOINEUI_MAX, NULL, 16);
+    if (join_eui_max >= join_eui_min && join_eui_max != 0) {
+        pkt_fwd_route_t *route = &pf_config.routes[pf_config.num_routes++];
+        route->type = PKT_FWD_ROUTE_JOIN_EUI;
+        route->join_eui_min = join_eui_min;
+        route->join_eui_max = join_eui_max;
+        route->server = 1;
+    }
+#endif
     memcpy(pf_config.gateway_eui, config->gateway_eui, 8);
     pf_config.keepalive_interval_ms = config->server.keepalive_interval;
     pf_config.stat_interval_ms = config->server.stat_interval;
@@ -171,6 +234,13 @@ void app_main(void)
     if (ret == ESP_OK && net_manager_is_connected()) {
         pkt_fwd_start();
         ESP_LOGI(TAG, "Packet Forwarder started");
+#ifdef CONFIG_PKT_FWD_MQTT_BENCHMARK
+        pkt_fwd_mqtt_benchmark(CONFIG_PKT_FWD_MQTT_BENCHMARK_UPLINKS);
+#endif
+#ifdef CONFIG_PKT_FWD_BURST_BENCHMARK
+        pkt_fwd_burst_benchmark(CONFIG_PKT_FWD_BURST_BENCHMARK_BURSTS,
+                                CONFIG_PKT_FWD_BURST_BENCHMARK_SIZE);
+#endif
     }
 
     // Create status monitoring task
@@ -192,27 +262,49 @@ void app_main(void)
     }
 }
 
-// Callback for received LoRa packets
-static void rx_packet_handler(const lora_rx_packet_t *packet, void *user_data)
+// Forwarding of received packets (uplink bus subscriber, the forwarder's
+// only uplink producer)
+static void uplink_fwd_task(void *arg)
 {
-    if (!packet) {
-        return;
-    }
+    int sub = (int)(intptr_t)arg;
+    const lora_rx_packet_t *packet;
 
-    ESP_LOGI(TAG, "RX Packet: %d bytes, RSSI=%d dBm, SNR=%.1f dB",
-             packet->payload_size, packet->rssi, packet->snr);
+    while (1) {
+        if (!uplink_bus_receive(sub, &packet, portMAX_DELAY)) {
+            continue;
+        }
 
-    // Log first few bytes as hex
-    char hex_str[64];
-    int hex_len = (packet->payload_size > 16) ? 16 : packet->payload_size;
-    for (int i = 0; i < hex_len; i++) {
-        sprintf(&hex_str[i * 3], "%02X ", packet->payload[i]);
+        if (pkt_fwd_is_connected()) {
+            pkt_fwd_send_uplink(packet);
+        }
+
+        uplink_bus_release(packet);
     }
-    ESP_LOGI(TAG, "Data: %s%s", hex_str, (packet->payload_size > 16) ? "..." : "");
+}
+
+// Serial log of received packets (uplink bus subscriber)
+static void rx_log_task(void *arg)
+{
+    int sub = (int)(intptr_t)arg;
+    const lora_rx_packet_t *packet;
+
+    while (1) {
+        if (!uplink_bus_receive(sub, &packet, portMAX_DELAY)) {
+            continue;
+        }
+
+        ESP_LOGI(TAG, "RX Packet: %d bytes, RSSI=%d dBm, SNR=%.1f dB",
+                 packet->payload_size, packet->rssi, packet->snr);
+
+        // Log first few bytes as hex
+        char hex_str[64];
+        int hex_len = (packet->payload_size > 16) ? 16 : packet->payload_size;
+        for (int i = 0; i < hex_len; i++) {
+            sprintf(&hex_str[i * 3], "%02X ", packet->payload[i]);
+        }
+        ESP_LOGI(TAG, "Data: %s%s", hex_str, (packet->payload_size > 16) ? "..." : "");
 
-    // Forward to packet forwarder
-    if (pkt_fwd_is_connected()) {
-        pkt_fwd_send_uplink(packet);
+        uplink_bus_release(packet);
     }
 }
 
@@ -266,6 +358,16 @@ static void print_gateway_info(void)
 static void status_task(void *arg)
 {
     gateway_stats_t stats;
+    pkt_fwd_perf_t perf;
+    gw_pipeline_stats_t pipeline;
+    spsc_ring_stats_t uplink_ring;
+    pkt_fwd_spool_stats_t spool;
+    pkt_fwd_class_stats_t classes;
+    pkt_fwd_mqtt_stats_t mqtt;
+    gw_tx_timing_stats_t tx_timing;
+    gw_deadline_stats_t deadline;
+    gw_bus_stats_t bus;
+    flash_sched_stats_t flash;
 
     while (1) {
         vTaskDelay(pdMS_TO_TICKS(60000));  // Every minute
@@ -279,13 +381,138 @@ static void status_task(void *arg)
                      stats.rx_total, stats.rx_ok, stats.rx_bad);
             ESP_LOGI(TAG, "TX: total=%lu, ok=%lu, fail=%lu",
                      stats.tx_total, stats.tx_ok, stats.tx_fail);
+            channel_manager_get_tx_timing_stats(&tx_timing);
+            ESP_LOGI(TAG, "TX start (%s): n=%lu, late=%lu, timeout=%lu, fire avg=%ld max=%lu us, air avg=%ld [%ld..%ld] us",
+                     tx_timing.prelock ? "FSTX pre-lock" : "from standby",
+                     tx_timing.scheduled, tx_timing.late, tx_timing.timeouts,
+                     tx_timing.fire_err_avg_us, tx_timing.fire_err_max_us,
+                     tx_timing.start_err_avg_us, tx_timing.start_err_min_us,
+                     tx_timing.start_err_max_us);
+            ESP_LOGI(TAG, "TX queue: n=%lu, wait avg=%lu max=%lu us, late starts=%lu",
+                     tx_timing.dequeued, tx_timing.queue_wait_avg_us,
+                     tx_timing.queue_wait_max_us, tx_timing.late_starts);
+            ESP_LOGI(TAG, "Radio: noise=%d dBm, temp RX=%d C TX=%d C, recal=%lu (deferred %lu, %+d dB)",
+                     stats.noise_floor, stats.rx_temperature, stats.tx_temperature,
+                     stats.image_cal, stats.image_cal_deferred, stats.cal_noise_delta);
+            ESP_LOGI(TAG, "Gain switches: %lu, hops deferred: %lu",
+                     stats.gain_switches, stats.hops_deferred);
+            ESP_LOGI(TAG, "Devices: %lu, DL compensated=%lu, confirmed acked=%lu missed=%lu",
+                     stats.devices_tracked, stats.dl_freq_compensated,
+                     stats.dl_confirmed_acked, stats.dl_confirmed_missed);
+            ESP_LOGI(TAG, "Predictive listen: periodic=%lu, windows=%lu, hits=%lu, misses=%lu",
+                     stats.devices_periodic, stats.listen_windows,
+                     stats.listen_hits, stats.listen_misses);
+            ESP_LOGI(TAG, "Coex: retunes=%lu, RX during TX=%lu (bad=%lu), retuned=%lu (bad=%lu), "
+                     "bad outside TX=%lu",
+                     stats.coex_retunes, stats.rx_during_tx, stats.rx_during_tx_bad,
+                     stats.rx_during_tx_retuned, stats.rx_during_tx_retuned_bad,
+                     stats.rx_bad - stats.rx_during_tx_bad);
+#ifdef CONFIG_LORA_DUAL_TX
+            ESP_LOGI(TAG, "Dual TX: sent on RX radio=%lu, declined=%lu, RX blind=%lu ms (max %lu us)",
+                     stats.dual_tx_sent, stats.dual_tx_declined, stats.rx_blind_ms,
+                     stats.rx_blind_max_us);
+#endif
+            if (uplink_bus_get_stats(&bus) == ESP_OK) {
+                ESP_LOGI(TAG, "Uplink bus: published=%lu, pool exhausted=%lu, pool max=%lu/%d",
+                         bus.published, bus.pool_exhausted, bus.pool_in_use_max,
+                         UPLINK_BUS_POOL_SIZE);
+                for (int i = 0; i < bus.subscribers; i++) {
+                    ESP_LOGI(TAG, "  %s: delivered=%lu, dropped=%lu, backlog=%lu (max %lu)",
+                             bus.subs[i].name, bus.subs[i].delivered, bus.subs[i].dropped,
+                             bus.subs[i].backlog, bus.subs[i].high_water);
+                }
+            }
+            flash_sched_get_stats(&flash);
+            ESP_LOGI(TAG, "Flash: writes=%lu (failed %lu, pending %lu), steps=%lu, deferrals=%lu, "
+                     "deferred=%lu ms (max %lu), forced=%lu",
+                     flash.jobs, flash.failed, flash.pending, flash.steps, flash.deferrals,
+                     flash.deferred_ms, flash.deferred_max_ms, flash.forced);
             ESP_LOGI(TAG, "Network: %s",
                      net_manager_is_connected() ? "Connected" : "Disconnected");
             ESP_LOGI(TAG, "Server: %s",
                      pkt_fwd_is_connected() ? "Connected" : "Disconnected");
 
-            // Print heap info
-            ESP_LOGI(TAG, "Free heap: %lu bytes", esp_get_free_heap_size());
+            pkt_fwd_get_perf(&perf);
+            ESP_LOGI(TAG, "Encode (core 1): n=%lu, avg=%lu us, max=%lu us",
+                     perf.encoded, perf.encode_avg_us, perf.encode_max_us);
+            ESP_LOGI(TAG, "Forward (core 0): dgrams=%lu, uplinks=%lu, avg=%lu us, max=%lu us",
+                     perf.datagrams, perf.uplinks, perf.assemble_avg_us, perf.assemble_max_us);
+            ESP_LOGI(TAG, "RX->sent latency: avg=%lu us, max=%lu us",
+                     perf.latency_avg_us, perf.latency_max_us);
+
+            // Stage handoffs: wakeups/pushed = consumer context switches per packet
+            if (lora_gateway_get_pipeline_stats(&pipeline) == ESP_OK) {
+                ESP_LOGI(TAG, "DIO0->svc: irqs=%lu, avg=%lu us, max=%lu us, headers=%lu",
+                         pipeline.rx_radio.irqs, pipeline.rx_radio.irq_latency_avg_us,
+                         pipeline.rx_radio.irq_latency_max_us, pipeline.rx_radio.headers);
+                ESP_LOGI(TAG, "FIFO DMA: reads=%lu, avg=%lu us, max=%lu us, SPI %lu Hz (spot %lu, err %lu)",
+                         pipeline.rx_radio.fifo_reads, pipeline.rx_radio.fifo_read_avg_us,
+                         pipeline.rx_radio.fifo_read_max_us, pipeline.rx_radio.spi_clock_hz,
+                         pipeline.rx_radio.spot_checks, pipeline.rx_radio.spi_errors);
+                ESP_LOGI(TAG, "RX ring: pushed=%lu, wakeups=%lu, drop=%lu, hw=%lu, avg=%lu us, max=%lu us",
+                         pipeline.rx_ring.pushed, pipeline.rx_ring.wakeups, pipeline.rx_ring.dropped,
+                         pipeline.rx_ring.high_water, pipeline.rx_ring.handoff_avg_us,
+                         pipeline.rx_ring.handoff_max_us);
+                ESP_LOGI(TAG, "TX ring: pushed=%lu, wakeups=%lu, drop=%lu, avg=%lu us, max=%lu us",
+                         pipeline.tx_ring.pushed, pipeline.tx_ring.wakeups, pipeline.tx_ring.dropped,
+                         pipeline.tx_ring.handoff_avg_us, pipeline.tx_ring.handoff_max_us);
+                for (int i = 0; i < SX1276_CMD_COUNT; i++) {
+                    const sx1276_cmd_stats_t *rx = &pipeline.rx_cmds[i];
+                    const sx1276_cmd_stats_t *tx = &pipeline.tx_cmds[i];
+                    if (rx->executed == 0 && tx->executed == 0) {
+                        continue;
+                    }
+                    ESP_LOGI(TAG, "Radio cmd %s: RX n=%lu coalesced=%lu avg=%lu max=%lu us, "
+                             "TX n=%lu coalesced=%lu avg=%lu max=%lu us",
+                             sx1276_cmd_name(i), rx->executed, rx->coalesced,
+                             rx->latency_avg_us, rx->latency_max_us, tx->executed,
+                             tx->coalesced, tx->latency_avg_us, tx->latency_max_us);
+                }
+            }
+            if (pkt_fwd_get_ring_stats(0, &uplink_ring) == ESP_OK) {
+                ESP_LOGI(TAG, "Uplink ring: pushed=%lu, wakeups=%lu, drop=%lu, avg=%lu us, max=%lu us",
+                         uplink_ring.pushed, uplink_ring.wakeups, uplink_ring.dropped,
+                         uplink_ring.handoff_avg_us, uplink_ring.handoff_max_us);
+            }
+            if (pkt_fwd_get_spool_stats(0, &spool) == ESP_OK) {
+                ESP_LOGI(TAG, "Spool: held=%lu (%lu/%lu B), spooled=%lu, replayed=%lu, lost=%lu",
+                         spool.records, spool.bytes_used, spool.capacity,
+                         spool.spooled, spool.replayed, spool.overwritten);
+            }
+            if (pkt_fwd_get_class_stats(0, &classes) == ESP_OK) {
+                ESP_LOGI(TAG, "Pull path: rtt avg=%lu us max=%lu us, tx_ack avg=%lu us max=%lu us",
+                         classes.pull_rtt_avg_us, classes.pull_rtt_max_us,
+                         classes.tx_ack_avg_us, classes.tx_ack_max_us);
+                ESP_LOGI(TAG, "Push path: rtt avg=%lu us max=%lu us, held=%lu",
+                         classes.push_rtt_avg_us, classes.push_rtt_max_us, classes.bulk_held);
+            }
+            if (pkt_fwd_get_mqtt_stats(&mqtt) == ESP_OK) {
+                ESP_LOGI(TAG, "MQTT: published=%lu, acked=%lu, in flight=%lu/%lu, stalls=%lu, "
+                         "lost=%lu, ack avg=%lu us max=%lu us, downlinks=%lu",
+                         mqtt.published, mqtt.acked, mqtt.in_flight, mqtt.window,
+                         mqtt.window_stalls, mqtt.lost, mqtt.ack_avg_us, mqtt.ack_max_us,
+                         mqtt.downlinks);
+            }
+
+            // Stages that missed their latency budget since boot
+            for (int i = 0; i < GW_STAGE_COUNT; i++) {
+                if (deadline_monitor_get_stats(i, &deadline) == ESP_OK && deadline.overruns > 0) {
+                    ESP_LOGW(TAG, "Deadline %s: %lu/%lu over %lu us, max=%lu us, last=%lu us (core %d), heals=%lu",
+                             deadline.name, deadline.overruns, deadline.checks, deadline.budget_us,
+                             deadline.max_us, deadline.last_overrun_us, deadline.last_core,
+                             deadline.heals);
+                }
+            }
+
+            // Print heap info (largest block falling while free stays flat = fragmentation)
+            lora_codec_alloc_stats_t codec;
+            lora_codec_get_alloc_stats(&codec);
+            ESP_LOGI(TAG, "Free heap: %lu bytes, largest block=%u, min=%u",
+                     esp_get_free_heap_size(),
+                     heap_caps_get_largest_free_block(MALLOC_CAP_8BIT),
+                     heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT));
+            ESP_LOGI(TAG, "txpk arena: parses=%lu, peak=%lu/%lu B, heap overflows=%lu",
+                     codec.parses, codec.arena_peak, codec.arena_size, codec.heap_allocs);
         }
     }
 }